@@ -1,12 +1,23 @@
 #include "build.h"
 #include "../../common/compiler.h"
+#include "clang_pool.h"
+#include "clock.h"
 #include "compile_commands.h"
 #include "fdbuf.h"
 #include "file_queue.h"
+#include "git.h"
+#include "hash.h"
 #include "option.h"
 #include "path.h"
+#include "pch.h"
+#include "profile.h"
 #include "progress.h"
+#include "record_table.h"
+#include "set.h"
 #include "sigint.h"
+#include "str_queue.h"
+#include "throttle.h"
+#include "trace.h"
 #include <assert.h>
 #include <clink/clink.h>
 #include <errno.h>
@@ -18,6 +29,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 
 /// Debug printf. This is implemented as a macro to avoid expensive varargs
 /// handling when we are not in debug mode.
@@ -31,6 +43,186 @@
 /// saved current working directory
 static char *cur_dir;
 
+/// files parsed during this build
+static set_t *parsed;
+
+/// files parsed during this build that had previously been parsed
+static str_queue_t *modified;
+
+/// number of files parsed during this build
+static size_t parsed_count;
+
+/// mutual exclusion for `parsed`, `parsed_count` and `modified`
+static pthread_mutex_t parsed_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// a modified file whose record is withheld until its dependents are known
+typedef struct {
+  char *path;
+  uint64_t hash;
+  uint64_t timestamp;
+} deferred_t;
+
+/// modified files whose records are incomplete until `find_dependents` runs
+static deferred_t *deferred;
+static size_t deferred_len;
+static size_t deferred_size;
+
+/// number of files to process between database commits
+static const size_t COMMIT_INTERVAL = 100;
+
+/// files processed since the last database commit
+static size_t uncommitted;
+
+/// mutual exclusion for `uncommitted` and the database transaction
+static pthread_mutex_t commit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// file records as they were when this build began
+static record_table_t *records;
+
+/// estimated time to parse each byte of a file we have not parsed before
+static double ns_per_byte = 1;
+
+/// worker processes to run libclang in, if it is being isolated
+static clang_pool_t *clang_pool;
+
+/// libclang state of each thread, created on first use and then kept until
+/// the end of the build
+static clink_clang_t **clang_states;
+
+/// precompiled headers for libclang parses, if we are using them
+static pch_t *pch;
+
+/// timing information about this build, if it is being profiled
+static profile_t *profile;
+
+/// timeline of this build, if it is being traced
+static trace_t *trace;
+
+/// limiter of concurrent work, if there are multiple workers
+static throttle_t *throttle;
+
+/// bytes of memory we expect a libclang parse to need, if not told otherwise
+static const uint64_t CLANG_ESTIMATE = UINT64_C(512) << 20;
+
+/// Attribute the time since `mark` to a phase of the current file, if we are
+/// profiling or tracing. This is a macro to avoid any cost when we are not.
+#define TIME(phase)                                                            \
+  do {                                                                         \
+    if (UNLIKELY(profile != NULL || trace != NULL)) {                          \
+      lap(thread_id, &pf, traced, (phase), &mark);                             \
+    }                                                                          \
+  } while (0)
+
+/// parse the given source with libclang, in a worker process if requested
+static int run_clang(unsigned long thread_id, clink_db_t *db, const char *path,
+                     size_t argc, const char **argv) {
+
+  if (clang_pool == NULL) {
+    assert(clang_states != NULL);
+    clink_clang_t **clang = &clang_states[thread_id];
+    if (*clang == NULL) {
+      int rc = clink_clang_new(clang);
+      if (LIKELY(rc == 0))
+        rc = clink_clang_use_index(*clang, option.clang_index);
+      if (UNLIKELY(rc != 0)) {
+        clink_clang_free(clang);
+        return rc;
+      }
+    }
+    int rc = clink_clang_parse(*clang, db, path, argc, argv);
+    if (rc == EIO) {
+      progress_warn(thread_id, "libclang crashed when parsing %s", path);
+      rc = 0;
+    }
+    return rc;
+  }
+
+  // give a file that kills a worker one more chance in a fresh worker, in
+  // case the failure was transient
+  for (unsigned attempt = 1;; ++attempt) {
+
+    const int rc =
+        clang_pool_parse(clang_pool, thread_id, db, path, argc, argv);
+
+    const char *failure = NULL;
+    if (rc == EIO) {
+      failure = "crashed";
+    } else if (rc == ETIMEDOUT) {
+      failure = "timed out";
+    } else if (rc == ENOBUFS) {
+      failure = "exceeded its memory limit";
+    }
+
+    if (failure == NULL)
+      return rc;
+
+    if (attempt == 2) {
+      progress_warn(thread_id, "libclang %s when parsing %s", failure, path);
+      return 0;
+    }
+
+    DEBUG("libclang %s when parsing %s; retrying", failure, path);
+  }
+}
+
+/// parse the given source with libclang, with a precompiled header if there
+/// is a suitable one
+static int run_clang_pch(unsigned long thread_id, clink_db_t *db,
+                         const char *path, size_t argc, const char **argv) {
+
+  char *header = NULL;
+  if (pch != NULL) {
+    const int rc = pch_find(pch, path, argc, argv, &header);
+    if (UNLIKELY(rc != 0))
+      DEBUG("failed to find a precompiled header for %s: %s", path,
+            strerror(rc));
+  }
+
+  if (header == NULL)
+    return run_clang(thread_id, db, path, argc, argv);
+
+  int rc = 0;
+  const char **av = calloc(argc + 2, sizeof(av[0]));
+  if (UNLIKELY(av == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  for (size_t i = 0; i < argc; ++i)
+    av[i] = argv[i];
+  av[argc] = "-include-pch";
+  av[argc + 1] = header;
+
+  DEBUG("parsing %s with precompiled header %s", path, header);
+  rc = run_clang(thread_id, db, path, argc + 2, av);
+
+  // libclang failing to read the precompiled header is not a reason to give up
+  if (rc == EPROTO) {
+    DEBUG("failed to use precompiled header %s; retrying without it", header);
+    rc = run_clang(thread_id, db, path, argc, argv);
+  }
+
+done:
+  free(av);
+  free(header);
+
+  return rc;
+}
+
+/// parse the given source with libclang, once there is memory to do so
+static int parse_with_clang(unsigned long thread_id, clink_db_t *db,
+                            const char *path, size_t argc, const char **argv) {
+
+  if (throttle != NULL)
+    throttle_clang_enter(throttle);
+
+  const int rc = run_clang_pch(thread_id, db, path, argc, argv);
+
+  if (throttle != NULL)
+    throttle_clang_exit(throttle);
+
+  return rc;
+}
+
 /// use a compilation database to parse the given source with libclang
 static int parse_with_comp_db(unsigned long thread_id, clink_db_t *db,
                               const char *path) {
@@ -70,11 +262,7 @@ static int parse_with_comp_db(unsigned long thread_id, clink_db_t *db,
     }
   }
 
-  rc = clink_parse_with_clang(db, path, ac, av);
-  if (rc == EIO) {
-    progress_warn(thread_id, "libclang crashed when parsing %s", path);
-    rc = 0;
-  }
+  rc = parse_with_clang(thread_id, db, path, ac, av);
   if (rc != 0)
     goto done;
 
@@ -118,10 +306,20 @@ static const char *filetype(const char *path) {
   return "Yacc";
 }
 
+/** parse a file into the database
+ *
+ * \param thread_id Calling thread
+ * \param db Database to insert into
+ * \param path Absolute path of the file to parse
+ * \param id Record of the file
+ * \param parser [out] Name of the parser used
+ * \return 0 on success or an errno on failure
+ */
 static int parse(unsigned long thread_id, clink_db_t *db, const char *path,
-                 clink_record_id_t id) {
+                 clink_record_id_t id, const char **parser) {
 
   assert(id >= 0);
+  assert(parser != NULL);
 
   int rc = 0;
 
@@ -129,6 +327,7 @@ static int parse(unsigned long thread_id, clink_db_t *db, const char *path,
   const char *display = disppath(cur_dir, path);
 
   if (use_clang(path)) {
+    *parser = "clang";
     progress_status(thread_id, "Clang-parsing %s file %s", filetype(path),
                     display);
 
@@ -147,11 +346,7 @@ static int parse(unsigned long thread_id, clink_db_t *db, const char *path,
       // for this path, parse with our default arguments
       assert(option.clang_argc > 0 && option.clang_argv != NULL);
       const char **argv = (const char **)option.clang_argv;
-      rc = clink_parse_with_clang(db, path, option.clang_argc, argv);
-      if (rc == EIO) {
-        progress_warn(thread_id, "libclang crashed when parsing %s", path);
-        rc = 0;
-      }
+      rc = parse_with_clang(thread_id, db, path, option.clang_argc, argv);
     } while (0);
 
     // parse with the preprocessor
@@ -159,81 +354,260 @@ static int parse(unsigned long thread_id, clink_db_t *db, const char *path,
       rc = clink_parse_cpp(db, path);
 
   } else if (use_cscope(path)) {
+    *parser = "cscope";
     progress_status(thread_id, "Cscope-parsing %s file %s", filetype(path),
                     display);
     rc = clink_parse_with_cscope(db, path, id);
 
   } else if (is_asm(path)) {
-
+    *parser = "asm";
     progress_status(thread_id, "parsing asm file %s", display);
     rc = clink_parse_asm(db, path);
 
     // C++ with generic parser
   } else if (is_cxx(path) && option.parse_cxx == GENERIC) {
+    *parser = "generic-c++";
     progress_status(thread_id, "generic-parsing C++ file %s", display);
     rc = clink_parse_cxx(db, path);
 
     // C with generic parser
   } else if (is_c(path) && option.parse_c == GENERIC) {
+    *parser = "generic-c";
     progress_status(thread_id, "generic-parsing C file %s", display);
     rc = clink_parse_c(db, path);
 
     // DEF
   } else if (is_def(path)) {
+    *parser = "def";
     progress_status(thread_id, "parsing DEF file %s", display);
     rc = clink_parse_def(db, path);
 
     // Lex/Flex
   } else if (is_lex(path)) {
+    *parser = "lex";
     progress_status(thread_id, "generic parsing Lex file %s", display);
     rc = clink_parse_cxx(db, path); // parse as C++
 
     // Python
   } else if (is_python(path)) {
+    *parser = "python";
     progress_status(thread_id, "parsing Python file %s", display);
     rc = clink_parse_python(db, path);
 
     // TableGen
   } else if (is_tablegen(path)) {
+    *parser = "tablegen";
     progress_status(thread_id, "parsing TableGen file %s", display);
     rc = clink_parse_tablegen(db, path);
 
     // Yacc/Bison
   } else {
     assert(is_yacc(path));
+    *parser = "yacc";
     progress_status(thread_id, "generic parsing Yacc file %s", display);
     rc = clink_parse_cxx(db, path); // parse as C++
   }
 
-  if (rc != 0) {
+  if (rc != 0)
     progress_error(thread_id, "failed to parse %s: %s", display, strerror(rc));
-    goto done;
+
+  return rc;
+}
+
+/// syntax highlight a file into the database
+static int highlight(unsigned long thread_id, clink_db_t *db,
+                     const char *path) {
+
+  assert(db != NULL);
+  assert(path != NULL);
+
+  const char *display = disppath(cur_dir, path);
+  progress_status(thread_id, "syntax highlighting %s", display);
+
+  int rc = clink_vim_read_into(db, path);
+  if (UNLIKELY(rc != 0)) {
+
+    // If the user hit Ctrl+C, Vim may have been SIGINTed causing it to
+    // fail cryptically. If it looks like this happened, give the user a
+    // less confusing message.
+    if (sigint_pending()) {
+      progress_error(thread_id, "failed to read %s: received SIGINT", display);
+
+    } else {
+      progress_error(thread_id, "failed to read %s: %s", display,
+                     strerror(rc));
+    }
   }
 
-  if (option.highlighting == EAGER) {
-    progress_status(thread_id, "syntax highlighting %s", display);
+  return rc;
+}
+
+/// modification time of a file, in nanoseconds
+static uint64_t mtime(const struct stat *st) {
+#ifdef __APPLE__
+  const struct timespec *ts = &st->st_mtimespec;
+#else
+  const struct timespec *ts = &st->st_mtim;
+#endif
+  return (uint64_t)ts->tv_sec * 1000000000 + (uint64_t)ts->tv_nsec;
+}
 
-    if (UNLIKELY((rc = clink_vim_read_into(db, path)))) {
+/** decide whether a file needs processing, and how soon
+ *
+ * This is called while discovering files, to avoid queueing those that have
+ * not changed. Files predicted to take longest are given the highest priority.
+ */
+static bool assess(const char *path, const struct stat *st, uint64_t *priority,
+                   void *context UNUSED) {
 
-      // If the user hit Ctrl+C, Vim may have been SIGINTed causing it to
-      // fail cryptically. If it looks like this happened, give the user a
-      // less confusing message.
-      if (sigint_pending()) {
-        progress_error(thread_id, "failed to read %s: received SIGINT",
-                       display);
+  assert(path != NULL);
+  assert(priority != NULL);
 
-      } else {
-        progress_error(thread_id, "failed to read %s: %s", display,
-                       strerror(rc));
-      }
-      goto done;
+  // discovery does not run on a worker thread, so report as the first of them
+  const unsigned long thread_id = 0;
+
+  // note that this file still exists, so we do not purge its record
+  record_table_mark(records, path);
+
+  const clink_record_t *record = record_table_find(records, path);
+
+  // if it has not been touched since last update, skip it
+  if (record != NULL && st != NULL && record->timestamp == mtime(st)) {
+    DEBUG("skipping unmodified file %s", path);
+    return false;
+  }
+
+  // if we have parsed this file before, assume it will take as long again
+  if (record != NULL && record->duration > 0) {
+    *priority = record->duration;
+    return true;
+  }
+
+  // otherwise guess based on its size
+  if (st != NULL)
+    *priority = (uint64_t)((double)st->st_size * ns_per_byte);
+  return true;
+}
+
+/** withhold completing a modified file’s record until its dependents are known
+ *
+ * The caller is expected to hold `parsed_lock`.
+ *
+ * \param path Absolute path of the file
+ * \param hash Content hash to eventually record
+ * \param timestamp Modification time to eventually record
+ * \return 0 on success or an errno on failure
+ */
+static int defer(const char *path, uint64_t hash, uint64_t timestamp) {
+
+  assert(path != NULL);
+
+  if (deferred_len == deferred_size) {
+    const size_t size = deferred_size == 0 ? 64 : deferred_size * 2;
+    deferred_t *d = realloc(deferred, size * sizeof(deferred[0]));
+    if (UNLIKELY(d == NULL))
+      return ENOMEM;
+    deferred = d;
+    deferred_size = size;
+  }
+
+  char *p = strdup(path);
+  if (UNLIKELY(p == NULL))
+    return ENOMEM;
+
+  deferred[deferred_len] =
+      (deferred_t){.path = p, .hash = hash, .timestamp = timestamp};
+  ++deferred_len;
+
+  return 0;
+}
+
+/** note that a file has been processed, committing if enough have accumulated
+ *
+ * Committing in groups bounds how much work is lost if the build is
+ * interrupted or crashes, while keeping most additions inside a transaction.
+ *
+ * \param thread_id Calling thread
+ * \param db Database being built
+ * \param waited [inout] Accumulator for time spent waiting on other threads,
+ *   or `NULL`
+ */
+static void completed(unsigned long thread_id, clink_db_t *db,
+                      uint64_t *waited) {
+
+  assert(db != NULL);
+
+  profile_lock(&commit_lock, waited);
+
+  ++uncommitted;
+  if (uncommitted >= COMMIT_INTERVAL) {
+    int rc = clink_db_commit_transaction(db);
+    if (UNLIKELY(rc != 0)) {
+      progress_warn(thread_id, "failed to commit database transaction: %s",
+                    strerror(rc));
+    } else {
+      uncommitted = 0;
+      if (UNLIKELY((rc = clink_db_begin_transaction(db))))
+        progress_warn(thread_id, "failed to restart database transaction: %s",
+                      strerror(rc));
     }
   }
 
-done:
+  int r UNUSED = pthread_mutex_unlock(&commit_lock);
+  assert(r == 0);
+}
+
+/// save the timing of a processed file, for the throttle and any profile
+static int note_timing(unsigned long thread_id, profile_file_t *pf,
+                       clink_db_bulk_time_t bulk, uint64_t size) {
+
+  assert(pf != NULL);
+
+  const clink_db_bulk_time_t after = clink_db_bulk_time();
+  pf->insert_wait = after.wait - bulk.wait;
+  pf->insert = after.insert - bulk.insert;
+
+  if (throttle != NULL)
+    throttle_done(throttle, size, pf->insert_wait + pf->lock_wait);
+
+  if (LIKELY(profile == NULL))
+    return 0;
+
+  int rc = profile_file(profile, thread_id, pf);
+  if (UNLIKELY(rc != 0))
+    progress_error(thread_id, "failed to record timing of %s: %s", pf->path,
+                   strerror(rc));
   return rc;
 }
 
+/// note the current time, reading the CPU clock only if we are profiling
+static profile_mark_t mark_now(void) {
+  if (profile != NULL)
+    return profile_mark();
+  return (profile_mark_t){.wall = now()};
+}
+
+/// attribute the time since `mark` to a phase of the current file
+static void lap(unsigned long thread_id, profile_file_t *pf, const char *traced,
+                profile_phase_t phase, profile_mark_t *mark) {
+
+  assert(pf != NULL);
+  assert(mark != NULL);
+
+  const uint64_t start = mark->wall;
+
+  if (profile != NULL) {
+    profile_lap(pf, phase, mark);
+  } else {
+    *mark = mark_now();
+  }
+
+  if (trace != NULL)
+    trace_span(trace, thread_id, profile_phase_name(phase),
+               phase == PROFILE_PARSE ? pf->parser : NULL, traced, start,
+               mark->wall);
+}
+
 /// drain a work queue, processing its entries into the database
 static int process(unsigned long thread_id, pthread_t *threads, clink_db_t *db,
                    file_queue_t *q) {
@@ -245,9 +619,35 @@ static int process(unsigned long thread_id, pthread_t *threads, clink_db_t *db,
 
   while (true) {
 
+    // timing of this file
+    profile_file_t pf = {0};
+    profile_mark_t mark = {0};
+    clink_db_bulk_time_t bulk = {0};
+    const char *traced = NULL;
+
+    // wait our turn, if there are more of us than is productive
+    if (throttle != NULL)
+      throttle_wait(throttle, thread_id);
+
     // get an item from the work queue
     const char *path = NULL;
+    if (UNLIKELY(profile != NULL || trace != NULL))
+      mark = mark_now();
     rc = file_queue_pop(q, &path);
+    if (UNLIKELY(profile != NULL || trace != NULL)) {
+      const profile_mark_t popped = mark_now();
+      if (profile != NULL)
+        profile_idle(profile, thread_id, popped.wall - mark.wall);
+      if (trace != NULL) {
+        trace_span(trace, thread_id, "pop", NULL, NULL, mark.wall,
+                   popped.wall);
+        if (rc == 0)
+          traced = trace_path(trace, thread_id, path);
+      }
+      mark = popped;
+    }
+    bulk = clink_db_bulk_time();
+    pf.path = path;
 
     // if we have exhausted the work queue, we are done
     if (rc == ENOMSG) {
@@ -263,39 +663,103 @@ static int process(unsigned long thread_id, pthread_t *threads, clink_db_t *db,
 
     assert(path != NULL);
 
+    // more files may have been discovered since we last looked
+    progress_set_total(file_queue_total(q));
+
     // see if we know of this file
     uint64_t hash = 0;
     uint64_t timestamp = 0;
+    uint64_t size = 0;
+    bool has_record = false;
     {
-      bool has_record = clink_db_find_record(db, path, &hash, &timestamp) == 0;
-      // stat the file to see if it has changed
+      // Files whose timestamp is unchanged were already excluded by assess(),
+      // so we only need to check whether the content differs.
+      const clink_record_t *record = record_table_find(records, path);
+      if (record != NULL) {
+        has_record = true;
+        hash = record->hash;
+      }
       struct stat st;
       bool has_file = stat(path, &st) == 0;
-      if (has_record && has_file) {
-        // if it has not changed since last update, skip it
-        if (hash == (uint64_t)st.st_size) {
-          if (timestamp == (uint64_t)st.st_mtime) {
-            DEBUG("skipping unmodified file %s", path);
-            progress_increment();
-            continue;
-          }
-        }
-      }
       if (has_file) {
-        hash = (uint64_t)st.st_size;
-        timestamp = (uint64_t)st.st_mtime;
+        timestamp = mtime(&st);
+        size = (uint64_t)st.st_size;
+        // Something like a `git checkout` may have touched the file without
+        // changing it, so see if its content actually differs.
+        const uint64_t previous = hash;
+        if (hash_file(path, &hash) != 0) {
+          hash = 0;
+        } else if (has_record && hash == previous) {
+          DEBUG("skipping touched but unmodified file %s", path);
+          TIME(PROFILE_HASH);
+          (void)clink_db_update_record(db, path, hash, timestamp);
+          completed(thread_id, db, &pf.lock_wait);
+          TIME(PROFILE_FINISH);
+          if (UNLIKELY((rc = note_timing(thread_id, &pf, bulk, size))))
+            break;
+          progress_increment();
+          continue;
+        }
       }
     }
 
+    TIME(PROFILE_HASH);
+
     // remove anything related to the file we are about to parse
     clink_db_remove(db, path);
 
-    // insert a new record for the file
+    // Insert a new record for the file. The database may be committed at any
+    // point while we work on it, so the hash and timestamp are left zero until
+    // we are done, to make sure a build resuming from such a commit redoes it.
     clink_record_id_t id = -1;
-    if (UNLIKELY((rc = clink_db_add_record(db, path, hash, timestamp, &id))))
+    if (UNLIKELY((rc = clink_db_add_record(db, path, 0, 0, &id))))
+      break;
+
+    TIME(PROFILE_PREPARE);
+
+    const uint64_t start = now();
+    if (UNLIKELY((rc = parse(thread_id, db, path, id, &pf.parser))))
       break;
 
-    if (UNLIKELY((rc = parse(thread_id, db, path, id))))
+    // remember how long this took, to schedule the file better next time
+    (void)clink_db_set_cost(db, id, size, now() - start);
+    TIME(PROFILE_PARSE);
+
+    if (option.highlighting == EAGER) {
+      if (UNLIKELY((rc = highlight(thread_id, db, path))))
+        break;
+      TIME(PROFILE_HIGHLIGHT);
+    }
+
+    // If this file is #included by others, they need to be reparsed. Until we
+    // know which they are, a resumed build needs to treat this file as
+    // modified again, so only complete records that nothing can depend on.
+    const bool any_clang = option.parse_c == CLANG || option.parse_cxx == CLANG;
+    if (!(has_record && any_clang))
+      (void)clink_db_update_record(db, path, hash, timestamp);
+
+    // note that we parsed this file, so dependents can be reparsed afterwards
+    {
+      profile_lock(&parsed_lock, &pf.lock_wait);
+      const char *p = path;
+      rc = set_add(parsed, &p);
+      if (LIKELY(rc == 0))
+        ++parsed_count;
+      if (LIKELY(rc == 0 || rc == EALREADY))
+        rc = has_record ? str_queue_push(modified, path) : 0;
+      if (rc == EALREADY)
+        rc = 0;
+      if (LIKELY(rc == 0) && has_record && any_clang)
+        rc = defer(path, hash, timestamp);
+      int r UNUSED = pthread_mutex_unlock(&parsed_lock);
+      assert(r == 0);
+      if (UNLIKELY(rc))
+        break;
+    }
+
+    completed(thread_id, db, &pf.lock_wait);
+    TIME(PROFILE_FINISH);
+    if (UNLIKELY((rc = note_timing(thread_id, &pf, bulk, size))))
       break;
 
     // bump the progress counter
@@ -308,6 +772,10 @@ static int process(unsigned long thread_id, pthread_t *threads, clink_db_t *db,
     }
   }
 
+  // let anyone held back see there is nothing left for them
+  if (throttle != NULL)
+    throttle_release(throttle);
+
   // Signals are delivered to one arbitrary thread in a multithreaded process.
   // So if we saw a SIGINT, signal the thread before us so that it cascades and
   // is eventually propagated to all threads.
@@ -362,6 +830,20 @@ static int mt_process(clink_db_t *db, file_queue_t *q) {
     return ENOMEM;
   }
 
+  // limit how many of them work at once, if that proves beneficial
+  {
+    const uint64_t estimate = option.clang_memory_limit > 0
+                                  ? (uint64_t)option.clang_memory_limit << 20
+                                  : CLANG_ESTIMATE;
+    const int rc = throttle_new(&throttle, option.threads,
+                                option.adapt_threads, estimate);
+    if (UNLIKELY(rc != 0)) {
+      free(args);
+      free(threads);
+      return rc;
+    }
+  }
+
   // set up data for all threads
   for (size_t i = 1; i < option.threads; ++i)
     args[i - 1] =
@@ -401,43 +883,376 @@ static int mt_process(clink_db_t *db, file_queue_t *q) {
   }
 
   // clean up memory
+  throttle_free(&throttle);
   free(args);
   free(threads);
 
   return rc;
 }
 
-int build(clink_db_t *db) {
+/** find files that need reparsing due to changes in files they #include
+ *
+ * Only libclang parsing depends on the content of #included files, so other
+ * files are not considered. The files found have their database records
+ * removed, forcing them to be reparsed when they are processed.
+ *
+ * \param db Database to operate on
+ * \param q Queue to add files needing reparsing to
+ * \return 0 on success or an errno on failure
+ */
+static int find_dependents(clink_db_t *db, file_queue_t *q) {
 
   assert(db != NULL);
+  assert(q != NULL);
 
-  fdbuf_t err = {0};
   int rc = 0;
 
-  // setup a work queue to manage our tasks
-  file_queue_t *q = NULL;
-  if (UNLIKELY((rc = file_queue_new(&q)))) {
-    fprintf(stderr, "failed to create work queue: %s\n", strerror(rc));
+  // files we need to reparse
+  str_queue_t *dependents = NULL;
+  if (UNLIKELY((rc = str_queue_new(&dependents))))
     goto done;
+
+  while (true) {
+
+    const char *path = NULL;
+    if ((rc = str_queue_pop(modified, &path))) {
+      if (LIKELY(rc == ENOMSG))
+        rc = 0;
+      break;
+    }
+
+    clink_iter_t *it = NULL;
+    rc = clink_db_find_transitive_includer(db, path, NULL, &it);
+    if (UNLIKELY(rc))
+      goto done;
+
+    while (true) {
+      const clink_symbol_t *symbol = NULL;
+      if ((rc = clink_iter_next_symbol(it, &symbol))) {
+        if (LIKELY(rc == ENOMSG))
+          rc = 0;
+        break;
+      }
+
+      if (!use_clang(symbol->path))
+        continue;
+
+      // skip anything we have already parsed during this build
+      const char *p = symbol->path;
+      if ((rc = set_add(parsed, &p))) {
+        if (LIKELY(rc == EALREADY)) {
+          rc = 0;
+          continue;
+        }
+        break;
+      }
+
+      if (UNLIKELY((rc = str_queue_push(dependents, symbol->path)))) {
+        if (rc != EALREADY)
+          break;
+        rc = 0;
+      }
+    }
+
+    clink_iter_free(&it);
+    if (UNLIKELY(rc))
+      goto done;
   }
 
-  // add our source paths to the work queue
-  for (size_t i = 0; i < option.src_len; ++i) {
-    rc = file_queue_push(q, option.src[i]);
+  // We can only modify the database now that we are no longer iterating
+  // through it. Remove the dependents’ records to make them look new.
+  while (true) {
+
+    const char *path = NULL;
+    if ((rc = str_queue_pop(dependents, &path))) {
+      if (LIKELY(rc == ENOMSG))
+        rc = 0;
+      break;
+    }
+
+    clink_db_remove(db, path);
+    record_table_forget(records, path);
+
+    if (UNLIKELY((rc = file_queue_push(q, path))))
+      goto done;
+  }
+
+done:
+  str_queue_free(&dependents);
+
+  return rc;
+}
+
+// a vehicle for passing data to discover()
+typedef struct {
+  file_queue_t *q;     ///< queue to populate
+  const char **src;    ///< paths to queue
+  size_t src_len;      ///< number of entries in `src`
+  bool complete;       ///< are `src` all our sources, rather than changes?
+  const char *reading; ///< namefile currently being read, if any
+  const char *failed;  ///< source path that could not be queued, if any
+  char *entry;         ///< owned storage for `failed`, when from a namefile
+  int rc;              ///< error encountered when queueing `failed`
+  uint64_t start;      ///< when discovery began
+  uint64_t duration;   ///< nanoseconds discovery took
+} discover_args_t;
+
+/// `clink_parse_namefile` callback for queueing an entry
+static int queue_entry(const char *name, void *context) {
+
+  assert(name != NULL);
+  assert(context != NULL);
+
+  discover_args_t *a = context;
+
+  // stop early if the user has hit Ctrl+C
+  if (UNLIKELY(sigint_pending()))
+    return ECANCELED;
+
+  // make the path absolute, as is done for sources from the command line
+  int rc = 0;
+  char *absolute = realpath(name, NULL);
+  if (absolute == NULL) {
+    rc = errno;
+  } else {
+    rc = file_queue_push(a->q, absolute);
+    free(absolute);
+  }
+
+  // ignore duplicate paths
+  if (rc == EALREADY)
+    rc = 0;
+
+  if (UNLIKELY(rc)) {
+    a->entry = strdup(name);
+    a->failed = a->entry == NULL ? "namefile entry" : a->entry;
+    a->rc = rc;
+  }
+
+  return rc;
+}
+
+/// `clink_parse_namefile` callback for syntax errors
+static int bad_entry(unsigned long lineno, unsigned long colno,
+                     const char *message, void *context) {
+
+  assert(message != NULL);
+  assert(context != NULL);
+
+  discover_args_t *a = context;
+
+  if (asprintf(&a->entry, "%s line %lu, column %lu (%s)", a->reading, lineno,
+               colno, message) < 0) {
+    a->entry = NULL;
+    a->failed = "namefile entry";
+  } else {
+    a->failed = a->entry;
+  }
+  a->rc = EIO;
+
+  return EIO;
+}
+
+/// add our source paths to the work queue, and then close it
+static void *discover(void *args) {
+
+  discover_args_t *a = args;
+  assert(a != NULL);
+  assert(a->q != NULL);
+
+  const uint64_t start = now();
+  a->start = start;
+
+  for (size_t i = 0; i < a->src_len; ++i) {
+
+    // stop early if the user has hit Ctrl+C
+    if (UNLIKELY(sigint_pending()))
+      break;
+
+    int rc = file_queue_push(a->q, a->src[i]);
 
     // ignore duplicate paths
     if (rc == EALREADY)
       rc = 0;
 
+    // ignore changed paths that have since been deleted
+    if (!a->complete && rc == ENOENT)
+      rc = 0;
+
     if (UNLIKELY(rc)) {
-      fprintf(stderr, "failed to add %s to work queue: %s\n", option.src[i],
+      a->failed = a->src[i];
+      a->rc = rc;
+      break;
+    }
+  }
+
+  // Stream the entries of any namefiles straight into the queue. For very
+  // large namefiles, this avoids holding a list of them in memory in addition
+  // to the queue’s own copies.
+  if (a->complete) {
+    for (size_t i = 0; i < option.namefiles_len && a->rc == 0; ++i) {
+      const namefile_t *n = &option.namefiles[i];
+      a->reading = n->path;
+      const int rc =
+          clink_parse_namefile(n->stream, queue_entry, bad_entry, a);
+      if (rc == ECANCELED)
+        break;
+      if (UNLIKELY(rc != 0 && a->rc == 0)) {
+        a->failed = n->path;
+        a->rc = rc;
+      }
+    }
+  }
+
+  a->duration = now() - start;
+
+  // let the workers know there is nothing more coming
+  file_queue_close(a->q);
+
+  return NULL;
+}
+
+/// observer of directories read during discovery
+static void (*dir_observer)(const char *path, void *context);
+static void *dir_observer_context;
+
+void build_set_dir_observer(void (*observer)(const char *path, void *context),
+                            void *context) {
+  dir_observer = observer;
+  dir_observer_context = context;
+}
+
+/// note the time taken by a stage of the build, if we are profiling or tracing
+static void note_stage(profile_stage_t stage, uint64_t start, uint64_t end) {
+
+  if (profile != NULL)
+    profile_stage(profile, stage, end - start);
+
+  // discovery overlaps other stages, so it gets a lane of its own after those
+  // of the worker threads, and the remaining stages share the lane after that
+  if (trace != NULL) {
+    const unsigned long lane =
+        option.threads + (stage == PROFILE_DISCOVER ? 0 : 1);
+    trace_span(trace, lane, profile_stage_name(stage), NULL, NULL, start, end);
+  }
+}
+
+/** update the database from a set of source paths
+ *
+ * \param db Database to operate on
+ * \param src Files and directories to scan
+ * \param src_len Number of entries in `src`
+ * \param complete Are `src` all our sources? If not, only records of files
+ *   within `src` are candidates for removal.
+ * \return 0 on success or an errno on failure
+ */
+static int update(clink_db_t *db, const char **src, size_t src_len,
+                  bool complete) {
+
+  assert(db != NULL);
+  assert(src != NULL || src_len == 0);
+
+  fdbuf_t err = {0};
+  int rc = 0;
+  file_queue_t *q = NULL;
+  discover_args_t discovery = {0};
+  pthread_t discoverer;
+  bool discovering = false;
+  const char **vanished = NULL;
+  size_t vanished_count = 0;
+  uint64_t stage_start = 0;
+
+  // start collecting timing information, if requested
+  if (option.profile != NULL) {
+    if (UNLIKELY((rc = profile_new(&profile, option.threads)))) {
+      fprintf(stderr, "failed to create profile: %s\n", strerror(rc));
+      goto done;
+    }
+  }
+  if (option.trace != NULL) {
+    // a lane for each worker, one for discovery, and one for other stages
+    if (UNLIKELY((rc = trace_new(&trace, option.threads + 2)))) {
+      fprintf(stderr, "failed to create trace: %s\n", strerror(rc));
+      goto done;
+    }
+    for (unsigned long i = 0; i < option.threads && rc == 0; ++i) {
+      char name[sizeof("worker ") + 20];
+      (void)snprintf(name, sizeof(name), "worker %lu", i);
+      rc = trace_name(trace, i, name);
+    }
+    if (LIKELY(rc == 0))
+      rc = trace_name(trace, option.threads, "discovery");
+    if (LIKELY(rc == 0))
+      rc = trace_name(trace, option.threads + 1, "stages");
+    if (UNLIKELY(rc)) {
+      fprintf(stderr, "failed to name trace lanes: %s\n", strerror(rc));
+      goto done;
+    }
+  }
+
+  // load what we knew about files at the end of the last build
+  if (UNLIKELY((rc = record_table_new(&records, db)))) {
+    fprintf(stderr, "failed to load database records: %s\n", strerror(rc));
+    goto done;
+  }
+
+  // calibrate our guesses for files we have no history for
+  {
+    uint64_t size = 0;
+    uint64_t duration = 0;
+    record_table_cost(records, &size, &duration);
+    if (size > 0)
+      ns_per_byte = (double)duration / (double)size;
+  }
+
+  // start a pool of workers to isolate libclang in, if requested
+  if (option.isolate_clang &&
+      (option.parse_c == CLANG || option.parse_cxx == CLANG)) {
+    const size_t rss_limit = (size_t)option.clang_memory_limit << 20;
+    if (UNLIKELY((rc = clang_pool_new(&clang_pool, option.threads,
+                                      option.clang_timeout, rss_limit,
+                                      option.clang_index)))) {
+      fprintf(stderr, "failed to create libclang worker pool: %s\n",
+              strerror(rc));
+      goto done;
+    }
+  } else if (option.parse_c == CLANG || option.parse_cxx == CLANG) {
+    clang_states = calloc(option.threads, sizeof(clang_states[0]));
+    if (UNLIKELY(clang_states == NULL)) {
+      rc = ENOMEM;
+      fprintf(stderr, "failed to allocate libclang state: %s\n",
               strerror(rc));
       goto done;
     }
   }
 
-  // learn how many files we just enqueued
-  size_t total_files = file_queue_size(q);
+  // share the parsing of common #includes between sources, if possible
+  if (option.pch && (option.parse_c == CLANG || option.parse_cxx == CLANG)) {
+    assert(option.pch_cache != NULL);
+    const int r = pch_new(&pch, option.pch_cache);
+    if (UNLIKELY(r != 0) && option.debug)
+      fprintf(stderr, "failed to set up precompiled headers in %s: %s\n",
+              option.pch_cache, strerror(r));
+  }
+
+  // setup a work queue to manage our tasks
+  if (UNLIKELY((rc = file_queue_new(&q)))) {
+    fprintf(stderr, "failed to create work queue: %s\n", strerror(rc));
+    goto done;
+  }
+  file_queue_set_filter(q, assess, NULL);
+  file_queue_set_dir_callback(q, dir_observer, dir_observer_context);
+
+  // setup tracking of what we parse
+  if (UNLIKELY((rc = set_new(&parsed)))) {
+    fprintf(stderr, "failed to create parsed set: %s\n", strerror(rc));
+    goto done;
+  }
+  parsed_count = 0;
+  if (UNLIKELY((rc = str_queue_new(&modified)))) {
+    fprintf(stderr, "failed to create modified queue: %s\n", strerror(rc));
+    goto done;
+  }
 
   // find the current working directory
   if (UNLIKELY(rc = cwd(&cur_dir))) {
@@ -446,12 +1261,6 @@ int build(clink_db_t *db) {
     goto done;
   }
 
-  // select a highlighting mode, if necessary
-  if (option.highlighting == BEHAVIOUR_AUTO) {
-    static const size_t LARGE = 100; // a heuristic for when things get annoying
-    option.highlighting = total_files >= LARGE ? LAZY : EAGER;
-  }
-
   // suppress SIGINT, so that we do not get interrupted midway through a
   // database write and corrupt it
   if (UNLIKELY((rc = sigint_block()))) {
@@ -459,7 +1268,8 @@ int build(clink_db_t *db) {
     goto done;
   }
 
-  if (UNLIKELY((rc = progress_init(total_files)))) {
+  // set up progress output, the total of which will grow as we find files
+  if (UNLIKELY((rc = progress_init(0)))) {
     fprintf(stderr, "failed to setup progress output: %s\n", strerror(rc));
     goto done;
   }
@@ -473,6 +1283,27 @@ int build(clink_db_t *db) {
     }
   }
 
+  // Find source files in the background, so we can begin parsing the first of
+  // them while still looking for the rest. This thread inherits our blocked
+  // SIGINT.
+  file_queue_open(q);
+  discovery.q = q;
+  discovery.src = src;
+  discovery.src_len = src_len;
+  discovery.complete = complete;
+  if (pthread_create(&discoverer, NULL, discover, &discovery) == 0) {
+    discovering = true;
+  } else {
+    // fall back to finding everything up front
+    (void)discover(&discovery);
+  }
+
+  // select a highlighting mode, if necessary
+  if (option.highlighting == BEHAVIOUR_AUTO) {
+    static const size_t LARGE = 100; // a heuristic for when things get annoying
+    option.highlighting = file_queue_wait(q, LARGE) >= LARGE ? LAZY : EAGER;
+  }
+
   // notify the user if we cannot leverage Clang fully
   if (option.parse_c == CLANG || option.parse_cxx == CLANG) {
     if (option.compile_commands.db == NULL)
@@ -484,13 +1315,147 @@ int build(clink_db_t *db) {
   if (UNLIKELY((rc = clink_db_begin_transaction(db))))
     progress_warn(0, "failed to start database transaction");
 
+  stage_start = now();
   if (UNLIKELY((rc = option.threads > 1 ? mt_process(db, q)
                                         : process(0, NULL, db, q))))
     goto done;
+  note_stage(PROFILE_PROCESS, stage_start, now());
+
+  // the queue was drained, so discovery has finished
+  if (discovering) {
+    int r UNUSED = pthread_join(discoverer, NULL);
+    assert(r == 0);
+    discovering = false;
+  }
+  note_stage(PROFILE_DISCOVER, discovery.start,
+             discovery.start + discovery.duration);
 
   progress_free();
   printf("\n");
 
+  if (UNLIKELY(discovery.rc != 0)) {
+    rc = discovery.rc;
+    fdbuf_free(&err);
+    fprintf(stderr, "failed to add %s to work queue: %s\n", discovery.failed,
+            strerror(rc));
+    goto done;
+  }
+
+  // If we saw every source file, any record we did not see is for a file that
+  // has been deleted or is no longer among our sources. If we only looked at
+  // some changed paths, the same is true within them.
+  if (!sigint_pending() && complete) {
+    if (UNLIKELY((rc = record_table_unseen(records, &vanished,
+                                           &vanished_count)))) {
+      fprintf(stderr, "failed to find vanished files: %s\n", strerror(rc));
+      goto done;
+    }
+  } else if (!sigint_pending()) {
+    for (size_t i = 0; i < src_len; ++i) {
+      const char **within = NULL;
+      size_t within_count = 0;
+      if (UNLIKELY((rc = record_table_unseen_within(records, src[i], &within,
+                                                    &within_count)))) {
+        fprintf(stderr, "failed to find vanished files: %s\n", strerror(rc));
+        goto done;
+      }
+      if (within_count > 0) {
+        const char **v = realloc(vanished, (vanished_count + within_count) *
+                                               sizeof(vanished[0]));
+        if (UNLIKELY(v == NULL)) {
+          free(within);
+          rc = ENOMEM;
+          fprintf(stderr, "failed to find vanished files: %s\n", strerror(rc));
+          goto done;
+        }
+        vanished = v;
+        memcpy(&vanished[vanished_count], within,
+               within_count * sizeof(within[0]));
+        vanished_count += within_count;
+      }
+      free(within);
+    }
+  }
+
+  // Anything that #includes a vanished file needs to be reparsed, but the
+  // vanished files themselves cannot be. Marking them as parsed prevents
+  // find_dependents() from trying to.
+  for (size_t i = 0; i < vanished_count; ++i) {
+    const char *p = vanished[i];
+    if (UNLIKELY((rc = set_add(parsed, &p)) && rc != EALREADY)) {
+      fprintf(stderr, "failed to add to parsed set: %s\n", strerror(rc));
+      goto done;
+    }
+    if (UNLIKELY((rc = str_queue_push(modified, vanished[i])) &&
+                 rc != EALREADY)) {
+      fprintf(stderr, "failed to add to modified queue: %s\n", strerror(rc));
+      goto done;
+    }
+    rc = 0;
+  }
+
+  // reparse anything that #includes a file that changed
+  const bool any_clang = option.parse_c == CLANG || option.parse_cxx == CLANG;
+  stage_start = now();
+  if (any_clang && str_queue_size(modified) > 0 && !sigint_pending()) {
+    file_queue_t *dependents = NULL;
+    if (UNLIKELY((rc = file_queue_new(&dependents)))) {
+      fprintf(stderr, "failed to create work queue: %s\n", strerror(rc));
+      goto done;
+    }
+    file_queue_set_filter(dependents, assess, NULL);
+
+    if (UNLIKELY((rc = find_dependents(db, dependents)))) {
+      file_queue_free(&dependents);
+      fprintf(stderr, "failed to find dependent files: %s\n", strerror(rc));
+      goto done;
+    }
+
+    // The dependents’ records are gone, so a resumed build would reparse them.
+    // Hence the modified files no longer need to look modified.
+    for (size_t i = 0; i < deferred_len; ++i)
+      (void)clink_db_update_record(db, deferred[i].path, deferred[i].hash,
+                                   deferred[i].timestamp);
+
+    if (file_queue_size(dependents) > 0) {
+      if (UNLIKELY((rc = progress_init(file_queue_size(dependents))))) {
+        file_queue_free(&dependents);
+        fprintf(stderr, "failed to setup progress output: %s\n",
+                strerror(rc));
+        goto done;
+      }
+
+      rc = option.threads > 1 ? mt_process(db, dependents)
+                              : process(0, NULL, db, dependents);
+      file_queue_free(&dependents);
+      if (UNLIKELY(rc))
+        goto done;
+
+      progress_free();
+      printf("\n");
+    } else {
+      file_queue_free(&dependents);
+    }
+  }
+
+  note_stage(PROFILE_DEPENDENTS, stage_start, now());
+
+  // remove everything we knew about vanished files in one go
+  stage_start = now();
+  if (UNLIKELY((rc = clink_db_purge(db, vanished, vanished_count)))) {
+    fprintf(stderr, "failed to purge vanished files: %s\n", strerror(rc));
+    goto done;
+  }
+  note_stage(PROFILE_PURGE, stage_start, now());
+
+  // make any new symbol names available to “did you mean” suggestions
+  stage_start = now();
+  if (parsed_count > 0 && UNLIKELY((rc = clink_db_index_names(db)))) {
+    fprintf(stderr, "failed to index symbol names: %s\n", strerror(rc));
+    goto done;
+  }
+  note_stage(PROFILE_INDEX, stage_start, now());
+
   if (!option.debug) {
     // see if libclang crashed or Cscope errored
     assert(err.subject != NULL && "operating on uninitialised fd buffer");
@@ -508,13 +1473,109 @@ int build(clink_db_t *db) {
   }
 
 done:
+  if (discovering)
+    (void)pthread_join(discoverer, NULL);
   (void)clink_db_commit_transaction(db);
   (void)fdbuf_free(&err);
   progress_free();
   (void)sigint_unblock();
   free(cur_dir);
   cur_dir = NULL;
+  str_queue_free(&modified);
+  set_free(&parsed);
   file_queue_free(&q);
+  free(vanished);
+  free(discovery.entry);
+  for (size_t i = 0; i < deferred_len; ++i)
+    free(deferred[i].path);
+  free(deferred);
+  deferred = NULL;
+  deferred_len = 0;
+  deferred_size = 0;
+  uncommitted = 0;
+  pch_free(&pch);
+  clang_pool_free(&clang_pool);
+  if (clang_states != NULL) {
+    for (size_t i = 0; i < option.threads; ++i)
+      clink_clang_free(&clang_states[i]);
+  }
+  free(clang_states);
+  clang_states = NULL;
+  record_table_free(&records);
+  if (profile != NULL && rc == 0) {
+    rc = profile_write(profile, option.profile);
+    if (UNLIKELY(rc != 0))
+      fprintf(stderr, "failed to write profile to %s: %s\n", option.profile,
+              strerror(rc));
+  }
+  profile_free(&profile);
+  if (trace != NULL && rc == 0) {
+    rc = trace_write(trace, option.trace);
+    if (UNLIKELY(rc != 0))
+      fprintf(stderr, "failed to write trace to %s: %s\n", option.trace,
+              strerror(rc));
+  }
+  trace_free(&trace);
+
+  return rc;
+}
+
+int build(clink_db_t *db) {
+
+  assert(db != NULL);
+
+  int rc = 0;
+  git_state_t *state = NULL;
+  char **changed = NULL;
+  size_t changed_count = 0;
+
+  // Note the state of the checkout before looking at any files, so anything
+  // that changes while we are building is seen as changed next time too.
+  // Failure is not fatal, as we can still scan the file system.
+  if (option.git && git_state_new(&state) != 0 && option.debug)
+    fprintf(stderr, "Git state unavailable; scanning all sources\n");
+
+  const bool incremental =
+      state != NULL && git_changes(db, state, &changed, &changed_count) == 0;
+
+  // Any build makes an existing baseline stale, so remove it in case we are
+  // interrupted before we can save a new one.
+  if (UNLIKELY((rc = git_state_clear(db)))) {
+    fprintf(stderr, "failed to clear Git baseline: %s\n", strerror(rc));
+    goto done;
+  }
+
+  if (incremental) {
+    if (option.debug)
+      fprintf(stderr, "Git reports %zu possibly changed files\n",
+              changed_count);
+    rc = update(db, (const char **)changed, changed_count, false);
+  } else {
+    rc = update(db, (const char **)option.src, option.src_len, true);
+  }
+  if (rc)
+    goto done;
+
+  if (state != NULL) {
+    if (UNLIKELY((rc = git_state_save(db, state)))) {
+      fprintf(stderr, "failed to save Git baseline: %s\n", strerror(rc));
+      goto done;
+    }
+  }
+
+done:
+  for (size_t i = 0; i < changed_count; ++i)
+    free(changed[i]);
+  free(changed);
+  git_state_free(&state);
 
   return rc;
 }
+
+int build_changes(clink_db_t *db, const char **paths, size_t count) {
+
+  assert(db != NULL);
+  assert(paths != NULL || count == 0);
+
+  return update(db, paths, count, false);
+}
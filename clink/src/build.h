@@ -1,6 +1,7 @@
 #pragma once
 
 #include <clink/clink.h>
+#include <stddef.h>
 
 /** build or update a Clink database
  *
@@ -8,3 +9,27 @@
  * \return 0 on success or an errno on failure
  */
 int build(clink_db_t *db);
+
+/** update a Clink database for changes to some paths
+ *
+ * Each path is a file or directory within our sources that may have been
+ * created, modified, or deleted since the last build. Existing source files
+ * within these paths are reparsed if they have changed, and records of files
+ * within them that no longer exist are removed.
+ *
+ * \param db Database to operate on
+ * \param paths Absolute paths that changed
+ * \param count Number of entries in `paths`
+ * \return 0 on success or an errno on failure
+ */
+int build_changes(clink_db_t *db, const char **paths, size_t count);
+
+/** set a function to be told of each directory read while finding sources
+ *
+ * The observer may be called from multiple threads concurrently.
+ *
+ * \param observer Callback, or `NULL` to disable notification
+ * \param context State passed to `observer`
+ */
+void build_set_dir_observer(void (*observer)(const char *path, void *context),
+                            void *context);
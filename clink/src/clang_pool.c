@@ -0,0 +1,834 @@
+#include "clang_pool.h"
+#include "../../common/compiler.h"
+#include "../../common/pipe.h"
+#include "clock.h"
+#include "find_me.h"
+#include <assert.h>
+#include <clink/clink.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <crt_externs.h>
+#endif
+
+/// message types a worker sends back
+enum {
+  MSG_SYMBOL = 1, ///< a symbol found in the file being parsed
+  MSG_DONE = 2,   ///< parsing is complete, followed by its errno
+};
+
+/// how often to check on a worker’s memory usage, in milliseconds
+enum { CHECK_INTERVAL = 100 };
+
+/// buffered reader over a pipe
+typedef struct {
+  int fd;
+
+  /// process at the other end, whose limits to enforce, or 0
+  pid_t pid;
+
+  /// `CLOCK_MONOTONIC` nanoseconds after which to give up, or 0
+  uint64_t deadline;
+
+  /// bytes of resident memory `pid` may use, or 0
+  size_t rss_limit;
+
+  /// when `pid`’s memory usage was last checked
+  uint64_t last_check;
+
+  uint8_t buffer[BUFSIZ];
+  size_t offset;
+  size_t length;
+} reader_t;
+
+/// storage for a received string field
+typedef struct {
+  char *value; ///< most recent non-`NULL` value received, or `NULL`
+  size_t size; ///< allocated bytes in `value`
+} field_t;
+
+/// string fields of a symbol
+enum { NAME, PATH, PARENT, FIELDS };
+
+/// a worker process
+typedef struct {
+  pid_t pid; ///< 0 if not running
+
+  /// write end of the worker’s stdin
+  int request;
+
+  /// read end of the worker’s stdout
+  reader_t response;
+
+  /// previous value of each symbol field the worker sent
+  field_t fields[FIELDS];
+} worker_t;
+
+struct clang_pool {
+
+  /// path to our own executable
+  char *me;
+
+  /// limits to apply to each worker
+  unsigned long timeout;
+  size_t rss_limit;
+
+  /// should workers parse through libclang’s indexing API?
+  bool use_index;
+
+  size_t size;
+  worker_t workers[];
+};
+
+static char **get_environ(void) {
+#ifdef __APPLE__
+  // on macOS, environ is not directly accessible
+  return *_NSGetEnviron();
+#else
+  // some platforms fail to expose environ in a header (e.g. FreeBSD), so
+  // declare it ourselves
+  extern char **environ;
+
+  return environ;
+#endif
+}
+
+/** determine how much resident memory a process is using
+ *
+ * This is only supported where `/proc` is available. Elsewhere it returns 0,
+ * so a memory limit is never triggered.
+ *
+ * \param pid Process to examine
+ * \return Resident bytes
+ */
+static size_t rss(pid_t pid) {
+
+  char path[sizeof("/proc//statm") + 20];
+  (void)snprintf(path, sizeof(path), "/proc/%ld/statm", (long)pid);
+
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+    return 0;
+
+  unsigned long size = 0;
+  unsigned long resident = 0;
+  if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+    resident = 0;
+  (void)fclose(f);
+
+  const long page = sysconf(_SC_PAGESIZE);
+  if (page < 1)
+    return 0;
+
+  return (size_t)resident * (size_t)page;
+}
+
+/** read more data into a reader’s buffer
+ *
+ * \param r Reader to fill
+ * \return 0 on success, EPIPE on end of file, ETIMEDOUT or ENOBUFS if the
+ *   process at the other end exceeded its limits, or another errno on failure
+ */
+static int refill(reader_t *r) {
+
+  assert(r != NULL);
+  assert(r->offset == r->length);
+
+  while (true) {
+
+    int timeout = -1;
+    if (r->pid != 0) {
+      const uint64_t t = now();
+
+      if (r->deadline != 0) {
+        if (t >= r->deadline)
+          return ETIMEDOUT;
+        const uint64_t remaining = (r->deadline - t) / 1000000 + 1;
+        timeout = remaining > INT32_MAX ? INT32_MAX : (int)remaining;
+      }
+
+      if (r->rss_limit != 0) {
+        if (t - r->last_check >= (uint64_t)CHECK_INTERVAL * 1000000) {
+          if (rss(r->pid) > r->rss_limit)
+            return ENOBUFS;
+          r->last_check = t;
+        }
+        if (timeout < 0 || timeout > CHECK_INTERVAL)
+          timeout = CHECK_INTERVAL;
+      }
+    }
+
+    struct pollfd pfd = {.fd = r->fd, .events = POLLIN};
+    const int p = poll(&pfd, 1, timeout);
+    if (UNLIKELY(p < 0)) {
+      if (errno == EINTR)
+        continue;
+      return errno;
+    }
+    if (p == 0)
+      continue;
+
+    const ssize_t n = read(r->fd, r->buffer, sizeof(r->buffer));
+    if (UNLIKELY(n < 0)) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      return errno;
+    }
+    if (n == 0)
+      return EPIPE;
+
+    r->offset = 0;
+    r->length = (size_t)n;
+    return 0;
+  }
+}
+
+static int get_bytes(reader_t *r, void *dst, size_t len) {
+
+  assert(r != NULL);
+  assert(dst != NULL || len == 0);
+
+  uint8_t *d = dst;
+  while (len > 0) {
+    if (r->offset == r->length) {
+      const int rc = refill(r);
+      if (rc != 0)
+        return rc;
+    }
+    size_t chunk = r->length - r->offset;
+    if (chunk > len)
+      chunk = len;
+    memcpy(d, &r->buffer[r->offset], chunk);
+    r->offset += chunk;
+    d += chunk;
+    len -= chunk;
+  }
+
+  return 0;
+}
+
+static int get_uint(reader_t *r, uint64_t *value) {
+
+  assert(r != NULL);
+  assert(value != NULL);
+
+  uint64_t v = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    uint8_t b = 0;
+    const int rc = get_bytes(r, &b, sizeof(b));
+    if (rc != 0)
+      return rc;
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      *value = v;
+      return 0;
+    }
+  }
+
+  return EPROTO;
+}
+
+static int get_ulong(reader_t *r, unsigned long *value) {
+
+  assert(value != NULL);
+
+  uint64_t v = 0;
+  const int rc = get_uint(r, &v);
+  if (rc != 0)
+    return rc;
+
+  if (UNLIKELY(v > ULONG_MAX))
+    return EPROTO;
+
+  *value = (unsigned long)v;
+  return 0;
+}
+
+/** read a string
+ *
+ * Strings are encoded as a length+2 followed by their bytes, 0 for `NULL`, or
+ * 1 for a repeat of the previous value of the same field.
+ *
+ * \param r Reader to read from
+ * \param f Field to read into
+ * \param value [out] The string read, valid until the next read into `f`
+ * \return 0 on success or an errno on failure
+ */
+static int get_str(reader_t *r, field_t *f, const char **value) {
+
+  assert(f != NULL);
+  assert(value != NULL);
+
+  uint64_t n = 0;
+  int rc = get_uint(r, &n);
+  if (rc != 0)
+    return rc;
+
+  if (n == 0) {
+    *value = NULL;
+    return 0;
+  }
+
+  if (n == 1) {
+    if (UNLIKELY(f->value == NULL))
+      return EPROTO;
+    *value = f->value;
+    return 0;
+  }
+
+  const uint64_t len = n - 2;
+  if (UNLIKELY(len >= SIZE_MAX))
+    return EPROTO;
+
+  if (f->size < len + 1) {
+    char *v = realloc(f->value, len + 1);
+    if (UNLIKELY(v == NULL))
+      return ENOMEM;
+    f->value = v;
+    f->size = len + 1;
+  }
+
+  if ((rc = get_bytes(r, f->value, len)))
+    return rc;
+  f->value[len] = '\0';
+
+  *value = f->value;
+  return 0;
+}
+
+static void field_clear(field_t *f) {
+  assert(f != NULL);
+  free(f->value);
+  *f = (field_t){0};
+}
+
+static int put_uint(FILE *f, uint64_t value) {
+
+  assert(f != NULL);
+
+  do {
+    uint8_t b = value & 0x7f;
+    value >>= 7;
+    if (value != 0)
+      b |= 0x80;
+    if (UNLIKELY(putc(b, f) == EOF))
+      return EIO;
+  } while (value != 0);
+
+  return 0;
+}
+
+/** write a string
+ *
+ * \param f Stream to write to
+ * \param last [inout] Previous value written to this field, for encoding
+ *   repeats, or `NULL` if repeats should not be encoded
+ * \param value String to write
+ * \return 0 on success or an errno on failure
+ */
+static int put_str(FILE *f, char **last, const char *value) {
+
+  if (value == NULL)
+    return put_uint(f, 0);
+
+  if (last != NULL && *last != NULL && strcmp(*last, value) == 0)
+    return put_uint(f, 1);
+
+  const size_t len = strlen(value);
+  int rc = put_uint(f, (uint64_t)len + 2);
+  if (rc != 0)
+    return rc;
+  if (UNLIKELY(fwrite(value, 1, len, f) != len))
+    return EIO;
+
+  if (last != NULL) {
+    char *copy = strdup(value);
+    if (UNLIKELY(copy == NULL))
+      return ENOMEM;
+    free(*last);
+    *last = copy;
+  }
+
+  return 0;
+}
+
+/** write data to a pipe, without dying if the reader has gone
+ *
+ * \param fd File descriptor to write to
+ * \param data Bytes to write
+ * \param len Number of bytes in `data`
+ * \return 0 on success, EPIPE if the reader has exited, or another errno on
+ *   failure
+ */
+static int write_all(int fd, const void *data, size_t len) {
+
+#ifndef __APPLE__
+  // Writing to a closed pipe raises a SIGPIPE for this thread. Block it for
+  // the duration of the write, and then consume any that we caused before
+  // unblocking. On macOS, this is avoided by `F_SETNOSIGPIPE` instead.
+  sigset_t pipe_set;
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  sigset_t old;
+  int rc = pthread_sigmask(SIG_BLOCK, &pipe_set, &old);
+  if (UNLIKELY(rc != 0))
+    return rc;
+  sigset_t pending;
+  sigemptyset(&pending);
+  (void)sigpending(&pending);
+  const bool was_pending = sigismember(&pending, SIGPIPE);
+#else
+  int rc = 0;
+#endif
+
+  const uint8_t *d = data;
+  while (len > 0) {
+    const ssize_t n = write(fd, d, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      rc = errno;
+      break;
+    }
+    d += n;
+    len -= (size_t)n;
+  }
+
+#ifndef __APPLE__
+  if (rc == EPIPE && !was_pending) {
+    const struct timespec zero = {0};
+    while (sigtimedwait(&pipe_set, NULL, &zero) < 0 && errno == EINTR)
+      ;
+  }
+
+  (void)pthread_sigmask(SIG_SETMASK, &old, NULL);
+#endif
+
+  return rc;
+}
+
+/// start a worker process
+static int start(clang_pool_t *pool, worker_t *w) {
+
+  assert(pool != NULL);
+  assert(w != NULL);
+  assert(w->pid == 0 && "starting a worker that is already running");
+
+  int rc = 0;
+  posix_spawn_file_actions_t fa;
+  int request[2] = {-1, -1};
+  int response[2] = {-1, -1};
+
+  if (UNLIKELY((rc = posix_spawn_file_actions_init(&fa))))
+    return rc;
+
+  if (UNLIKELY((rc = pipe_(request))))
+    goto done;
+  if (UNLIKELY((rc = pipe_(response))))
+    goto done;
+
+#ifdef __APPLE__
+  // do not raise SIGPIPE when writing to a worker that has exited
+  if (UNLIKELY(fcntl(request[1], F_SETNOSIGPIPE, 1) < 0)) {
+    rc = errno;
+    goto done;
+  }
+#endif
+
+  // wire the pipes to the child’s stdin and stdout
+  if (UNLIKELY((rc = posix_spawn_file_actions_adddup2(&fa, request[0],
+                                                      STDIN_FILENO))))
+    goto done;
+  if (UNLIKELY((rc = posix_spawn_file_actions_adddup2(&fa, response[1],
+                                                      STDOUT_FILENO))))
+    goto done;
+
+  {
+    const char *argv[] = {pool->me, "--clang-worker",
+                          pool->use_index ? "index" : NULL, NULL};
+    char *const *args = (char *const *)argv;
+    pid_t pid;
+    if (UNLIKELY(
+            (rc = posix_spawn(&pid, argv[0], &fa, NULL, args, get_environ()))))
+      goto done;
+
+    *w = (worker_t){.pid = pid,
+                    .request = request[1],
+                    .response = {.fd = response[0], .pid = pid}};
+    request[1] = -1;
+    response[0] = -1;
+  }
+
+done:
+  for (size_t i = 0; i < 2; ++i) {
+    if (request[i] != -1)
+      (void)close(request[i]);
+    if (response[i] != -1)
+      (void)close(response[i]);
+  }
+  (void)posix_spawn_file_actions_destroy(&fa);
+
+  return rc;
+}
+
+/// kill and clean up a worker process
+static void stop(worker_t *w) {
+
+  assert(w != NULL);
+
+  if (w->pid == 0)
+    return;
+
+  (void)kill(w->pid, SIGKILL);
+  while (waitpid(w->pid, &(int){0}, 0) < 0 && errno == EINTR)
+    ;
+
+  (void)close(w->request);
+  (void)close(w->response.fd);
+  for (size_t i = 0; i < FIELDS; ++i)
+    field_clear(&w->fields[i]);
+
+  *w = (worker_t){0};
+}
+
+int clang_pool_new(clang_pool_t **pool, size_t size, unsigned long timeout,
+                   size_t rss_limit, bool use_index) {
+
+  if (UNLIKELY(pool == NULL))
+    return EINVAL;
+
+  if (UNLIKELY(size == 0))
+    return EINVAL;
+
+  if (UNLIKELY(size > (SIZE_MAX - sizeof(clang_pool_t)) / sizeof(worker_t)))
+    return EOVERFLOW;
+
+  clang_pool_t *p = calloc(1, sizeof(*p) + size * sizeof(p->workers[0]));
+  if (UNLIKELY(p == NULL))
+    return ENOMEM;
+
+  // workers are ourselves, so figure out where we live
+  p->me = find_me();
+  if (UNLIKELY(p->me == NULL)) {
+    free(p);
+    return ENOENT;
+  }
+
+  p->timeout = timeout;
+  p->rss_limit = rss_limit;
+  p->use_index = use_index;
+  p->size = size;
+
+  *pool = p;
+  return 0;
+}
+
+int clang_pool_parse(clang_pool_t *pool, size_t index, clink_db_t *db,
+                     const char *filename, size_t argc, const char **argv) {
+
+  assert(pool != NULL);
+  assert(index < pool->size);
+  assert(db != NULL);
+  assert(filename != NULL);
+  assert(argc == 0 || argv != NULL);
+
+  worker_t *w = &pool->workers[index];
+  int rc = 0;
+  char *request = NULL;
+  size_t request_size = 0;
+  FILE *buffer = NULL;
+
+  // has the worker fallen out of sync with us?
+  bool broken = false;
+
+  // encode the request
+  buffer = open_memstream(&request, &request_size);
+  if (UNLIKELY(buffer == NULL)) {
+    rc = errno;
+    goto done;
+  }
+  if (UNLIKELY((rc = put_uint(buffer, argc))))
+    goto done;
+  if (UNLIKELY((rc = put_str(buffer, NULL, filename))))
+    goto done;
+  for (size_t i = 0; i < argc; ++i) {
+    if (UNLIKELY((rc = put_str(buffer, NULL, argv[i]))))
+      goto done;
+  }
+  if (UNLIKELY(fclose(buffer) < 0)) {
+    buffer = NULL;
+    rc = errno;
+    goto done;
+  }
+  buffer = NULL;
+
+  if (w->pid == 0) {
+    if (UNLIKELY((rc = start(pool, w))))
+      goto done;
+  }
+
+  // from here on, any failure leaves the worker out of sync with us
+  broken = true;
+
+  if ((rc = write_all(w->request, request, request_size)))
+    goto done;
+
+  w->response.deadline =
+      pool->timeout == 0 ? 0 : now() + (uint64_t)pool->timeout * 1000000000;
+  w->response.rss_limit = pool->rss_limit;
+  w->response.last_check = 0;
+
+  // insert symbols as they arrive
+  while (true) {
+
+    uint64_t msg = 0;
+    if ((rc = get_uint(&w->response, &msg)))
+      goto done;
+
+    if (msg == MSG_DONE) {
+      uint64_t err = 0;
+      if ((rc = get_uint(&w->response, &err)))
+        goto done;
+      broken = false;
+      rc = err > INT_MAX ? EPROTO : (int)err;
+      break;
+    }
+
+    if (UNLIKELY(msg != MSG_SYMBOL)) {
+      rc = EPROTO;
+      goto done;
+    }
+
+    clink_symbol_t symbol = {0};
+    {
+      uint64_t category = 0;
+      if ((rc = get_uint(&w->response, &category)))
+        goto done;
+      symbol.category = (clink_category_t)category;
+    }
+    {
+      const char *name = NULL;
+      if ((rc = get_str(&w->response, &w->fields[NAME], &name)))
+        goto done;
+      symbol.name = (char *)name;
+    }
+    {
+      const char *path = NULL;
+      if ((rc = get_str(&w->response, &w->fields[PATH], &path)))
+        goto done;
+      symbol.path = (char *)path;
+    }
+    {
+      const char *parent = NULL;
+      if ((rc = get_str(&w->response, &w->fields[PARENT], &parent)))
+        goto done;
+      symbol.parent = (char *)parent;
+    }
+    unsigned long *const locations[] = {
+        &symbol.lineno,      &symbol.colno,      &symbol.start.lineno,
+        &symbol.start.colno, &symbol.start.byte, &symbol.end.lineno,
+        &symbol.end.colno,   &symbol.end.byte};
+    for (size_t i = 0; i < sizeof(locations) / sizeof(locations[0]); ++i) {
+      if ((rc = get_ulong(&w->response, locations[i])))
+        goto done;
+    }
+
+    if (UNLIKELY(symbol.name == NULL || symbol.path == NULL)) {
+      rc = EPROTO;
+      goto done;
+    }
+
+    if (UNLIKELY((rc = clink_db_add_symbol(db, &symbol))))
+      goto done;
+  }
+
+done:
+  if (buffer != NULL)
+    (void)fclose(buffer);
+  free(request);
+
+  // if the worker died or we could not follow what it was saying, replace it
+  if (broken) {
+    stop(w);
+    if (rc == EPIPE)
+      rc = EIO;
+  }
+
+  return rc;
+}
+
+void clang_pool_free(clang_pool_t **pool) {
+
+  if (pool == NULL || *pool == NULL)
+    return;
+
+  clang_pool_t *p = *pool;
+
+  for (size_t i = 0; i < p->size; ++i)
+    stop(&p->workers[i]);
+
+  free(p->me);
+  free(p);
+  *pool = NULL;
+}
+
+/// state for streaming symbols back to our requester
+typedef struct {
+  FILE *out;
+  char *last[FIELDS]; ///< previous value sent for each symbol field
+} sender_t;
+
+/// `clink_clang_parse_cb` callback
+static int send_symbol(const clink_symbol_t *symbol, void *context) {
+
+  assert(symbol != NULL);
+  assert(context != NULL);
+
+  sender_t *s = context;
+  int rc = 0;
+
+  if ((rc = put_uint(s->out, MSG_SYMBOL)))
+    return rc;
+  if ((rc = put_uint(s->out, (uint64_t)symbol->category)))
+    return rc;
+  if ((rc = put_str(s->out, &s->last[NAME], symbol->name)))
+    return rc;
+  if ((rc = put_str(s->out, &s->last[PATH], symbol->path)))
+    return rc;
+  if ((rc = put_str(s->out, &s->last[PARENT], symbol->parent)))
+    return rc;
+
+  const unsigned long locations[] = {
+      symbol->lineno,      symbol->colno,      symbol->start.lineno,
+      symbol->start.colno, symbol->start.byte, symbol->end.lineno,
+      symbol->end.colno,   symbol->end.byte};
+  for (size_t i = 0; i < sizeof(locations) / sizeof(locations[0]); ++i) {
+    if ((rc = put_uint(s->out, locations[i])))
+      return rc;
+  }
+
+  return 0;
+}
+
+int clang_worker(int in, int out, bool use_index) {
+
+  int rc = 0;
+  reader_t *request = NULL;
+  sender_t sender = {0};
+  field_t *args = NULL;
+  size_t args_size = 0;
+  const char **argv = NULL;
+  clink_clang_t *clang = NULL;
+
+  request = calloc(1, sizeof(*request));
+  if (UNLIKELY(request == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  request->fd = in;
+
+  sender.out = fdopen(out, "w");
+  if (UNLIKELY(sender.out == NULL)) {
+    rc = errno;
+    goto done;
+  }
+
+  while (true) {
+
+    // the requester closing our input is how we are told to exit
+    uint64_t argc = 0;
+    if ((rc = get_uint(request, &argc))) {
+      if (rc == EPIPE)
+        rc = 0;
+      goto done;
+    }
+    if (UNLIKELY(argc >= SIZE_MAX / sizeof(argv[0]))) {
+      rc = EPROTO;
+      goto done;
+    }
+
+    // make room for the filename followed by the arguments
+    if (args_size < argc + 1) {
+      field_t *a = realloc(args, (argc + 1) * sizeof(args[0]));
+      if (UNLIKELY(a == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+      for (size_t i = args_size; i < argc + 1; ++i)
+        a[i] = (field_t){0};
+      args = a;
+      args_size = argc + 1;
+
+      const char **v = realloc(argv, (argc + 1) * sizeof(argv[0]));
+      if (UNLIKELY(v == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+      argv = v;
+    }
+
+    const char *filename = NULL;
+    if ((rc = get_str(request, &args[0], &filename)))
+      goto done;
+    for (size_t i = 0; i < argc; ++i) {
+      if ((rc = get_str(request, &args[i + 1], &argv[i])))
+        goto done;
+    }
+    if (UNLIKELY(filename == NULL)) {
+      rc = EPROTO;
+      goto done;
+    }
+
+    // reuse libclang state across requests, creating it on first use
+    int r = 0;
+    if (clang == NULL) {
+      r = clink_clang_new(&clang);
+      if (LIKELY(r == 0))
+        r = clink_clang_use_index(clang, use_index);
+      if (UNLIKELY(r != 0))
+        clink_clang_free(&clang);
+    }
+    if (LIKELY(r == 0))
+      r = clink_clang_parse_cb(clang, filename, (size_t)argc, argv,
+                               send_symbol, &sender);
+
+    if (UNLIKELY((rc = put_uint(sender.out, MSG_DONE))))
+      goto done;
+    if (UNLIKELY((rc = put_uint(sender.out, (uint64_t)r))))
+      goto done;
+    if (UNLIKELY(fflush(sender.out) == EOF)) {
+      rc = errno;
+      goto done;
+    }
+  }
+
+done:
+  clink_clang_free(&clang);
+  free(argv);
+  for (size_t i = 0; i < args_size; ++i)
+    field_clear(&args[i]);
+  free(args);
+  for (size_t i = 0; i < FIELDS; ++i)
+    free(sender.last[i]);
+  if (sender.out != NULL)
+    (void)fclose(sender.out);
+  free(request);
+
+  return rc;
+}
@@ -0,0 +1,72 @@
+/// \file
+/// \brief libclang parsing isolated in worker subprocesses
+///
+/// Workers are instances of this executable, started with the
+/// `--clang-worker` argument, followed by `index` if they should parse through
+/// libclang’s indexing API. Requests are written to a worker’s stdin and the
+/// symbols it finds are streamed back over its stdout. Integers are encoded as
+/// LEB128 varints and each string field can refer back to its previous value,
+/// so most symbols only cost a few bytes plus their name.
+
+#pragma once
+
+#include <clink/clink.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/// opaque pointer to a pool of workers
+typedef struct clang_pool clang_pool_t;
+
+/** create a pool of libclang workers
+ *
+ * Workers are started on demand. Each is dedicated to the caller thread that
+ * uses its index, so different threads can parse concurrently without
+ * contending for workers.
+ *
+ * \param pool [out] Created pool on success
+ * \param size Number of workers
+ * \param timeout Seconds a worker may spend on one file, or 0 for no limit
+ * \param rss_limit Bytes of resident memory a worker may use, or 0 for no
+ *   limit
+ * \param use_index Whether workers should parse through libclang’s indexing
+ *   API instead of walking the AST
+ * \return 0 on success or an errno on failure
+ */
+int clang_pool_new(clang_pool_t **pool, size_t size, unsigned long timeout,
+                   size_t rss_limit, bool use_index);
+
+/** parse a C/C++ file with libclang in a worker process
+ *
+ * Symbols are inserted into the database as the worker finds them. A worker
+ * that crashes or exceeds its limits is killed, and a fresh one is started on
+ * the next call.
+ *
+ * \param pool Pool to draw a worker from
+ * \param index Index of the worker to use
+ * \param db Database to insert into
+ * \param filename Absolute path to source file to parse
+ * \param argc Number of Clang command line arguments
+ * \param argv Clang command line arguments
+ * \return 0 on success, EIO if the worker crashed, ETIMEDOUT if it exceeded
+ *   its time limit, ENOBUFS if it exceeded its memory limit, or another errno
+ *   on failure
+ */
+int clang_pool_parse(clang_pool_t *pool, size_t index, clink_db_t *db,
+                     const char *filename, size_t argc, const char **argv);
+
+/** stop all workers and deallocate a pool
+ *
+ * \param pool Pool to destroy
+ */
+void clang_pool_free(clang_pool_t **pool);
+
+/** run as a libclang worker
+ *
+ * This serves requests until the requesting process closes `in`.
+ *
+ * \param in File descriptor to read requests from
+ * \param out File descriptor to write results to
+ * \param use_index Whether to parse through libclang’s indexing API
+ * \return 0 on success or an errno on failure
+ */
+int clang_worker(int in, int out, bool use_index);
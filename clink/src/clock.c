@@ -0,0 +1,9 @@
+#include "clock.h"
+#include <stdint.h>
+#include <time.h>
+
+uint64_t now(void) {
+  struct timespec ts = {0};
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,11 @@
+// monotonic time, for measuring durations
+
+#pragma once
+
+#include <stdint.h>
+
+/** current monotonic time
+ *
+ * \return Nanoseconds since some arbitrary, fixed point
+ */
+uint64_t now(void);
@@ -1,10 +1,17 @@
 #include "file_queue.h"
+#include "../../common/compiler.h"
+#include "option.h"
 #include "path.h"
+#include "sigint.h"
 #include "str_queue.h"
 #include <assert.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -14,6 +21,15 @@ struct file_queue {
 
   /// paths we have enqueued, but not yet opened
   str_queue_t *pending;
+
+  /// optional judge of whether and how urgently to process a file
+  bool (*filter)(const char *path, const struct stat *st, uint64_t *priority,
+                 void *context);
+  void *filter_context;
+
+  /// optional observer of each directory read
+  void (*dir_callback)(const char *path, void *context);
+  void *dir_callback_context;
 };
 
 int file_queue_new(file_queue_t **fq) {
@@ -40,49 +56,215 @@ done:
   return rc;
 }
 
-static int push_file(file_queue_t *fq, const char *path) {
+/// should a file be processed, and how soon?
+static bool admit(file_queue_t *fq, const char *path, const struct stat *st,
+                  uint64_t *priority) {
 
   assert(fq != NULL);
   assert(path != NULL);
+  assert(priority != NULL);
 
-  return str_queue_push(fq->pending, path);
+  *priority = 0;
+  if (fq->filter == NULL)
+    return true;
+  return fq->filter(path, st, priority, fq->filter_context);
 }
 
-/// `is_dir`, but also taking advantage of dirent information
-static bool is_directory(struct dirent entry, const char *path) {
+static int push_file(file_queue_t *fq, const char *path) {
+
+  assert(fq != NULL);
   assert(path != NULL);
 
-  if (entry.d_type == DT_DIR)
-    return true;
+  struct stat st;
+  const bool has_stat = stat(path, &st) == 0;
 
-  if (entry.d_type == DT_UNKNOWN)
-    return is_dir(path);
+  uint64_t priority = 0;
+  if (!admit(fq, path, has_stat ? &st : NULL, &priority))
+    return 0;
 
-  return false;
+  return str_queue_push_priority(fq->pending, path, priority);
 }
 
-/// `is_file`, but also taking advantage of dirent information
-static bool is_reg_file(struct dirent entry, const char *path) {
+/// maximum number of directory descriptors to hold open for pending work
+enum { MAX_OPEN_DIRS = 128 };
+
+/// a directory waiting to be read
+typedef struct dir_item {
+  struct dir_item *next; ///< next pending directory
+  int fd;                ///< open descriptor for this directory, or -1
+  char path[];           ///< absolute path to this directory
+} dir_item_t;
+
+/// state shared between threads walking a directory tree
+typedef struct {
+  file_queue_t *fq;      ///< queue to populate
+  pthread_mutex_t lock;  ///< guard for all following fields
+  pthread_cond_t change; ///< signalled when `pending` or `active` changes
+  dir_item_t *pending;   ///< directories that have yet to be read
+  size_t active;         ///< number of threads currently reading a directory
+  int rc;                ///< first error any thread encountered
+  size_t open_dirs;      ///< descriptors held by `pending` (atomic)
+} walk_t;
+
+/// files a single thread has found but not yet added to the queue
+typedef struct {
+  char *paths;          ///< NUL-separated paths
+  size_t size;          ///< bytes used in `paths`
+  size_t capacity;      ///< bytes allocated for `paths`
+  uint64_t *priorities; ///< priority of each path
+  const char **index;   ///< scratch space for pointers into `paths`
+  size_t count;         ///< number of paths in `paths`
+  size_t slots;         ///< entries allocated for `priorities` and `index`
+} batch_t;
+
+/// number of bytes to initially allocate for a batch
+enum { BATCH_SIZE = 64 * 1024 };
+
+/// add a path to a batch, if the queue’s filter accepts it
+static int batch_add(file_queue_t *fq, batch_t *b, const char *path,
+                     const struct stat *st) {
+  assert(fq != NULL);
+  assert(b != NULL);
   assert(path != NULL);
 
-  if (entry.d_type == DT_REG)
-    return true;
+  uint64_t priority = 0;
+  if (!admit(fq, path, st, &priority))
+    return 0;
+
+  const size_t len = strlen(path) + 1;
+  if (b->capacity - b->size < len) {
+    size_t c = b->capacity == 0 ? BATCH_SIZE : b->capacity;
+    while (c - b->size < len)
+      c *= 2;
+    char *p = realloc(b->paths, c);
+    if (p == NULL)
+      return ENOMEM;
+    b->paths = p;
+    b->capacity = c;
+  }
 
-  if (entry.d_type == DT_UNKNOWN)
-    return is_file(path);
+  if (b->count == b->slots) {
+    const size_t s = b->slots == 0 ? 1024 : b->slots * 2;
+    uint64_t *p = realloc(b->priorities, s * sizeof(b->priorities[0]));
+    if (p == NULL)
+      return ENOMEM;
+    b->priorities = p;
+    const char **i = realloc(b->index, s * sizeof(b->index[0]));
+    if (i == NULL)
+      return ENOMEM;
+    b->index = i;
+    b->slots = s;
+  }
 
-  return false;
+  memcpy(&b->paths[b->size], path, len);
+  b->size += len;
+  b->priorities[b->count] = priority;
+  ++b->count;
+  return 0;
 }
 
-static int push_dir(file_queue_t *fq, const char *path) {
-
+/// move the contents of a batch into the queue
+static int batch_flush(file_queue_t *fq, batch_t *b) {
   assert(fq != NULL);
+  assert(b != NULL);
+
+  for (size_t i = 0, offset = 0; i < b->count; ++i) {
+    b->index[i] = &b->paths[offset];
+    offset += strlen(&b->paths[offset]) + 1;
+  }
+
+  // Add everything at once, so a consumer waiting on the queue sees the whole
+  // batch and can pick the highest priority entry from it.
+  int rc = str_queue_push_all(fq->pending, b->count, b->index, b->priorities);
+  if (rc != 0)
+    return rc;
+
+  b->size = 0;
+  b->count = 0;
+  return 0;
+}
+
+/// release memory associated with a batch
+static void batch_free(batch_t *b) {
+  assert(b != NULL);
+  free(b->index);
+  free(b->priorities);
+  free(b->paths);
+  *b = (batch_t){0};
+}
+
+/// create a pending directory
+static int dir_item_new(walk_t *w, int parent, const char *path,
+                        const char *name, dir_item_t **item) {
+  assert(w != NULL);
   assert(path != NULL);
+  assert(item != NULL);
+
+  dir_item_t *i = malloc(sizeof(*i) + strlen(path) + 1);
+  if (i == NULL)
+    return ENOMEM;
+  strcpy(i->path, path);
+  i->next = NULL;
+  i->fd = -1;
+
+  // Open the directory relative to its parent while we have it, to save a full
+  // path resolution later. But limit how many of these we hold, so a wide tree
+  // does not exhaust our file descriptors.
+  if (name != NULL &&
+      __atomic_fetch_add(&w->open_dirs, 1, __ATOMIC_ACQ_REL) < MAX_OPEN_DIRS) {
+    i->fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (i->fd < 0)
+      (void)__atomic_fetch_sub(&w->open_dirs, 1, __ATOMIC_ACQ_REL);
+  } else if (name != NULL) {
+    (void)__atomic_fetch_sub(&w->open_dirs, 1, __ATOMIC_ACQ_REL);
+  }
+
+  *item = i;
+  return 0;
+}
+
+/// read a single directory, queueing the files and subdirectories within it
+static int read_dir(walk_t *w, dir_item_t *item, batch_t *batch) {
+  assert(w != NULL);
+  assert(item != NULL);
+  assert(batch != NULL);
+
+  int rc = 0;
+  DIR *dir = NULL;
+  char *sub = NULL;
+  dir_item_t *subdirs = NULL;
 
   // open the directory for reading
-  DIR *dir = opendir(path);
-  if (dir == NULL)
-    return errno;
+  int fd = item->fd;
+  if (fd >= 0) {
+    item->fd = -1;
+    (void)__atomic_fetch_sub(&w->open_dirs, 1, __ATOMIC_ACQ_REL);
+  } else {
+    fd = open(item->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+      return errno;
+  }
+  dir = fdopendir(fd);
+  if (dir == NULL) {
+    rc = errno;
+    (void)close(fd);
+    return rc;
+  }
+
+  if (w->fq->dir_callback != NULL)
+    w->fq->dir_callback(item->path, w->fq->dir_callback_context);
+
+  // create space to form paths to each entry, without an allocation per entry
+  size_t prefix_len = strlen(item->path);
+  if (prefix_len > 0 && item->path[prefix_len - 1] == '/')
+    --prefix_len;
+  sub = malloc(prefix_len + 1 + NAME_MAX + 1);
+  if (sub == NULL) {
+    rc = ENOMEM;
+    goto done;
+  }
+  memcpy(sub, item->path, prefix_len);
+  sub[prefix_len] = '/';
 
   while (true) {
 
@@ -91,14 +273,14 @@ static int push_dir(file_queue_t *fq, const char *path) {
     struct dirent *entry = readdir(dir);
 
     // end of directory?
-    if (entry == NULL && errno == 0) {
-      (void)closedir(dir);
+    if (entry == NULL && errno == 0)
       break;
-    }
 
     // error?
-    if (entry == NULL)
-      return errno;
+    if (entry == NULL) {
+      rc = errno;
+      goto done;
+    }
 
     // skip this entry if we have enough information to know it is irrelevant
     if (entry->d_type != DT_REG && entry->d_type != DT_DIR &&
@@ -110,33 +292,200 @@ static int push_dir(file_queue_t *fq, const char *path) {
       continue;
 
     // form an absolute path to this entry
-    char *sub = NULL;
-    int rc = join(path, entry->d_name, &sub);
-    if (rc != 0)
-      return rc;
-
-    // if this is a directory, recurse
-    if (is_directory(*entry, sub)) {
-      int r = push_dir(fq, sub);
-      free(sub);
-      if (r != 0)
-        return r;
+    strcpy(&sub[prefix_len + 1], entry->d_name);
+
+    // if the file system did not tell us what this is, ask directly
+    bool is_directory = entry->d_type == DT_DIR;
+    bool is_reg_file = entry->d_type == DT_REG;
+    struct stat st;
+    bool has_stat = false;
+    if (entry->d_type == DT_UNKNOWN) {
+      if (fstatat(dirfd(dir), entry->d_name, &st, 0) == 0) {
+        has_stat = true;
+        is_directory = S_ISDIR(st.st_mode);
+        is_reg_file = S_ISREG(st.st_mode);
+      }
+    }
+
+    // if this is a directory, note it for later reading
+    if (is_directory) {
+      dir_item_t *i = NULL;
+      if ((rc = dir_item_new(w, dirfd(dir), sub, entry->d_name, &i)))
+        goto done;
+      i->next = subdirs;
+      subdirs = i;
       continue;
     }
 
     // if this is a file eligible for parsing, enqueue it
-    if (is_reg_file(*entry, sub) && is_source(sub)) {
-      int r = push_file(fq, sub);
-      free(sub);
-      if (r != 0 && r != EALREADY)
-        return r;
-      continue;
+    if (is_reg_file && is_source(sub)) {
+      // the filter needs to know about the file, but we can tell it cheaply
+      // by looking the file up relative to its directory
+      if (!has_stat && w->fq->filter != NULL)
+        has_stat = fstatat(dirfd(dir), entry->d_name, &st, 0) == 0;
+      if ((rc = batch_add(w->fq, batch, sub, has_stat ? &st : NULL)))
+        goto done;
     }
+  }
 
-    free(sub);
+  // share the subdirectories we found with the other threads
+  if (subdirs != NULL) {
+    int r UNUSED = pthread_mutex_lock(&w->lock);
+    assert(r == 0);
+    while (subdirs != NULL) {
+      dir_item_t *i = subdirs;
+      subdirs = i->next;
+      i->next = w->pending;
+      w->pending = i;
+    }
+    r = pthread_cond_broadcast(&w->change);
+    assert(r == 0);
+    r = pthread_mutex_unlock(&w->lock);
+    assert(r == 0);
   }
 
-  return 0;
+done:
+  while (subdirs != NULL) {
+    dir_item_t *i = subdirs;
+    subdirs = i->next;
+    if (i->fd >= 0) {
+      (void)close(i->fd);
+      (void)__atomic_fetch_sub(&w->open_dirs, 1, __ATOMIC_ACQ_REL);
+    }
+    free(i);
+  }
+  free(sub);
+  (void)closedir(dir);
+
+  return rc;
+}
+
+/// read directories until the tree has been exhausted
+static void walk(walk_t *w) {
+  assert(w != NULL);
+
+  batch_t batch = {0};
+
+  int r UNUSED = pthread_mutex_lock(&w->lock);
+  assert(r == 0);
+
+  while (true) {
+
+    // wait until there is work, or until all other threads are idle
+    while (w->pending == NULL && w->active > 0 && w->rc == 0) {
+      r = pthread_cond_wait(&w->change, &w->lock);
+      assert(r == 0);
+    }
+
+    // has the walk finished or failed?
+    if (w->pending == NULL || w->rc != 0)
+      break;
+
+    // if the user has hit Ctrl+C, give up early
+    if (UNLIKELY(sigint_pending()))
+      break;
+
+    dir_item_t *item = w->pending;
+    w->pending = item->next;
+    ++w->active;
+
+    r = pthread_mutex_unlock(&w->lock);
+    assert(r == 0);
+
+    int rc = read_dir(w, item, &batch);
+
+    // Add the files we found to the queue. We do this after every directory so
+    // that consumers of the queue can begin processing files while we are
+    // still walking.
+    if (rc == 0 && batch.count > 0)
+      rc = batch_flush(w->fq, &batch);
+    if (item->fd >= 0) {
+      (void)close(item->fd);
+      (void)__atomic_fetch_sub(&w->open_dirs, 1, __ATOMIC_ACQ_REL);
+    }
+    free(item);
+
+    r = pthread_mutex_lock(&w->lock);
+    assert(r == 0);
+
+    --w->active;
+    if (rc != 0 && w->rc == 0)
+      w->rc = rc;
+
+    // wake others if they may now be able to finish
+    if (w->active == 0 || rc != 0) {
+      r = pthread_cond_broadcast(&w->change);
+      assert(r == 0);
+    }
+  }
+
+  r = pthread_mutex_unlock(&w->lock);
+  assert(r == 0);
+
+  batch_free(&batch);
+}
+
+// trampoline for unpacking the calling convention used by pthreads
+static void *walk_entry(void *arg) {
+  walk(arg);
+  return NULL;
+}
+
+/// queue all source files within a directory tree
+static int push_dir(file_queue_t *fq, const char *path) {
+
+  assert(fq != NULL);
+  assert(path != NULL);
+
+  walk_t w = {.fq = fq};
+  pthread_t *threads = NULL;
+  size_t started = 0;
+  int rc = 0;
+
+  if ((rc = pthread_mutex_init(&w.lock, NULL)))
+    return rc;
+
+  if ((rc = pthread_cond_init(&w.change, NULL))) {
+    (void)pthread_mutex_destroy(&w.lock);
+    return rc;
+  }
+
+  if ((rc = dir_item_new(&w, -1, path, NULL, &w.pending)))
+    goto done;
+
+  // start helper threads, tolerating failure as we can walk the tree alone
+  const size_t thread_count = option.threads > 1 ? option.threads - 1 : 0;
+  if (thread_count > 0)
+    threads = calloc(thread_count, sizeof(threads[0]));
+  if (threads != NULL) {
+    for (; started < thread_count; ++started) {
+      if (pthread_create(&threads[started], NULL, walk_entry, &w) != 0)
+        break;
+    }
+  }
+
+  // join in helping
+  walk(&w);
+
+  for (size_t i = 0; i < started; ++i)
+    (void)pthread_join(threads[i], NULL);
+
+  rc = w.rc;
+
+done:
+  // clean up anything left after a failure
+  while (w.pending != NULL) {
+    dir_item_t *i = w.pending;
+    w.pending = i->next;
+    if (i->fd >= 0)
+      (void)close(i->fd);
+    free(i);
+  }
+  free(threads);
+  (void)pthread_cond_destroy(&w.change);
+  (void)pthread_mutex_destroy(&w.lock);
+
+  return rc;
 }
 
 int file_queue_push(file_queue_t *fq, const char *path) {
@@ -158,11 +507,50 @@ int file_queue_push(file_queue_t *fq, const char *path) {
   return is_dir(path) ? push_dir(fq, path) : push_file(fq, path);
 }
 
+void file_queue_set_filter(file_queue_t *fq,
+                           bool (*filter)(const char *path,
+                                          const struct stat *st,
+                                          uint64_t *priority, void *context),
+                           void *context) {
+  assert(fq != NULL);
+  fq->filter = filter;
+  fq->filter_context = context;
+}
+
+void file_queue_set_dir_callback(file_queue_t *fq,
+                                 void (*callback)(const char *path,
+                                                  void *context),
+                                 void *context) {
+  assert(fq != NULL);
+  fq->dir_callback = callback;
+  fq->dir_callback_context = context;
+}
+
+void file_queue_open(file_queue_t *fq) {
+  assert(fq != NULL);
+  str_queue_open(fq->pending);
+}
+
+void file_queue_close(file_queue_t *fq) {
+  assert(fq != NULL);
+  str_queue_close(fq->pending);
+}
+
 size_t file_queue_size(const file_queue_t *fq) {
   assert(fq != NULL);
   return str_queue_size(fq->pending);
 }
 
+size_t file_queue_total(const file_queue_t *fq) {
+  assert(fq != NULL);
+  return str_queue_total(fq->pending);
+}
+
+size_t file_queue_wait(file_queue_t *fq, size_t count) {
+  assert(fq != NULL);
+  return str_queue_wait(fq->pending, count);
+}
+
 int file_queue_pop(file_queue_t *fq, const char **path) {
 
   if (fq == NULL)
@@ -2,7 +2,10 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
 
 typedef struct file_queue file_queue_t;
 
@@ -13,12 +16,67 @@ typedef struct file_queue file_queue_t;
  */
 int file_queue_new(file_queue_t **fq);
 
+/** set a function for deciding which files to queue, and in what order
+ *
+ * The filter is given the path of each file about to be queued and the result
+ * of `stat`-ing it, or `NULL` if this failed. It returns `false` to omit the
+ * file from the queue, or `true` and a priority for the file. Files of greater
+ * priority are popped before those of lesser priority. Without a filter, all
+ * files are queued and popped in the order they were pushed.
+ *
+ * The filter may be called from multiple threads concurrently, and should be
+ * set before any files are pushed.
+ *
+ * \param fq Queue to operate on
+ * \param filter Filter, or `NULL` to accept everything without prioritisation
+ * \param context State passed to `filter`
+ */
+void file_queue_set_filter(file_queue_t *fq,
+                           bool (*filter)(const char *path,
+                                          const struct stat *st,
+                                          uint64_t *priority, void *context),
+                           void *context);
+
+/** set a function to be told of each directory the queue reads
+ *
+ * The callback is given the path of each directory as it is opened for reading
+ * while pushing a directory tree. It may be called from multiple threads
+ * concurrently, and should be set before any directories are pushed.
+ *
+ * \param fq Queue to operate on
+ * \param callback Callback, or `NULL` to disable notification
+ * \param context State passed to `callback`
+ */
+void file_queue_set_dir_callback(file_queue_t *fq,
+                                 void (*callback)(const char *path,
+                                                  void *context),
+                                 void *context);
+
+/** indicate more files may be pushed to a queue
+ *
+ * Until `file_queue_close` is called, `file_queue_pop` waits for files to
+ * arrive rather than reporting an empty queue. This allows one thread to
+ * discover files while others process them.
+ *
+ * \param fq Queue to operate on
+ */
+void file_queue_open(file_queue_t *fq);
+
+/** indicate no more files will be pushed to a queue
+ *
+ * \param fq Queue to operate on
+ */
+void file_queue_close(file_queue_t *fq);
+
 /** add a new file or directory to queue
+ *
+ * This function is thread-safe with respect to `file_queue_pop`.
  *
  * \param fq Queue to operate on
  * \param path File or directory to add
- * \return 0 on success if the string was added, EALREADY if the path had
- *   already been in the queue previously, or another errno on failure
+ * \return 0 on success if the path was added or omitted by the queue’s filter,
+ *   EALREADY if the path had already been in the queue previously, or another
+ *   errno on failure
  */
 int file_queue_push(file_queue_t *fq, const char *path);
 
@@ -29,12 +87,30 @@ int file_queue_push(file_queue_t *fq, const char *path);
  */
 size_t file_queue_size(const file_queue_t *fq);
 
-/** remove a file from the head of the queue
+/** retrieve the number of files ever added to a queue
+ *
+ * \param fq Queue to inspect
+ * \return Number of files pushed to this queue, including those since popped
+ */
+size_t file_queue_total(const file_queue_t *fq);
+
+/** wait until a queue has received a given number of files
+ *
+ * \param fq Queue to inspect
+ * \param count Number of files to wait for
+ * \return Number of files pushed to this queue, which is less than `count`
+ *   only if the queue has been closed
+ */
+size_t file_queue_wait(file_queue_t *fq, size_t count);
+
+/** remove the most expensive file from the queue
+ *
+ * If the queue is open and empty, this waits for a file to be pushed.
  *
  * \param fq Queue to operate on
  * \param path [out] File that was popped
- * \return 0 if an entry was popped, ENOMSG if the queue was empty, or an errno
- *   on failure
+ * \return 0 if an entry was popped, ENOMSG if the queue was empty and closed,
+ *   or an errno on failure
  */
 int file_queue_pop(file_queue_t *fq, const char **path);
 
@@ -0,0 +1,553 @@
+#include "git.h"
+#include "../../common/compiler.h"
+#include "../../common/pipe.h"
+#include "option.h"
+#include "path.h"
+#include "set.h"
+#include <assert.h>
+#include <clink/clink.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <crt_externs.h>
+#endif
+
+/// database metadata keys for the baseline of the last build
+static const char KEY_COMMIT[] = "git.commit";
+static const char KEY_DIRTY[] = "git.dirty";
+static const char KEY_FINGERPRINT[] = "git.fingerprint";
+
+struct git_state {
+  char *top;         ///< root directory of the checkout
+  char *commit;      ///< commit checked out
+  char *dirty;       ///< newline-terminated sources that differ from `commit`
+  char *fingerprint; ///< description of what was built from the checkout
+};
+
+static char **get_environ(void) {
+#ifdef __APPLE__
+  // on macOS, environ is not directly accessible
+  return *_NSGetEnviron();
+#else
+  // some platforms fail to expose environ in a header (e.g. FreeBSD), so
+  // declare it ourselves
+  extern char **environ;
+
+  return environ;
+#endif
+}
+
+/** run a Git command and capture its output
+ *
+ * \param dir Directory to run the command in
+ * \param args Arguments to Git, terminated by `NULL`
+ * \param output [out] NUL-terminated output of the command on success
+ * \param size [out] Number of bytes in `output`, excluding the terminator
+ * \return 0 on success, ENOTSUP if Git could not be run or failed, or another
+ *   errno on failure
+ */
+static int git(const char *dir, const char **args, char **output,
+               size_t *size) {
+
+  assert(dir != NULL);
+  assert(args != NULL);
+  assert(output != NULL);
+  assert(size != NULL);
+
+  int rc = 0;
+  posix_spawn_file_actions_t fa;
+  int out[2] = {-1, -1};
+  const char **argv = NULL;
+  char *buffer = NULL;
+  size_t buffer_size = 0;
+  size_t used = 0;
+  pid_t pid = 0;
+
+  if (UNLIKELY((rc = posix_spawn_file_actions_init(&fa))))
+    return rc;
+
+  // construct `git -C dir args...`
+  size_t argc = 0;
+  while (args[argc] != NULL)
+    ++argc;
+  argv = calloc(argc + 4, sizeof(argv[0]));
+  if (UNLIKELY(argv == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  argv[0] = "git";
+  argv[1] = "-C";
+  argv[2] = dir;
+  for (size_t i = 0; i < argc; ++i)
+    argv[i + 3] = args[i];
+
+  if (UNLIKELY((rc = pipe_(out))))
+    goto done;
+
+  // wire the child’s stdout to our pipe and silence everything else
+  if (UNLIKELY((rc = posix_spawn_file_actions_addopen(&fa, STDIN_FILENO,
+                                                      "/dev/null", O_RDONLY,
+                                                      0))))
+    goto done;
+  if (UNLIKELY((rc = posix_spawn_file_actions_adddup2(&fa, out[1],
+                                                      STDOUT_FILENO))))
+    goto done;
+  if (UNLIKELY((rc = posix_spawn_file_actions_addopen(&fa, STDERR_FILENO,
+                                                      "/dev/null", O_WRONLY,
+                                                      0))))
+    goto done;
+
+  {
+    char *const *a = (char *const *)argv;
+    if (posix_spawnp(&pid, argv[0], &fa, NULL, a, get_environ()) != 0) {
+      pid = 0;
+      rc = ENOTSUP;
+      goto done;
+    }
+  }
+  (void)close(out[1]);
+  out[1] = -1;
+
+  // read everything the child says
+  while (true) {
+    if (buffer_size - used < BUFSIZ) {
+      const size_t s = buffer_size == 0 ? BUFSIZ * 2 : buffer_size * 2;
+      char *b = realloc(buffer, s);
+      if (UNLIKELY(b == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+      buffer = b;
+      buffer_size = s;
+    }
+    const ssize_t r = read(out[0], &buffer[used], buffer_size - used - 1);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (UNLIKELY(r < 0)) {
+      rc = errno;
+      goto done;
+    }
+    if (r == 0)
+      break;
+    used += (size_t)r;
+  }
+  buffer[used] = '\0';
+
+done:
+  for (size_t i = 0; i < 2; ++i) {
+    if (out[i] != -1)
+      (void)close(out[i]);
+  }
+  if (pid != 0) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+      ;
+    if (rc == 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+      rc = ENOTSUP;
+  }
+  (void)posix_spawn_file_actions_destroy(&fa);
+  free(argv);
+
+  if (rc == 0) {
+    *output = buffer;
+    *size = used;
+  } else {
+    free(buffer);
+  }
+
+  return rc;
+}
+
+/// run a Git command whose output is a single line, and strip its newline
+static int git_line(const char *dir, const char **args, char **output) {
+
+  assert(dir != NULL);
+  assert(args != NULL);
+  assert(output != NULL);
+
+  char *line = NULL;
+  size_t size = 0;
+  int rc = git(dir, args, &line, &size);
+  if (rc)
+    return rc;
+
+  while (size > 0 && line[size - 1] == '\n')
+    line[--size] = '\0';
+
+  if (size == 0) {
+    free(line);
+    return ENOTSUP;
+  }
+
+  *output = line;
+  return 0;
+}
+
+/** append the sources among a list of paths from Git
+ *
+ * \param top Root directory of the checkout
+ * \param paths NUL-separated paths, relative to `top`
+ * \param size Number of bytes in `paths`
+ * \param list [inout] Newline-terminated relative paths to append to
+ * \return 0 on success, ENOTSUP if a path contains a newline, or another errno
+ *   on failure
+ */
+static int append_sources(const char *top, const char *paths, size_t size,
+                          FILE *list) {
+
+  assert(top != NULL);
+  assert(paths != NULL);
+  assert(list != NULL);
+
+  for (size_t offset = 0; offset < size;) {
+    const char *rel = &paths[offset];
+    const size_t len = strlen(rel);
+    offset += len + 1;
+
+    if (len == 0 || !is_source(rel))
+      continue;
+
+    // our baseline format cannot represent these
+    if (UNLIKELY(strchr(rel, '\n') != NULL))
+      return ENOTSUP;
+
+    char *path = NULL;
+    int rc = join(top, rel, &path);
+    if (UNLIKELY(rc))
+      return rc;
+    const bool relevant = is_within_sources(path);
+    free(path);
+
+    if (relevant && fprintf(list, "%s\n", rel) < 0)
+      return EIO;
+  }
+
+  return 0;
+}
+
+/// describe what a build covers, to detect a baseline from a different one
+static int fingerprint(const char *top, char **fp) {
+
+  assert(top != NULL);
+  assert(fp != NULL);
+
+  char *f = NULL;
+  size_t f_size = 0;
+  FILE *buffer = open_memstream(&f, &f_size);
+  if (UNLIKELY(buffer == NULL))
+    return errno;
+
+  (void)fprintf(buffer, "%s\n", top);
+  for (size_t i = 0; i < option.src_len; ++i)
+    (void)fprintf(buffer, "%s\n", option.src[i]);
+  (void)fprintf(buffer, "%d %d %d %d %d %d %d %d\n", (int)option.parse_asm,
+                (int)option.parse_c, (int)option.parse_cxx,
+                (int)option.parse_def, (int)option.parse_lex,
+                (int)option.parse_python, (int)option.parse_tablegen,
+                (int)option.parse_yacc);
+
+  if (UNLIKELY(fclose(buffer) != 0)) {
+    free(f);
+    return ENOMEM;
+  }
+
+  *fp = f;
+  return 0;
+}
+
+int git_state_new(git_state_t **state) {
+
+  if (state == NULL)
+    return EINVAL;
+
+  if (option.src_len == 0)
+    return ENOTSUP;
+
+  int rc = 0;
+  char *dir = NULL;
+  char *output = NULL;
+  FILE *dirty = NULL;
+  size_t dirty_size = 0;
+
+  git_state_t *s = calloc(1, sizeof(*s));
+  if (UNLIKELY(s == NULL))
+    return ENOMEM;
+
+  // find the root of the checkout containing our first source
+  if (is_dir(option.src[0])) {
+    dir = strdup(option.src[0]);
+    if (UNLIKELY(dir == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+  } else if (UNLIKELY((rc = dirname(option.src[0], &dir)))) {
+    goto done;
+  }
+  {
+    const char *args[] = {"rev-parse", "--show-toplevel", NULL};
+    if ((rc = git_line(dir, args, &s->top)))
+      goto done;
+  }
+
+  // all other sources need to be in the same checkout
+  for (size_t i = 0; i < option.src_len; ++i) {
+    const size_t len = strlen(s->top);
+    const char *src = option.src[i];
+    if (strncmp(src, s->top, len) != 0 ||
+        (src[len] != '\0' && src[len] != '/' && !is_root(s->top))) {
+      rc = ENOTSUP;
+      goto done;
+    }
+  }
+
+  {
+    const char *args[] = {"rev-parse", "--verify", "--quiet", "HEAD^{commit}",
+                          NULL};
+    if ((rc = git_line(s->top, args, &s->commit)))
+      goto done;
+  }
+
+  dirty = open_memstream(&s->dirty, &dirty_size);
+  if (UNLIKELY(dirty == NULL)) {
+    rc = errno;
+    goto done;
+  }
+
+  // note tracked files that differ from the commit…
+  {
+    const char *args[] = {"diff", "--name-only", "--no-renames", "-z",
+                          s->commit, "--", NULL};
+    size_t size = 0;
+    if ((rc = git(s->top, args, &output, &size)))
+      goto done;
+    if ((rc = append_sources(s->top, output, size, dirty)))
+      goto done;
+    free(output);
+    output = NULL;
+  }
+
+  // …and untracked files, including ignored ones
+  {
+    const char *args[] = {"ls-files", "--others", "-z", NULL};
+    size_t size = 0;
+    if ((rc = git(s->top, args, &output, &size)))
+      goto done;
+    if ((rc = append_sources(s->top, output, size, dirty)))
+      goto done;
+    free(output);
+    output = NULL;
+  }
+
+  if (UNLIKELY(fclose(dirty) != 0)) {
+    dirty = NULL;
+    rc = ENOMEM;
+    goto done;
+  }
+  dirty = NULL;
+
+  if (UNLIKELY((rc = fingerprint(s->top, &s->fingerprint))))
+    goto done;
+
+done:
+  if (dirty != NULL)
+    (void)fclose(dirty);
+  free(output);
+  free(dir);
+
+  if (rc) {
+    git_state_free(&s);
+  } else {
+    *state = s;
+  }
+
+  return rc;
+}
+
+int git_changes(clink_db_t *db, const git_state_t *state, char ***paths,
+                size_t *count) {
+
+  if (db == NULL)
+    return EINVAL;
+
+  if (state == NULL)
+    return EINVAL;
+
+  if (paths == NULL)
+    return EINVAL;
+
+  if (count == NULL)
+    return EINVAL;
+
+  int rc = 0;
+  char *commit = NULL;
+  char *fp = NULL;
+  char *dirty = NULL;
+  char *output = NULL;
+  FILE *changed = NULL;
+  char *changed_list = NULL;
+  size_t changed_size = 0;
+  set_t *seen = NULL;
+  char **p = NULL;
+  size_t c = 0;
+  size_t size = 0;
+
+  // is there a baseline from a build like this one?
+  if ((rc = clink_db_get_metadata(db, KEY_COMMIT, &commit)))
+    goto done;
+  if (strcmp(commit, "") == 0) {
+    rc = ENOENT;
+    goto done;
+  }
+  if ((rc = clink_db_get_metadata(db, KEY_FINGERPRINT, &fp)))
+    goto done;
+  if (strcmp(fp, state->fingerprint) != 0) {
+    rc = ENOENT;
+    goto done;
+  }
+  if ((rc = clink_db_get_metadata(db, KEY_DIRTY, &dirty)))
+    goto done;
+
+  changed = open_memstream(&changed_list, &changed_size);
+  if (UNLIKELY(changed == NULL)) {
+    rc = errno;
+    goto done;
+  }
+
+  // find what differs from the baseline’s commit, which may no longer exist
+  {
+    const char *args[] = {"diff", "--name-only", "--no-renames", "-z",
+                          commit, "--", NULL};
+    size_t out_size = 0;
+    if ((rc = git(state->top, args, &output, &out_size))) {
+      rc = ENOENT;
+      goto done;
+    }
+    if ((rc = append_sources(state->top, output, out_size, changed)))
+      goto done;
+  }
+
+  if (UNLIKELY(fclose(changed) != 0)) {
+    changed = NULL;
+    rc = ENOMEM;
+    goto done;
+  }
+  changed = NULL;
+
+  // combine this with anything that was or is untracked or modified
+  if (UNLIKELY((rc = set_new(&seen))))
+    goto done;
+  const char *lists[] = {changed_list, dirty, state->dirty};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i) {
+    for (const char *l = lists[i]; *l != '\0';) {
+      const char *end = strchr(l, '\n');
+      if (end == NULL)
+        end = l + strlen(l);
+      char *rel = strndup(l, (size_t)(end - l));
+      if (UNLIKELY(rel == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+      l = *end == '\n' ? end + 1 : end;
+
+      const char *r = rel;
+      rc = set_add(seen, &r);
+      free(rel);
+      if (rc == EALREADY) {
+        rc = 0;
+        continue;
+      }
+      if (UNLIKELY(rc))
+        goto done;
+
+      if (c == size) {
+        const size_t s = size == 0 ? 128 : size * 2;
+        char **n = realloc(p, s * sizeof(p[0]));
+        if (UNLIKELY(n == NULL)) {
+          rc = ENOMEM;
+          goto done;
+        }
+        p = n;
+        size = s;
+      }
+      if (UNLIKELY((rc = join(state->top, r, &p[c]))))
+        goto done;
+      ++c;
+    }
+  }
+
+done:
+  set_free(&seen);
+  if (changed != NULL)
+    (void)fclose(changed);
+  free(changed_list);
+  free(output);
+  free(dirty);
+  free(fp);
+  free(commit);
+
+  if (rc) {
+    for (size_t i = 0; i < c; ++i)
+      free(p[i]);
+    free(p);
+  } else {
+    *paths = p;
+    *count = c;
+  }
+
+  return rc;
+}
+
+int git_state_clear(clink_db_t *db) {
+
+  if (db == NULL)
+    return EINVAL;
+
+  return clink_db_set_metadata(db, KEY_COMMIT, "");
+}
+
+int git_state_save(clink_db_t *db, const git_state_t *state) {
+
+  if (db == NULL)
+    return EINVAL;
+
+  if (state == NULL)
+    return EINVAL;
+
+  int rc = 0;
+
+  if (UNLIKELY((rc = clink_db_set_metadata(db, KEY_FINGERPRINT,
+                                           state->fingerprint))))
+    return rc;
+
+  if (UNLIKELY((rc = clink_db_set_metadata(db, KEY_DIRTY, state->dirty))))
+    return rc;
+
+  // the commit goes last, as its presence is what makes the baseline valid
+  return clink_db_set_metadata(db, KEY_COMMIT, state->commit);
+}
+
+void git_state_free(git_state_t **state) {
+
+  if (state == NULL || *state == NULL)
+    return;
+
+  git_state_t *s = *state;
+
+  free(s->fingerprint);
+  free(s->dirty);
+  free(s->commit);
+  free(s->top);
+
+  free(s);
+  *state = NULL;
+}
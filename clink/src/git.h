@@ -0,0 +1,59 @@
+// use of Git to find changed files without scanning the file system
+
+#pragma once
+
+#include <clink/clink.h>
+#include <stddef.h>
+
+/// state of a Git checkout at some point in time
+typedef struct git_state git_state_t;
+
+/** capture the current state of the checkout containing our sources
+ *
+ * \param state [out] Captured state on success
+ * \return 0 on success, ENOTSUP if our sources are not all within a single
+ *   Git checkout with at least one commit, or another errno on failure
+ */
+int git_state_new(git_state_t **state);
+
+/** find source files that may have changed since the last build
+ *
+ * This relies on a baseline saved by `git_state_save` at the end of the last
+ * build. The files found are those that differ from the commit the baseline
+ * was taken at, those that are untracked, and those that differed from the
+ * commit when the baseline was taken. Any file not among these is unchanged
+ * since the last build.
+ *
+ * \param db Database to read the baseline from
+ * \param state Current state of the checkout
+ * \param paths [out] Absolute paths of possibly changed files on success
+ * \param count [out] Number of entries in `paths` on success
+ * \return 0 on success, ENOENT if there is no usable baseline, or another
+ *   errno on failure
+ */
+int git_changes(clink_db_t *db, const git_state_t *state, char ***paths,
+                size_t *count);
+
+/** discard any baseline, so the next build scans the file system
+ *
+ * This should be called before a build begins, so that one which does not
+ * complete leaves no baseline behind.
+ *
+ * \param db Database to operate on
+ * \return 0 on success or an errno on failure
+ */
+int git_state_clear(clink_db_t *db);
+
+/** save a checkout state as the baseline for the next build
+ *
+ * \param db Database to operate on
+ * \param state State to save
+ * \return 0 on success or an errno on failure
+ */
+int git_state_save(clink_db_t *db, const git_state_t *state);
+
+/** deallocate a checkout state
+ *
+ * \param state State to destroy
+ */
+void git_state_free(git_state_t **state);
@@ -0,0 +1,150 @@
+#include "hash.h"
+#include "../../common/compiler.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint64_t PRIME1 = UINT64_C(0x9E3779B185EBCA87);
+static const uint64_t PRIME2 = UINT64_C(0xC2B2AE3D27D4EB4F);
+static const uint64_t PRIME3 = UINT64_C(0x165667B19E3779F9);
+static const uint64_t PRIME4 = UINT64_C(0x85EBCA77C2B2AE63);
+static const uint64_t PRIME5 = UINT64_C(0x27D4EB2F165667C5);
+
+static uint64_t rotl(uint64_t x, unsigned r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t round_(uint64_t acc, uint64_t input) {
+  acc += input * PRIME2;
+  acc = rotl(acc, 31);
+  return acc * PRIME1;
+}
+
+static uint64_t merge(uint64_t acc, uint64_t val) {
+  acc ^= round_(0, val);
+  return acc * PRIME1 + PRIME4;
+}
+
+uint64_t hash(const void *data, size_t size) {
+
+  const uint8_t *p = data;
+  const uint8_t *const end = p + size;
+  uint64_t h;
+
+  if (size >= 32) {
+    // consume 32-byte stripes into four independent accumulators
+    uint64_t v1 = PRIME1 + PRIME2;
+    uint64_t v2 = PRIME2;
+    uint64_t v3 = 0;
+    uint64_t v4 = -PRIME1;
+    do {
+      v1 = round_(v1, read64(p));
+      v2 = round_(v2, read64(p + 8));
+      v3 = round_(v3, read64(p + 16));
+      v4 = round_(v4, read64(p + 24));
+      p += 32;
+    } while (end - p >= 32);
+
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge(h, v1);
+    h = merge(h, v2);
+    h = merge(h, v3);
+    h = merge(h, v4);
+  } else {
+    h = PRIME5;
+  }
+
+  h += (uint64_t)size;
+
+  // consume the remaining tail
+  for (; end - p >= 8; p += 8) {
+    h ^= round_(0, read64(p));
+    h = rotl(h, 27) * PRIME1 + PRIME4;
+  }
+  if (end - p >= 4) {
+    h ^= (uint64_t)read32(p) * PRIME1;
+    h = rotl(h, 23) * PRIME2 + PRIME3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= *p * PRIME5;
+    h = rotl(h, 11) * PRIME1;
+  }
+
+  // final avalanche
+  h ^= h >> 33;
+  h *= PRIME2;
+  h ^= h >> 29;
+  h *= PRIME3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+int hash_file(const char *path, uint64_t *digest) {
+
+  if (UNLIKELY(path == NULL))
+    return EINVAL;
+
+  if (UNLIKELY(digest == NULL))
+    return EINVAL;
+
+  int rc = 0;
+  void *base = MAP_FAILED;
+  size_t size = 0;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (UNLIKELY(fd < 0)) {
+    rc = errno;
+    goto done;
+  }
+
+  struct stat st;
+  if (UNLIKELY(fstat(fd, &st) < 0)) {
+    rc = errno;
+    goto done;
+  }
+  size = (size_t)st.st_size;
+
+  // mmap rejects 0-sized mappings, so hash empty files directly
+  if (size == 0) {
+    *digest = hash("", 0);
+    goto done;
+  }
+
+  base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (UNLIKELY(base == MAP_FAILED)) {
+    rc = errno;
+    goto done;
+  }
+
+  // we are going to read the whole file once, front to back
+  (void)madvise(base, size, MADV_SEQUENTIAL);
+
+  *digest = hash(base, size);
+
+done:
+  if (base != MAP_FAILED)
+    (void)munmap(base, size);
+  if (fd >= 0)
+    (void)close(fd);
+
+  return rc;
+}
@@ -0,0 +1,25 @@
+// fast non-cryptographic hashing of file contents
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** hash a block of memory
+ *
+ * This is the XXH64 algorithm with a seed of 0, reading the input in native
+ * byte order. It is intended for detecting changes, not for security.
+ *
+ * \param data Start of the memory to hash
+ * \param size Number of bytes to hash
+ * \return Digest of the given memory
+ */
+uint64_t hash(const void *data, size_t size);
+
+/** hash the contents of a file
+ *
+ * \param path Path to the file to hash
+ * \param digest [out] Digest of the file’s content on success
+ * \return 0 on success or an errno on failure
+ */
+int hash_file(const char *path, uint64_t *digest);
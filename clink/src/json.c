@@ -0,0 +1,20 @@
+#include "json.h"
+#include <assert.h>
+#include <stdio.h>
+
+void json_string(FILE *out, const char *s) {
+  assert(out != NULL);
+  assert(s != NULL);
+
+  fputc('"', out);
+  for (const char *p = s; *p != '\0'; ++p) {
+    if (*p == '"' || *p == '\\') {
+      fprintf(out, "\\%c", *p);
+    } else if ((unsigned char)*p < 0x20) {
+      fprintf(out, "\\u%04x", (unsigned)(unsigned char)*p);
+    } else {
+      fputc(*p, out);
+    }
+  }
+  fputc('"', out);
+}
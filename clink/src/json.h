@@ -0,0 +1,12 @@
+// helpers for writing JSON
+
+#pragma once
+
+#include <stdio.h>
+
+/** write a string as a JSON string literal
+ *
+ * \param out Stream to write to
+ * \param s String to write
+ */
+void json_string(FILE *out, const char *s);
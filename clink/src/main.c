@@ -1,11 +1,13 @@
 #include "../../common/compiler.h"
 #include "build.h"
+#include "clang_pool.h"
 #include "have_vim.h"
 #include "help.h"
 #include "option.h"
 #include "path.h"
 #include "sigint.h"
 #include "ui.h"
+#include "watch.h"
 #include <assert.h>
 #include <clink/clink.h>
 #include <errno.h>
@@ -13,6 +15,7 @@
 #include <limits.h>
 #include <sqlite3.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,11 +33,15 @@ static char *xstrdup(const char *s) {
 
 static void xappend(char ***list, size_t *len, const char *item) {
 
-  // expand the list
-  *list = realloc(*list, (*len + 1) * sizeof(**list));
-  if (*list == NULL) {
-    fprintf(stderr, "out of memory\n");
-    exit(EX_OSERR);
+  // expand the list, doubling its capacity whenever its length reaches a power
+  // of 2 so long lists are not copied over and over
+  if ((*len & (*len - 1)) == 0) {
+    const size_t capacity = *len == 0 ? 1 : *len * 2;
+    *list = realloc(*list, capacity * sizeof(**list));
+    if (*list == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(EX_OSERR);
+    }
   }
   ++(*len);
 
@@ -61,9 +68,14 @@ static void parse_args(int argc, char **argv) {
   while (true) {
     enum {
       OPT_ANIMATION = 128,
+      OPT_CLANG_API,
+      OPT_CLANG_MEMORY_LIMIT,
+      OPT_CLANG_TIMEOUT,
       OPT_COLOUR,
       OPT_COMPILE_COMMANDS,
       OPT_DEBUG,
+      OPT_GIT,
+      OPT_ISOLATE_CLANG,
       OPT_PARSE_ASM,
       OPT_PARSE_C,
       OPT_PARSE_CXX,
@@ -72,19 +84,30 @@ static void parse_args(int argc, char **argv) {
       OPT_PARSE_PYTHON,
       OPT_PARSE_TABLEGEN,
       OPT_PARSE_YACC,
+      OPT_PCH,
+      OPT_PCH_CACHE,
+      OPT_PROFILE,
+      OPT_SCOPE,
+      OPT_TRACE,
+      OPT_WATCH,
     };
 
     static const struct option opts[] = {
         // clang-format off
         {"animation",            required_argument, 0, OPT_ANIMATION},
         {"build-only",           no_argument,       0, 'b'},
+        {"clang-api",            required_argument, 0, OPT_CLANG_API},
+        {"clang-memory-limit",   required_argument, 0, OPT_CLANG_MEMORY_LIMIT},
+        {"clang-timeout",        required_argument, 0, OPT_CLANG_TIMEOUT},
         {"color",                required_argument, 0, OPT_COLOUR},
         {"colour",               required_argument, 0, OPT_COLOUR},
         {"compile-commands",     required_argument, 0, OPT_COMPILE_COMMANDS},
         {"compile-commands-dir", required_argument, 0, OPT_COMPILE_COMMANDS},
         {"database",             required_argument, 0, 'f'},
         {"debug",                no_argument,       0, OPT_DEBUG},
+        {"git",                  no_argument,       0, OPT_GIT},
         {"help",                 no_argument,       0, 'h'},
+        {"isolate-clang",        no_argument,       0, OPT_ISOLATE_CLANG},
         {"jobs",                 required_argument, 0, 'j'},
         {"no-build",             no_argument,       0, 'd'},
         {"parse-asm",            required_argument, 0, OPT_PARSE_ASM},
@@ -97,9 +120,15 @@ static void parse_args(int argc, char **argv) {
         {"parse-python",         required_argument, 0, OPT_PARSE_PYTHON},
         {"parse-tablegen",       required_argument, 0, OPT_PARSE_TABLEGEN},
         {"parse-yacc",           required_argument, 0, OPT_PARSE_YACC},
+        {"pch",                  required_argument, 0, OPT_PCH},
+        {"pch-cache",            required_argument, 0, OPT_PCH_CACHE},
+        {"profile",              required_argument, 0, OPT_PROFILE},
+        {"scope",                required_argument, 0, OPT_SCOPE},
         {"script",               required_argument, 0, 'c'},
         {"syntax-highlighting",  required_argument, 0, 's'},
+        {"trace",                required_argument, 0, OPT_TRACE},
         {"version",              no_argument,       0, 'V'},
+        {"watch",                no_argument,       0, OPT_WATCH},
         {0, 0, 0, 0},
         // clang-format on
     };
@@ -164,14 +193,17 @@ static void parse_args(int argc, char **argv) {
           exit(EX_USAGE);
         }
       }
-      const int r =
-          clink_parse_namefile(namefile, accept_name, error_name, NULL);
-      if (strcmp(optarg, "-") != 0)
-        (void)fclose(namefile);
-      if (r != 0) {
-        fprintf(stderr, "failed to parse %s: %s\n", optarg, strerror(errno));
-        exit(EX_USAGE);
+      // defer reading it, so its entries can be streamed into the build
+      namefile_t *n = realloc(option.namefiles, (option.namefiles_len + 1) *
+                                                    sizeof(n[0]));
+      if (n == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EX_OSERR);
       }
+      option.namefiles = n;
+      option.namefiles[option.namefiles_len] =
+          (namefile_t){.path = xstrdup(optarg), .stream = namefile};
+      ++option.namefiles_len;
       break;
     }
 
@@ -202,6 +234,43 @@ static void parse_args(int argc, char **argv) {
       }
       break;
 
+    case OPT_CLANG_API: // --clang-api
+      if (strcmp(optarg, "ast") == 0) {
+        option.clang_index = false;
+      } else if (strcmp(optarg, "index") == 0) {
+        option.clang_index = true;
+      } else {
+        fprintf(stderr, "illegal value to --clang-api: %s\n", optarg);
+        exit(EX_USAGE);
+      }
+      break;
+
+    case OPT_CLANG_MEMORY_LIMIT: { // --clang-memory-limit
+      char *endptr;
+      errno = 0;
+      option.clang_memory_limit = strtoul(optarg, &endptr, 0);
+      if (optarg == endptr || *endptr != '\0' || errno == ERANGE ||
+          option.clang_memory_limit > SIZE_MAX >> 20) {
+        fprintf(stderr, "illegal value to --clang-memory-limit: %s\n", optarg);
+        exit(EX_USAGE);
+      }
+      option.isolate_clang = true;
+      break;
+    }
+
+    case OPT_CLANG_TIMEOUT: { // --clang-timeout
+      char *endptr;
+      errno = 0;
+      option.clang_timeout = strtoul(optarg, &endptr, 0);
+      if (optarg == endptr || *endptr != '\0' || errno == ERANGE ||
+          option.clang_timeout > UINT64_MAX / 1000000000) {
+        fprintf(stderr, "illegal value to --clang-timeout: %s\n", optarg);
+        exit(EX_USAGE);
+      }
+      option.isolate_clang = true;
+      break;
+    }
+
     case OPT_COLOUR: // --colour
       if (strcmp(optarg, "auto") == 0) {
         option.colour = AUTO;
@@ -232,6 +301,14 @@ static void parse_args(int argc, char **argv) {
       clink_debug_on();
       break;
 
+    case OPT_GIT: // --git
+      option.git = true;
+      break;
+
+    case OPT_ISOLATE_CLANG: // --isolate-clang
+      option.isolate_clang = true;
+      break;
+
     case OPT_PARSE_ASM: // --parse-asm
       if (strcmp(optarg, "generic") == 0) {
         option.parse_asm = GENERIC;
@@ -340,6 +417,37 @@ static void parse_args(int argc, char **argv) {
       }
       break;
 
+    case OPT_PCH: // --pch
+      if (strcmp(optarg, "on") == 0) {
+        option.pch = true;
+      } else if (strcmp(optarg, "off") == 0) {
+        option.pch = false;
+      } else {
+        fprintf(stderr, "illegal value to --pch: %s\n", optarg);
+        exit(EX_USAGE);
+      }
+      break;
+
+    case OPT_PCH_CACHE: // --pch-cache
+      free(option.pch_cache);
+      option.pch_cache = xstrdup(optarg);
+      break;
+
+    case OPT_PROFILE: // --profile
+      free(option.profile);
+      option.profile = xstrdup(optarg);
+      break;
+
+    case OPT_SCOPE: // --scope
+      free(option.scope);
+      option.scope = xstrdup(optarg);
+      break;
+
+    case OPT_TRACE: // --trace
+      free(option.trace);
+      option.trace = xstrdup(optarg);
+      break;
+
     case 'V': { // --version
       clink_version_info_t version = clink_version_info();
       fprintf(stderr, "clink version %s\n", version.version);
@@ -354,6 +462,11 @@ static void parse_args(int argc, char **argv) {
       exit(EXIT_SUCCESS);
     }
 
+    case OPT_WATCH: // --watch
+      option.watch = true;
+      option.ui = false;
+      break;
+
     default:
       exit(EX_USAGE);
     }
@@ -363,8 +476,30 @@ static void parse_args(int argc, char **argv) {
   for (size_t i = optind; i < (size_t)argc; ++i)
     xappend(&option.src, &option.src_len, argv[i]);
 
-  // if the user wanted automatic parallelism, give them a thread per core
+  // Watching and asking Git both need to know all our sources up front, and
+  // watching may build more than once, so read namefiles in their entirety.
+  if (option.watch || option.git) {
+    for (size_t i = 0; i < option.namefiles_len; ++i) {
+      namefile_t *n = &option.namefiles[i];
+      const int r = clink_parse_namefile(n->stream, accept_name, error_name,
+                                         NULL);
+      if (r != 0) {
+        fprintf(stderr, "failed to parse %s: %s\n", n->path, strerror(r));
+        exit(EX_USAGE);
+      }
+      if (n->stream != stdin)
+        (void)fclose(n->stream);
+      free(n->path);
+    }
+    free(option.namefiles);
+    option.namefiles = NULL;
+    option.namefiles_len = 0;
+  }
+
+  // If the user wanted automatic parallelism, give them a thread per core. But
+  // let the build back off from this if it proves counterproductive.
   if (option.threads == 0) {
+    option.adapt_threads = true;
     long r = sysconf(_SC_NPROCESSORS_ONLN);
     if (r < 1) {
       option.threads = 1;
@@ -383,10 +518,23 @@ static void parse_args(int argc, char **argv) {
     fprintf(stderr, "--build-only and --script cannot be used together\n");
     exit(EX_USAGE);
   }
+
+  if (option.watch && !option.update_database) {
+    fprintf(stderr, "--watch and --no-build cannot be used together\n");
+    exit(EX_USAGE);
+  }
 }
 
 int main(int argc, char **argv) {
 
+  // are we a libclang worker for another instance of ourselves?
+  if ((argc == 2 || argc == 3) && strcmp(argv[1], "--clang-worker") == 0) {
+    const bool use_index = argc == 3 && strcmp(argv[2], "index") == 0;
+    return clang_worker(STDIN_FILENO, STDOUT_FILENO, use_index) == 0
+               ? EXIT_SUCCESS
+               : EXIT_FAILURE;
+  }
+
   // parse command line arguments
   parse_args(argc, argv);
 
@@ -404,7 +552,8 @@ int main(int argc, char **argv) {
             strerror(rc));
     goto done;
   }
-  assert(option.src != NULL && option.src_len > 0);
+  assert((option.src != NULL && option.src_len > 0) ||
+         option.namefiles_len > 0);
 
   // setup our connection to compile_commands.json
   if (option.update_database) {
@@ -450,6 +599,12 @@ int main(int argc, char **argv) {
         fprintf(stderr, "failed to set Clang flags: %s\n", strerror(rc));
         goto done;
       }
+      rc = set_pch_cache();
+      if (UNLIKELY(rc)) {
+        fprintf(stderr, "failed to set precompiled header cache: %s\n",
+                strerror(rc));
+        goto done;
+      }
     }
   }
 
@@ -503,6 +658,30 @@ int main(int argc, char **argv) {
     }
   }
 
+  // make the search scope absolute, so it can be compared to database paths
+  if (option.scope != NULL) {
+    char *absolute = realpath(option.scope, NULL);
+    if (absolute == NULL) {
+      rc = errno;
+      fprintf(stderr, "failed to make %s absolute: %s\n", option.scope,
+              strerror(rc));
+      goto done;
+    }
+    free(option.scope);
+    option.scope = absolute;
+
+    // a directory should not match its siblings that share a name prefix
+    if (is_dir(option.scope) && !is_root(option.scope)) {
+      char *dir = NULL;
+      if (asprintf(&dir, "%s/", option.scope) < 0) {
+        rc = ENOMEM;
+        goto done;
+      }
+      free(option.scope);
+      option.scope = dir;
+    }
+  }
+
   // ensure SQLite is safe to use multi-threaded
   if (option.threads > 1) {
     if (!sqlite3_threadsafe()) {
@@ -557,7 +736,10 @@ int main(int argc, char **argv) {
   (void)sigint_unblock();
 
   // build/update the database, if requested
-  if (option.update_database) {
+  if (option.watch) {
+    if ((rc = watch(db)))
+      goto done1;
+  } else if (option.update_database) {
     if ((rc = build(db)))
       goto done1;
   }
@@ -18,9 +18,16 @@ option_t option = {
     .database_path = NULL,
     .src = NULL,
     .src_len = 0,
+    .namefiles = NULL,
+    .namefiles_len = 0,
     .update_database = true,
     .ui = true,
+    .watch = false,
+    .git = false,
+    .profile = NULL,
+    .trace = NULL,
     .threads = 0,
+    .adapt_threads = false,
     .colour = AUTO,
     .animation = true,
     .debug = false,
@@ -35,8 +42,15 @@ option_t option = {
     .parse_yacc = PARSER_AUTO,
     .clang_argc = 0,
     .clang_argv = NULL,
+    .clang_index = false,
+    .isolate_clang = false,
+    .clang_timeout = 0,
+    .clang_memory_limit = 0,
     .compile_commands = {0},
+    .pch = false,
+    .pch_cache = NULL,
     .script = NULL,
+    .scope = NULL,
 };
 
 int set_db_path(void) {
@@ -123,7 +137,7 @@ done:
 int set_src(void) {
 
   // if we were given some explicit sources, we need nothing further
-  if (option.src_len > 0)
+  if (option.src_len > 0 || option.namefiles_len > 0)
     return 0;
 
   int rc = 0;
@@ -150,6 +164,29 @@ done:
   return rc;
 }
 
+int set_pch_cache(void) {
+
+  // if precompiling is off or the user chose a directory, nothing to do
+  if (!option.pch || option.pch_cache != NULL)
+    return 0;
+
+  // follow the XDG Base Directory Specification
+  const char *base = getenv("XDG_CACHE_HOME");
+  const char *suffix = "clink/pch";
+  if (base == NULL || base[0] != '/') {
+    base = getenv("HOME");
+    suffix = ".cache/clink/pch";
+  }
+
+  // if we have nowhere to keep precompiled headers, do without them
+  if (base == NULL || base[0] != '/') {
+    option.pch = false;
+    return 0;
+  }
+
+  return join(base, suffix, &option.pch_cache);
+}
+
 int set_clang_flags(void) {
 
   int rc = 0;
@@ -279,6 +316,15 @@ void clean_up_options(void) {
   option.src = NULL;
   option.src_len = 0;
 
+  for (size_t i = 0; i < option.namefiles_len; ++i) {
+    if (option.namefiles[i].stream != stdin)
+      (void)fclose(option.namefiles[i].stream);
+    free(option.namefiles[i].path);
+  }
+  free(option.namefiles);
+  option.namefiles = NULL;
+  option.namefiles_len = 0;
+
   for (size_t i = 0; i < option.clang_argc; ++i)
     free(option.clang_argv[i]);
   free(option.clang_argv);
@@ -290,4 +336,16 @@ void clean_up_options(void) {
 
   free(option.script);
   option.script = NULL;
+
+  free(option.profile);
+  option.profile = NULL;
+
+  free(option.trace);
+  option.trace = NULL;
+
+  free(option.scope);
+  option.scope = NULL;
+
+  free(option.pch_cache);
+  option.pch_cache = NULL;
 }
@@ -3,6 +3,7 @@
 #include "compile_commands.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 
 typedef enum {
   AUTO,
@@ -10,6 +11,12 @@ typedef enum {
   NEVER,
 } colour_t;
 
+/// a Cscope namefile listing sources
+typedef struct {
+  char *path;   ///< path given on the command line, or "-" for stdin
+  FILE *stream; ///< stream to read entries from
+} namefile_t;
+
 typedef enum {
   BEHAVIOUR_AUTO, ///< pick `LAZY` or `EAGER` based on amount of work
   LAZY,           ///< do action on-demand, when its results are needed
@@ -33,15 +40,35 @@ typedef struct {
   char **src;
   size_t src_len;
 
+  // namefiles listing further sources, whose entries are streamed into the
+  // first build rather than being added to `src`
+  namefile_t *namefiles;
+  size_t namefiles_len;
+
   // update the Clink symbol database with latest source file changes?
   bool update_database;
 
   // run the TUI interface?
   bool ui;
 
+  // keep the database up to date as sources change?
+  bool watch;
+
+  // use Git to find files changed since the last build?
+  bool git;
+
+  // path to write a JSON build profile to, if requested
+  char *profile;
+
+  // path to write a trace of the build’s timeline to, if requested
+  char *trace;
+
   // parallelism (0 == auto)
   unsigned long threads;
 
+  // vary the number of active threads according to how well they are doing?
+  bool adapt_threads;
+
   // colour terminal output on or off
   colour_t colour;
 
@@ -68,12 +95,33 @@ typedef struct {
   size_t clang_argc;
   char **clang_argv;
 
+  // parse through libclang’s indexing API instead of walking the AST?
+  bool clang_index;
+
+  // run libclang in worker processes?
+  bool isolate_clang;
+
+  // seconds a libclang worker may spend on one file (0 == unlimited)
+  unsigned long clang_timeout;
+
+  // mebibytes of resident memory a libclang worker may use (0 == unlimited)
+  unsigned long clang_memory_limit;
+
   // compile_commands.json database
   compile_commands_t compile_commands;
 
+  // precompile #includes commonly shared by sources parsed with libclang?
+  bool pch;
+
+  // directory to keep precompiled headers in
+  char *pch_cache;
+
   // text to type into the UI on start up
   char *script;
 
+  // absolute path prefix to restrict searches to, if set on the command line
+  char *scope;
+
 } option_t;
 
 extern option_t option;
@@ -87,6 +135,9 @@ int set_compile_commands(void);
 // setup option.src after option parsing
 int set_src(void);
 
+// setup option.pch_cache after option parsing
+int set_pch_cache(void);
+
 /** setup flags for Clang
  *
  * This function assumes the caller wants system include directories enabled.
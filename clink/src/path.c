@@ -100,6 +100,23 @@ bool is_source(const char *path) {
 
 bool is_tablegen(const char *path) { return has_ext(path, "td"); }
 
+bool is_within_sources(const char *path) {
+
+  if (path == NULL)
+    return false;
+
+  for (size_t i = 0; i < option.src_len; ++i) {
+    const char *src = option.src[i];
+    if (is_root(src))
+      return true;
+    const size_t len = strlen(src);
+    if (strncmp(path, src, len) == 0 && (path[len] == '\0' || path[len] == '/'))
+      return true;
+  }
+
+  return false;
+}
+
 bool is_yacc(const char *path) {
   return has_ext(path, "y") || has_ext(path, "yy") || has_ext(path, "y++") ||
          has_ext(path, "yxx") || has_ext(path, "ypp");
@@ -122,6 +122,13 @@ bool is_source(const char *path);
  */
 bool is_tablegen(const char *path);
 
+/** is this one of our sources or within one of them?
+ *
+ * \param path Absolute path to assess
+ * \return True if this is among or beneath the paths we were asked to scan
+ */
+bool is_within_sources(const char *path);
+
 /** is this a path to a Yacc/Bison file?
  *
  * \param path Path to assess
@@ -0,0 +1,1159 @@
+#include "pch.h"
+#include "../../common/compiler.h"
+#include "debug.h"
+#include "hash.h"
+#include "path.h"
+#include <assert.h>
+#include <clang-c/Index.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/// number of sources that must begin with a run of #includes before it is worth
+/// precompiling
+static const size_t THRESHOLD = 4;
+
+/// most #includes at the start of a source to consider
+enum { MAX_INCLUDES = 32 };
+
+/// most bytes at the start of a source to look through for #includes
+static const size_t MAX_SCAN = 64 * 1024;
+
+/// most bytes the cache directory may hold once a build has finished
+static const uint64_t MAX_CACHE = 512ull * 1024 * 1024;
+
+/// seconds a precompiled header may go unused before it is evicted
+static const time_t MAX_AGE = 30 * 24 * 60 * 60;
+
+/// first line of a manifest, identifying its format
+static const char MAGIC[] = "clink-pch 1";
+
+/// what we know about precompiling a run of #includes
+typedef enum {
+  UNCHECKED, ///< not yet looked for in the cache directory
+  CHECKING,  ///< being looked for in the cache directory by some thread
+  ABSENT,    ///< not in the cache directory and not yet built
+  BUILDING,  ///< being built by some thread
+  READY,     ///< built and usable
+  UNUSABLE,  ///< cannot be used, e.g. because it does not compile
+} state_t;
+
+/// a run of #includes, as parsed with particular flags
+typedef struct {
+  uint64_t key;  ///< digest of the flags and #includes, or 0 if unused
+  size_t count;  ///< number of sources seen that begin with this run
+  state_t state; ///< whether we have a precompiled header for it
+} entry_t;
+
+struct pch {
+  char *dir;     ///< directory precompiled headers are stored in
+  char *version; ///< libclang’s version, which precompiled headers depend on
+
+  pthread_mutex_t lock; ///< guard for all following fields
+  entry_t *entries;     ///< open-addressed table of runs seen
+  size_t entries_len;   ///< number of slots of `entries` in use
+  size_t entries_size;  ///< number of slots in `entries`
+};
+
+/// the #includes a source begins with and the flags it is parsed with
+typedef struct {
+  char *text;                ///< flags, then one #include per line
+  size_t flags_len;          ///< bytes of `text` before the first #include
+  size_t ends[MAX_INCLUDES]; ///< offset just past each #include line
+  size_t len;                ///< number of #includes
+  const char *lang;          ///< language to precompile the #includes as
+} run_t;
+
+/// does a string start with the given prefix?
+static bool startswith(const char *s, const char *prefix) {
+  assert(s != NULL);
+  assert(prefix != NULL);
+  return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+/// is this a path to a header, rather than something that includes them?
+static bool is_header(const char *path) {
+  const char *ext = strrchr(path, '.');
+  if (ext == NULL)
+    return false;
+  return strcmp(ext, ".h") == 0 || strcmp(ext, ".hh") == 0 ||
+         strcmp(ext, ".hpp") == 0;
+}
+
+/// does this argument stop a source sharing a precompiled header with others?
+static bool is_prohibitive(const char *arg) {
+  // a forced language or forced #includes would change what a run means
+  return startswith(arg, "-x") || startswith(arg, "-include") ||
+         startswith(arg, "--include") || startswith(arg, "-imacros");
+}
+
+/// How many arguments, starting at this one, only affect the output of
+/// compilation and so can differ between sources sharing a precompiled header?
+static size_t output_only(const char *arg) {
+  static const char *ONE[] = {"-c", "-MD", "-MMD", "-MP"};
+  for (size_t i = 0; i < sizeof(ONE) / sizeof(ONE[0]); ++i) {
+    if (strcmp(arg, ONE[i]) == 0)
+      return 1;
+  }
+  static const char *TWO[] = {"-o", "-MF", "-MT", "-MQ"};
+  for (size_t i = 0; i < sizeof(TWO) / sizeof(TWO[0]); ++i) {
+    if (strcmp(arg, TWO[i]) == 0)
+      return 2;
+    if (i > 0 && startswith(arg, TWO[i]))
+      return 1;
+  }
+  return 0;
+}
+
+/// modification time of a file, in nanoseconds
+static uint64_t mtime(const struct stat *st) {
+#ifdef __APPLE__
+  const struct timespec *ts = &st->st_mtimespec;
+#else
+  const struct timespec *ts = &st->st_mtim;
+#endif
+  return (uint64_t)ts->tv_sec * 1000000000 + (uint64_t)ts->tv_nsec;
+}
+
+/// key a run of the first `n` #includes is stored under
+static uint64_t key_of(const run_t *run, size_t n) {
+  assert(run != NULL);
+  assert(n > 0 && n <= run->len);
+  const uint64_t key = hash(run->text, run->ends[n - 1]);
+  // 0 marks an unused slot, so avoid it
+  return key == 0 ? 1 : key;
+}
+
+/// path of a file in the cache directory
+static char *cache_path(const pch_t *pch, uint64_t key, const char *ext) {
+  char *path = NULL;
+  if (UNLIKELY(asprintf(&path, "%s/%016" PRIx64 ".%s", pch->dir, key, ext) <
+               0))
+    return NULL;
+  return path;
+}
+
+/// create a directory and any missing parents
+static int mkdirs(const char *path) {
+
+  if (mkdir(path, 0755) == 0 || errno == EEXIST)
+    return 0;
+  if (errno != ENOENT)
+    return errno;
+
+  char *parent = NULL;
+  int rc = dirname(path, &parent);
+  if (UNLIKELY(rc != 0))
+    return rc;
+  if (strcmp(parent, path) != 0)
+    rc = mkdirs(parent);
+  free(parent);
+  if (rc != 0)
+    return rc;
+
+  if (mkdir(path, 0755) < 0 && errno != EEXIST)
+    return errno;
+  return 0;
+}
+
+int pch_new(pch_t **pch, const char *dir) {
+
+  if (pch == NULL)
+    return EINVAL;
+
+  if (dir == NULL)
+    return EINVAL;
+
+  int rc = mkdirs(dir);
+  if (rc != 0)
+    return rc;
+
+  pch_t *p = calloc(1, sizeof(*p));
+  if (UNLIKELY(p == NULL))
+    return ENOMEM;
+
+  p->dir = strdup(dir);
+  if (UNLIKELY(p->dir == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+
+  {
+    CXString version = clang_getClangVersion();
+    const char *v = clang_getCString(version);
+    p->version = strdup(v == NULL ? "" : v);
+    clang_disposeString(version);
+    if (UNLIKELY(p->version == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+  }
+
+  if (UNLIKELY((rc = pthread_mutex_init(&p->lock, NULL))))
+    goto done;
+
+  *pch = p;
+  p = NULL;
+
+done:
+  if (p != NULL) {
+    free(p->version);
+    free(p->dir);
+  }
+  free(p);
+
+  return rc;
+}
+
+/// find or create the entry for a run
+static entry_t *lookup(pch_t *pch, uint64_t key) {
+
+  assert(pch != NULL);
+  assert(key != 0);
+
+  if (pch->entries_size > 0) {
+    size_t i = (size_t)key & (pch->entries_size - 1);
+    while (pch->entries[i].key != 0) {
+      if (pch->entries[i].key == key)
+        return &pch->entries[i];
+      i = (i + 1) & (pch->entries_size - 1);
+    }
+  }
+
+  // keep the table at most half full
+  if ((pch->entries_len + 1) * 2 > pch->entries_size) {
+    const size_t size = pch->entries_size == 0 ? 256 : pch->entries_size * 2;
+    entry_t *e = calloc(size, sizeof(e[0]));
+    if (UNLIKELY(e == NULL))
+      return NULL;
+    for (size_t i = 0; i < pch->entries_size; ++i) {
+      if (pch->entries[i].key == 0)
+        continue;
+      size_t j = (size_t)pch->entries[i].key & (size - 1);
+      while (e[j].key != 0)
+        j = (j + 1) & (size - 1);
+      e[j] = pch->entries[i];
+    }
+    free(pch->entries);
+    pch->entries = e;
+    pch->entries_size = size;
+  }
+
+  size_t i = (size_t)key & (pch->entries_size - 1);
+  while (pch->entries[i].key != 0)
+    i = (i + 1) & (pch->entries_size - 1);
+
+  pch->entries[i] = (entry_t){.key = key, .state = UNCHECKED};
+  ++pch->entries_len;
+
+  return &pch->entries[i];
+}
+
+/// skip over spaces and tabs
+static const char *skip_blanks(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t'))
+    ++p;
+  return p;
+}
+
+/** find the #includes a source begins with
+ *
+ * Only a run of plain `#include` lines, separated by nothing but white space
+ * and comments, is recognised. Anything else ends the run. Quoted #includes
+ * that resolve relative to the source are rewritten to absolute paths, so they
+ * mean the same thing from another directory.
+ *
+ * \param path Absolute path of the source
+ * \param run [inout] Run to append to
+ * \param out Stream backing `run->text`
+ * \return 0 on success or an errno on failure
+ */
+static int scan(const char *path, run_t *run, FILE *out) {
+
+  assert(path != NULL);
+  assert(run != NULL);
+  assert(out != NULL);
+
+  int rc = 0;
+  char *buffer = NULL;
+  char *dir = NULL;
+
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+    return errno;
+
+  buffer = malloc(MAX_SCAN);
+  if (UNLIKELY(buffer == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  const size_t size = fread(buffer, 1, MAX_SCAN, f);
+  if (ferror(f)) {
+    rc = EIO;
+    goto done;
+  }
+
+  if (UNLIKELY((rc = dirname(path, &dir))))
+    goto done;
+
+  const char *p = buffer;
+  const char *const end = buffer + size;
+  while (p < end && run->len < MAX_INCLUDES) {
+
+    // skip white space and comments
+    if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '\f' ||
+        *p == '\v') {
+      ++p;
+      continue;
+    }
+    if (end - p >= 2 && strncmp(p, "//", 2) == 0) {
+      const char *eol = memchr(p, '\n', (size_t)(end - p));
+      if (eol == NULL)
+        break;
+      p = eol + 1;
+      continue;
+    }
+    if (end - p >= 2 && strncmp(p, "/*", 2) == 0) {
+      const char *close = NULL;
+      for (const char *q = p + 2; q + 1 < end; ++q) {
+        if (q[0] == '*' && q[1] == '/') {
+          close = q;
+          break;
+        }
+      }
+      if (close == NULL)
+        break;
+      p = close + 2;
+      continue;
+    }
+
+    // otherwise, we expect `#include <…>` or `#include "…"`
+    if (*p != '#')
+      break;
+    p = skip_blanks(p + 1, end);
+    static const char INCLUDE[] = "include";
+    if ((size_t)(end - p) < sizeof(INCLUDE) ||
+        strncmp(p, INCLUDE, sizeof(INCLUDE) - 1) != 0)
+      break;
+    p = skip_blanks(p + sizeof(INCLUDE) - 1, end);
+    if (p == end || (*p != '<' && *p != '"'))
+      break;
+    const char close = *p == '<' ? '>' : '"';
+    const char *name = p + 1;
+    const char *name_end = name;
+    while (name_end < end && *name_end != close && *name_end != '\n')
+      ++name_end;
+    if (name_end == end || *name_end != close || name_end == name)
+      break;
+
+    // the directive must be alone on its line
+    p = skip_blanks(name_end + 1, end);
+    if (end - p >= 2 && strncmp(p, "//", 2) == 0) {
+      p = memchr(p, '\n', (size_t)(end - p));
+      if (p == NULL)
+        break;
+    }
+    if (p < end && *p == '\r')
+      ++p;
+    if (p == end || *p != '\n')
+      break;
+    ++p;
+
+    const int name_len = (int)(name_end - name);
+    if (close == '"' && name[0] != '/') {
+      char *relative = strndup(name, (size_t)name_len);
+      if (UNLIKELY(relative == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+      char *absolute = NULL;
+      rc = join(dir, relative, &absolute);
+      free(relative);
+      if (UNLIKELY(rc != 0))
+        goto done;
+      if (access(absolute, F_OK) == 0) {
+        fprintf(out, "#include \"%s\"\n", absolute);
+      } else {
+        fprintf(out, "#include \"%.*s\"\n", name_len, name);
+      }
+      free(absolute);
+    } else {
+      fprintf(out, "#include %c%.*s%c\n", close == '>' ? '<' : '"', name_len,
+              name, close);
+    }
+
+    const long offset = ftell(out);
+    if (UNLIKELY(offset < 0)) {
+      rc = errno;
+      goto done;
+    }
+    run->ends[run->len] = (size_t)offset;
+    ++run->len;
+  }
+
+done:
+  free(dir);
+  free(buffer);
+  (void)fclose(f);
+
+  return rc;
+}
+
+/** work out which runs of #includes a source could use
+ *
+ * \param pch Cache being consulted
+ * \param path Absolute path of the source
+ * \param argc Number of entries in `argv`
+ * \param argv Arguments it will be parsed with
+ * \param run [out] The source’s #includes on success
+ * \return 0 on success or an errno on failure
+ */
+static int get_run(const pch_t *pch, const char *path, size_t argc,
+                   const char **argv, run_t *run) {
+
+  assert(pch != NULL);
+  assert(path != NULL);
+  assert(run != NULL);
+
+  *run = (run_t){.lang = is_cxx(path) ? "c++-header" : "c-header"};
+
+  size_t size = 0;
+  FILE *out = open_memstream(&run->text, &size);
+  if (UNLIKELY(out == NULL))
+    return errno;
+
+  // start with everything other than #includes that affects the result
+  fprintf(out, "%s\n%s\n%s\n", MAGIC, pch->version, run->lang);
+  for (size_t i = 0; i < argc;) {
+    const size_t skip = output_only(argv[i]);
+    if (skip > 0) {
+      i += skip;
+      continue;
+    }
+    fputs(argv[i], out);
+    fputc('\0', out);
+    ++i;
+  }
+  fputc('\n', out);
+  const long flags_len = ftell(out);
+  if (UNLIKELY(flags_len < 0)) {
+    const int rc = errno;
+    (void)fclose(out);
+    return rc;
+  }
+  run->flags_len = (size_t)flags_len;
+
+  int rc = scan(path, run, out);
+
+  if (UNLIKELY(fclose(out) != 0 && rc == 0))
+    rc = errno;
+
+  return rc;
+}
+
+/** is the precompiled header for a run in the cache directory?
+ *
+ * \param pch Cache to look in
+ * \param key Run to look for
+ * \return `READY` or `UNUSABLE` if a previous build of the run is still valid,
+ *   or `ABSENT` if it needs to be (re)built
+ */
+static state_t check(const pch_t *pch, uint64_t key) {
+
+  assert(pch != NULL);
+
+  state_t state = ABSENT;
+  char *line = NULL;
+  size_t line_size = 0;
+  FILE *f = NULL;
+
+  char *path = cache_path(pch, key, "deps");
+  if (UNLIKELY(path == NULL))
+    goto done;
+
+  f = fopen(path, "r");
+  if (f == NULL)
+    goto done;
+
+  // the first line tells us how the last build went
+  if (getline(&line, &line_size, f) < 0)
+    goto done;
+  line[strcspn(line, "\n")] = '\0';
+  state_t outcome = ABSENT;
+  if (startswith(line, MAGIC) && strcmp(line + strlen(MAGIC), " ok") == 0) {
+    outcome = READY;
+  } else if (startswith(line, MAGIC) &&
+             strcmp(line + strlen(MAGIC), " unusable") == 0) {
+    outcome = UNUSABLE;
+  } else {
+    goto done;
+  }
+
+  // then each file it depended on, which must not have changed since
+  while (getline(&line, &line_size, f) > 0) {
+    line[strcspn(line, "\n")] = '\0';
+    uint64_t modified = 0;
+    unsigned long long size = 0;
+    int offset = 0;
+    if (sscanf(line, "%" SCNu64 " %llu %n", &modified, &size, &offset) != 2)
+      goto done;
+    struct stat st;
+    if (stat(line + offset, &st) < 0)
+      goto done;
+    if (mtime(&st) != modified || (unsigned long long)st.st_size != size)
+      goto done;
+  }
+
+  if (outcome == READY) {
+    free(path);
+    path = cache_path(pch, key, "pch");
+    if (UNLIKELY(path == NULL))
+      goto done;
+    if (access(path, R_OK) < 0)
+      goto done;
+  }
+
+  // note that the run is still in use, so eviction leaves it until last
+  {
+    free(path);
+    path = cache_path(pch, key, "deps");
+    if (path != NULL)
+      (void)utimensat(AT_FDCWD, path, NULL, 0);
+  }
+
+  state = outcome;
+
+done:
+  free(line);
+  if (f != NULL)
+    (void)fclose(f);
+  free(path);
+
+  return state;
+}
+
+/// files included while precompiling a run
+typedef struct {
+  CXTranslationUnit tu; ///< translation unit being examined
+  char **paths;         ///< every file read
+  size_t paths_len;     ///< number of entries in `paths`
+  bool unguarded;       ///< was a run member not protected by a guard?
+  int rc;               ///< any error encountered
+} inclusions_t;
+
+/// `clang_getInclusions` callback
+static void note_inclusion(CXFile file, CXSourceLocation *stack,
+                           unsigned stack_len, CXClientData data) {
+
+  (void)stack;
+
+  inclusions_t *in = data;
+  if (in->rc != 0)
+    return;
+
+  // Sources will #include the run again after the precompiled header. This is
+  // only harmless if the second time is a no-op.
+  if (stack_len == 1 && !clang_isFileMultipleIncludeGuarded(in->tu, file))
+    in->unguarded = true;
+
+  char **p = realloc(in->paths, (in->paths_len + 1) * sizeof(p[0]));
+  if (UNLIKELY(p == NULL)) {
+    in->rc = ENOMEM;
+    return;
+  }
+  in->paths = p;
+
+  CXString name = clang_getFileName(file);
+  const char *n = clang_getCString(name);
+  in->paths[in->paths_len] = strdup(n == NULL ? "" : n);
+  clang_disposeString(name);
+  if (UNLIKELY(in->paths[in->paths_len] == NULL)) {
+    in->rc = ENOMEM;
+    return;
+  }
+  ++in->paths_len;
+}
+
+/// atomically create a file in the cache directory from a temporary one
+static int publish(const char *tmp, const char *path, bool replace) {
+  int rc = 0;
+  if (replace) {
+    if (rename(tmp, path) < 0)
+      rc = errno;
+  } else {
+    // leave any existing copy alone, as precompiled headers record its mtime
+    if (link(tmp, path) < 0 && errno != EEXIST)
+      rc = errno;
+  }
+  (void)unlink(tmp);
+  return rc;
+}
+
+/// create a temporary file next to the given path
+static FILE *temp(const char *path, char **tmp) {
+  if (UNLIKELY(asprintf(tmp, "%s.XXXXXX", path) < 0)) {
+    *tmp = NULL;
+    errno = ENOMEM;
+    return NULL;
+  }
+  const int fd = mkstemp(*tmp);
+  if (fd < 0) {
+    free(*tmp);
+    *tmp = NULL;
+    return NULL;
+  }
+  FILE *f = fdopen(fd, "w");
+  if (f == NULL) {
+    const int err = errno;
+    (void)close(fd);
+    (void)unlink(*tmp);
+    free(*tmp);
+    *tmp = NULL;
+    errno = err;
+  }
+  return f;
+}
+
+/// write the contents of a file via a temporary
+static int write_file(const char *path, const char *content, size_t len,
+                      bool replace) {
+  char *tmp = NULL;
+  FILE *f = temp(path, &tmp);
+  if (f == NULL)
+    return errno;
+  int rc = 0;
+  if (fwrite(content, 1, len, f) != len)
+    rc = EIO;
+  if (fclose(f) != 0 && rc == 0)
+    rc = errno;
+  if (rc != 0) {
+    (void)unlink(tmp);
+  } else {
+    rc = publish(tmp, path, replace);
+  }
+  free(tmp);
+  return rc;
+}
+
+/** precompile a run of #includes into the cache directory
+ *
+ * \param pch Cache to build into
+ * \param key Run to build
+ * \param run Source of the run
+ * \param n Number of #includes in the run
+ * \param argc Number of entries in `argv`
+ * \param argv Arguments sources using the run will be parsed with
+ * \return `READY` if the run can be used or `UNUSABLE` if not
+ */
+static state_t build(const pch_t *pch, uint64_t key, const run_t *run,
+                     size_t n, size_t argc, const char **argv) {
+
+  assert(pch != NULL);
+  assert(run != NULL);
+  assert(n > 0 && n <= run->len);
+
+  state_t state = UNUSABLE;
+  int rc = 0;
+  char *header = NULL;
+  char *output = NULL;
+  char *tmp = NULL;
+  const char **av = NULL;
+  CXIndex index = NULL;
+  CXTranslationUnit tu = NULL;
+  inclusions_t inclusions = {0};
+  char *manifest = NULL;
+  size_t manifest_size = 0;
+  FILE *m = NULL;
+
+  // write the run out as a header of its own
+  header = cache_path(pch, key, "h");
+  if (UNLIKELY(header == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  const char *text = run->text + run->flags_len;
+  if (UNLIKELY((rc = write_file(header, text, run->ends[n - 1] - run->flags_len,
+                                false))))
+    goto done;
+
+  // parse it with the same flags as its users, less those about output
+  av = calloc(argc + 2, sizeof(av[0]));
+  if (UNLIKELY(av == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  size_t ac = 0;
+  for (size_t i = 0; i < argc;) {
+    const size_t skip = output_only(argv[i]);
+    if (skip > 0) {
+      i += skip;
+      continue;
+    }
+    av[ac++] = argv[i++];
+  }
+  av[ac++] = "-x";
+  av[ac++] = run->lang;
+
+  index = clang_createIndex(0, 0);
+  if (UNLIKELY(index == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  // Sources’ expansions of macros defined in the run are only reported if
+  // definitions were recorded here too.
+  const unsigned options = CXTranslationUnit_DetailedPreprocessingRecord |
+                           CXTranslationUnit_ForSerialization |
+                           CXTranslationUnit_Incomplete;
+  const enum CXErrorCode err = clang_parseTranslationUnit2(
+      index, header, av, (int)ac, NULL, 0, options, &tu);
+  if (ERROR(err != CXError_Success)) {
+    rc = EIO;
+    goto done;
+  }
+
+  // it is only usable if it compiled cleanly and every member is guarded
+  bool usable = true;
+  for (unsigned i = 0; i < clang_getNumDiagnostics(tu); ++i) {
+    CXDiagnostic d = clang_getDiagnostic(tu, i);
+    if (clang_getDiagnosticSeverity(d) >= CXDiagnostic_Error)
+      usable = false;
+    clang_disposeDiagnostic(d);
+  }
+  inclusions.tu = tu;
+  clang_getInclusions(tu, note_inclusion, &inclusions);
+  if (UNLIKELY((rc = inclusions.rc)))
+    goto done;
+  if (inclusions.unguarded)
+    usable = false;
+
+  if (usable) {
+    output = cache_path(pch, key, "pch");
+    if (UNLIKELY(output == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+    FILE *f = temp(output, &tmp);
+    if (f == NULL) {
+      rc = errno;
+      goto done;
+    }
+    (void)fclose(f);
+    const unsigned save = clang_defaultSaveOptions(tu);
+    if (ERROR(clang_saveTranslationUnit(tu, tmp, save) != CXSaveError_None)) {
+      (void)unlink(tmp);
+      rc = EIO;
+      goto done;
+    }
+    if (UNLIKELY((rc = publish(tmp, output, true))))
+      goto done;
+  }
+
+  // record the outcome and what it depended on, for later builds to check
+  m = open_memstream(&manifest, &manifest_size);
+  if (UNLIKELY(m == NULL)) {
+    rc = errno;
+    goto done;
+  }
+  fprintf(m, "%s %s\n", MAGIC, usable ? "ok" : "unusable");
+  for (size_t i = 0; i < inclusions.paths_len; ++i) {
+    struct stat st;
+    if (stat(inclusions.paths[i], &st) < 0) {
+      rc = errno;
+      goto done;
+    }
+    fprintf(m, "%" PRIu64 " %llu %s\n", mtime(&st),
+            (unsigned long long)st.st_size, inclusions.paths[i]);
+  }
+  if (UNLIKELY(fclose(m) != 0)) {
+    m = NULL;
+    rc = errno;
+    goto done;
+  }
+  m = NULL;
+  {
+    char *path = cache_path(pch, key, "deps");
+    if (UNLIKELY(path == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+    rc = write_file(path, manifest, manifest_size, true);
+    free(path);
+    if (UNLIKELY(rc != 0))
+      goto done;
+  }
+
+  state = usable ? READY : UNUSABLE;
+
+done:
+  if (rc != 0)
+    DEBUG("failed to precompile %s: %s", header == NULL ? "header" : header,
+          strerror(rc));
+  if (m != NULL)
+    (void)fclose(m);
+  free(manifest);
+  for (size_t i = 0; i < inclusions.paths_len; ++i)
+    free(inclusions.paths[i]);
+  free(inclusions.paths);
+  if (tu != NULL)
+    clang_disposeTranslationUnit(tu);
+  if (index != NULL)
+    clang_disposeIndex(index);
+  free(av);
+  free(tmp);
+  free(output);
+  free(header);
+
+  return state;
+}
+
+int pch_find(pch_t *pch, const char *path, size_t argc, const char **argv,
+             char **found) {
+
+  if (pch == NULL)
+    return EINVAL;
+
+  if (path == NULL)
+    return EINVAL;
+
+  if (argc > 0 && argv == NULL)
+    return EINVAL;
+
+  if (found == NULL)
+    return EINVAL;
+
+  *found = NULL;
+
+  // headers are parsed as headers, so cannot use a precompiled one
+  if (is_header(path))
+    return 0;
+
+  for (size_t i = 0; i < argc; ++i) {
+    if (is_prohibitive(argv[i]))
+      return 0;
+  }
+
+  run_t run = {0};
+  int rc = get_run(pch, path, argc, argv, &run);
+  if (rc != 0)
+    goto done;
+
+  if (run.len == 0)
+    goto done;
+
+  uint64_t chosen = 0;
+  size_t chosen_len = 0;
+  bool building = false;
+
+  {
+    int r UNUSED = pthread_mutex_lock(&pch->lock);
+    assert(r == 0);
+
+    // count this source towards every run it begins with
+    for (size_t n = 1; n <= run.len; ++n) {
+      entry_t *e = lookup(pch, key_of(&run, n));
+      if (UNLIKELY(e == NULL)) {
+        rc = ENOMEM;
+        break;
+      }
+      ++e->count;
+    }
+
+    // use the longest run we have, or build the longest that is popular enough
+    while (rc == 0) {
+      uint64_t unchecked = 0;
+      for (size_t n = run.len; n > 0; --n) {
+        const uint64_t key = key_of(&run, n);
+        entry_t *e = lookup(pch, key);
+        assert(e != NULL && "run unexpectedly missing");
+        if (e->state == UNCHECKED) {
+          e->state = CHECKING;
+          unchecked = key;
+          break;
+        }
+        if (e->state == READY) {
+          chosen = key;
+          break;
+        }
+        if (e->state == ABSENT && e->count >= THRESHOLD) {
+          e->state = BUILDING;
+          chosen = key;
+          chosen_len = n;
+          building = true;
+          break;
+        }
+      }
+      if (unchecked == 0)
+        break;
+
+      // look in the cache directory without holding up other threads, then
+      // reconsider with what we found
+      r = pthread_mutex_unlock(&pch->lock);
+      assert(r == 0);
+
+      const state_t state = check(pch, unchecked);
+
+      r = pthread_mutex_lock(&pch->lock);
+      assert(r == 0);
+
+      entry_t *e = lookup(pch, unchecked);
+      assert(e != NULL && "run unexpectedly missing");
+      e->state = state;
+    }
+
+    r = pthread_mutex_unlock(&pch->lock);
+    assert(r == 0);
+  }
+
+  if (rc != 0 || chosen == 0)
+    goto done;
+
+  if (building) {
+    const state_t state = build(pch, chosen, &run, chosen_len, argc, argv);
+
+    int r UNUSED = pthread_mutex_lock(&pch->lock);
+    assert(r == 0);
+
+    entry_t *e = lookup(pch, chosen);
+    assert(e != NULL && "run unexpectedly missing");
+    e->state = state;
+
+    r = pthread_mutex_unlock(&pch->lock);
+    assert(r == 0);
+
+    if (state != READY)
+      goto done;
+  }
+
+  *found = cache_path(pch, chosen, "pch");
+  if (UNLIKELY(*found == NULL))
+    rc = ENOMEM;
+
+done:
+  free(run.text);
+
+  return rc;
+}
+
+/// a file in the cache directory
+typedef struct {
+  uint64_t key;  ///< run the file belongs to
+  char *path;    ///< absolute path of the file
+  time_t mtime;  ///< when the file was last modified
+  uint64_t size; ///< bytes in the file
+} cached_t;
+
+/// the files in the cache directory belonging to one run
+typedef struct {
+  uint64_t key;  ///< run the files are for
+  time_t used;   ///< when the run was last built or used
+  uint64_t size; ///< total bytes of its files
+  bool evict;    ///< should the run be removed?
+} usage_t;
+
+/// `qsort` comparator for ordering files by run
+static int by_key(const void *a, const void *b) {
+  const cached_t *x = a;
+  const cached_t *y = b;
+  if (x->key != y->key)
+    return x->key < y->key ? -1 : 1;
+  return 0;
+}
+
+/// `qsort` comparator for ordering runs least recently used first
+static int older(const void *a, const void *b) {
+  const usage_t *x = a;
+  const usage_t *y = b;
+  if (x->used != y->used)
+    return x->used < y->used ? -1 : 1;
+  if (x->key != y->key)
+    return x->key < y->key ? -1 : 1;
+  return 0;
+}
+
+/// `qsort` comparator for ordering runs by key
+static int by_run(const void *a, const void *b) {
+  const usage_t *x = a;
+  const usage_t *y = b;
+  if (x->key != y->key)
+    return x->key < y->key ? -1 : 1;
+  return 0;
+}
+
+/// parse the run a file in the cache directory belongs to
+static bool key_of_name(const char *name, uint64_t *key) {
+  uint64_t k = 0;
+  for (size_t i = 0; i < 16; ++i) {
+    const char c = name[i];
+    if (c >= '0' && c <= '9') {
+      k = k * 16 + (uint64_t)(c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      k = k * 16 + (uint64_t)(c - 'a' + 10);
+    } else {
+      return false;
+    }
+  }
+  if (name[16] != '.')
+    return false;
+  *key = k;
+  return true;
+}
+
+/// is this file in the cache directory a temporary, not yet published?
+static bool is_temporary(const char *name) {
+  // published files are “<key>.<ext>” and temporaries “<key>.<ext>.XXXXXX”
+  return strchr(name + 17, '.') != NULL;
+}
+
+/** bound the space the cache directory takes up
+ *
+ * Runs unused for longer than `MAX_AGE` are removed, then the least recently
+ * used runs until the directory holds at most `MAX_CACHE` bytes. Temporaries
+ * may still be being written by another Clink process sharing the directory,
+ * so they are only removed once they too are older than `MAX_AGE`.
+ *
+ * \param pch Cache to trim
+ * \return 0 on success or an errno on failure
+ */
+static int trim(const pch_t *pch) {
+
+  assert(pch != NULL);
+
+  int rc = 0;
+  cached_t *files = NULL;
+  size_t files_len = 0;
+  size_t files_size = 0;
+  usage_t *runs = NULL;
+  size_t runs_len = 0;
+
+  DIR *dir = opendir(pch->dir);
+  if (dir == NULL)
+    return errno;
+
+  const time_t cutoff = time(NULL) - MAX_AGE;
+
+  // list every published file belonging to a run
+  for (struct dirent *e = readdir(dir); e != NULL; e = readdir(dir)) {
+    uint64_t key = 0;
+    if (!key_of_name(e->d_name, &key))
+      continue;
+    if (files_len == files_size) {
+      const size_t size = files_size == 0 ? 64 : files_size * 2;
+      cached_t *f = realloc(files, size * sizeof(f[0]));
+      if (UNLIKELY(f == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+      files = f;
+      files_size = size;
+    }
+    cached_t *f = &files[files_len];
+    *f = (cached_t){.key = key};
+    if (UNLIKELY((rc = join(pch->dir, e->d_name, &f->path))))
+      goto done;
+    struct stat st;
+    if (stat(f->path, &st) < 0) {
+      free(f->path);
+      continue;
+    }
+    f->mtime = st.st_mtime;
+    f->size = (uint64_t)st.st_size;
+
+    // remove abandoned temporaries, but leave any that may still be in use
+    if (is_temporary(e->d_name)) {
+      if (f->mtime < cutoff) {
+        DEBUG("removing stale temporary %s", f->path);
+        (void)unlink(f->path);
+      }
+      free(f->path);
+      continue;
+    }
+
+    ++files_len;
+  }
+
+  if (files_len == 0)
+    goto done;
+
+  // total them up per run
+  qsort(files, files_len, sizeof(files[0]), by_key);
+  runs = calloc(files_len, sizeof(runs[0]));
+  if (UNLIKELY(runs == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  uint64_t total = 0;
+  for (size_t i = 0; i < files_len; ++i) {
+    if (runs_len == 0 || runs[runs_len - 1].key != files[i].key)
+      runs[runs_len++] = (usage_t){.key = files[i].key};
+    usage_t *r = &runs[runs_len - 1];
+    r->size += files[i].size;
+    // the manifest is touched on each use, so the newest file says when the
+    // run was last used
+    if (files[i].mtime > r->used)
+      r->used = files[i].mtime;
+    total += files[i].size;
+  }
+
+  // choose the stale runs, then the oldest until we are within bounds
+  qsort(runs, runs_len, sizeof(runs[0]), older);
+  for (size_t i = 0; i < runs_len; ++i) {
+    if (runs[i].used >= cutoff && total <= MAX_CACHE)
+      break;
+    runs[i].evict = true;
+    total -= runs[i].size;
+  }
+
+  // both lists are now ordered by run, so remove the chosen runs in one pass
+  qsort(runs, runs_len, sizeof(runs[0]), by_run);
+  for (size_t i = 0, j = 0; i < files_len; ++i) {
+    while (runs[j].key != files[i].key)
+      ++j;
+    if (!runs[j].evict)
+      continue;
+    DEBUG("evicting %s from the precompiled header cache", files[i].path);
+    (void)unlink(files[i].path);
+  }
+
+done:
+  free(runs);
+  for (size_t i = 0; i < files_len; ++i)
+    free(files[i].path);
+  free(files);
+  (void)closedir(dir);
+
+  return rc;
+}
+
+void pch_free(pch_t **pch) {
+
+  if (pch == NULL || *pch == NULL)
+    return;
+
+  pch_t *p = *pch;
+
+  {
+    const int rc = trim(p);
+    if (rc != 0)
+      DEBUG("failed to trim precompiled header cache %s: %s", p->dir,
+            strerror(rc));
+  }
+
+  (void)pthread_mutex_destroy(&p->lock);
+  free(p->entries);
+  free(p->version);
+  free(p->dir);
+  free(p);
+
+  *pch = NULL;
+}
@@ -0,0 +1,46 @@
+// automatic precompiled headers for the #includes that sources begin with
+
+#pragma once
+
+#include <stddef.h>
+
+/// A cache of precompiled headers. Sources that begin with the same run of
+/// #includes and are parsed with the same flags can share a precompiled header
+/// of that run, instead of each reparsing it. Runs are counted as sources are
+/// seen, and a run is precompiled once enough sources have shared it.
+/// Precompiled headers are kept in a directory, to be reused by later builds
+/// until a header they were built from changes.
+typedef struct pch pch_t;
+
+/** create a new precompiled header cache
+ *
+ * \param pch [out] Created cache on success
+ * \param dir Directory to store precompiled headers in, created if necessary
+ * \return 0 on success or an errno on failure
+ */
+int pch_new(pch_t **pch, const char *dir);
+
+/** find a precompiled header a source can be parsed with
+ *
+ * This may build a precompiled header before returning. It is thread-safe.
+ *
+ * \param pch Cache to consult
+ * \param path Absolute path of the source about to be parsed
+ * \param argc Number of entries in `argv`
+ * \param argv Clang command line arguments it will be parsed with
+ * \param found [out] Path to pass to `-include-pch` on success, or `NULL` if
+ *   the source should be parsed without a precompiled header
+ * \return 0 on success or an errno on failure
+ */
+int pch_find(pch_t *pch, const char *path, size_t argc, const char **argv,
+             char **found);
+
+/** deallocate a precompiled header cache
+ *
+ * This leaves the cache directory in place, but first trims it by removing
+ * precompiled headers that have gone unused for a month and then the least
+ * recently used ones until it holds no more than 512MiB.
+ *
+ * \param pch Cache to destroy
+ */
+void pch_free(pch_t **pch);
@@ -0,0 +1,410 @@
+#include "profile.h"
+#include "../../common/compiler.h"
+#include "clock.h"
+#include "json.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/// number of files to list in the slowest files section of a report
+enum { SLOWEST = 20 };
+
+/// names of each phase, as they appear in a report
+static const char *PHASE_NAMES[PROFILE_PHASES] = {
+    [PROFILE_HASH] = "hash",           [PROFILE_PREPARE] = "prepare",
+    [PROFILE_PARSE] = "parse",         [PROFILE_HIGHLIGHT] = "highlight",
+    [PROFILE_FINISH] = "finish",
+};
+
+/// names of each stage, as they appear in a report
+static const char *STAGE_NAMES[PROFILE_STAGES] = {
+    [PROFILE_DISCOVER] = "discover",     [PROFILE_PROCESS] = "process",
+    [PROFILE_DEPENDENTS] = "dependents", [PROFILE_PURGE] = "purge",
+    [PROFILE_INDEX] = "index",
+};
+
+/// timing collected by a single thread
+typedef struct {
+  profile_file_t *files; ///< files this thread processed
+  size_t count;          ///< number of entries in `files`
+  size_t size;           ///< number of allocated entries in `files`
+  uint64_t idle;         ///< nanoseconds spent waiting for work
+} thread_t;
+
+struct profile {
+  uint64_t start;                 ///< when the profile was created
+  uint64_t stages[PROFILE_STAGES]; ///< nanoseconds spent in each stage
+  size_t threads;                 ///< number of entries in `thread`
+  thread_t thread[];              ///< per-thread timing
+};
+
+const char *profile_phase_name(profile_phase_t phase) {
+  assert(phase < PROFILE_PHASES);
+  return PHASE_NAMES[phase];
+}
+
+const char *profile_stage_name(profile_stage_t stage) {
+  assert(stage < PROFILE_STAGES);
+  return STAGE_NAMES[stage];
+}
+
+static uint64_t cpu_now(void) {
+  struct timespec ts = {0};
+  (void)clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+int profile_new(profile_t **profile, size_t threads) {
+
+  if (profile == NULL)
+    return EINVAL;
+
+  if (threads == 0)
+    return EINVAL;
+
+  profile_t *p = calloc(1, sizeof(*p) + threads * sizeof(p->thread[0]));
+  if (p == NULL)
+    return ENOMEM;
+
+  p->start = now();
+  p->threads = threads;
+
+  *profile = p;
+  return 0;
+}
+
+profile_mark_t profile_mark(void) {
+  return (profile_mark_t){.wall = now(), .cpu = cpu_now()};
+}
+
+void profile_lap(profile_file_t *file, profile_phase_t phase,
+                 profile_mark_t *since) {
+
+  assert(file != NULL);
+  assert(phase < PROFILE_PHASES);
+  assert(since != NULL);
+
+  const profile_mark_t mark = profile_mark();
+  file->wall[phase] += mark.wall - since->wall;
+  file->cpu[phase] += mark.cpu - since->cpu;
+  *since = mark;
+}
+
+void profile_lock(pthread_mutex_t *mutex, uint64_t *waited) {
+
+  assert(mutex != NULL);
+
+  int r UNUSED = 0;
+
+  // only pay for reading the clock if we actually have to wait
+  if (waited == NULL || (r = pthread_mutex_trylock(mutex)) == EBUSY) {
+    const uint64_t start = waited == NULL ? 0 : now();
+    r = pthread_mutex_lock(mutex);
+    if (waited != NULL)
+      *waited += now() - start;
+  }
+  assert(r == 0);
+}
+
+int profile_file(profile_t *profile, unsigned long thread_id,
+                 const profile_file_t *file) {
+
+  if (profile == NULL)
+    return EINVAL;
+
+  if (thread_id >= profile->threads)
+    return EINVAL;
+
+  if (file == NULL || file->path == NULL)
+    return EINVAL;
+
+  thread_t *t = &profile->thread[thread_id];
+
+  if (t->count == t->size) {
+    const size_t s = t->size == 0 ? 128 : t->size * 2;
+    profile_file_t *f = realloc(t->files, s * sizeof(f[0]));
+    if (UNLIKELY(f == NULL))
+      return ENOMEM;
+    t->files = f;
+    t->size = s;
+  }
+
+  char *path = strdup(file->path);
+  if (UNLIKELY(path == NULL))
+    return ENOMEM;
+
+  t->files[t->count] = *file;
+  t->files[t->count].path = path;
+  ++t->count;
+
+  return 0;
+}
+
+void profile_idle(profile_t *profile, unsigned long thread_id, uint64_t wall) {
+
+  assert(profile != NULL);
+  assert(thread_id < profile->threads);
+
+  profile->thread[thread_id].idle += wall;
+}
+
+void profile_stage(profile_t *profile, profile_stage_t stage, uint64_t wall) {
+
+  assert(profile != NULL);
+  assert(stage < PROFILE_STAGES);
+
+  profile->stages[stage] += wall;
+}
+
+/// total wall time spent on a file
+static uint64_t total(const profile_file_t *file) {
+  assert(file != NULL);
+  uint64_t t = file->lock_wait;
+  for (size_t i = 0; i < PROFILE_PHASES; ++i)
+    t += file->wall[i];
+  return t;
+}
+
+/// `qsort` comparator for ordering files slowest first
+static int slower(const void *a, const void *b) {
+  const profile_file_t *const *x = a;
+  const profile_file_t *const *y = b;
+  const uint64_t tx = total(*x);
+  const uint64_t ty = total(*y);
+  if (tx > ty)
+    return -1;
+  if (tx < ty)
+    return 1;
+  return strcmp((*x)->path, (*y)->path);
+}
+
+/// write a duration in seconds
+static void json_seconds(FILE *out, uint64_t ns) {
+  assert(out != NULL);
+  fprintf(out, "%.6f", (double)ns / 1e9);
+}
+
+/// write per-phase wall and CPU times
+static void json_phases(FILE *out, const uint64_t *wall, const uint64_t *cpu) {
+  assert(out != NULL);
+  assert(wall != NULL);
+  assert(cpu != NULL);
+
+  fputc('{', out);
+  for (size_t i = 0; i < PROFILE_PHASES; ++i) {
+    fprintf(out, "%s\"%s\": {\"wall\": ", i == 0 ? "" : ", ", PHASE_NAMES[i]);
+    json_seconds(out, wall[i]);
+    fputs(", \"cpu\": ", out);
+    json_seconds(out, cpu[i]);
+    fputc('}', out);
+  }
+  fputc('}', out);
+}
+
+/// aggregate timing of all files handled by one parser
+typedef struct {
+  const char *parser;
+  size_t files;
+  uint64_t wall;
+  uint64_t cpu;
+} parser_total_t;
+
+/// `qsort` comparator for ordering parsers by descending time
+static int busier(const void *a, const void *b) {
+  const parser_total_t *x = a;
+  const parser_total_t *y = b;
+  if (x->wall > y->wall)
+    return -1;
+  if (x->wall < y->wall)
+    return 1;
+  return strcmp(x->parser, y->parser);
+}
+
+int profile_write(const profile_t *profile, const char *path) {
+
+  if (profile == NULL)
+    return EINVAL;
+
+  if (path == NULL)
+    return EINVAL;
+
+  int rc = 0;
+  FILE *out = NULL;
+  const profile_file_t **files = NULL;
+  parser_total_t *parsers = NULL;
+  size_t parsers_len = 0;
+
+  const uint64_t elapsed = now() - profile->start;
+
+  // collect every file, to find the slowest
+  size_t count = 0;
+  for (size_t i = 0; i < profile->threads; ++i)
+    count += profile->thread[i].count;
+  if (count > 0) {
+    files = calloc(count, sizeof(files[0]));
+    if (UNLIKELY(files == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+  }
+  {
+    size_t n = 0;
+    for (size_t i = 0; i < profile->threads; ++i) {
+      for (size_t j = 0; j < profile->thread[i].count; ++j)
+        files[n++] = &profile->thread[i].files[j];
+    }
+  }
+  if (count > 0)
+    qsort(files, count, sizeof(files[0]), slower);
+
+  // total up time by parser
+  for (size_t i = 0; i < count; ++i) {
+    if (files[i]->parser == NULL)
+      continue;
+    size_t j = 0;
+    for (; j < parsers_len; ++j) {
+      if (strcmp(parsers[j].parser, files[i]->parser) == 0)
+        break;
+    }
+    if (j == parsers_len) {
+      parser_total_t *p =
+          realloc(parsers, (parsers_len + 1) * sizeof(parsers[0]));
+      if (UNLIKELY(p == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+      parsers = p;
+      parsers[parsers_len] = (parser_total_t){.parser = files[i]->parser};
+      ++parsers_len;
+    }
+    ++parsers[j].files;
+    parsers[j].wall += files[i]->wall[PROFILE_PARSE];
+    parsers[j].cpu += files[i]->cpu[PROFILE_PARSE];
+  }
+  if (parsers_len > 0)
+    qsort(parsers, parsers_len, sizeof(parsers[0]), busier);
+
+  out = fopen(path, "w");
+  if (out == NULL) {
+    rc = errno;
+    goto done;
+  }
+
+  fprintf(out, "{\n  \"threads\": %zu,\n  \"files\": %zu,\n  \"wall\": ",
+          profile->threads, count);
+  json_seconds(out, elapsed);
+
+  fputs(",\n  \"stages\": {", out);
+  for (size_t i = 0; i < PROFILE_STAGES; ++i) {
+    fprintf(out, "%s\"%s\": ", i == 0 ? "" : ", ", STAGE_NAMES[i]);
+    json_seconds(out, profile->stages[i]);
+  }
+  fputc('}', out);
+
+  // per-thread breakdown, to show load imbalance and contention
+  fputs(",\n  \"per_thread\": [", out);
+  for (size_t i = 0; i < profile->threads; ++i) {
+    const thread_t *t = &profile->thread[i];
+    uint64_t wall[PROFILE_PHASES] = {0};
+    uint64_t cpu[PROFILE_PHASES] = {0};
+    uint64_t insert_wait = 0;
+    uint64_t insert = 0;
+    uint64_t lock_wait = 0;
+    for (size_t j = 0; j < t->count; ++j) {
+      for (size_t k = 0; k < PROFILE_PHASES; ++k) {
+        wall[k] += t->files[j].wall[k];
+        cpu[k] += t->files[j].cpu[k];
+      }
+      insert_wait += t->files[j].insert_wait;
+      insert += t->files[j].insert;
+      lock_wait += t->files[j].lock_wait;
+    }
+    fprintf(out, "%s\n    {\"thread\": %zu, \"files\": %zu, \"idle\": ",
+            i == 0 ? "" : ",", i, t->count);
+    json_seconds(out, t->idle);
+    fputs(", \"insert_wait\": ", out);
+    json_seconds(out, insert_wait);
+    fputs(", \"insert\": ", out);
+    json_seconds(out, insert);
+    fputs(", \"lock_wait\": ", out);
+    json_seconds(out, lock_wait);
+    fputs(", \"phases\": ", out);
+    json_phases(out, wall, cpu);
+    fputc('}', out);
+  }
+  fputs("\n  ]", out);
+
+  fputs(",\n  \"parsers\": [", out);
+  for (size_t i = 0; i < parsers_len; ++i) {
+    fprintf(out, "%s\n    {\"parser\": ", i == 0 ? "" : ",");
+    json_string(out, parsers[i].parser);
+    fprintf(out, ", \"files\": %zu, \"wall\": ", parsers[i].files);
+    json_seconds(out, parsers[i].wall);
+    fputs(", \"cpu\": ", out);
+    json_seconds(out, parsers[i].cpu);
+    fputc('}', out);
+  }
+  fputs("\n  ]", out);
+
+  fputs(",\n  \"slowest_files\": [", out);
+  for (size_t i = 0; i < count && i < SLOWEST; ++i) {
+    const profile_file_t *f = files[i];
+    fprintf(out, "%s\n    {\"path\": ", i == 0 ? "" : ",");
+    json_string(out, f->path);
+    fputs(", \"parser\": ", out);
+    if (f->parser == NULL) {
+      fputs("null", out);
+    } else {
+      json_string(out, f->parser);
+    }
+    fputs(", \"wall\": ", out);
+    json_seconds(out, total(f));
+    fputs(", \"insert_wait\": ", out);
+    json_seconds(out, f->insert_wait);
+    fputs(", \"insert\": ", out);
+    json_seconds(out, f->insert);
+    fputs(", \"lock_wait\": ", out);
+    json_seconds(out, f->lock_wait);
+    fputs(", \"phases\": ", out);
+    json_phases(out, f->wall, f->cpu);
+    fputc('}', out);
+  }
+  fputs("\n  ]\n}\n", out);
+
+  if (UNLIKELY(ferror(out)))
+    rc = EIO;
+
+done:
+  if (out != NULL) {
+    if (fclose(out) != 0 && rc == 0)
+      rc = errno;
+  }
+  free(parsers);
+  free(files);
+
+  return rc;
+}
+
+void profile_free(profile_t **profile) {
+
+  if (profile == NULL || *profile == NULL)
+    return;
+
+  profile_t *p = *profile;
+
+  for (size_t i = 0; i < p->threads; ++i) {
+    for (size_t j = 0; j < p->thread[i].count; ++j)
+      free((char *)p->thread[i].files[j].path);
+    free(p->thread[i].files);
+  }
+
+  free(p);
+  *profile = NULL;
+}
@@ -0,0 +1,134 @@
+// collection of timing information about a build
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// stages of processing a single file
+typedef enum {
+  PROFILE_HASH,      ///< checking whether the file has changed
+  PROFILE_PREPARE,   ///< removing stale data and creating a record
+  PROFILE_PARSE,     ///< parsing, including inserting symbols
+  PROFILE_HIGHLIGHT, ///< syntax highlighting with Vim
+  PROFILE_FINISH,    ///< completing the record and committing
+  PROFILE_PHASES,    ///< number of phases, not a phase itself
+} profile_phase_t;
+
+/// stages of a build that are not specific to any one file
+typedef enum {
+  PROFILE_DISCOVER,   ///< finding source files
+  PROFILE_PROCESS,    ///< processing files found by discovery
+  PROFILE_DEPENDENTS, ///< finding and processing files that #include others
+  PROFILE_PURGE,      ///< removing vanished files
+  PROFILE_INDEX,      ///< indexing symbol names
+  PROFILE_STAGES,     ///< number of stages, not a stage itself
+} profile_stage_t;
+
+/// a point in time, as seen by the calling thread
+typedef struct {
+  uint64_t wall; ///< monotonic time in nanoseconds
+  uint64_t cpu;  ///< CPU time of the calling thread in nanoseconds
+} profile_mark_t;
+
+/// timing of the processing of a single file
+typedef struct {
+  const char *path;              ///< absolute path to the file
+  const char *parser;            ///< parser used, or `NULL` if not parsed
+  uint64_t wall[PROFILE_PHASES]; ///< wall time spent in each phase
+  uint64_t cpu[PROFILE_PHASES];  ///< thread CPU time spent in each phase
+  uint64_t insert_wait; ///< time waiting for other threads’ symbol insertions
+  uint64_t insert;      ///< time spent inserting symbols
+  uint64_t lock_wait;   ///< time waiting for build bookkeeping locks
+} profile_file_t;
+
+typedef struct profile profile_t;
+
+/** get the name of a file processing phase
+ *
+ * \param phase Phase to describe
+ * \return A static string naming the phase
+ */
+const char *profile_phase_name(profile_phase_t phase);
+
+/** get the name of a build stage
+ *
+ * \param stage Stage to describe
+ * \return A static string naming the stage
+ */
+const char *profile_stage_name(profile_stage_t stage);
+
+/** create a new, empty profile
+ *
+ * \param profile [out] Created profile on success
+ * \param threads Number of threads that will contribute to the profile
+ * \return 0 on success or an errno on failure
+ */
+int profile_new(profile_t **profile, size_t threads);
+
+/** note the current time
+ *
+ * \return A mark for the calling thread
+ */
+profile_mark_t profile_mark(void);
+
+/** attribute time elapsed since a mark to a phase of a file
+ *
+ * \param file File being processed
+ * \param phase Phase the time was spent in
+ * \param since [inout] Mark to measure from, which is then updated to now
+ */
+void profile_lap(profile_file_t *file, profile_phase_t phase,
+                 profile_mark_t *since);
+
+/** lock a mutex, accounting for any time spent waiting
+ *
+ * \param mutex Mutex to lock
+ * \param waited [inout] Accumulator for nanoseconds spent waiting, or `NULL`
+ *   if this is not of interest
+ */
+void profile_lock(pthread_mutex_t *mutex, uint64_t *waited);
+
+/** record the timing of a processed file
+ *
+ * Each thread has its own storage, so this does not contend with other
+ * threads.
+ *
+ * \param profile Profile to update
+ * \param thread_id Thread that processed the file
+ * \param file Timing to record, whose path is copied
+ * \return 0 on success or an errno on failure
+ */
+int profile_file(profile_t *profile, unsigned long thread_id,
+                 const profile_file_t *file);
+
+/** record time a thread spent waiting for work
+ *
+ * \param profile Profile to update
+ * \param thread_id Thread that waited
+ * \param wall Nanoseconds spent waiting
+ */
+void profile_idle(profile_t *profile, unsigned long thread_id, uint64_t wall);
+
+/** record the time taken by a stage of the build
+ *
+ * \param profile Profile to update
+ * \param stage Stage that completed
+ * \param wall Nanoseconds the stage took
+ */
+void profile_stage(profile_t *profile, profile_stage_t stage, uint64_t wall);
+
+/** write a profile to a file as JSON
+ *
+ * \param profile Profile to write
+ * \param path Path of the file to write
+ * \return 0 on success or an errno on failure
+ */
+int profile_write(const profile_t *profile, const char *path);
+
+/** deallocate a profile
+ *
+ * \param profile Profile to destroy
+ */
+void profile_free(profile_t **profile);
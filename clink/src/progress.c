@@ -95,9 +95,12 @@ static void update(unsigned long thread_id, char *line) {
 static void progress(void) {
   assert(done <= total && "progress exceeding total item count");
 
+  // how much of the work is complete?
+  const double fraction = total == 0 ? 0 : (double)done / total;
+
   // print progress
   const int printed =
-      printf("%zu / %zu (%.02f%%) ", done, total, (double)done / total * 100);
+      printf("%zu / %zu (%.02f%%) ", done, total, fraction * 100);
 
   // determine terminal width
   struct winsize ws = {0};
@@ -111,8 +114,7 @@ static void progress(void) {
     // how many segments of `9 × available` should be filled?
     const char *blocks[] = {" ", "▏", "▎", "▍", "▌", "▋", "▊", "▉", "█"};
     const size_t blocks_len = sizeof(blocks) / sizeof(blocks[0]);
-    const size_t filled =
-        (size_t)(available * blocks_len * (double)done / total);
+    const size_t filled = (size_t)(available * blocks_len * fraction);
 
     for (size_t i = 0; i < available; ++i) {
       if (filled < blocks_len * i) {
@@ -242,11 +244,22 @@ void progress_error(unsigned long thread_id, const char *fmt, ...) {
   update(thread_id, base);
 }
 
+void progress_set_total(size_t count) {
+
+  flockfile(stdout);
+
+  if (count > total)
+    total = count;
+
+  funlockfile(stdout);
+}
+
 void progress_increment(void) {
-  assert(done < total && "progress exceeding total item count");
 
   flockfile(stdout);
 
+  assert(done < total && "progress exceeding total item count");
+
   // move to the beginning of the line
   if (smart_progress())
     printf("\033[1G");
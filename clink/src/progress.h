@@ -40,10 +40,19 @@ PRINTF(2, 3) void progress_warn(unsigned long thread_id, const char *fmt, ...);
  */
 PRINTF(2, 3) void progress_error(unsigned long thread_id, const char *fmt, ...);
 
+/** raise the total number of items to process
+ *
+ * This is for when work is discovered while it is being processed. A `count`
+ * less than the current total is ignored.
+ *
+ * \param count New total number of items the caller needs to process
+ */
+void progress_set_total(size_t count);
+
 /** add one to the progress counter
  *
  * It is assumed that the total number of times this will ever be called is ≤
- * `count` passed in `progress_init`.
+ * the total from `progress_init` or `progress_set_total`.
  */
 void progress_increment(void);
 
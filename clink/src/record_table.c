@@ -0,0 +1,288 @@
+#include "record_table.h"
+#include "hash.h"
+#include <assert.h>
+#include <clink/clink.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// an entry in the hash table
+typedef struct {
+  clink_record_t record;
+  bool forgotten; ///< has `record_table_forget` been called on this?
+  bool seen;      ///< has `record_table_mark` been called on this? (atomic)
+} slot_t;
+
+struct record_table {
+
+  /// open-addressed hash table of records, with `NULL` paths for empty slots
+  slot_t *slots;
+  size_t capacity; ///< a power of 2
+
+  /// number of occupied slots
+  size_t count;
+
+  /// totals over records whose parse cost is known
+  uint64_t size;
+  uint64_t duration;
+};
+
+/// find the slot that does or would contain a given path
+static size_t slot_of(const record_table_t *rt, const char *path) {
+  assert(rt != NULL);
+  assert(rt->capacity > 0);
+  assert(path != NULL);
+
+  const size_t mask = rt->capacity - 1;
+  size_t i = (size_t)hash(path, strlen(path)) & mask;
+  while (rt->slots[i].record.path != NULL &&
+         strcmp(rt->slots[i].record.path, path) != 0)
+    i = (i + 1) & mask;
+  return i;
+}
+
+/// double the number of slots in a table
+static int grow(record_table_t *rt) {
+  assert(rt != NULL);
+
+  record_table_t bigger = *rt;
+  bigger.capacity = rt->capacity == 0 ? 1024 : rt->capacity * 2;
+  bigger.slots = calloc(bigger.capacity, sizeof(bigger.slots[0]));
+  if (bigger.slots == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < rt->capacity; ++i) {
+    if (rt->slots[i].record.path != NULL)
+      bigger.slots[slot_of(&bigger, rt->slots[i].record.path)] = rt->slots[i];
+  }
+
+  free(rt->slots);
+  *rt = bigger;
+  return 0;
+}
+
+/// `clink_db_get_records` callback to add a record to the table
+static int add(const clink_record_t *record, void *context) {
+  assert(record != NULL);
+  assert(context != NULL);
+
+  record_table_t *rt = context;
+  int rc = 0;
+
+  // keep the table at most half full
+  if (rt->count >= rt->capacity / 2) {
+    if ((rc = grow(rt)))
+      return rc;
+  }
+
+  const size_t i = slot_of(rt, record->path);
+  if (rt->slots[i].record.path != NULL)
+    return EALREADY;
+
+  char *path = strdup(record->path);
+  if (path == NULL)
+    return ENOMEM;
+
+  rt->slots[i] = (slot_t){.record = *record};
+  rt->slots[i].record.path = path;
+  ++rt->count;
+
+  if (record->size > 0 && record->duration > 0) {
+    rt->size += record->size;
+    rt->duration += record->duration;
+  }
+
+  return 0;
+}
+
+int record_table_new(record_table_t **rt, clink_db_t *db) {
+
+  if (rt == NULL)
+    return EINVAL;
+
+  if (db == NULL)
+    return EINVAL;
+
+  record_table_t *r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    return ENOMEM;
+
+  int rc = 0;
+
+  if ((rc = grow(r)))
+    goto done;
+
+  if ((rc = clink_db_get_records(db, add, r)))
+    goto done;
+
+done:
+  if (rc) {
+    record_table_free(&r);
+  } else {
+    *rt = r;
+  }
+
+  return rc;
+}
+
+const clink_record_t *record_table_find(const record_table_t *rt,
+                                        const char *path) {
+  assert(rt != NULL);
+  assert(path != NULL);
+
+  const size_t i = slot_of(rt, path);
+  if (rt->slots[i].record.path == NULL || rt->slots[i].forgotten)
+    return NULL;
+  return &rt->slots[i].record;
+}
+
+void record_table_forget(record_table_t *rt, const char *path) {
+  assert(rt != NULL);
+  assert(path != NULL);
+
+  // we leave the entry in place, so as not to break the probe sequence of any
+  // other entries that collided with it
+  const size_t i = slot_of(rt, path);
+  if (rt->slots[i].record.path != NULL)
+    rt->slots[i].forgotten = true;
+}
+
+void record_table_mark(record_table_t *rt, const char *path) {
+  assert(rt != NULL);
+  assert(path != NULL);
+
+  const size_t i = slot_of(rt, path);
+  if (rt->slots[i].record.path != NULL)
+    __atomic_store_n(&rt->slots[i].seen, true, __ATOMIC_RELEASE);
+}
+
+/// append a path to a dynamically growing array
+static int append(const char ***paths, size_t *count, size_t *size,
+                  const char *path) {
+
+  assert(paths != NULL);
+  assert(count != NULL);
+  assert(size != NULL);
+
+  if (*count == *size) {
+    const size_t s = *size == 0 ? 128 : *size * 2;
+    const char **n = realloc(*paths, s * sizeof((*paths)[0]));
+    if (n == NULL)
+      return ENOMEM;
+    *paths = n;
+    *size = s;
+  }
+  (*paths)[*count] = path;
+  ++*count;
+
+  return 0;
+}
+
+int record_table_unseen(const record_table_t *rt, const char ***paths,
+                        size_t *count) {
+
+  if (rt == NULL)
+    return EINVAL;
+
+  if (paths == NULL)
+    return EINVAL;
+
+  if (count == NULL)
+    return EINVAL;
+
+  const char **p = NULL;
+  size_t c = 0;
+  size_t size = 0;
+
+  for (size_t i = 0; i < rt->capacity; ++i) {
+    const slot_t *slot = &rt->slots[i];
+    if (slot->record.path == NULL)
+      continue;
+    if (__atomic_load_n(&slot->seen, __ATOMIC_ACQUIRE))
+      continue;
+
+    if (append(&p, &c, &size, slot->record.path) != 0) {
+      free(p);
+      return ENOMEM;
+    }
+  }
+
+  *paths = p;
+  *count = c;
+  return 0;
+}
+
+int record_table_unseen_within(const record_table_t *rt, const char *path,
+                               const char ***paths, size_t *count) {
+
+  if (rt == NULL)
+    return EINVAL;
+
+  if (path == NULL)
+    return EINVAL;
+
+  if (paths == NULL)
+    return EINVAL;
+
+  if (count == NULL)
+    return EINVAL;
+
+  // ignore any trailing slash, so a directory matches with or without one
+  size_t len = strlen(path);
+  while (len > 1 && path[len - 1] == '/')
+    --len;
+
+  const char **p = NULL;
+  size_t c = 0;
+  size_t size = 0;
+
+  for (size_t i = 0; i < rt->capacity; ++i) {
+    const slot_t *slot = &rt->slots[i];
+    if (slot->record.path == NULL)
+      continue;
+    if (__atomic_load_n(&slot->seen, __ATOMIC_ACQUIRE))
+      continue;
+    const char *r = slot->record.path;
+    if (strncmp(r, path, len) != 0)
+      continue;
+    if (r[len] != '\0' && r[len] != '/' && !(len == 1 && path[0] == '/'))
+      continue;
+
+    if (append(&p, &c, &size, r) != 0) {
+      free(p);
+      return ENOMEM;
+    }
+  }
+
+  *paths = p;
+  *count = c;
+  return 0;
+}
+
+void record_table_cost(const record_table_t *rt, uint64_t *size,
+                       uint64_t *duration) {
+  assert(rt != NULL);
+  assert(size != NULL);
+  assert(duration != NULL);
+
+  *size = rt->size;
+  *duration = rt->duration;
+}
+
+void record_table_free(record_table_t **rt) {
+
+  if (rt == NULL || *rt == NULL)
+    return;
+
+  record_table_t *r = *rt;
+
+  for (size_t i = 0; i < r->capacity; ++i)
+    free((char *)r->slots[i].record.path);
+  free(r->slots);
+
+  free(r);
+  *rt = NULL;
+}
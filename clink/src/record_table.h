@@ -0,0 +1,94 @@
+// in-memory copy of the file records in a database
+
+#pragma once
+
+#include <clink/clink.h>
+#include <stdint.h>
+
+/// opaque pointer to a record table
+typedef struct record_table record_table_t;
+
+/** load all file records from a database
+ *
+ * The created table is a snapshot, and does not reflect later changes to the
+ * database. Once created, it is safe for multiple threads to query the table
+ * concurrently.
+ *
+ * \param rt [out] Created table on success
+ * \param db Database whose records to load
+ * \return 0 on success or an errno on failure
+ */
+int record_table_new(record_table_t **rt, clink_db_t *db);
+
+/** find the record for a given file
+ *
+ * \param rt Table to search
+ * \param path Absolute path of the file to lookup
+ * \return The file’s record, or `NULL` if there was none
+ */
+const clink_record_t *record_table_find(const record_table_t *rt,
+                                        const char *path);
+
+/** mark a record as no longer reflecting the database
+ *
+ * Following this, `record_table_find` will not find `path`. This must not be
+ * called concurrently with any other operation on the table.
+ *
+ * \param rt Table to operate on
+ * \param path Absolute path of the file whose record to forget
+ */
+void record_table_forget(record_table_t *rt, const char *path);
+
+/** note that a file has been seen on disk
+ *
+ * This is thread-safe, and may be called concurrently with
+ * `record_table_find`. Paths that have no record are ignored.
+ *
+ * \param rt Table to operate on
+ * \param path Absolute path of the file that was seen
+ */
+void record_table_mark(record_table_t *rt, const char *path);
+
+/** find records whose files have not been seen
+ *
+ * On success, the caller should free `paths` but not its entries, which
+ * remain valid until the table is freed.
+ *
+ * \param rt Table to inspect
+ * \param paths [out] Absolute paths of records not passed to
+ *   `record_table_mark`
+ * \param count [out] Number of entries in `paths`
+ * \return 0 on success or an errno on failure
+ */
+int record_table_unseen(const record_table_t *rt, const char ***paths,
+                        size_t *count);
+
+/** find records not yet marked of a file or of the files within a directory
+ *
+ * This is `record_table_unseen` limited to a single file or directory tree.
+ * On success, the caller should free `paths` but not its entries, which
+ * remain valid until the table is freed.
+ *
+ * \param rt Table to inspect
+ * \param path Absolute path of a file or directory
+ * \param paths [out] Absolute paths of unmarked records at or beneath `path`
+ * \param count [out] Number of entries in `paths`
+ * \return 0 on success or an errno on failure
+ */
+int record_table_unseen_within(const record_table_t *rt, const char *path,
+                               const char ***paths, size_t *count);
+
+/** sum the costs of all records whose parse cost is known
+ *
+ * \param rt Table to inspect
+ * \param size [out] Total size of these files in bytes
+ * \param duration [out] Total time spent parsing these files in nanoseconds
+ */
+void record_table_cost(const record_table_t *rt, uint64_t *size,
+                       uint64_t *duration);
+
+/** deallocate a record table
+ *
+ * \param rt Table to destroy
+ */
+void record_table_free(record_table_t **rt);
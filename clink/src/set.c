@@ -4,15 +4,19 @@
 #include <stdlib.h>
 #include <string.h>
 
+/// initial number of buckets, which must be a power of 2
 enum { BUCKETS = 1024 };
 
 typedef struct set_node {
-  char *value;
   struct set_node *next;
+  uint64_t hash; ///< hash of `value`, kept to make resizing cheap
+  char value[];  ///< the string itself, stored inline to save an allocation
 } set_node_t;
 
 struct set {
-  set_node_t *nodes[BUCKETS];
+  set_node_t **nodes; ///< hash table of entries
+  size_t buckets;     ///< number of entries in `nodes`
+  size_t size;        ///< number of strings in the set
 };
 
 int set_new(set_t **s) {
@@ -24,6 +28,13 @@ int set_new(set_t **s) {
   if (set == NULL)
     return ENOMEM;
 
+  set->nodes = calloc(BUCKETS, sizeof(set->nodes[0]));
+  if (set->nodes == NULL) {
+    free(set);
+    return ENOMEM;
+  }
+  set->buckets = BUCKETS;
+
   *s = set;
   return 0;
 }
@@ -84,6 +95,31 @@ static uint64_t hash(const char *key) {
   return h;
 }
 
+/// double the number of buckets in a set
+static int grow(set_t *s) {
+
+  const size_t buckets = s->buckets * 2;
+  set_node_t **nodes = calloc(buckets, sizeof(nodes[0]));
+  if (nodes == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < s->buckets; ++i) {
+    for (set_node_t *n = s->nodes[i]; n != NULL;) {
+      set_node_t *next = n->next;
+      const size_t bucket = n->hash & (buckets - 1);
+      n->next = nodes[bucket];
+      nodes[bucket] = n;
+      n = next;
+    }
+  }
+
+  free(s->nodes);
+  s->nodes = nodes;
+  s->buckets = buckets;
+
+  return 0;
+}
+
 int set_add(set_t *s, const char **item) {
 
   if (s == NULL)
@@ -95,29 +131,36 @@ int set_add(set_t *s, const char **item) {
   if (*item == NULL)
     return EINVAL;
 
-  uint64_t bucket = hash(*item) % BUCKETS;
+  const uint64_t h = hash(*item);
+  size_t bucket = h & (s->buckets - 1);
 
   // check if this item already exists
-  for (const set_node_t *n = s->nodes[bucket]; n != NULL; n = n->next) {
-    if (strcmp(n->value, *item) == 0) {
+  for (set_node_t *n = s->nodes[bucket]; n != NULL; n = n->next) {
+    if (n->hash == h && strcmp(n->value, *item) == 0) {
       *item = n->value;
       return EALREADY;
     }
   }
 
-  set_node_t *n = calloc(1, sizeof(*n));
+  // Keep chains short as the set grows, so very large sets stay fast. If we
+  // cannot, carry on with longer chains.
+  if (s->size >= s->buckets) {
+    if (grow(s) == 0)
+      bucket = h & (s->buckets - 1);
+  }
+
+  const size_t len = strlen(*item);
+  set_node_t *n = malloc(sizeof(*n) + len + 1);
   if (n == NULL)
     return ENOMEM;
 
-  n->value = strdup(*item);
-  if (n->value == NULL) {
-    free(n);
-    return ENOMEM;
-  }
+  n->hash = h;
+  memcpy(n->value, *item, len + 1);
   *item = n->value;
 
   n->next = s->nodes[bucket];
   s->nodes[bucket] = n;
+  ++s->size;
 
   return 0;
 }
@@ -129,16 +172,15 @@ void set_free(set_t **s) {
 
   set_t *set = *s;
 
-  for (size_t i = 0; i < BUCKETS; ++i) {
+  for (size_t i = 0; i < set->buckets; ++i) {
     for (set_node_t *n = set->nodes[i]; n != NULL;) {
       set_node_t *next = n->next;
-      free(n->value);
       free(n);
       n = next;
     }
-    set->nodes[i] = NULL;
   }
 
+  free(set->nodes);
   free(set);
   *s = NULL;
 }
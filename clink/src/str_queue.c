@@ -1,40 +1,74 @@
 #include "str_queue.h"
+#include "../../common/compiler.h"
 #include "set.h"
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+/// a string waiting in the queue
+typedef struct {
+  const char *str;
+  uint64_t priority;
+  size_t order; ///< number of strings pushed before this one
+} entry_t;
+
 struct str_queue {
 
   /// strings we have previously added to the queue
   set_t *seen;
 
-  /// backing memory for the queue
-  const char **base;
+  /// backing memory for the queue, arranged as a binary heap
+  entry_t *base;
   size_t capacity;
 
-  /// data curently within the backing memory above
-  size_t head;
-  size_t tail;
+  /// number of entries within the heap
+  size_t size;
+
+  /// number of strings ever pushed
+  size_t total;
+
+  /// may producers still push more strings?
+  bool open;
+
+  /// guard for all the above
+  pthread_mutex_t lock;
+
+  /// signalled when a string is pushed or the queue is closed
+  pthread_cond_t change;
 };
 
 static void check_invariant(const str_queue_t *sq) {
 
-  size_t head = __atomic_load_n(&sq->head, __ATOMIC_ACQUIRE);
-
-  // head should be within the allocated region
-  assert(head <= sq->capacity);
+  size_t size = __atomic_load_n(&sq->size, __ATOMIC_ACQUIRE);
+  size_t total = __atomic_load_n(&sq->total, __ATOMIC_ACQUIRE);
 
-  // tail should be within the allocated region
-  assert(sq->tail <= sq->capacity);
+  // the heap should be within the allocated region
+  assert(size <= sq->capacity);
 
-  // head should precede tail
-  assert(head <= sq->tail);
+  // we cannot contain more than we have been given
+  assert(size <= total);
 
   (void)sq;
-  (void)head;
+  (void)size;
+  (void)total;
+}
+
+/// should entry `a` be popped before entry `b`?
+static bool precedes(const entry_t *a, const entry_t *b) {
+  if (a->priority != b->priority)
+    return a->priority > b->priority;
+  return a->order < b->order;
+}
+
+/// swap two entries in the heap
+static void swap(str_queue_t *sq, size_t a, size_t b) {
+  const entry_t tmp = sq->base[a];
+  sq->base[a] = sq->base[b];
+  sq->base[b] = tmp;
 }
 
 int str_queue_new(str_queue_t **sq) {
@@ -48,6 +82,17 @@ int str_queue_new(str_queue_t **sq) {
 
   int rc = 0;
 
+  if ((rc = pthread_mutex_init(&q->lock, NULL))) {
+    free(q);
+    return rc;
+  }
+
+  if ((rc = pthread_cond_init(&q->change, NULL))) {
+    (void)pthread_mutex_destroy(&q->lock);
+    free(q);
+    return rc;
+  }
+
   if ((rc = set_new(&q->seen)))
     goto done;
 
@@ -62,18 +107,30 @@ done:
   return rc;
 }
 
-int str_queue_push(str_queue_t *sq, const char *str) {
+/// change whether producers may still push, waking any waiting consumers
+static void set_open(str_queue_t *sq, bool open) {
+  assert(sq != NULL);
 
-  if (sq == NULL)
-    return EINVAL;
+  int r UNUSED = pthread_mutex_lock(&sq->lock);
+  assert(r == 0);
 
-  if (str == NULL)
-    return EINVAL;
+  sq->open = open;
 
-  check_invariant(sq);
+  r = pthread_cond_broadcast(&sq->change);
+  assert(r == 0);
+
+  r = pthread_mutex_unlock(&sq->lock);
+  assert(r == 0);
+}
 
-  assert(sq->head == 0 &&
-         "head and base are out of sync; pop in str_queue phase 1?");
+void str_queue_open(str_queue_t *sq) { set_open(sq, true); }
+
+void str_queue_close(str_queue_t *sq) { set_open(sq, false); }
+
+/// add a string to the queue, with `sq->lock` held
+static int push(str_queue_t *sq, const char *str, uint64_t priority) {
+
+  check_invariant(sq);
 
   // check if we have already seen this string
   int rc = set_add(sq->seen, &str);
@@ -81,12 +138,12 @@ int str_queue_push(str_queue_t *sq, const char *str) {
     return rc;
 
   // do we need to expand the backing memory?
-  if (sq->capacity == sq->tail) {
+  if (sq->capacity == sq->size) {
     size_t new_capacity = sq->capacity * 2;
     if (new_capacity == 0)
       new_capacity = 4096 / sizeof(sq->base[0]);
 
-    const char **b = realloc(sq->base, new_capacity * sizeof(sq->base[0]));
+    entry_t *b = realloc(sq->base, new_capacity * sizeof(sq->base[0]));
     if (b == NULL)
       return ENOMEM;
 
@@ -96,16 +153,121 @@ int str_queue_push(str_queue_t *sq, const char *str) {
     check_invariant(sq);
   }
 
-  assert(sq->tail < sq->capacity);
-  sq->base[sq->tail] = str;
-  ++sq->tail;
+  // append the new entry and sift it up to its place in the heap
+  assert(sq->size < sq->capacity);
+  size_t i = sq->size;
+  sq->base[i] = (entry_t){.str = str, .priority = priority, .order = sq->total};
+  while (i > 0 && precedes(&sq->base[i], &sq->base[(i - 1) / 2])) {
+    swap(sq, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+  __atomic_store_n(&sq->size, sq->size + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&sq->total, sq->total + 1, __ATOMIC_RELEASE);
 
   return 0;
 }
 
+int str_queue_push(str_queue_t *sq, const char *str) {
+  return str_queue_push_priority(sq, str, 0);
+}
+
+int str_queue_push_priority(str_queue_t *sq, const char *str,
+                            uint64_t priority) {
+
+  if (sq == NULL)
+    return EINVAL;
+
+  if (str == NULL)
+    return EINVAL;
+
+  int r UNUSED = pthread_mutex_lock(&sq->lock);
+  assert(r == 0);
+
+  const int rc = push(sq, str, priority);
+
+  // wake any consumers that may be waiting for this string
+  if (rc == 0) {
+    r = pthread_cond_broadcast(&sq->change);
+    assert(r == 0);
+  }
+
+  r = pthread_mutex_unlock(&sq->lock);
+  assert(r == 0);
+
+  return rc;
+}
+
+int str_queue_push_all(str_queue_t *sq, size_t count, const char **strs,
+                       const uint64_t *priorities) {
+
+  if (sq == NULL)
+    return EINVAL;
+
+  if (count > 0 && strs == NULL)
+    return EINVAL;
+
+  if (count > 0 && priorities == NULL)
+    return EINVAL;
+
+  int r UNUSED = pthread_mutex_lock(&sq->lock);
+  assert(r == 0);
+
+  int rc = 0;
+  bool added = false;
+  for (size_t i = 0; i < count; ++i) {
+    if (strs[i] == NULL) {
+      rc = EINVAL;
+      break;
+    }
+    rc = push(sq, strs[i], priorities[i]);
+    if (rc == EALREADY) {
+      rc = 0;
+      continue;
+    }
+    if (rc != 0)
+      break;
+    added = true;
+  }
+
+  // wake any consumers that may be waiting for these strings
+  if (added) {
+    r = pthread_cond_broadcast(&sq->change);
+    assert(r == 0);
+  }
+
+  r = pthread_mutex_unlock(&sq->lock);
+  assert(r == 0);
+
+  return rc;
+}
+
 size_t str_queue_size(const str_queue_t *sq) {
   assert(sq != NULL);
-  return sq->tail - sq->head;
+  return __atomic_load_n(&sq->size, __ATOMIC_ACQUIRE);
+}
+
+size_t str_queue_total(const str_queue_t *sq) {
+  assert(sq != NULL);
+  return __atomic_load_n(&sq->total, __ATOMIC_ACQUIRE);
+}
+
+size_t str_queue_wait(str_queue_t *sq, size_t count) {
+  assert(sq != NULL);
+
+  int r UNUSED = pthread_mutex_lock(&sq->lock);
+  assert(r == 0);
+
+  while (sq->open && sq->total < count) {
+    r = pthread_cond_wait(&sq->change, &sq->lock);
+    assert(r == 0);
+  }
+
+  const size_t total = sq->total;
+
+  r = pthread_mutex_unlock(&sq->lock);
+  assert(r == 0);
+
+  return total;
 }
 
 int str_queue_pop(str_queue_t *sq, const char **str) {
@@ -116,25 +278,48 @@ int str_queue_pop(str_queue_t *sq, const char **str) {
   if (str == NULL)
     return EINVAL;
 
+  int r UNUSED = pthread_mutex_lock(&sq->lock);
+  assert(r == 0);
+
   check_invariant(sq);
 
-  // we can read tail unsynchronised because it is not modified since the last
-  // multithreading sequence point, but we need to protect our read of head
-  size_t head = __atomic_load_n(&sq->head, __ATOMIC_ACQUIRE);
-  size_t tail = sq->tail;
+  // wait for a string to become available, if more may yet arrive
+  while (sq->open && sq->size == 0) {
+    r = pthread_cond_wait(&sq->change, &sq->lock);
+    assert(r == 0);
+  }
 
-  do {
-    // is the queue empty?
-    if (head == tail)
-      return ENOMSG;
+  int rc = 0;
 
-    *str = sq->base[head];
+  // is the queue empty?
+  if (sq->size == 0) {
+    rc = ENOMSG;
+  } else {
+    *str = sq->base[0].str;
+
+    // move the last entry to the root and sift it down to its place
+    const size_t size = sq->size - 1;
+    sq->base[0] = sq->base[size];
+    for (size_t i = 0;;) {
+      size_t first = i;
+      const size_t left = 2 * i + 1;
+      const size_t right = 2 * i + 2;
+      if (left < size && precedes(&sq->base[left], &sq->base[first]))
+        first = left;
+      if (right < size && precedes(&sq->base[right], &sq->base[first]))
+        first = right;
+      if (first == i)
+        break;
+      swap(sq, i, first);
+      i = first;
+    }
+    __atomic_store_n(&sq->size, size, __ATOMIC_RELEASE);
+  }
 
-    // try to remove the head
-  } while (!__atomic_compare_exchange_n(&sq->head, &head, head + 1, true,
-                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+  r = pthread_mutex_unlock(&sq->lock);
+  assert(r == 0);
 
-  return 0;
+  return rc;
 }
 
 void str_queue_free(str_queue_t **sq) {
@@ -146,6 +331,9 @@ void str_queue_free(str_queue_t **sq) {
 
   set_free(&(*sq)->seen);
 
+  (void)pthread_cond_destroy(&(*sq)->change);
+  (void)pthread_mutex_destroy(&(*sq)->lock);
+
   free(*sq);
   *sq = NULL;
 }
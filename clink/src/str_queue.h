@@ -3,6 +3,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 /// opaque pointer to a queue structure
 typedef struct str_queue str_queue_t;
@@ -14,12 +15,28 @@ typedef struct str_queue str_queue_t;
  */
 int str_queue_new(str_queue_t **sq);
 
+/** indicate more strings may be pushed to a queue
+ *
+ * While a queue is open, `str_queue_pop` waits for a string to arrive instead
+ * of reporting that the queue is empty. This lets consumers begin work while
+ * producers are still running.
+ *
+ * \param sq Queue to operate on
+ */
+void str_queue_open(str_queue_t *sq);
+
+/** indicate no more strings will be pushed to a queue
+ *
+ * Any consumers waiting in `str_queue_pop` or `str_queue_wait` are woken.
+ *
+ * \param sq Queue to operate on
+ */
+void str_queue_close(str_queue_t *sq);
+
 /** add a new string to queue
  *
- * It is assumed nothing has been popped from the queue when you call this
- * function. That is, operation on a `str_queue_t` is expected to proceed in two
- * distinct phases: (1) push elements, (2) pop elements. Interleaving push and
- * pop steps is not supported.
+ * This function is thread-safe, and may be called concurrently with other
+ * pushes and with `str_queue_pop`.
  *
  * \param sq Queue to operate on
  * \param str String to add
@@ -28,6 +45,35 @@ int str_queue_new(str_queue_t **sq);
  */
 int str_queue_push(str_queue_t *sq, const char *str);
 
+/** add a new string to queue, ahead of those with lower priority
+ *
+ * Strings of equal priority are popped in the order they were pushed.
+ * `str_queue_push` is equivalent to calling this with a priority of 0.
+ *
+ * \param sq Queue to operate on
+ * \param str String to add
+ * \param priority Urgency of this string, with greater values popped first
+ * \return 0 on success if the string was added, EALREADY if the string had
+ *   already been in the queue previously, or another errno on failure
+ */
+int str_queue_push_priority(str_queue_t *sq, const char *str,
+                            uint64_t priority);
+
+/** add multiple strings to a queue at once
+ *
+ * This is equivalent to calling `str_queue_push_priority` for each string,
+ * except that consumers cannot pop any of the strings until all have been
+ * added. Strings that had already been in the queue are skipped.
+ *
+ * \param sq Queue to operate on
+ * \param count Number of strings to add
+ * \param strs Strings to add
+ * \param priorities Priority of each string in `strs`
+ * \return 0 on success or an errno on failure
+ */
+int str_queue_push_all(str_queue_t *sq, size_t count, const char **strs,
+                       const uint64_t *priorities);
+
 /** number of elements in a queue
  *
  * \param sq Queue to inspect
@@ -35,15 +81,33 @@ int str_queue_push(str_queue_t *sq, const char *str);
  */
 size_t str_queue_size(const str_queue_t *sq);
 
-/** remove a string from the head of the queue
+/** number of elements ever added to a queue
+ *
+ * \param sq Queue to inspect
+ * \return Number of elements pushed to this queue, including those since
+ *   popped
+ */
+size_t str_queue_total(const str_queue_t *sq);
+
+/** wait until a queue has received a given number of elements
+ *
+ * \param sq Queue to inspect
+ * \param count Number of elements to wait for
+ * \return Number of elements pushed to this queue, which is less than `count`
+ *   only if the queue is not open
+ */
+size_t str_queue_wait(str_queue_t *sq, size_t count);
+
+/** remove the highest priority string from the queue
  *
  * This function is thread-safe, in the sense that multiple threads can call it
- * concurrently, passing the same `sq`.
+ * concurrently, passing the same `sq`. If the queue is empty but open, this
+ * blocks until a string is pushed or the queue is closed.
  *
  * \param sq Queue to operate on
  * \param str [out] String that was popped
- * \return 0 if a string was popped, ENOMSG if the queue was empty, or an errno
- *   on failure
+ * \return 0 if a string was popped, ENOMSG if the queue was empty and closed,
+ *   or an errno on failure
  */
 int str_queue_pop(str_queue_t *sq, const char **str);
 
@@ -0,0 +1,336 @@
+#include "throttle.h"
+#include "../../common/compiler.h"
+#include "clock.h"
+#include "debug.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/// minimum nanoseconds over which to measure throughput before adjusting
+static const uint64_t WINDOW = 1000000000;
+
+/// fraction of worker time spent waiting on the database beyond which adding
+/// workers only adds contention
+static const double CONTENDED = 0.25;
+
+/// relative change in throughput we treat as real rather than noise
+static const double SIGNIFICANT = 0.05;
+
+/// number of windows to leave the limit alone for after backing off
+static const unsigned HOLD = 5;
+
+/// milliseconds to wait before checking available memory again
+static const long MEMORY_POLL_MS = 100;
+
+struct throttle {
+  pthread_mutex_t lock;  ///< guard for all following fields
+  pthread_cond_t change; ///< signalled when `limit` or `clang_running` falls
+  size_t threads;        ///< number of workers
+  size_t limit;          ///< number of workers permitted to run
+  bool adapt;            ///< should `limit` be adjusted?
+  bool released;         ///< have all workers been permanently allowed to run?
+
+  uint64_t clang_estimate; ///< bytes we expect a libclang parse to need
+  size_t clang_running;    ///< number of libclang parses in progress
+
+  // measurements over the current window
+  uint64_t window_start; ///< when the window began
+  uint64_t bytes;        ///< bytes of files processed
+  size_t files;          ///< number of files processed
+  uint64_t waited;       ///< nanoseconds spent waiting on the database
+
+  double last_rate; ///< bytes per second in the previous window
+  int last_move;    ///< direction `limit` was last moved in
+  unsigned hold;    ///< windows remaining before we probe upwards again
+
+  uint64_t (*clock)(void);     ///< source of monotonic nanoseconds
+  uint64_t (*available)(void); ///< source of available memory in bytes
+};
+
+/// bytes of memory the system could give us without swapping
+static uint64_t available(void) {
+#ifdef __linux__
+  FILE *f = fopen("/proc/meminfo", "r");
+  if (f == NULL)
+    return UINT64_MAX;
+
+  uint64_t kb = UINT64_MAX;
+  char line[128];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    unsigned long long n = 0;
+    if (sscanf(line, "MemAvailable: %llu kB", &n) == 1) {
+      kb = (uint64_t)n;
+      break;
+    }
+  }
+  (void)fclose(f);
+
+  if (kb == UINT64_MAX)
+    return UINT64_MAX;
+  return kb * 1024;
+#else
+  // without a way to tell, assume we are unconstrained
+  return UINT64_MAX;
+#endif
+}
+
+int throttle_new(throttle_t **throttle, size_t threads, bool adapt,
+                 uint64_t clang_estimate) {
+
+  if (throttle == NULL)
+    return EINVAL;
+
+  if (threads == 0)
+    return EINVAL;
+
+  throttle_t *t = calloc(1, sizeof(*t));
+  if (UNLIKELY(t == NULL))
+    return ENOMEM;
+
+  int rc = 0;
+
+  if (UNLIKELY((rc = pthread_mutex_init(&t->lock, NULL)))) {
+    free(t);
+    return rc;
+  }
+
+  if (UNLIKELY((rc = pthread_cond_init(&t->change, NULL)))) {
+    (void)pthread_mutex_destroy(&t->lock);
+    free(t);
+    return rc;
+  }
+
+  // start with everyone working, and back off if that proves counterproductive
+  t->threads = threads;
+  t->limit = threads;
+  t->adapt = adapt && threads > 1;
+  t->clang_estimate = clang_estimate;
+  t->clock = now;
+  t->available = available;
+  t->window_start = t->clock();
+
+  *throttle = t;
+  return 0;
+}
+
+void throttle_wait(throttle_t *throttle, unsigned long thread_id) {
+
+  assert(throttle != NULL);
+
+  if (!throttle->adapt)
+    return;
+
+  int r UNUSED = pthread_mutex_lock(&throttle->lock);
+  assert(r == 0);
+
+  while (!throttle->released && thread_id >= throttle->limit) {
+    r = pthread_cond_wait(&throttle->change, &throttle->lock);
+    assert(r == 0);
+  }
+
+  r = pthread_mutex_unlock(&throttle->lock);
+  assert(r == 0);
+}
+
+/// decide on a new limit based on the window just ended
+static void adjust(throttle_t *t, uint64_t elapsed) {
+
+  assert(t != NULL);
+  assert(elapsed > 0);
+
+  const double rate = (double)t->bytes * 1e9 / (double)elapsed;
+  const double contention =
+      (double)t->waited / ((double)elapsed * (double)t->limit);
+  const size_t previous = t->limit;
+
+  const bool worse = rate < t->last_rate * (1 - SIGNIFICANT);
+  const bool better = rate > t->last_rate * (1 + SIGNIFICANT);
+
+  if (contention > CONTENDED && t->limit > 1) {
+    // workers are mostly queueing behind each other’s database writes
+    --t->limit;
+    t->last_move = -1;
+    t->hold = HOLD;
+
+  } else if (worse && t->last_move != 0) {
+    // our last move hurt, so undo it and hold there
+    if (t->last_move > 0 && t->limit > 1) {
+      --t->limit;
+    } else if (t->last_move < 0 && t->limit < t->threads) {
+      ++t->limit;
+    }
+    t->last_move = 0;
+    t->hold = HOLD;
+
+  } else if (t->hold > 0 && !better) {
+    --t->hold;
+    t->last_move = 0;
+
+  } else if (t->limit < t->threads && t->available() >= t->clang_estimate) {
+    // probe whether another worker helps
+    ++t->limit;
+    t->last_move = 1;
+    t->hold = 0;
+
+  } else {
+    t->last_move = 0;
+  }
+
+  t->last_rate = rate;
+
+  if (t->limit != previous) {
+    DEBUG("adjusting active workers from %zu to %zu (%.0f bytes/s, %.0f%% "
+          "waiting on the database)",
+          previous, t->limit, rate, contention * 100);
+    if (t->limit > previous) {
+      int r UNUSED = pthread_cond_broadcast(&t->change);
+      assert(r == 0);
+    }
+  }
+}
+
+void throttle_done(throttle_t *throttle, uint64_t bytes, uint64_t waited) {
+
+  assert(throttle != NULL);
+
+  if (!throttle->adapt)
+    return;
+
+  int r UNUSED = pthread_mutex_lock(&throttle->lock);
+  assert(r == 0);
+
+  throttle->bytes += bytes;
+  ++throttle->files;
+  throttle->waited += waited;
+
+  // wait for a window long enough and containing enough files to be a fair
+  // measure of the current limit
+  const uint64_t t = throttle->clock();
+  const uint64_t elapsed = t - throttle->window_start;
+  if (!throttle->released && elapsed >= WINDOW &&
+      throttle->files >= throttle->limit) {
+    adjust(throttle, elapsed);
+    throttle->window_start = t;
+    throttle->bytes = 0;
+    throttle->files = 0;
+    throttle->waited = 0;
+  }
+
+  r = pthread_mutex_unlock(&throttle->lock);
+  assert(r == 0);
+}
+
+void throttle_release(throttle_t *throttle) {
+
+  assert(throttle != NULL);
+
+  int r UNUSED = pthread_mutex_lock(&throttle->lock);
+  assert(r == 0);
+
+  throttle->released = true;
+  r = pthread_cond_broadcast(&throttle->change);
+  assert(r == 0);
+
+  r = pthread_mutex_unlock(&throttle->lock);
+  assert(r == 0);
+}
+
+void throttle_clang_enter(throttle_t *throttle) {
+
+  assert(throttle != NULL);
+
+  int r UNUSED = pthread_mutex_lock(&throttle->lock);
+  assert(r == 0);
+
+  // Memory in use by running parses is already missing from what is available,
+  // but they may yet grow. So this is a heuristic, not a guarantee.
+  while (throttle->clang_running > 0 &&
+         throttle->available() < throttle->clang_estimate) {
+    struct timespec deadline = {0};
+    (void)clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += MEMORY_POLL_MS * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      ++deadline.tv_sec;
+      deadline.tv_nsec -= 1000000000;
+    }
+    r = pthread_cond_timedwait(&throttle->change, &throttle->lock, &deadline);
+    assert(r == 0 || r == ETIMEDOUT);
+  }
+
+  ++throttle->clang_running;
+
+  r = pthread_mutex_unlock(&throttle->lock);
+  assert(r == 0);
+}
+
+void throttle_clang_exit(throttle_t *throttle) {
+
+  assert(throttle != NULL);
+
+  int r UNUSED = pthread_mutex_lock(&throttle->lock);
+  assert(r == 0);
+
+  assert(throttle->clang_running > 0);
+  --throttle->clang_running;
+  r = pthread_cond_broadcast(&throttle->change);
+  assert(r == 0);
+
+  r = pthread_mutex_unlock(&throttle->lock);
+  assert(r == 0);
+}
+
+size_t throttle_limit(throttle_t *throttle) {
+
+  assert(throttle != NULL);
+
+  int r UNUSED = pthread_mutex_lock(&throttle->lock);
+  assert(r == 0);
+
+  const size_t limit = throttle->limit;
+
+  r = pthread_mutex_unlock(&throttle->lock);
+  assert(r == 0);
+
+  return limit;
+}
+
+void throttle_set_sources(throttle_t *throttle, uint64_t (*clock)(void),
+                          uint64_t (*memory)(void)) {
+
+  assert(throttle != NULL);
+
+  int r UNUSED = pthread_mutex_lock(&throttle->lock);
+  assert(r == 0);
+
+  throttle->clock = clock == NULL ? now : clock;
+  throttle->available = memory == NULL ? available : memory;
+
+  // restart the current window on the new clock
+  throttle->window_start = throttle->clock();
+  throttle->bytes = 0;
+  throttle->files = 0;
+  throttle->waited = 0;
+
+  r = pthread_mutex_unlock(&throttle->lock);
+  assert(r == 0);
+}
+
+void throttle_free(throttle_t **throttle) {
+
+  if (throttle == NULL || *throttle == NULL)
+    return;
+
+  throttle_t *t = *throttle;
+
+  (void)pthread_cond_destroy(&t->change);
+  (void)pthread_mutex_destroy(&t->lock);
+  free(t);
+
+  *throttle = NULL;
+}
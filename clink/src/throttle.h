@@ -0,0 +1,92 @@
+// control of how many worker threads are active during a build
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// A limit on the number of workers processing files at once. Each worker
+/// calls `throttle_wait` before taking on a file, and those beyond the limit
+/// block until it is raised again. If adaptation is enabled, the limit moves
+/// in response to measured throughput, time spent waiting on the database, and
+/// available memory.
+typedef struct throttle throttle_t;
+
+/** create a new throttle
+ *
+ * \param throttle [out] Created throttle on success
+ * \param threads Number of workers
+ * \param adapt Should the limit be adjusted while running? If not, all
+ *   workers are always active and only libclang parses are restrained.
+ * \param clang_estimate Bytes of memory a libclang parse is expected to need
+ * \return 0 on success or an errno on failure
+ */
+int throttle_new(throttle_t **throttle, size_t threads, bool adapt,
+                 uint64_t clang_estimate);
+
+/** wait until the calling worker is permitted to take on work
+ *
+ * \param throttle Throttle to consult
+ * \param thread_id Calling worker
+ */
+void throttle_wait(throttle_t *throttle, unsigned long thread_id);
+
+/** report that a file has been processed
+ *
+ * \param throttle Throttle to update
+ * \param bytes Size of the file
+ * \param waited Nanoseconds spent waiting on other workers’ database writes
+ */
+void throttle_done(throttle_t *throttle, uint64_t bytes, uint64_t waited);
+
+/** permanently allow all workers to run
+ *
+ * This should be called by any worker that stops taking on work, so that
+ * those blocked can see there is no more and exit.
+ *
+ * \param throttle Throttle to update
+ */
+void throttle_release(throttle_t *throttle);
+
+/** wait until there is likely enough memory to begin a libclang parse
+ *
+ * A parse is always admitted if no others are running, so progress is
+ * guaranteed.
+ *
+ * \param throttle Throttle to consult
+ */
+void throttle_clang_enter(throttle_t *throttle);
+
+/** note that a libclang parse admitted by `throttle_clang_enter` has ended
+ *
+ * \param throttle Throttle to update
+ */
+void throttle_clang_exit(throttle_t *throttle);
+
+/** find how many workers are currently permitted to run
+ *
+ * \param throttle Throttle to consult
+ * \return Workers with IDs below this do not block in `throttle_wait`
+ */
+size_t throttle_limit(throttle_t *throttle);
+
+/** replace where a throttle gets the time and available memory from
+ *
+ * This is intended for testing, to make adaptation deterministic. It restarts
+ * the current measurement window.
+ *
+ * \param throttle Throttle to update
+ * \param clock Function returning monotonic nanoseconds, or `NULL` for the
+ *   system’s monotonic clock
+ * \param memory Function returning bytes of available memory, or `NULL` for
+ *   the system’s figure
+ */
+void throttle_set_sources(throttle_t *throttle, uint64_t (*clock)(void),
+                          uint64_t (*memory)(void));
+
+/** deallocate a throttle
+ *
+ * \param throttle Throttle to destroy
+ */
+void throttle_free(throttle_t **throttle);
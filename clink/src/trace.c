@@ -0,0 +1,259 @@
+#include "trace.h"
+#include "../../common/compiler.h"
+#include "clock.h"
+#include "json.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// an activity on the timeline
+typedef struct {
+  const char *name;   ///< what was happening
+  const char *detail; ///< optional refinement of `name`
+  const char *path;   ///< optional file this related to
+  uint64_t start;     ///< monotonic time in nanoseconds the activity began
+  uint64_t end;       ///< monotonic time in nanoseconds the activity finished
+} span_t;
+
+/// number of spans in each block of a lane’s storage
+enum { CHUNK = 1024 };
+
+/// A block of storage for spans. Lanes grow by adding blocks rather than by
+/// reallocating, so recording never has to copy what came before.
+typedef struct chunk {
+  struct chunk *next; ///< following block
+  size_t count;       ///< number of entries in `span` in use
+  span_t span[CHUNK]; ///< recorded activities
+} chunk_t;
+
+/// spans recorded by a single thread
+typedef struct {
+  char *name;        ///< how to label this lane
+  chunk_t *head;     ///< first block of spans
+  chunk_t *tail;     ///< last block of spans
+  char **paths;      ///< paths referenced by spans in this lane
+  size_t paths_len;  ///< number of entries in `paths`
+  size_t paths_size; ///< number of allocated entries in `paths`
+  bool dropped;      ///< were any spans lost to memory exhaustion?
+} lane_t;
+
+struct trace {
+  uint64_t start; ///< when the trace was created
+  size_t lanes;   ///< number of entries in `lane`
+  lane_t lane[];  ///< per-thread timelines
+};
+
+int trace_new(trace_t **trace, size_t lanes) {
+
+  if (trace == NULL)
+    return EINVAL;
+
+  if (lanes == 0)
+    return EINVAL;
+
+  trace_t *t = calloc(1, sizeof(*t) + lanes * sizeof(t->lane[0]));
+  if (t == NULL)
+    return ENOMEM;
+
+  t->start = now();
+  t->lanes = lanes;
+
+  *trace = t;
+  return 0;
+}
+
+int trace_name(trace_t *trace, unsigned long lane, const char *name) {
+
+  if (trace == NULL)
+    return EINVAL;
+
+  if (lane >= trace->lanes)
+    return EINVAL;
+
+  if (name == NULL)
+    return EINVAL;
+
+  char *n = strdup(name);
+  if (UNLIKELY(n == NULL))
+    return ENOMEM;
+
+  free(trace->lane[lane].name);
+  trace->lane[lane].name = n;
+
+  return 0;
+}
+
+const char *trace_path(trace_t *trace, unsigned long lane, const char *path) {
+
+  assert(trace != NULL);
+  assert(lane < trace->lanes);
+  assert(path != NULL);
+
+  lane_t *l = &trace->lane[lane];
+
+  if (l->paths_len == l->paths_size) {
+    const size_t s = l->paths_size == 0 ? 128 : l->paths_size * 2;
+    char **p = realloc(l->paths, s * sizeof(p[0]));
+    if (UNLIKELY(p == NULL)) {
+      l->dropped = true;
+      return NULL;
+    }
+    l->paths = p;
+    l->paths_size = s;
+  }
+
+  char *copy = strdup(path);
+  if (UNLIKELY(copy == NULL)) {
+    l->dropped = true;
+    return NULL;
+  }
+
+  l->paths[l->paths_len] = copy;
+  ++l->paths_len;
+
+  return copy;
+}
+
+void trace_span(trace_t *trace, unsigned long lane, const char *name,
+                const char *detail, const char *path, uint64_t start,
+                uint64_t end) {
+
+  assert(trace != NULL);
+  assert(lane < trace->lanes);
+  assert(name != NULL);
+
+  lane_t *l = &trace->lane[lane];
+
+  if (l->tail == NULL || l->tail->count == CHUNK) {
+    chunk_t *c = malloc(sizeof(*c));
+    if (UNLIKELY(c == NULL)) {
+      l->dropped = true;
+      return;
+    }
+    c->next = NULL;
+    c->count = 0;
+    if (l->tail == NULL) {
+      l->head = c;
+    } else {
+      l->tail->next = c;
+    }
+    l->tail = c;
+  }
+
+  l->tail->span[l->tail->count] = (span_t){
+      .name = name, .detail = detail, .path = path, .start = start, .end = end};
+  ++l->tail->count;
+}
+
+/// write a point in time as microseconds since the trace began
+static void json_time(FILE *out, const trace_t *trace, uint64_t ns) {
+  assert(out != NULL);
+  assert(trace != NULL);
+  const uint64_t since = ns > trace->start ? ns - trace->start : 0;
+  fprintf(out, "%.3f", (double)since / 1e3);
+}
+
+int trace_write(const trace_t *trace, const char *path) {
+
+  if (trace == NULL)
+    return EINVAL;
+
+  if (path == NULL)
+    return EINVAL;
+
+  // a trace with holes in it would be misleading
+  for (size_t i = 0; i < trace->lanes; ++i) {
+    if (trace->lane[i].dropped)
+      return ENOMEM;
+  }
+
+  FILE *out = fopen(path, "w");
+  if (out == NULL)
+    return errno;
+
+  fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n", out);
+  fputs("  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, "
+        "\"args\": {\"name\": \"clink\"}}",
+        out);
+
+  for (size_t i = 0; i < trace->lanes; ++i) {
+    const lane_t *l = &trace->lane[i];
+
+    if (l->name != NULL) {
+      fprintf(out,
+              ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+              "\"tid\": %zu, \"args\": {\"name\": ",
+              i);
+      json_string(out, l->name);
+      fputs("}}", out);
+      // keep lanes in the order we created them, rather than by name
+      fprintf(out,
+              ",\n  {\"name\": \"thread_sort_index\", \"ph\": \"M\", "
+              "\"pid\": 1, \"tid\": %zu, \"args\": {\"sort_index\": %zu}}",
+              i, i);
+    }
+
+    for (const chunk_t *c = l->head; c != NULL; c = c->next) {
+      for (size_t j = 0; j < c->count; ++j) {
+        const span_t *s = &c->span[j];
+        fputs(",\n  {\"name\": \"", out);
+        fputs(s->name, out);
+        if (s->detail != NULL)
+          fprintf(out, " %s", s->detail);
+        fputs("\", \"cat\": \"", out);
+        fputs(s->name, out);
+        fprintf(out, "\", \"ph\": \"X\", \"pid\": 1, \"tid\": %zu, \"ts\": ",
+                i);
+        json_time(out, trace, s->start);
+        fputs(", \"dur\": ", out);
+        fprintf(out, "%.3f",
+                (double)(s->end > s->start ? s->end - s->start : 0) / 1e3);
+        if (s->path != NULL) {
+          fputs(", \"args\": {\"path\": ", out);
+          json_string(out, s->path);
+          fputc('}', out);
+        }
+        fputc('}', out);
+      }
+    }
+  }
+
+  fputs("\n]}\n", out);
+
+  int rc = 0;
+  if (UNLIKELY(ferror(out)))
+    rc = EIO;
+  if (fclose(out) != 0 && rc == 0)
+    rc = errno;
+
+  return rc;
+}
+
+void trace_free(trace_t **trace) {
+
+  if (trace == NULL || *trace == NULL)
+    return;
+
+  trace_t *t = *trace;
+
+  for (size_t i = 0; i < t->lanes; ++i) {
+    lane_t *l = &t->lane[i];
+    free(l->name);
+    for (chunk_t *c = l->head; c != NULL;) {
+      chunk_t *next = c->next;
+      free(c);
+      c = next;
+    }
+    for (size_t j = 0; j < l->paths_len; ++j)
+      free(l->paths[j]);
+    free(l->paths);
+  }
+
+  free(t);
+  *trace = NULL;
+}
@@ -0,0 +1,68 @@
+// recording of a timeline of a build, for viewing in a trace viewer
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// A timeline, divided into lanes. Each lane belongs to a single thread, so
+/// recording into it needs no synchronisation.
+typedef struct trace trace_t;
+
+/** create a new, empty trace
+ *
+ * \param trace [out] Created trace on success
+ * \param lanes Number of lanes the trace will have
+ * \return 0 on success or an errno on failure
+ */
+int trace_new(trace_t **trace, size_t lanes);
+
+/** set the name a lane is shown with
+ *
+ * \param trace Trace to update
+ * \param lane Lane to name
+ * \param name Name to give it, which is copied
+ * \return 0 on success or an errno on failure
+ */
+int trace_name(trace_t *trace, unsigned long lane, const char *name);
+
+/** take a copy of a path, for attaching to spans
+ *
+ * \param trace Trace to update
+ * \param lane Lane the path will be used in
+ * \param path Path to copy
+ * \return A copy that lives as long as the trace, or `NULL` if memory was
+ *   exhausted
+ */
+const char *trace_path(trace_t *trace, unsigned long lane, const char *path);
+
+/** record a span of time
+ *
+ * This does not fail. If memory is exhausted, the span is dropped and the
+ * failure is reported by `trace_write`.
+ *
+ * \param trace Trace to update
+ * \param lane Lane to record into
+ * \param name Static string describing the activity
+ * \param detail Static string refining `name`, or `NULL`
+ * \param path Path from `trace_path` the activity related to, or `NULL`
+ * \param start Monotonic time in nanoseconds the activity began
+ * \param end Monotonic time in nanoseconds the activity finished
+ */
+void trace_span(trace_t *trace, unsigned long lane, const char *name,
+                const char *detail, const char *path, uint64_t start,
+                uint64_t end);
+
+/** write a trace to a file in Chrome’s trace event format
+ *
+ * \param trace Trace to write
+ * \param path Path of the file to write
+ * \return 0 on success or an errno on failure
+ */
+int trace_write(const trace_t *trace, const char *path);
+
+/** deallocate a trace
+ *
+ * \param trace Trace to destroy
+ */
+void trace_free(trace_t **trace);
@@ -57,6 +57,7 @@ static char *cur_dir;
 
 typedef struct {
   clink_symbol_t *rows;
+  bool *looked_up; ///< have we tried to retrieve context for each row?
   size_t count;
   size_t size;
 } results_t;
@@ -64,6 +65,13 @@ typedef struct {
 /// results of the last query we ran
 static results_t results;
 
+/// names similar to that of the last query, if it had no results
+static char **suggestions;
+static size_t suggestions_size;
+
+/// maximum number of similar names to display
+enum { MAX_SUGGESTIONS = 5 };
+
 /// number of result columns excluding the hot key
 enum { COLUMN_COUNT = 4 };
 
@@ -111,6 +119,8 @@ static int find_call(const char *query);
 static int find_caller(const char *query);
 static int find_includer(const char *query);
 static int find_assign(const char *query);
+static int find_call_chain(const char *query);
+static int find_transitive_includer(const char *query);
 
 static const struct searcher {
   const char *prompt;
@@ -122,6 +132,8 @@ static const struct searcher {
     {"Find functions calling this function", find_caller},
     {"Find files #including this file", find_includer},
     {"Find assignments to this symbol", find_assign},
+    {"Find functions transitively calling this function", find_call_chain},
+    {"Find files transitively #including this file", find_transitive_includer},
 };
 
 static const size_t FUNCTIONS_SZ = sizeof(functions) / sizeof(functions[0]);
@@ -143,10 +155,9 @@ static int format_results(clink_iter_t *it) {
 
   int rc = 0;
 
-  // files we have not yet highlighted
-  str_queue_t *to_highlight = NULL;
-  if (UNLIKELY((rc = str_queue_new(&to_highlight))))
-    goto done;
+  // the last file we checked the existence of, and whether it exists
+  const char *checked = NULL;
+  bool exists = false;
 
   while (true) {
 
@@ -158,9 +169,14 @@ static int format_results(clink_iter_t *it) {
       break;
     }
 
-    // skip if the containing file has been deleted or moved
-    assert(symbol->path != NULL);
-    if (UNLIKELY(access(symbol->path, F_OK) < 0))
+    // Skip if the containing file has been deleted or moved since the database
+    // was last built. Results from the same file are usually adjacent and have
+    // identical path pointers, so we only need to check when this changes.
+    if (symbol->path != checked) {
+      checked = symbol->path;
+      exists = access(symbol->path, F_OK) == 0;
+    }
+    if (UNLIKELY(!exists))
       continue;
 
     // If this duplicates the previous result, skip it. This can happen when,
@@ -182,6 +198,12 @@ static int format_results(clink_iter_t *it) {
         goto done;
       }
       results.rows = r;
+      bool *l = realloc(results.looked_up, s * sizeof(results.looked_up[0]));
+      if (UNLIKELY(l == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+      results.looked_up = l;
       results.size = s;
     }
 
@@ -189,12 +211,84 @@ static int format_results(clink_iter_t *it) {
     clink_symbol_t *target = &results.rows[results.count];
     if (UNLIKELY((rc = clink_symbol_copy(target, symbol))))
       break;
+    // context is retrieved later, only for the rows that get displayed
+    results.looked_up[results.count] = false;
     ++results.count;
+  }
+
+done:
+
+  spinner_off();
+  {
+    size_t rows = screen_get_rows();
+    move(rows - FUNCTIONS_SZ, 1);
+    PRINT("%s", CLRTOEOL);
+  }
+
+  clink_iter_free(&it);
+
+  return rc;
+}
+
+/** retrieve context for a range of results from the database
+ *
+ * Rows are looked up in batches of consecutive rows from the same file.
+ * Failure to retrieve context is not considered an error.
+ *
+ * \param from Index of the first row to look up
+ * \param count Number of rows to look up
+ * \param missing [out] Optional queue to add files lacking context to
+ * \return 0 on success or an errno on failure
+ */
+static int lookup_context(size_t from, size_t count, str_queue_t *missing) {
+  assert(from + count <= results.count);
+
+  int rc = 0;
+  unsigned long *linenos = NULL;
+  size_t *indices = NULL;
+  char **contents = NULL;
+
+  linenos = calloc(count, sizeof(linenos[0]));
+  indices = calloc(count, sizeof(indices[0]));
+  contents = calloc(count, sizeof(contents[0]));
+  if (UNLIKELY(count > 0 &&
+               (linenos == NULL || indices == NULL || contents == NULL))) {
+    rc = ENOMEM;
+    goto done;
+  }
+
+  for (size_t i = from; i < from + count;) {
+    const char *path = results.rows[i].path;
+
+    // gather the rows from this file that still need context
+    size_t n = 0;
+    size_t j = i;
+    for (; j < from + count && strcmp(results.rows[j].path, path) == 0; ++j) {
+      if (results.looked_up[j] || results.rows[j].context != NULL)
+        continue;
+      linenos[n] = results.rows[j].lineno;
+      indices[n] = j;
+      ++n;
+    }
+    i = j;
+
+    if (n == 0)
+      continue;
+
+    // ignore failure here
+    (void)clink_db_get_contents(database, path, linenos, n, contents);
+
+    bool is_missing = false;
+    for (size_t k = 0; k < n; ++k) {
+      results.rows[indices[k]].context = contents[k];
+      if (contents[k] == NULL)
+        is_missing = true;
+    }
 
     // if the context is missing (can happen if it was delayed), queue it for
-    // highlighting now
-    if (target->context == NULL) {
-      int r = str_queue_push(to_highlight, target->path);
+    // highlighting
+    if (is_missing && missing != NULL) {
+      int r = str_queue_push(missing, path);
       if (r != 0 && r != EALREADY) {
         rc = r;
         goto done;
@@ -202,101 +296,204 @@ static int format_results(clink_iter_t *it) {
     }
   }
 
-  // highlight all the pending files
-  {
-    size_t rows = screen_get_rows();
-    rc = highlight(database, cur_dir, to_highlight, rows - FUNCTIONS_SZ);
-    if (rc != 0)
-      goto done;
-  }
+done:
+  free(contents);
+  free(indices);
+  free(linenos);
 
-  // try to populate any symbols with missing context
-  for (size_t i = 0; i < results.count; ++i) {
-    clink_symbol_t *target = &results.rows[i];
-    if (target->context == NULL) {
-      // ignore failure here
-      (void)clink_db_get_content(database, target->path, target->lineno,
-                                 &target->context);
-    }
-  }
+  return rc;
+}
 
-done:
+/** populate context for a range of results that are about to be displayed
+ *
+ * \param from Index of the first row to populate
+ * \param count Number of rows to populate
+ * \return 0 on success or an errno on failure
+ */
+static int fetch_context(size_t from, size_t count) {
 
-  spinner_off();
-  {
+  int rc = 0;
+
+  // files we have not yet highlighted
+  str_queue_t *to_highlight = NULL;
+  if (UNLIKELY((rc = str_queue_new(&to_highlight))))
+    goto done;
+
+  if (UNLIKELY((rc = lookup_context(from, count, to_highlight))))
+    goto done;
+
+  // highlight any pending files and then retry the rows still lacking context
+  if (str_queue_size(to_highlight) > 0) {
     size_t rows = screen_get_rows();
+    rc = highlight(database, cur_dir, to_highlight, rows - FUNCTIONS_SZ);
     move(rows - FUNCTIONS_SZ, 1);
     PRINT("%s", CLRTOEOL);
+    if (rc != 0)
+      goto done;
+
+    if (UNLIKELY((rc = lookup_context(from, count, NULL))))
+      goto done;
   }
 
+  // do not retry rows whose context we could not find
+  for (size_t i = from; i < from + count; ++i)
+    results.looked_up[i] = true;
+
+done:
   str_queue_free(&to_highlight);
-  clink_iter_free(&it);
 
   return rc;
 }
 
 // wrappers for each database query
 
-static int find_symbol(const char *query) {
+/** run a search, restricted to the user’s chosen scope
+ *
+ * \param query Criteria to search for, excluding the scope
+ * \return 0 on success or an errno on failure
+ */
+static int search(clink_query_t query) {
+
+  query.path = option.scope;
 
   clink_iter_t *it = NULL;
-  int rc = clink_db_find_symbol(database, query, &it);
+  int rc = clink_db_query(database, &query, &it);
   if (UNLIKELY(rc))
     return rc;
 
   return format_results(it);
 }
 
+static int find_symbol(const char *query) {
+
+  // match the given symbol exactly
+  char *pattern = NULL;
+  if (UNLIKELY(asprintf(&pattern, "^%s$", query) < 0))
+    return ENOMEM;
+
+  int rc = search((clink_query_t){.name = pattern});
+  free(pattern);
+
+  return rc;
+}
+
 static int find_definition(const char *query) {
 
-  clink_iter_t *it = NULL;
-  int rc = clink_db_find_definition(database, query, &it);
-  if (UNLIKELY(rc))
-    return rc;
+  // match the given definition exactly
+  char *pattern = NULL;
+  if (UNLIKELY(asprintf(&pattern, "^%s$", query) < 0))
+    return ENOMEM;
 
-  return format_results(it);
+  int rc = search((clink_query_t){
+      .categories = CLINK_CATEGORY_SET(CLINK_DEFINITION), .name = pattern});
+  free(pattern);
+
+  return rc;
 }
 
 static int find_call(const char *query) {
 
-  clink_iter_t *it = NULL;
-  int rc = clink_db_find_call(database, query, &it);
-  if (UNLIKELY(rc))
-    return rc;
+  // match calls within the given function exactly
+  char *pattern = NULL;
+  if (UNLIKELY(asprintf(&pattern, "^%s$", query) < 0))
+    return ENOMEM;
 
-  return format_results(it);
+  int rc = search((clink_query_t){
+      .categories = CLINK_CATEGORY_SET(CLINK_FUNCTION_CALL),
+      .parent = pattern});
+  free(pattern);
+
+  return rc;
 }
 
 static int find_caller(const char *query) {
 
-  clink_iter_t *it = NULL;
-  int rc = clink_db_find_caller(database, query, &it);
-  if (UNLIKELY(rc))
-    return rc;
+  // match calls to the given function exactly
+  char *pattern = NULL;
+  if (UNLIKELY(asprintf(&pattern, "^%s$", query) < 0))
+    return ENOMEM;
 
-  return format_results(it);
+  int rc = search((clink_query_t){
+      .categories = CLINK_CATEGORY_SET(CLINK_FUNCTION_CALL), .name = pattern});
+  free(pattern);
+
+  return rc;
 }
 
 static int find_includer(const char *query) {
 
+  // allow arbitrary leading path components, e.g. “foo.h” matching “bar/foo.h”
+  char *pattern = NULL;
+  if (UNLIKELY(asprintf(&pattern, "%s$", query) < 0))
+    return ENOMEM;
+
+  int rc = search((clink_query_t){
+      .categories = CLINK_CATEGORY_SET(CLINK_INCLUDE), .name = pattern});
+  free(pattern);
+
+  return rc;
+}
+
+static int find_assign(const char *query) {
+
+  // match assignments to the given symbol exactly
+  char *pattern = NULL;
+  if (UNLIKELY(asprintf(&pattern, "^%s$", query) < 0))
+    return ENOMEM;
+
+  int rc = search((clink_query_t){
+      .categories = CLINK_CATEGORY_SET(CLINK_ASSIGNMENT), .name = pattern});
+  free(pattern);
+
+  return rc;
+}
+
+/// how many calls away to search for transitive callers
+enum { CALL_CHAIN_DEPTH = 4 };
+
+static int find_call_chain(const char *query) {
+
   clink_iter_t *it = NULL;
-  int rc = clink_db_find_includer(database, query, &it);
+  int rc = clink_db_find_call_chain(database, query, CLINK_CALLERS,
+                                    CALL_CHAIN_DEPTH, option.scope, &it);
   if (UNLIKELY(rc))
     return rc;
 
   return format_results(it);
 }
 
-static int find_assign(const char *query) {
+static int find_transitive_includer(const char *query) {
 
   clink_iter_t *it = NULL;
-  int rc = clink_db_find_assignment(database, query, &it);
+  int rc =
+      clink_db_find_transitive_includer(database, query, option.scope, &it);
   if (UNLIKELY(rc))
     return rc;
 
   return format_results(it);
 }
 
+/** discard any previous suggestions
+ */
+static void clear_suggestions(void) {
+  for (size_t i = 0; i < suggestions_size; ++i)
+    free(suggestions[i]);
+  free(suggestions);
+  suggestions = NULL;
+  suggestions_size = 0;
+}
+
+/** lookup names similar to a query that found nothing
+ *
+ * \param query The failed query
+ * \return 0 on success or an errno on failure
+ */
+static int suggest(const char *query) {
+  clear_suggestions();
+  return clink_db_find_similar(database, query, &suggestions,
+                               &suggestions_size);
+}
+
 static void print_menu(void) {
   for (size_t i = 0; i < FUNCTIONS_SZ; ++i) {
     move(screen_get_rows() - FUNCTIONS_SZ + 1 + i, 1);
@@ -361,6 +558,13 @@ static int print_results(void) {
   if (row_count > sizeof(HOTKEYS) - 1)
     row_count = sizeof(HOTKEYS) - 1;
 
+  // retrieve context for only the rows we are about to display
+  {
+    int rc = fetch_context(from_row, row_count);
+    if (UNLIKELY(rc != 0))
+      return rc;
+  }
+
   // figure out column widths
   size_t widths[COLUMN_COUNT] = {0};
   for (size_t i = 0; i < COLUMN_COUNT; ++i) {
@@ -426,6 +630,14 @@ static int print_results(void) {
   PRINT("* ");
   if (results.count == 0) {
     PRINT("No results");
+    for (size_t i = 0; i < suggestions_size && i < MAX_SUGGESTIONS; ++i) {
+      const bool is_last =
+          i + 1 == suggestions_size || i + 1 == MAX_SUGGESTIONS;
+      PRINT("%s%s", i == 0 ? "; did you mean " : is_last ? " or " : ", ",
+            suggestions[i]);
+      if (is_last)
+        PRINT("?");
+    }
   } else {
     PRINT("Lines %zu-%zu of %zu", from_row + 1, from_row + row_count,
           results.count);
@@ -569,6 +781,14 @@ static int handle_input(void) {
         return 0;
       } while (0);
       int rc = functions[prompt_index].handler(query);
+      if (rc == 0) {
+        // if we found nothing, maybe the user misspelled something
+        if (results.count == 0) {
+          rc = suggest(query);
+        } else {
+          clear_suggestions();
+        }
+      }
       free(query);
       if (UNLIKELY(rc))
         return rc;
@@ -1074,7 +1294,10 @@ done:
   results.count = 0;
   free(results.rows);
   results.rows = NULL;
+  free(results.looked_up);
+  results.looked_up = NULL;
   results.size = 0;
+  clear_suggestions();
 
   screen_free();
   free(cur_dir);
@@ -0,0 +1,348 @@
+#include "watch.h"
+#include "../../common/compiler.h"
+#include "build.h"
+#include "clock.h"
+#include "option.h"
+#include "path.h"
+#include "set.h"
+#include <assert.h>
+#include <clink/clink.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/// events that indicate a directory entry may need reparsing or removing
+static const uint32_t MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                             IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+/// milliseconds without an event after which a batch of changes is processed
+static const int QUIET_MS = 100;
+
+/// milliseconds after which a batch of changes is processed regardless
+static const int BATCH_MS = 1000;
+
+/// inotify state
+typedef struct {
+  int fd;               ///< inotify instance
+  pthread_mutex_t lock; ///< guard for all following fields
+  char **dirs;          ///< path of each watched directory, by descriptor
+  size_t dirs_len;      ///< number of entries in `dirs`
+  size_t failed;        ///< number of directories we could not watch
+} watcher_t;
+
+/// start watching a directory, called during source discovery
+static void observe(const char *path, void *context) {
+
+  assert(path != NULL);
+  assert(context != NULL);
+
+  watcher_t *w = context;
+
+  int r UNUSED = pthread_mutex_lock(&w->lock);
+  assert(r == 0);
+
+  // watching an already watched directory returns its existing descriptor
+  const int wd = inotify_add_watch(w->fd, path, MASK);
+  if (UNLIKELY(wd < 0)) {
+    ++w->failed;
+    goto done;
+  }
+
+  if ((size_t)wd >= w->dirs_len) {
+    size_t len = w->dirs_len == 0 ? 1024 : w->dirs_len;
+    while (len <= (size_t)wd)
+      len *= 2;
+    char **d = realloc(w->dirs, len * sizeof(d[0]));
+    if (UNLIKELY(d == NULL)) {
+      (void)inotify_rm_watch(w->fd, wd);
+      ++w->failed;
+      goto done;
+    }
+    memset(&d[w->dirs_len], 0, (len - w->dirs_len) * sizeof(d[0]));
+    w->dirs = d;
+    w->dirs_len = len;
+  }
+
+  // the directory may have moved since we last saw this descriptor
+  char *p = strdup(path);
+  if (UNLIKELY(p == NULL)) {
+    (void)inotify_rm_watch(w->fd, wd);
+    ++w->failed;
+    goto done;
+  }
+  free(w->dirs[wd]);
+  w->dirs[wd] = p;
+
+done:
+  r = pthread_mutex_unlock(&w->lock);
+  assert(r == 0);
+}
+
+/// milliseconds on a monotonic clock
+static uint64_t now_ms(void) { return now() / 1000000; }
+
+/// changes accumulated from a series of events
+typedef struct {
+  set_t *seen;        ///< paths already in `paths`
+  const char **paths; ///< changed paths, owned by `seen`
+  size_t count;       ///< number of entries in `paths`
+  size_t size;        ///< number of allocated entries in `paths`
+  bool overflow;      ///< were events dropped, requiring a full rescan?
+} changes_t;
+
+/// note a changed path, ignoring repeats
+static int changes_add(changes_t *c, const char *path) {
+
+  assert(c != NULL);
+  assert(path != NULL);
+
+  const char *p = path;
+  int rc = set_add(c->seen, &p);
+  if (rc == EALREADY)
+    return 0;
+  if (UNLIKELY(rc != 0))
+    return rc;
+
+  if (c->count == c->size) {
+    const size_t s = c->size == 0 ? 128 : c->size * 2;
+    const char **n = realloc(c->paths, s * sizeof(n[0]));
+    if (UNLIKELY(n == NULL))
+      return ENOMEM;
+    c->paths = n;
+    c->size = s;
+  }
+  c->paths[c->count] = p;
+  ++c->count;
+
+  return 0;
+}
+
+/// translate a buffer of inotify events into changes
+static int digest(watcher_t *w, const char *buffer, size_t size,
+                  changes_t *changes) {
+
+  assert(w != NULL);
+  assert(buffer != NULL);
+  assert(changes != NULL);
+
+  int rc = 0;
+
+  for (size_t offset = 0; offset < size;) {
+    const struct inotify_event *e = (const void *)&buffer[offset];
+    offset += sizeof(*e) + e->len;
+
+    if (e->mask & IN_Q_OVERFLOW) {
+      changes->overflow = true;
+      continue;
+    }
+
+    if (e->wd < 0 || (size_t)e->wd >= w->dirs_len || w->dirs[e->wd] == NULL)
+      continue;
+
+    // the directory itself has gone, so forget about its descriptor
+    if (e->mask & IN_IGNORED) {
+      free(w->dirs[e->wd]);
+      w->dirs[e->wd] = NULL;
+      continue;
+    }
+
+    if (e->len == 0)
+      continue;
+
+    // only directories and source files can affect the database
+    if (!(e->mask & IN_ISDIR) && !is_source(e->name))
+      continue;
+
+    char *path = NULL;
+    if (UNLIKELY((rc = join(w->dirs[e->wd], e->name, &path))))
+      return rc;
+
+    if (is_within_sources(path))
+      rc = changes_add(changes, path);
+    free(path);
+    if (UNLIKELY(rc))
+      return rc;
+  }
+
+  return 0;
+}
+
+/// wait for some changes to accumulate
+static int collect(watcher_t *w, changes_t *changes) {
+
+  assert(w != NULL);
+  assert(changes != NULL);
+
+  // an event buffer, aligned as the kernel expects
+  char buffer[64 * 1024]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  uint64_t deadline = 0;
+
+  while (true) {
+
+    // wait indefinitely for the first event, and then briefly for more
+    int timeout = -1;
+    if (changes->count > 0 || changes->overflow) {
+      const uint64_t current = now_ms();
+      if (current >= deadline)
+        break;
+      timeout = deadline - current < (uint64_t)QUIET_MS
+                    ? (int)(deadline - current)
+                    : QUIET_MS;
+    }
+
+    struct pollfd pfd = {.fd = w->fd, .events = POLLIN};
+    int r = poll(&pfd, 1, timeout);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (UNLIKELY(r < 0))
+      return errno;
+
+    // no events within the quiet period?
+    if (r == 0)
+      break;
+
+    ssize_t size = read(w->fd, buffer, sizeof(buffer));
+    if (size < 0 && (errno == EAGAIN || errno == EINTR))
+      continue;
+    if (UNLIKELY(size < 0))
+      return errno;
+
+    const bool was_empty = changes->count == 0 && !changes->overflow;
+
+    int rc = 0;
+    if (UNLIKELY((rc = digest(w, buffer, (size_t)size, changes))))
+      return rc;
+
+    // start the batch clock on the first relevant event
+    if (was_empty && (changes->count > 0 || changes->overflow))
+      deadline = now_ms() + BATCH_MS;
+  }
+
+  return 0;
+}
+
+/// tell the user if some directories are not being watched
+static void report_failures(watcher_t *w, size_t *reported) {
+
+  assert(w != NULL);
+  assert(reported != NULL);
+
+  if (w->failed == *reported)
+    return;
+
+  fprintf(stderr,
+          "%swarning: failed to watch %zu directories; changes within them "
+          "will be missed%s\n",
+          option.colour == ALWAYS ? "\033[33m" : "", w->failed - *reported,
+          option.colour == ALWAYS ? "\033[0m" : "");
+  *reported = w->failed;
+}
+
+int watch(clink_db_t *db) {
+
+  assert(db != NULL);
+
+  int rc = 0;
+  watcher_t w = {.fd = -1};
+  size_t reported = 0;
+  changes_t changes = {0};
+
+  if (UNLIKELY((rc = pthread_mutex_init(&w.lock, NULL)))) {
+    fprintf(stderr, "failed to create mutex: %s\n", strerror(rc));
+    return rc;
+  }
+
+  w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (UNLIKELY(w.fd < 0)) {
+    rc = errno;
+    fprintf(stderr, "failed to create inotify instance: %s\n", strerror(rc));
+    goto done;
+  }
+
+  // watch the directories of any individual files we were given
+  for (size_t i = 0; i < option.src_len; ++i) {
+    if (is_dir(option.src[i]))
+      continue;
+    char *dir = NULL;
+    if (UNLIKELY((rc = dirname(option.src[i], &dir)))) {
+      fprintf(stderr, "failed to find directory of %s: %s\n", option.src[i],
+              strerror(rc));
+      goto done;
+    }
+    observe(dir, &w);
+    free(dir);
+  }
+
+  // every directory read while finding sources gets watched
+  build_set_dir_observer(observe, &w);
+
+  // bring the database up to date, after which only changes need processing
+  if ((rc = build(db)))
+    goto done;
+  report_failures(&w, &reported);
+
+  while (true) {
+
+    if (UNLIKELY((rc = set_new(&changes.seen)))) {
+      fprintf(stderr, "failed to create set: %s\n", strerror(rc));
+      goto done;
+    }
+
+    if (UNLIKELY((rc = collect(&w, &changes)))) {
+      fprintf(stderr, "failed to read file system events: %s\n", strerror(rc));
+      goto done;
+    }
+
+    // if we missed events, we no longer know what changed
+    if (changes.overflow) {
+      rc = build(db);
+    } else {
+      rc = build_changes(db, changes.paths, changes.count);
+    }
+    if (rc)
+      goto done;
+    report_failures(&w, &reported);
+
+    free(changes.paths);
+    set_free(&changes.seen);
+    changes = (changes_t){0};
+  }
+
+done:
+  build_set_dir_observer(NULL, NULL);
+  free(changes.paths);
+  set_free(&changes.seen);
+  for (size_t i = 0; i < w.dirs_len; ++i)
+    free(w.dirs[i]);
+  free(w.dirs);
+  if (w.fd >= 0)
+    (void)close(w.fd);
+  (void)pthread_mutex_destroy(&w.lock);
+
+  return rc;
+}
+
+#else
+
+int watch(clink_db_t *db) {
+
+  assert(db != NULL);
+
+  fprintf(stderr, "--watch is only supported on Linux\n");
+  return ENOTSUP;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <clink/clink.h>
+
+/** build a Clink database and then keep it up to date as sources change
+ *
+ * This only returns on failure or if interrupted by SIGINT.
+ *
+ * \param db Database to operate on
+ * \return 0 on success or an errno on failure
+ */
+int watch(clink_db_t *db);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <clink/db.h>
+#include <clink/symbol.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 #ifdef __cplusplus
@@ -30,6 +32,92 @@ extern "C" {
 CLINK_API int clink_parse_with_clang(clink_db_t *db, const char *filename,
                                      size_t argc, const char **argv);
 
+/** parse the given C/C++ file with Clang, passing each symbol to a callback
+ *
+ * This is the same as `clink_parse_with_clang`, but leaves it to the caller
+ * what to do with the symbols found. The symbol passed to `accept` is only
+ * valid for the duration of the call. If `accept` returns non-zero, parsing
+ * is abandoned and this value is returned.
+ *
+ * \param filename Path to source file to parse
+ * \param argc Number of Clang command line arguments
+ * \param argv Clang commang line arguments
+ * \param accept Callback to receive each symbol
+ * \param context Opaque state to pass to `accept`
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_parse_with_clang_cb(
+    const char *filename, size_t argc, const char **argv,
+    int (*accept)(const clink_symbol_t *symbol, void *context), void *context);
+
+/// libclang state that can be reused from one parse to the next
+typedef struct clink_clang clink_clang_t;
+
+/** create state for parsing with Clang
+ *
+ * Parsing a series of files through the same state avoids repeating libclang’s
+ * set up for each of them. The state is not thread-safe, so threads parsing in
+ * parallel should each have their own.
+ *
+ * \param clang [out] Created state on success
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_clang_new(clink_clang_t **clang);
+
+/** choose how parsing through the given state uses libclang
+ *
+ * By default, each file’s full AST is walked. With the indexing API enabled,
+ * libclang instead reports declarations and references directly, and skips
+ * the bodies of functions in headers it has already parsed through this state.
+ * This is faster when many files share headers, but does not report calls to
+ * compiler built-ins or macros defined in disabled `#if` blocks.
+ *
+ * \param clang State from `clink_clang_new`
+ * \param enable Whether to use the indexing API
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_clang_use_index(clink_clang_t *clang, bool enable);
+
+/** parse the given C/C++ file with Clang, reusing existing state
+ *
+ * This is the same as `clink_parse_with_clang`, but parses within the given
+ * state rather than creating and discarding new state.
+ *
+ * \param clang State from `clink_clang_new`
+ * \param db Database to insert into
+ * \param filename Path to source file to parse
+ * \param argc Number of Clang command line arguments
+ * \param argv Clang commang line arguments
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_clang_parse(clink_clang_t *clang, clink_db_t *db,
+                                const char *filename, size_t argc,
+                                const char **argv);
+
+/** parse the given C/C++ file with Clang, reusing existing state, passing each
+ * symbol to a callback
+ *
+ * This is the same as `clink_parse_with_clang_cb`, but parses within the given
+ * state rather than creating and discarding new state.
+ *
+ * \param clang State from `clink_clang_new`
+ * \param filename Path to source file to parse
+ * \param argc Number of Clang command line arguments
+ * \param argv Clang commang line arguments
+ * \param accept Callback to receive each symbol
+ * \param context Opaque state to pass to `accept`
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_clang_parse_cb(
+    clink_clang_t *clang, const char *filename, size_t argc, const char **argv,
+    int (*accept)(const clink_symbol_t *symbol, void *context), void *context);
+
+/** destroy state for parsing with Clang
+ *
+ * \param clang State to destroy
+ */
+CLINK_API void clink_clang_free(clink_clang_t **clang);
+
 #ifdef __cplusplus
 }
 #endif
@@ -2,6 +2,7 @@
 
 #include <clink/iter.h>
 #include <clink/symbol.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -99,6 +100,34 @@ CLINK_API int clink_db_add_symbol(clink_db_t *db, const clink_symbol_t *symbol);
 CLINK_API int clink_db_add_line(clink_db_t *db, const char *path,
                                 unsigned long lineno, const char *line);
 
+/** update the index of symbol names used for approximate matching
+ *
+ * This should be called after adding symbols to the database, to make their
+ * names visible to `clink_db_find_similar`. Only the names of symbols added
+ * since the last call are processed, so repeated calls are cheap.
+ *
+ * \param db Database to operate on
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_db_index_names(clink_db_t *db);
+
+/// time the calling thread has spent inserting symbols
+typedef struct {
+  uint64_t wait;   ///< nanoseconds waiting for other threads’ insertions
+  uint64_t insert; ///< nanoseconds spent performing insertions
+} clink_db_bulk_time_t;
+
+/** retrieve the time the calling thread has spent inserting symbols
+ *
+ * Parsers insert the symbols of each file in bulk, serialised with those of
+ * other threads. This reports cumulative time for the calling thread across
+ * all databases, so the difference between two calls gives the time spent on
+ * this in between.
+ *
+ * \return Nanoseconds spent by this thread on bulk insertions
+ */
+CLINK_API clink_db_bulk_time_t clink_db_bulk_time(void);
+
 /** remove all symbols and content related to a given file
  *
  * The `path` parameter must be an absolute path.
@@ -108,9 +137,110 @@ CLINK_API int clink_db_add_line(clink_db_t *db, const char *path,
  */
 CLINK_API void clink_db_remove(clink_db_t *db, const char *path);
 
+/** remove all records, symbols and content related to a set of files
+ *
+ * This is equivalent to calling `clink_db_remove` for each path, but is more
+ * efficient for a large number of paths. Paths that have no record are
+ * ignored.
+ *
+ * \param db Clink database to operate on
+ * \param paths Absolute paths of the files to remove information for
+ * \param count Number of entries in `paths`
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_db_purge(clink_db_t *db, const char **paths, size_t count);
+
+/** update the hash and timestamp of an existing file record
+ *
+ * Unlike `clink_db_add_record`, this leaves the symbols, content and other
+ * information associated with the file intact. It is intended for recording
+ * that a file was touched without its content changing.
+ *
+ * The `path` parameter must be an absolute path.
+ *
+ * \param db Database to operate on
+ * \param path Path of the subject to update
+ * \param hash New hash digest of the subject
+ * \param timestamp New modification time of the subject
+ * \return 0 on success, ENOENT if there is no record for `path`, or another
+ *   errno on failure
+ */
+CLINK_API int clink_db_update_record(clink_db_t *db, const char *path,
+                                     uint64_t hash, uint64_t timestamp);
+
+/** record the cost of parsing a file
+ *
+ * This information is not used by libclink itself, but allows callers to
+ * predict how long a file will take to parse next time.
+ *
+ * \param db Database to operate on
+ * \param id Record of the file that was parsed
+ * \param size Size in bytes of the file that was parsed
+ * \param duration Time spent parsing the file, in nanoseconds
+ * \return 0 on success, ENOENT if there is no such record, or another errno on
+ *   failure
+ */
+CLINK_API int clink_db_set_cost(clink_db_t *db, clink_record_id_t id,
+                                uint64_t size, uint64_t duration);
+
+/** store a property of the database as a whole
+ *
+ * This information is not used by libclink itself, but allows callers to
+ * remember things about the last build, like the version control revision it
+ * reflects. Any previous value for `key` is replaced.
+ *
+ * \param db Database to operate on
+ * \param key Name of the property
+ * \param value Value to store
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_db_set_metadata(clink_db_t *db, const char *key,
+                                    const char *value);
+
+/** retrieve a property stored with `clink_db_set_metadata`
+ *
+ * \param db Database to search
+ * \param key Name of the property
+ * \param value [out] Stored value on success, to be freed by the caller
+ * \return 0 on success, ENOENT if there is no such property, or another errno
+ *   on failure
+ */
+CLINK_API int clink_db_get_metadata(clink_db_t *db, const char *key,
+                                    char **value);
+
+/// information stored about a source file
+typedef struct {
+  const char *path;   ///< absolute path to the file
+  uint64_t hash;      ///< hash digest passed to `clink_db_add_record`
+  uint64_t timestamp; ///< timestamp passed to `clink_db_add_record`
+  uint64_t size;      ///< size passed to `clink_db_set_cost`, or 0
+  uint64_t duration;  ///< duration passed to `clink_db_set_cost`, or 0
+} clink_record_t;
+
+/** retrieve every file record in the database
+ *
+ * This is more efficient than calling `clink_db_find_record` for each of a
+ * large number of files. The `accept` function will be called once for each
+ * record. The record passed to it is only valid for the duration of the call.
+ * Returning non-zero from `accept` will terminate the retrieval and return the
+ * same non-zero value.
+ *
+ * \param db Database to search
+ * \param accept Callback for each record
+ * \param context State passed to `accept`
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_db_get_records(clink_db_t *db,
+                                   int (*accept)(const clink_record_t *record,
+                                                 void *context),
+                                   void *context);
+
 /** find assignments to a symbol in the database
  *
- * Symbols paths in the returned iterator are always absolute.
+ * Symbols paths in the returned iterator are always absolute. They remain
+ * valid after the iterator is freed, until records are next added to or
+ * removed from the database. Symbols are yielded without context; use
+ * `clink_db_get_contents` to retrieve it.
  *
  * \param db Database to search
  * \param regex Regular expression of a symbol to search for
@@ -122,7 +252,10 @@ CLINK_API int clink_db_find_assignment(clink_db_t *db, const char *regex,
 
 /** find function calls within a given function in the database
  *
- * Symbols paths in the returned iterator are always absolute.
+ * Symbols paths in the returned iterator are always absolute. They remain
+ * valid after the iterator is freed, until records are next added to or
+ * removed from the database. Symbols are yielded without context; use
+ * `clink_db_get_contents` to retrieve it.
  *
  * \param db Database to search
  * \param regex Regular expression of a containing function to lookup
@@ -132,9 +265,49 @@ CLINK_API int clink_db_find_assignment(clink_db_t *db, const char *regex,
 CLINK_API int clink_db_find_call(clink_db_t *db, const char *regex,
                                  clink_iter_t **it);
 
+/// direction in which to traverse the call graph
+typedef enum {
+  CLINK_CALLERS = 0, ///< towards functions that call the starting function
+  CLINK_CALLEES = 1, ///< towards functions the starting function calls
+} clink_call_direction_t;
+
+/** find calls transitively reachable from a function in the database
+ *
+ * This traverses the call graph outwards from the function `name`, up to
+ * `depth` calls away. For example, searching with `CLINK_CALLERS` and a depth
+ * of 1 finds the calls to `name` while a depth of 2 also finds calls to those
+ * callers. Each yielded symbol is a call site, with `name` the called function
+ * and `parent` the calling function. Only calls made from within a function
+ * are considered. Results are ordered by increasing distance from `name`.
+ *
+ * Unlike the other find functions, `name` is an exact function name rather
+ * than a regular expression, so the traversal can be answered from an index.
+ *
+ * Symbols paths in the returned iterator are always absolute. They remain
+ * valid after the iterator is freed, until records are next added to or
+ * removed from the database. Symbols are yielded without context; use
+ * `clink_db_get_contents` to retrieve it.
+ *
+ * \param db Database to search
+ * \param name Function to start from
+ * \param direction Whether to traverse towards callers or callees
+ * \param depth Maximum number of calls away from `name` to traverse
+ * \param path Absolute path that the paths of yielded call sites must start
+ *   with, as for `clink_query_t.path`, or `NULL` for no restriction
+ * \param it [out] Created symbol iterator on success
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_db_find_call_chain(clink_db_t *db, const char *name,
+                                       clink_call_direction_t direction,
+                                       unsigned long depth, const char *path,
+                                       clink_iter_t **it);
+
 /** find calls to a given function in the database
  *
- * Symbols paths in the returned iterator are always absolute.
+ * Symbols paths in the returned iterator are always absolute. They remain
+ * valid after the iterator is freed, until records are next added to or
+ * removed from the database. Symbols are yielded without context; use
+ * `clink_db_get_contents` to retrieve it.
  *
  * \param db Database to search
  * \param regex Regular expression of a function whose calls to lookup
@@ -146,7 +319,10 @@ CLINK_API int clink_db_find_caller(clink_db_t *db, const char *regex,
 
 /** find a definition in the database
  *
- * Symbols paths in the returned iterator are always absolute.
+ * Symbols paths in the returned iterator are always absolute. They remain
+ * valid after the iterator is freed, until records are next added to or
+ * removed from the database. Symbols are yielded without context; use
+ * `clink_db_get_contents` to retrieve it.
  *
  * \param db Database to search
  * \param regex Regular expression of a symbol to search for
@@ -158,7 +334,10 @@ CLINK_API int clink_db_find_definition(clink_db_t *db, const char *regex,
 
 /** find #includes or a given file in the database
  *
- * Symbols paths in the returned iterator are always absolute.
+ * Symbols paths in the returned iterator are always absolute. They remain
+ * valid after the iterator is freed, until records are next added to or
+ * removed from the database. Symbols are yielded without context; use
+ * `clink_db_get_contents` to retrieve it.
  *
  * \param db Database to search
  * \param regex Regular expressions of filename of the function being #included
@@ -168,6 +347,35 @@ CLINK_API int clink_db_find_definition(clink_db_t *db, const char *regex,
 CLINK_API int clink_db_find_includer(clink_db_t *db, const char *regex,
                                      clink_iter_t **it);
 
+/** find #includes that transitively lead to a given file in the database
+ *
+ * This answers “what is affected if this file changes?” Each yielded symbol is
+ * an #include site, either of the file itself or of some file that
+ * (transitively) #includes it. Every file that would see a change to the
+ * given file therefore appears as the path of at least one yielded symbol.
+ *
+ * #includes are resolved by matching their trailing path components against
+ * the files in the database, so an #include may be considered to lead to
+ * multiple files of the same name.
+ *
+ * Symbols paths in the returned iterator are always absolute. They remain
+ * valid after the iterator is freed, until records are next added to or
+ * removed from the database. Symbols are yielded without context; use
+ * `clink_db_get_contents` to retrieve it.
+ *
+ * \param db Database to search
+ * \param name Absolute path of the file, or any trailing components of its
+ *   path, e.g. `foo.h` or `include/foo.h`
+ * \param path Absolute path that the paths of yielded #include sites must
+ *   start with, as for `clink_query_t.path`, or `NULL` for no restriction
+ * \param it [out] Created symbol iterator on success
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_db_find_transitive_includer(clink_db_t *db,
+                                                const char *name,
+                                                const char *path,
+                                                clink_iter_t **it);
+
 /** find a record in the given database
  *
  * The hash and timestamp parameters can be NULL if the caller does not need
@@ -185,9 +393,35 @@ CLINK_API int clink_db_find_includer(clink_db_t *db, const char *regex,
 CLINK_API int clink_db_find_record(clink_db_t *db, const char *path,
                                    uint64_t *hash, uint64_t *timestamp);
 
+/** find names in the database that are similar to a given name
+ *
+ * This is intended as a fallback for when a search for `name` finds nothing,
+ * e.g. because it was misspelled. Names one insertion, deletion or substitution
+ * away from `name` are always found. Names two edits away are found if they
+ * can be made equal to `name` by deleting a single byte from each. Results are
+ * ordered by increasing edit distance, then alphabetically.
+ *
+ * Only names covered by the last call to `clink_db_index_names` are
+ * considered.
+ *
+ * On success, the caller is responsible for freeing each entry of `similar`
+ * and `similar` itself.
+ *
+ * \param db Database to search
+ * \param name Name to find similar names to
+ * \param similar [out] Similar names on success
+ * \param similar_size [out] Number of entries in `similar` on success
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_db_find_similar(clink_db_t *db, const char *name,
+                                    char ***similar, size_t *similar_size);
+
 /** find a symbol in the database
  *
- * Symbols paths in the returned iterator are always absolute.
+ * Symbols paths in the returned iterator are always absolute. They remain
+ * valid after the iterator is freed, until records are next added to or
+ * removed from the database. Symbols are yielded without context; use
+ * `clink_db_get_contents` to retrieve it.
  *
  * \param db Database to search
  * \param regex Regular expression of the symbol to lookup
@@ -197,6 +431,71 @@ CLINK_API int clink_db_find_record(clink_db_t *db, const char *path,
 CLINK_API int clink_db_find_symbol(clink_db_t *db, const char *regex,
                                    clink_iter_t **it);
 
+/// a set of symbol categories, for use in `clink_query_t`
+typedef unsigned clink_category_set_t;
+
+/// construct a category set containing a single category
+#define CLINK_CATEGORY_SET(category) ((clink_category_set_t)1 << (category))
+
+/// ordering of results from `clink_db_query`
+typedef enum {
+  CLINK_ORDER_PATH = 0, ///< by path, then line, then column
+  CLINK_ORDER_NONE = 1, ///< whatever order is fastest to retrieve
+} clink_order_t;
+
+/// description of the symbols a query should return
+///
+/// Every field is optional, and a zero-initialised structure matches every
+/// symbol in the database. Fields that are set are combined conjunctively.
+typedef struct {
+
+  /// categories of symbols to match, or 0 for any category
+  clink_category_set_t categories;
+
+  /// regular expression the symbol name must match
+  ///
+  /// This is not implicitly anchored. Callers wanting an exact match should
+  /// use `^` and `$`.
+  const char *name;
+
+  /// regular expression the symbol’s parent must match
+  ///
+  /// As with `name`, this is not implicitly anchored.
+  const char *parent;
+
+  /// absolute path that the containing file’s path must start with
+  ///
+  /// This is a textual prefix, so a caller wanting only the contents of a
+  /// directory should include a trailing `/`.
+  const char *path;
+
+  /// maximum number of results to return, or 0 for no limit
+  size_t limit;
+
+  /// order in which to return results
+  clink_order_t order;
+
+} clink_query_t;
+
+/** find symbols in the database matching a set of criteria
+ *
+ * The criteria are evaluated together in a single database query, so a
+ * combined search like “definitions of `foo` under `/src/drivers/`” does not
+ * need to scan all definitions of `foo`.
+ *
+ * Symbols paths in the returned iterator are always absolute. They remain
+ * valid after the iterator is freed, until records are next added to or
+ * removed from the database. Symbols are yielded without context; use
+ * `clink_db_get_contents` to retrieve it.
+ *
+ * \param db Database to search
+ * \param query Criteria to search for
+ * \param it [out] Created symbol iterator on success
+ * \return 0 on success or an errno on failure
+ */
+CLINK_API int clink_db_query(clink_db_t *db, const clink_query_t *query,
+                             clink_iter_t **it);
+
 /** retrieve a highlighted line from the database
  *
  * The `path` parameter must be an absolute path.
@@ -210,6 +509,27 @@ CLINK_API int clink_db_find_symbol(clink_db_t *db, const char *regex,
 CLINK_API int clink_db_get_content(clink_db_t *db, const char *path,
                                    unsigned long lineno, char **content);
 
+/** retrieve several highlighted lines of a single file from the database
+ *
+ * This is more efficient than repeated calls to `clink_db_get_content` when
+ * the caller needs context for multiple lines of the same file, e.g. for the
+ * results currently on screen.
+ *
+ * The `path` parameter must be an absolute path. Lines for which there is no
+ * content in the database are set to `NULL` in `contents`. On success, the
+ * caller is responsible for freeing each non-`NULL` entry of `contents`.
+ *
+ * \param db Database to search
+ * \param path Path to file whose content to retrieve
+ * \param linenos Line numbers of the lines to retrieve
+ * \param count Number of entries in `linenos` and `contents`
+ * \param contents [out] Highlighted line content on success
+ * \return 0 on success or an errno on failure.
+ */
+CLINK_API int clink_db_get_contents(clink_db_t *db, const char *path,
+                                    const unsigned long *linenos, size_t count,
+                                    char **contents);
+
 /** close a Clink symbol database
  *
  * \param db Database to close
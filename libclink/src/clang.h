@@ -0,0 +1,17 @@
+#pragma once
+
+#include <clang-c/Index.h>
+#include <stdbool.h>
+
+struct clink_clang {
+
+  /// libclang index that translation units are parsed within
+  CXIndex index;
+
+  /// parse through libclang’s indexing API instead of walking the AST?
+  bool use_index;
+
+  /// indexing session, created on first use, that remembers which headers have
+  /// had their function bodies parsed
+  CXIndexAction action;
+};
@@ -0,0 +1,18 @@
+#include "clang.h"
+#include <clang-c/Index.h>
+#include <clink/clang.h>
+#include <stdlib.h>
+
+void clink_clang_free(clink_clang_t **clang) {
+
+  // allow freeing NULL
+  if (clang == NULL || *clang == NULL)
+    return;
+
+  if ((*clang)->action != NULL)
+    clang_IndexAction_dispose((*clang)->action);
+  clang_disposeIndex((*clang)->index);
+
+  free(*clang);
+  *clang = NULL;
+}
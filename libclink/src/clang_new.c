@@ -0,0 +1,27 @@
+#include "clang.h"
+#include "debug.h"
+#include <clang-c/Index.h>
+#include <clink/clang.h>
+#include <errno.h>
+#include <stdlib.h>
+
+int clink_clang_new(clink_clang_t **clang) {
+
+  if (ERROR(clang == NULL))
+    return EINVAL;
+
+  clink_clang_t *c = calloc(1, sizeof(*c));
+  if (ERROR(c == NULL))
+    return ENOMEM;
+
+  static const int excludePCH = 0;
+  static const int displayDiagnostics = 0;
+  c->index = clang_createIndex(excludePCH, displayDiagnostics);
+  if (ERROR(c->index == NULL)) {
+    free(c);
+    return ENOMEM;
+  }
+
+  *clang = c;
+  return 0;
+}
@@ -0,0 +1,15 @@
+#include "clang.h"
+#include "debug.h"
+#include <clink/clang.h>
+#include <errno.h>
+#include <stdbool.h>
+
+int clink_clang_use_index(clink_clang_t *clang, bool enable) {
+
+  if (ERROR(clang == NULL))
+    return EINVAL;
+
+  clang->use_index = enable;
+
+  return 0;
+}
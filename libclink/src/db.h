@@ -1,9 +1,12 @@
 #pragma once
 
+#include "../../common/compiler.h"
+#include "path_table.h"
 #include "re.h"
 #include <pthread.h>
 #include <sqlite3.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 struct clink_db {
 
@@ -19,7 +22,17 @@ struct clink_db {
   /// pre-compiled regexes
   re_t *regexes;
 
+  /// cache of record IDs to absolute paths
+  path_table_t path_table;
+  bool path_table_inited : 1;
+
   /// mutual exclusion mechanism to accelerate bulk operations
   pthread_mutex_t bulk_operation;
   bool bulk_operation_inited : 1;
 };
+
+/// nanoseconds the calling thread has waited to begin bulk insertions
+INTERNAL extern _Thread_local uint64_t bulk_wait_ns;
+
+/// nanoseconds the calling thread has spent performing bulk insertions
+INTERNAL extern _Thread_local uint64_t bulk_insert_ns;
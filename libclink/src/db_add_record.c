@@ -2,13 +2,134 @@
 #include "debug.h"
 #include "get_id.h"
 #include "make_relative_to.h"
+#include "path_table.h"
 #include "sql.h"
 #include <clink/db.h>
+#include <clink/symbol.h>
 #include <errno.h>
 #include <sqlite3.h>
 #include <stdint.h>
 #include <string.h>
 
+/** discard #include information for any previous record of a path
+ *
+ * \param db Database to operate on
+ * \param rel Database-relative form of the path
+ * \return 0 on success or an errno on failure
+ */
+static int forget_includes(clink_db_t *db, const char *rel) {
+
+  static const char *const DELETES[] = {
+      "delete from suffixes where record = (select id from records where "
+      "path = @path);",
+      "delete from includes where included = (select id from records where "
+      "path = @path);",
+  };
+
+  int rc = 0;
+
+  for (size_t i = 0; i < sizeof(DELETES) / sizeof(DELETES[0]); ++i) {
+
+    sqlite3_stmt *s = NULL;
+    if (ERROR((rc = sql_prepare(db->db, DELETES[i], &s))))
+      return rc;
+
+    if (ERROR((rc = sql_bind_text(s, 1, rel)))) {
+      sqlite3_finalize(s);
+      return rc;
+    }
+
+    const int r = sqlite3_step(s);
+    sqlite3_finalize(s);
+    if (ERROR(r != SQLITE_DONE))
+      return sql_err_to_errno(r);
+  }
+
+  return rc;
+}
+
+/** make a record resolvable as the target of #includes
+ *
+ * Each trailing sequence of path components is stored as a way of reaching
+ * this record, and any existing #includes naming one of these are linked to
+ * it.
+ *
+ * \param db Database to operate on
+ * \param path Absolute path of the record
+ * \param id Identifier of the record
+ * \return 0 on success or an errno on failure
+ */
+static int add_suffixes(clink_db_t *db, const char *path,
+                        clink_record_id_t id) {
+
+  static const char SUFFIX_INSERT[] =
+      "insert or ignore into suffixes (suffix, record) values (@suffix, "
+      "@record);";
+
+  static const char INCLUDE_INSERT[] =
+      "insert or ignore into includes (includer, included) select path, "
+      "@record from symbols where name = @suffix and category = @category;";
+
+  int rc = 0;
+  sqlite3_stmt *suffix = NULL;
+  sqlite3_stmt *include = NULL;
+
+  if (ERROR((rc = sql_prepare(db->db, SUFFIX_INSERT, &suffix))))
+    goto done;
+  if (ERROR((rc = sql_prepare(db->db, INCLUDE_INSERT, &include))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_int(suffix, 2, id))))
+    goto done;
+  if (ERROR((rc = sql_bind_int(include, 1, id))))
+    goto done;
+  if (ERROR((rc = sql_bind_int(include, 3, CLINK_INCLUDE))))
+    goto done;
+
+  // walk backwards through the path, from the shortest suffix to the longest
+  for (size_t i = strlen(path); i-- > 0;) {
+    if (path[i] != '/')
+      continue;
+
+    // at the root, retain the leading `/` so #includes of absolute paths match
+    const char *s = i == 0 ? path : &path[i + 1];
+    if (*s == '\0')
+      continue;
+
+    if (ERROR((rc = sql_bind_text(suffix, 1, s))))
+      goto done;
+    {
+      const int r = sqlite3_step(suffix);
+      if (ERROR(r != SQLITE_DONE)) {
+        rc = sql_err_to_errno(r);
+        goto done;
+      }
+    }
+    if (ERROR((rc = sql_err_to_errno(sqlite3_reset(suffix)))))
+      goto done;
+
+    if (ERROR((rc = sql_bind_text(include, 2, s))))
+      goto done;
+    {
+      const int r = sqlite3_step(include);
+      if (ERROR(r != SQLITE_DONE)) {
+        rc = sql_err_to_errno(r);
+        goto done;
+      }
+    }
+    if (ERROR((rc = sql_err_to_errno(sqlite3_reset(include)))))
+      goto done;
+  }
+
+done:
+  if (include != NULL)
+    sqlite3_finalize(include);
+  if (suffix != NULL)
+    sqlite3_finalize(suffix);
+
+  return rc;
+}
+
 int clink_db_add_record(clink_db_t *db, const char *path, uint64_t hash,
                         uint64_t timestamp, clink_record_id_t *id) {
 
@@ -36,6 +157,10 @@ int clink_db_add_record(clink_db_t *db, const char *path, uint64_t hash,
   if (id != NULL)
     *id = -1;
 
+  // any previous incarnation of this record is about to be replaced
+  if (ERROR((rc = forget_includes(db, rel))))
+    return rc;
+
   sqlite3_stmt *insert = NULL;
   if (ERROR((rc = sql_prepare(db->db, INSERT, &insert))))
     goto done;
@@ -57,17 +182,24 @@ int clink_db_add_record(clink_db_t *db, const char *path, uint64_t hash,
     }
   }
 
-  // if the user did not need the ID of this row, we are done
-  if (id == NULL)
-    goto done;
+  // the insertion may have replaced an existing record or reused the ID of a
+  // deleted one, so any cached path resolutions are now suspect
+  path_table_invalidate(&db->path_table);
 
   // Now we need to look up the ID of the just-inserted record. We do this as a
   // separate query instead of using `sqlite3_last_insert_rowid` because
   // multiple threads or multiple processes may be operating on the database at
   // once.
-  if (ERROR((rc = get_id(db, path, id))))
+  clink_record_id_t inserted = -1;
+  if (ERROR((rc = get_id(db, path, &inserted))))
+    goto done;
+
+  if (ERROR((rc = add_suffixes(db, path, inserted))))
     goto done;
 
+  if (id != NULL)
+    *id = inserted;
+
 done:
   if (insert != NULL)
     sqlite3_finalize(insert);
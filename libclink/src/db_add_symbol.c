@@ -11,8 +11,18 @@
 #include <errno.h>
 #include <pthread.h>
 #include <sqlite3.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
+
+/// current monotonic time, in nanoseconds
+static uint64_t now(void) {
+  struct timespec ts = {0};
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
 
 static int add(sqlite3_stmt *stmt, clink_category_t category, span_t name,
                clink_record_id_t path, span_t parent) {
@@ -75,6 +85,86 @@ done:
   return rc;
 }
 
+static int add_call(sqlite3_stmt *stmt, span_t callee, clink_record_id_t path,
+                    span_t caller) {
+
+  assert(stmt != NULL);
+
+  int rc = 0;
+
+  if (ERROR((rc = sql_bind_span(stmt, 1, caller))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_span(stmt, 2, callee))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_int(stmt, 3, path))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_int(stmt, 4, callee.lineno))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_int(stmt, 5, callee.colno))))
+    goto done;
+
+  {
+    int r = sqlite3_step(stmt);
+    if (ERROR(r != SQLITE_DONE)) {
+      rc = sql_err_to_errno(r);
+      goto done;
+    }
+  }
+
+done:
+  return rc;
+}
+
+static int add_name(sqlite3_stmt *stmt, span_t name) {
+
+  assert(stmt != NULL);
+
+  int rc = 0;
+
+  if (ERROR((rc = sql_bind_span(stmt, 1, name))))
+    goto done;
+
+  {
+    int r = sqlite3_step(stmt);
+    if (ERROR(r != SQLITE_DONE)) {
+      rc = sql_err_to_errno(r);
+      goto done;
+    }
+  }
+
+done:
+  return rc;
+}
+
+static int add_include(sqlite3_stmt *stmt, clink_record_id_t path,
+                       span_t name) {
+
+  assert(stmt != NULL);
+
+  int rc = 0;
+
+  if (ERROR((rc = sql_bind_int(stmt, 1, path))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_span(stmt, 2, name))))
+    goto done;
+
+  {
+    int r = sqlite3_step(stmt);
+    if (ERROR(r != SQLITE_DONE)) {
+      rc = sql_err_to_errno(r);
+      goto done;
+    }
+  }
+
+done:
+  return rc;
+}
+
 int add_symbols(clink_db_t *db, size_t syms_size, symbol_t *syms,
                 clink_record_id_t id) {
 
@@ -90,17 +180,48 @@ int add_symbols(clink_db_t *db, size_t syms_size, symbol_t *syms,
       "values (@name, @path, @category, @line, @col, @start_line, @start_col, "
       "@start_byte, @end_line, @end_col, @end_byte, @parent);";
 
+  // note the symbol’s name for `clink_db_index_names` to pick up
+
+  static const char NAME_INSERT[] =
+      "insert or ignore into names (name) values (@name);";
+
+  // insert function calls into the call graph
+
+  static const char CALL_INSERT[] =
+      "insert or ignore into calls (caller, callee, path, line, col) values "
+      "(@caller, @callee, @path, @line, @col);";
+
+  // link #includes to any known records they may refer to
+
+  static const char INCLUDE_INSERT[] =
+      "insert or ignore into includes (includer, included) select @includer, "
+      "record from suffixes where suffix = @name;";
+
   int rc = 0;
 
   // assume other `add_symbols` calls are being done concurrently and try to
   // serialise them to accelerate throughput
-  if (ERROR((rc = pthread_mutex_lock(&db->bulk_operation))))
-    return rc;
+  if ((rc = pthread_mutex_trylock(&db->bulk_operation))) {
+    if (ERROR(rc != EBUSY))
+      return rc;
+    // another thread is inserting, so account for the time we wait on it
+    const uint64_t start = now();
+    if (ERROR((rc = pthread_mutex_lock(&db->bulk_operation))))
+      return rc;
+    bulk_wait_ns += now() - start;
+  }
+  const uint64_t start = now();
 
   sqlite3_stmt *s = NULL;
+  sqlite3_stmt *n = NULL;
+  sqlite3_stmt *c = NULL;
+  sqlite3_stmt *inc = NULL;
   if (ERROR((rc = sql_prepare(db->db, SYMBOL_INSERT, &s))))
     goto done;
 
+  if (ERROR((rc = sql_prepare(db->db, NAME_INSERT, &n))))
+    goto done;
+
   for (size_t i = 0; i < syms_size; ++i) {
 
     // if we already used the statement, clear it for reuse
@@ -123,12 +244,57 @@ int add_symbols(clink_db_t *db, size_t syms_size, symbol_t *syms,
     if (ERROR(
             (rc = add(s, syms[i].category, syms[i].name, id, syms[i].parent))))
       goto done;
+
+    // symbols often repeat the name before them, which we need not look up
+    const bool repeat = i > 0 && syms[i].name.size == syms[i - 1].name.size &&
+                        memcmp(syms[i].name.base, syms[i - 1].name.base,
+                               syms[i].name.size) == 0;
+    if (!repeat) {
+      int r UNUSED = sqlite3_reset(n);
+      assert(r == SQLITE_OK);
+      if (ERROR((rc = add_name(n, syms[i].name))))
+        goto done;
+    }
+
+    // calls from within a known function are also edges in the call graph
+    if (syms[i].category == CLINK_FUNCTION_CALL && syms[i].parent.size > 0) {
+      if (c == NULL) {
+        if (ERROR((rc = sql_prepare(db->db, CALL_INSERT, &c))))
+          goto done;
+      } else {
+        int r UNUSED = sqlite3_reset(c);
+        assert(r == SQLITE_OK);
+      }
+
+      if (ERROR((rc = add_call(c, syms[i].name, id, syms[i].parent))))
+        goto done;
+    }
+
+    if (syms[i].category == CLINK_INCLUDE) {
+      if (inc == NULL) {
+        if (ERROR((rc = sql_prepare(db->db, INCLUDE_INSERT, &inc))))
+          goto done;
+      } else {
+        int r UNUSED = sqlite3_reset(inc);
+        assert(r == SQLITE_OK);
+      }
+
+      if (ERROR((rc = add_include(inc, id, syms[i].name))))
+        goto done;
+    }
   }
 
 done:
+  if (inc != NULL)
+    sqlite3_finalize(inc);
+  if (c != NULL)
+    sqlite3_finalize(c);
+  if (n != NULL)
+    sqlite3_finalize(n);
   if (s != NULL)
     sqlite3_finalize(s);
 
+  bulk_insert_ns += now() - start;
   {
     int r UNUSED = pthread_mutex_unlock(&db->bulk_operation);
     assert(r == 0);
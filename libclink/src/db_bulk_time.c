@@ -0,0 +1,11 @@
+#include "db.h"
+#include <clink/db.h>
+#include <stdint.h>
+
+_Thread_local uint64_t bulk_wait_ns;
+
+_Thread_local uint64_t bulk_insert_ns;
+
+clink_db_bulk_time_t clink_db_bulk_time(void) {
+  return (clink_db_bulk_time_t){.wait = bulk_wait_ns, .insert = bulk_insert_ns};
+}
@@ -1,4 +1,5 @@
 #include "db.h"
+#include "path_table.h"
 #include "re.h"
 #include <clink/db.h>
 #include <pthread.h>
@@ -16,6 +17,10 @@ void clink_db_close(clink_db_t **db) {
     (void)pthread_mutex_destroy(&(*db)->bulk_operation);
   (*db)->bulk_operation_inited = false;
 
+  if ((*db)->path_table_inited)
+    path_table_free(&(*db)->path_table);
+  (*db)->path_table_inited = false;
+
   re_free(&(*db)->regexes);
 
   // close the database handle
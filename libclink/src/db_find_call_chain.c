@@ -0,0 +1,254 @@
+#include "db.h"
+#include "debug.h"
+#include "iter.h"
+#include "path_range.h"
+#include "path_table.h"
+#include "sql.h"
+#include <clink/db.h>
+#include <clink/iter.h>
+#include <clink/symbol.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// state for our iterator
+typedef struct {
+
+  /// database we are searching
+  clink_db_t *db;
+
+  /// the function we started from
+  char *name;
+
+  /// record paths within the path prefix
+  path_range_t range;
+
+  /// SQL query we are executing
+  sqlite3_stmt *stmt;
+
+  /// last symbol we yielded
+  clink_symbol_t last;
+
+} state_t;
+
+static void state_free(state_t **ss) {
+
+  if (ss == NULL || *ss == NULL)
+    return;
+
+  state_t *s = *ss;
+
+  s->last = (clink_symbol_t){0};
+
+  if (s->stmt != NULL)
+    sqlite3_finalize(s->stmt);
+  s->stmt = NULL;
+
+  path_range_free(&s->range);
+
+  free(s->name);
+  s->name = NULL;
+
+  free(s);
+  *ss = NULL;
+}
+
+static int next(clink_iter_t *it, const clink_symbol_t **yielded) {
+
+  if (ERROR(it == NULL))
+    return EINVAL;
+
+  if (ERROR(yielded == NULL))
+    return EINVAL;
+
+  state_t *s = it->state;
+
+  // discard any previous symbol we had
+  s->last = (clink_symbol_t){0};
+
+  // is the iterator exhausted?
+  if (s->stmt == NULL)
+    return ENOMSG;
+
+  // extract the next result
+  int rc = sqlite3_step(s->stmt);
+  if (ERROR(rc != SQLITE_ROW && rc != SQLITE_DONE))
+    return sql_err_to_errno(rc);
+
+  // did we just exhaust this iterator?
+  if (rc == SQLITE_DONE) {
+    sqlite3_finalize(s->stmt);
+    s->stmt = NULL;
+    return ENOMSG;
+  }
+
+  // construct a symbol from the result
+  s->last.category = CLINK_FUNCTION_CALL;
+  s->last.name = (char *)sqlite3_column_text(s->stmt, 0);
+  {
+    const clink_record_id_t id = sqlite3_column_int64(s->stmt, 1);
+    const char *path = NULL;
+    if (ERROR((rc = path_table_find(s->db, id, &path))))
+      return rc;
+    s->last.path = (char *)path;
+  }
+  s->last.lineno = sqlite3_column_int64(s->stmt, 2);
+  s->last.colno = sqlite3_column_int64(s->stmt, 3);
+  s->last.parent = (char *)sqlite3_column_text(s->stmt, 4);
+
+  // yield it
+  *yielded = &s->last;
+  return 0;
+}
+
+static void my_free(clink_iter_t *it) {
+
+  if (it == NULL)
+    return;
+
+  state_t *s = it->state;
+  state_free(&s);
+}
+
+int clink_db_find_call_chain(clink_db_t *db, const char *name,
+                             clink_call_direction_t direction,
+                             unsigned long depth, const char *path,
+                             clink_iter_t **it) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  if (ERROR(name == NULL))
+    return EINVAL;
+
+  if (ERROR(direction != CLINK_CALLERS && direction != CLINK_CALLEES))
+    return EINVAL;
+
+  // the traversal terminates on cycles only because it is depth-limited
+  if (ERROR(depth == 0))
+    return EINVAL;
+
+  if (ERROR(path != NULL && path[0] != '/'))
+    return EINVAL;
+
+  if (ERROR(it == NULL))
+    return EINVAL;
+
+  // Collect the functions within reach of `name`, then the calls into (or out
+  // of) each of them. `union` discards repeated (function, distance) pairs, so
+  // a function reachable by multiple routes is only expanded once per
+  // distance. The final grouping collapses these to the shortest distance.
+  // Any path prefix only restricts the call sites yielded, not the traversal.
+
+  static const char CALLERS[] =
+      "with recursive reach(name, distance) as (select @name, 0 union select "
+      "calls.caller, reach.distance + 1 from reach inner join calls on "
+      "calls.callee = reach.name where reach.distance + 1 < @depth) select "
+      "calls.callee, calls.path, calls.line, calls.col, calls.caller, "
+      "min(reach.distance) as distance from reach inner join calls on "
+      "calls.callee = reach.name inner join records on calls.path = "
+      "records.id";
+
+  static const char CALLEES[] =
+      "with recursive reach(name, distance) as (select @name, 0 union select "
+      "calls.callee, reach.distance + 1 from reach inner join calls on "
+      "calls.caller = reach.name where reach.distance + 1 < @depth) select "
+      "calls.callee, calls.path, calls.line, calls.col, calls.caller, "
+      "min(reach.distance) as distance from reach inner join calls on "
+      "calls.caller = reach.name inner join records on calls.path = "
+      "records.id";
+
+  static const char TAIL[] =
+      " group by calls.path, calls.line, calls.col, calls.caller, calls.callee "
+      "order by distance, records.path, calls.line, calls.col;";
+
+  int rc = 0;
+  clink_iter_t *i = NULL;
+  char *sql = NULL;
+  size_t sql_size = 0;
+  FILE *buffer = NULL;
+
+  // allocate state for our iterator
+  state_t *s = calloc(1, sizeof(*s));
+  if (ERROR(s == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  s->db = db;
+
+  s->name = strdup(name);
+  if (ERROR(s->name == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+
+  // translate the path prefix into ranges over `records.path`
+  if (path != NULL) {
+    if (ERROR((rc = path_range_init(&s->range, db, path))))
+      goto done;
+  }
+
+  // construct a query to traverse the call graph
+  buffer = open_memstream(&sql, &sql_size);
+  if (ERROR(buffer == NULL)) {
+    rc = errno;
+    goto done;
+  }
+  fputs(direction == CLINK_CALLERS ? CALLERS : CALLEES, buffer);
+  if (path != NULL) {
+    fputs(" where ", buffer);
+    path_range_write(&s->range, buffer);
+  }
+  fputs(TAIL, buffer);
+  if (ERROR(fclose(buffer) < 0)) {
+    buffer = NULL;
+    rc = errno;
+    goto done;
+  }
+  buffer = NULL;
+
+  if (ERROR((rc = sql_prepare(db->db, sql, &s->stmt))))
+    goto done;
+
+  // bind the where clause to our given function
+  if (ERROR((rc = sql_bind_text(s->stmt, 1, s->name))))
+    goto done;
+  if (depth > INT64_MAX)
+    depth = INT64_MAX;
+  if (ERROR((rc = sql_bind_int(s->stmt, 2, depth))))
+    goto done;
+  if (path != NULL) {
+    if (ERROR((rc = path_range_bind(&s->range, s->stmt))))
+      goto done;
+  }
+
+  // create an iterator for stepping through our query
+  i = calloc(1, sizeof(*i));
+  if (ERROR(i == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+
+  // configure it to iterate through our query
+  i->next_symbol = next;
+  i->state = s;
+  s = NULL;
+  i->free = my_free;
+
+done:
+  if (buffer != NULL)
+    (void)fclose(buffer);
+  free(sql);
+
+  if (rc) {
+    clink_iter_free(&i);
+    state_free(&s);
+  } else {
+    *it = i;
+  }
+
+  return rc;
+}
@@ -0,0 +1,229 @@
+#include "db.h"
+#include "debug.h"
+#include "sql.h"
+#include "variant_hash.h"
+#include <clink/db.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// maximum edit distance of names we consider similar
+enum { MAX_DISTANCE = 2 };
+
+/// a candidate similar name
+typedef struct {
+  char *name;      ///< the name itself
+  size_t distance; ///< edit distance from the name being searched for
+} candidate_t;
+
+/** Levenshtein distance between two strings
+ *
+ * \param a First string
+ * \param b Second string
+ * \param distance [out] Number of byte insertions, deletions and substitutions
+ *   needed to transform `a` into `b` on success
+ * \return 0 on success or an errno on failure
+ */
+static int edit_distance(const char *a, const char *b, size_t *distance) {
+
+  const size_t a_len = strlen(a);
+  const size_t b_len = strlen(b);
+
+  // the distance from each prefix of `a` to the previous and current prefix of
+  // `b`
+  size_t *prev = calloc(a_len + 1, sizeof(prev[0]));
+  size_t *cur = calloc(a_len + 1, sizeof(cur[0]));
+  if (ERROR(prev == NULL || cur == NULL)) {
+    free(cur);
+    free(prev);
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i <= a_len; ++i)
+    prev[i] = i;
+
+  for (size_t j = 1; j <= b_len; ++j) {
+    cur[0] = j;
+    for (size_t i = 1; i <= a_len; ++i) {
+      size_t d = prev[i - 1] + (a[i - 1] != b[j - 1]);
+      if (prev[i] + 1 < d)
+        d = prev[i] + 1;
+      if (cur[i - 1] + 1 < d)
+        d = cur[i - 1] + 1;
+      cur[i] = d;
+    }
+    size_t *tmp = prev;
+    prev = cur;
+    cur = tmp;
+  }
+
+  *distance = prev[a_len];
+
+  free(cur);
+  free(prev);
+  return 0;
+}
+
+static int cmp(const void *a, const void *b) {
+  const candidate_t *x = a;
+  const candidate_t *y = b;
+  if (x->distance < y->distance)
+    return -1;
+  if (x->distance > y->distance)
+    return 1;
+  return strcmp(x->name, y->name);
+}
+
+int clink_db_find_similar(clink_db_t *db, const char *name, char ***similar,
+                          size_t *similar_size) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  if (ERROR(name == NULL))
+    return EINVAL;
+
+  if (ERROR(similar == NULL))
+    return EINVAL;
+
+  if (ERROR(similar_size == NULL))
+    return EINVAL;
+
+  static const char CANDIDATES[] =
+      "select names.name from variants inner join names on variants.name = "
+      "names.id where variants.hash = @hash;";
+
+  static const char EXISTS[] = "select 1 from symbols where name = @name "
+                               "limit 1;";
+
+  int rc = 0;
+  sqlite3_stmt *candidates = NULL;
+  sqlite3_stmt *exists = NULL;
+  candidate_t *found = NULL;
+  size_t found_size = 0;
+  char **result = NULL;
+
+  if (ERROR((rc = sql_prepare(db->db, CANDIDATES, &candidates))))
+    goto done;
+
+  if (ERROR((rc = sql_prepare(db->db, EXISTS, &exists))))
+    goto done;
+
+  // Look up the name itself and each of its single-byte deletions. Any indexed
+  // name one insertion, deletion or substitution away shares one of these
+  // variants, as do some names two edits away.
+  const size_t len = strlen(name);
+  for (size_t skip = 0; skip <= len; ++skip) {
+
+    // the final iteration looks up the name with nothing omitted
+    const size_t omit = skip == len ? SIZE_MAX : skip;
+
+    // a run of repeated bytes produces the same deletion repeatedly
+    if (omit != SIZE_MAX && skip > 0 && name[skip] == name[skip - 1])
+      continue;
+
+    const int64_t hash = variant_hash(name, omit);
+    if (ERROR((rc = sql_err_to_errno(sqlite3_bind_int64(candidates, 1, hash)))))
+      goto done;
+
+    while (true) {
+      int r = sqlite3_step(candidates);
+      if (r == SQLITE_DONE)
+        break;
+      if (ERROR(r != SQLITE_ROW)) {
+        rc = sql_err_to_errno(r);
+        goto done;
+      }
+
+      const char *c = (const char *)sqlite3_column_text(candidates, 0);
+      if (ERROR(c == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+
+      // have we already seen this candidate via another variant?
+      bool seen = false;
+      for (size_t i = 0; i < found_size; ++i) {
+        if (strcmp(found[i].name, c) == 0) {
+          seen = true;
+          break;
+        }
+      }
+      if (seen)
+        continue;
+
+      // discard hash collisions and names that are too different
+      size_t distance = 0;
+      if (ERROR((rc = edit_distance(name, c, &distance))))
+        goto done;
+      if (distance > MAX_DISTANCE)
+        continue;
+
+      // discard names whose symbols have since been removed
+      if (ERROR((rc = sql_bind_text(exists, 1, c))))
+        goto done;
+      r = sqlite3_step(exists);
+      if (ERROR(r != SQLITE_ROW && r != SQLITE_DONE)) {
+        rc = sql_err_to_errno(r);
+        goto done;
+      }
+      const bool live = r == SQLITE_ROW;
+      if (ERROR((rc = sql_err_to_errno(sqlite3_reset(exists)))))
+        goto done;
+      if (!live)
+        continue;
+
+      candidate_t *f = realloc(found, (found_size + 1) * sizeof(found[0]));
+      if (ERROR(f == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+      found = f;
+      found[found_size].name = strdup(c);
+      if (ERROR(found[found_size].name == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+      found[found_size].distance = distance;
+      ++found_size;
+    }
+
+    if (ERROR((rc = sql_err_to_errno(sqlite3_reset(candidates)))))
+      goto done;
+  }
+
+  // order closest matches first
+  if (found_size > 0)
+    qsort(found, found_size, sizeof(found[0]), cmp);
+
+  if (found_size > 0) {
+    result = calloc(found_size, sizeof(result[0]));
+    if (ERROR(result == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+  }
+  for (size_t i = 0; i < found_size; ++i) {
+    result[i] = found[i].name;
+    found[i].name = NULL;
+  }
+
+  *similar = result;
+  *similar_size = found_size;
+
+done:
+  for (size_t i = 0; i < found_size; ++i)
+    free(found[i].name);
+  free(found);
+
+  if (exists != NULL)
+    sqlite3_finalize(exists);
+  if (candidates != NULL)
+    sqlite3_finalize(candidates);
+
+  return rc;
+}
@@ -0,0 +1,241 @@
+#include "db.h"
+#include "debug.h"
+#include "iter.h"
+#include "path_range.h"
+#include "path_table.h"
+#include "sql.h"
+#include <clink/db.h>
+#include <clink/iter.h>
+#include <clink/symbol.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// state for our iterator
+typedef struct {
+
+  /// database we are searching
+  clink_db_t *db;
+
+  /// the file we started from
+  char *name;
+
+  /// record paths within the path prefix
+  path_range_t range;
+
+  /// SQL query we are executing
+  sqlite3_stmt *stmt;
+
+  /// last symbol we yielded
+  clink_symbol_t last;
+
+} state_t;
+
+static void state_free(state_t **ss) {
+
+  if (ss == NULL || *ss == NULL)
+    return;
+
+  state_t *s = *ss;
+
+  s->last = (clink_symbol_t){0};
+
+  if (s->stmt != NULL)
+    sqlite3_finalize(s->stmt);
+  s->stmt = NULL;
+
+  path_range_free(&s->range);
+
+  free(s->name);
+  s->name = NULL;
+
+  free(s);
+  *ss = NULL;
+}
+
+static int next(clink_iter_t *it, const clink_symbol_t **yielded) {
+
+  if (ERROR(it == NULL))
+    return EINVAL;
+
+  if (ERROR(yielded == NULL))
+    return EINVAL;
+
+  state_t *s = it->state;
+
+  // discard any previous symbol we had
+  s->last = (clink_symbol_t){0};
+
+  // is the iterator exhausted?
+  if (s->stmt == NULL)
+    return ENOMSG;
+
+  // extract the next result
+  int rc = sqlite3_step(s->stmt);
+  if (ERROR(rc != SQLITE_ROW && rc != SQLITE_DONE))
+    return sql_err_to_errno(rc);
+
+  // did we just exhaust this iterator?
+  if (rc == SQLITE_DONE) {
+    sqlite3_finalize(s->stmt);
+    s->stmt = NULL;
+    return ENOMSG;
+  }
+
+  // construct a symbol from the result
+  s->last.category = CLINK_INCLUDE;
+  s->last.name = (char *)sqlite3_column_text(s->stmt, 0);
+  {
+    const clink_record_id_t id = sqlite3_column_int64(s->stmt, 1);
+    const char *path = NULL;
+    if (ERROR((rc = path_table_find(s->db, id, &path))))
+      return rc;
+    s->last.path = (char *)path;
+  }
+  s->last.lineno = sqlite3_column_int64(s->stmt, 2);
+  s->last.colno = sqlite3_column_int64(s->stmt, 3);
+  s->last.start.lineno = sqlite3_column_int64(s->stmt, 4);
+  s->last.start.colno = sqlite3_column_int64(s->stmt, 5);
+  s->last.start.byte = sqlite3_column_int64(s->stmt, 6);
+  s->last.end.lineno = sqlite3_column_int64(s->stmt, 7);
+  s->last.end.colno = sqlite3_column_int64(s->stmt, 8);
+  s->last.end.byte = sqlite3_column_int64(s->stmt, 9);
+  s->last.parent = (char *)sqlite3_column_text(s->stmt, 10);
+
+  // yield it
+  *yielded = &s->last;
+  return 0;
+}
+
+static void my_free(clink_iter_t *it) {
+
+  if (it == NULL)
+    return;
+
+  state_t *s = it->state;
+  state_free(&s);
+}
+
+int clink_db_find_transitive_includer(clink_db_t *db, const char *name,
+                                      const char *path, clink_iter_t **it) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  if (ERROR(name == NULL))
+    return EINVAL;
+
+  if (ERROR(path != NULL && path[0] != '/'))
+    return EINVAL;
+
+  if (ERROR(it == NULL))
+    return EINVAL;
+
+  // Collect the records that `name` refers to and everything that
+  // transitively #includes them, then find the #include sites that link these
+  // together. `union` discards records we have already reached, so cycles in
+  // the #include graph terminate. Any path prefix only restricts the #include
+  // sites yielded, not the traversal.
+
+  static const char QUERY[] =
+      "with recursive reach(id) as (select record from suffixes where suffix "
+      "= @name union select includes.includer from includes inner join reach "
+      "on includes.included = reach.id) select symbols.name, symbols.path, "
+      "symbols.line, symbols.col, symbols.start_line, symbols.start_col, "
+      "symbols.start_byte, symbols.end_line, symbols.end_col, "
+      "symbols.end_byte, symbols.parent from reach inner join includes on "
+      "includes.included = reach.id inner join suffixes on suffixes.record = "
+      "reach.id inner join symbols on symbols.path = includes.includer and "
+      "symbols.name = suffixes.suffix and symbols.category = @category inner "
+      "join records on symbols.path = records.id";
+
+  static const char TAIL[] = " group by symbols.rowid order by records.path, "
+                             "symbols.line, symbols.col;";
+
+  int rc = 0;
+  clink_iter_t *i = NULL;
+  char *sql = NULL;
+  size_t sql_size = 0;
+  FILE *buffer = NULL;
+
+  // allocate state for our iterator
+  state_t *s = calloc(1, sizeof(*s));
+  if (ERROR(s == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  s->db = db;
+
+  s->name = strdup(name);
+  if (ERROR(s->name == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+
+  // translate the path prefix into ranges over `records.path`
+  if (path != NULL) {
+    if (ERROR((rc = path_range_init(&s->range, db, path))))
+      goto done;
+  }
+
+  // construct a query to traverse the #include graph
+  buffer = open_memstream(&sql, &sql_size);
+  if (ERROR(buffer == NULL)) {
+    rc = errno;
+    goto done;
+  }
+  fputs(QUERY, buffer);
+  if (path != NULL) {
+    fputs(" where ", buffer);
+    path_range_write(&s->range, buffer);
+  }
+  fputs(TAIL, buffer);
+  if (ERROR(fclose(buffer) < 0)) {
+    buffer = NULL;
+    rc = errno;
+    goto done;
+  }
+  buffer = NULL;
+
+  if (ERROR((rc = sql_prepare(db->db, sql, &s->stmt))))
+    goto done;
+
+  // bind the where clause to our given file
+  if (ERROR((rc = sql_bind_text(s->stmt, 1, s->name))))
+    goto done;
+  if (ERROR((rc = sql_bind_int(s->stmt, 2, CLINK_INCLUDE))))
+    goto done;
+  if (path != NULL) {
+    if (ERROR((rc = path_range_bind(&s->range, s->stmt))))
+      goto done;
+  }
+
+  // create an iterator for stepping through our query
+  i = calloc(1, sizeof(*i));
+  if (ERROR(i == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+
+  // configure it to iterate through our query
+  i->next_symbol = next;
+  i->state = s;
+  s = NULL;
+  i->free = my_free;
+
+done:
+  if (buffer != NULL)
+    (void)fclose(buffer);
+  free(sql);
+
+  if (rc) {
+    clink_iter_free(&i);
+    state_free(&s);
+  } else {
+    *it = i;
+  }
+
+  return rc;
+}
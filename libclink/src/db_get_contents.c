@@ -0,0 +1,90 @@
+#include "db.h"
+#include "debug.h"
+#include "get_id.h"
+#include "sql.h"
+#include <clink/db.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+int clink_db_get_contents(clink_db_t *db, const char *path,
+                          const unsigned long *linenos, size_t count,
+                          char **contents) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  if (ERROR(path == NULL))
+    return EINVAL;
+
+  if (ERROR(path[0] != '/'))
+    return EINVAL;
+
+  if (ERROR(count > 0 && linenos == NULL))
+    return EINVAL;
+
+  if (ERROR(count > 0 && contents == NULL))
+    return EINVAL;
+
+  static const char QUERY[] =
+      "select body from content where path = @path and line = @line;";
+
+  int rc = 0;
+  sqlite3_stmt *stmt = NULL;
+
+  for (size_t i = 0; i < count; ++i)
+    contents[i] = NULL;
+
+  if (count == 0)
+    goto done;
+
+  // find the identifier for the given path, once for the whole batch
+  clink_record_id_t id = -1;
+  if (ERROR((rc = get_id(db, path, &id))))
+    goto done;
+
+  // create a query to lookup file content, that we will reuse for every line
+  if (ERROR((rc = sql_prepare(db->db, QUERY, &stmt))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_int(stmt, 1, id))))
+    goto done;
+
+  for (size_t i = 0; i < count; ++i) {
+
+    if (ERROR((rc = sql_bind_int(stmt, 2, linenos[i]))))
+      goto done;
+
+    const int r = sqlite3_step(stmt);
+    if (r == SQLITE_ROW) {
+      // duplicate it for the caller
+      contents[i] = strdup((const char *)sqlite3_column_text(stmt, 0));
+      if (ERROR(contents[i] == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+    } else if (ERROR(r != SQLITE_DONE)) {
+      rc = sql_err_to_errno(r);
+      goto done;
+    }
+
+    // prepare the query for the next line, retaining the path binding
+    if (ERROR((rc = sql_err_to_errno(sqlite3_reset(stmt)))))
+      goto done;
+  }
+
+done:
+  if (stmt != NULL)
+    sqlite3_finalize(stmt);
+
+  if (rc) {
+    for (size_t i = 0; i < count; ++i) {
+      free(contents[i]);
+      contents[i] = NULL;
+    }
+  }
+
+  return rc;
+}
@@ -0,0 +1,64 @@
+#include "../../common/compiler.h"
+#include "db.h"
+#include "debug.h"
+#include "sql.h"
+#include <clink/db.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <string.h>
+
+int clink_db_get_metadata(clink_db_t *db, const char *key, char **value) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  if (ERROR(db->db == NULL))
+    return EINVAL;
+
+  if (ERROR(key == NULL))
+    return EINVAL;
+
+  if (ERROR(value == NULL))
+    return EINVAL;
+
+  static const char QUERY[] = "select value from metadata where key = @key;";
+
+  int rc = 0;
+  sqlite3_stmt *s = NULL;
+
+  if (ERROR((rc = sql_prepare(db->db, QUERY, &s))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_text(s, 1, key))))
+    goto done;
+
+  {
+    int r = sqlite3_step(s);
+
+    if (r != SQLITE_ROW) {
+      if (LIKELY(r == SQLITE_DONE)) {
+        // no such property
+        rc = ENOENT;
+      } else {
+        rc = sql_err_to_errno(r);
+      }
+      goto done;
+    }
+  }
+
+  {
+    const char *v = (const char *)sqlite3_column_text(s, 0);
+    char *copy = strdup(v == NULL ? "" : v);
+    if (ERROR(copy == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+    *value = copy;
+  }
+
+done:
+  if (s != NULL)
+    sqlite3_finalize(s);
+
+  return rc;
+}
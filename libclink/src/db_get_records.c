@@ -0,0 +1,84 @@
+#include "db.h"
+#include "debug.h"
+#include "sql.h"
+#include <clink/db.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+int clink_db_get_records(clink_db_t *db,
+                         int (*accept)(const clink_record_t *record,
+                                       void *context),
+                         void *context) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  if (ERROR(db->db == NULL))
+    return EINVAL;
+
+  if (ERROR(accept == NULL))
+    return EINVAL;
+
+  static const char QUERY[] =
+      "select path, hash, timestamp, size, duration from records;";
+
+  int rc = 0;
+  sqlite3_stmt *s = NULL;
+  char *path = NULL;
+  size_t path_size = 0;
+
+  if (ERROR((rc = sql_prepare(db->db, QUERY, &s))))
+    goto done;
+
+  // paths are stored relative to the database’s directory if possible
+  const size_t dir_len = strlen(db->dir);
+
+  while (true) {
+    int r = sqlite3_step(s);
+    if (r == SQLITE_DONE)
+      break;
+    if (ERROR(r != SQLITE_ROW)) {
+      rc = sql_err_to_errno(r);
+      goto done;
+    }
+
+    const char *stored = (const char *)sqlite3_column_text(s, 0);
+    const size_t stored_len = (size_t)sqlite3_column_bytes(s, 0);
+    const size_t prefix_len = stored[0] == '/' ? 0 : dir_len;
+
+    // construct the absolute path, reusing the previous allocation if we can
+    if (prefix_len + stored_len + 1 > path_size) {
+      const size_t size = prefix_len + stored_len + 1;
+      char *p = realloc(path, size);
+      if (ERROR(p == NULL)) {
+        rc = ENOMEM;
+        goto done;
+      }
+      path = p;
+      path_size = size;
+    }
+    memcpy(path, db->dir, prefix_len);
+    memcpy(path + prefix_len, stored, stored_len + 1);
+
+    const clink_record_t record = {
+        .path = path,
+        .hash = (uint64_t)sqlite3_column_int64(s, 1),
+        .timestamp = (uint64_t)sqlite3_column_int64(s, 2),
+        .size = (uint64_t)sqlite3_column_int64(s, 3),
+        .duration = (uint64_t)sqlite3_column_int64(s, 4)};
+
+    if ((rc = accept(&record, context)))
+      goto done;
+  }
+
+done:
+  free(path);
+  if (s != NULL)
+    sqlite3_finalize(s);
+
+  return rc;
+}
@@ -0,0 +1,126 @@
+#include "db.h"
+#include "debug.h"
+#include "sql.h"
+#include "variant_hash.h"
+#include <clink/db.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** add a single variant of a name to the index
+ *
+ * \param insert Prepared insertion statement
+ * \param hash Hash of the variant
+ * \param id Identifier of the name this is a variant of
+ * \return 0 on success or an errno on failure
+ */
+static int add_variant(sqlite3_stmt *insert, int64_t hash, sqlite3_int64 id) {
+
+  int rc = sql_err_to_errno(sqlite3_bind_int64(insert, 1, hash));
+  if (ERROR(rc))
+    return rc;
+
+  if (ERROR((rc = sql_err_to_errno(sqlite3_bind_int64(insert, 2, id)))))
+    return rc;
+
+  int r = sqlite3_step(insert);
+  if (ERROR(r != SQLITE_DONE))
+    return sql_err_to_errno(r);
+
+  return sql_err_to_errno(sqlite3_reset(insert));
+}
+
+int clink_db_index_names(clink_db_t *db) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  static const char NEW_NAMES[] =
+      "select id, name from names where indexed = 0 order by id;";
+
+  static const char VARIANTS_INSERT[] = "insert or ignore into variants (hash, "
+                                        "name) values (@hash, @name);";
+
+  static const char MARK[] =
+      "update names set indexed = 1 where indexed = 0 and id <= @id;";
+
+  int rc = 0;
+  sqlite3_stmt *names = NULL;
+  sqlite3_stmt *insert = NULL;
+  sqlite3_stmt *mark = NULL;
+
+  // `add_symbols` records each new name in the `names` table as it goes, with
+  // `indexed` unset. So the names we have not yet processed can be found
+  // without scanning those we have.
+
+  if (ERROR((rc = sql_prepare(db->db, NEW_NAMES, &names))))
+    goto done;
+
+  if (ERROR((rc = sql_prepare(db->db, VARIANTS_INSERT, &insert))))
+    goto done;
+
+  sqlite3_int64 indexed = -1;
+  while (true) {
+
+    int r = sqlite3_step(names);
+    if (r == SQLITE_DONE)
+      break;
+    if (ERROR(r != SQLITE_ROW)) {
+      rc = sql_err_to_errno(r);
+      goto done;
+    }
+
+    const sqlite3_int64 name_id = sqlite3_column_int64(names, 0);
+    const char *name = (const char *)sqlite3_column_text(names, 1);
+    if (ERROR(name == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+
+    // store the name itself…
+    if (ERROR((rc = add_variant(insert, variant_hash(name, SIZE_MAX),
+                                name_id))))
+      goto done;
+
+    // …followed by each of its single-byte deletions
+    for (size_t skip = 0; name[skip] != '\0'; ++skip) {
+
+      // a run of repeated bytes produces the same deletion repeatedly
+      if (skip > 0 && name[skip] == name[skip - 1])
+        continue;
+
+      if (ERROR((rc = add_variant(insert, variant_hash(name, skip), name_id))))
+        goto done;
+    }
+
+    indexed = name_id;
+  }
+
+  // Mark what we processed, so the next call skips it. Any name added
+  // concurrently since we began has a higher ID than those we saw.
+  if (indexed >= 0) {
+    if (ERROR((rc = sql_prepare(db->db, MARK, &mark))))
+      goto done;
+
+    if (ERROR((rc = sql_err_to_errno(sqlite3_bind_int64(mark, 1, indexed)))))
+      goto done;
+
+    int r = sqlite3_step(mark);
+    if (ERROR(r != SQLITE_DONE)) {
+      rc = sql_err_to_errno(r);
+      goto done;
+    }
+  }
+
+done:
+  if (mark != NULL)
+    sqlite3_finalize(mark);
+  if (insert != NULL)
+    sqlite3_finalize(insert);
+  if (names != NULL)
+    sqlite3_finalize(names);
+
+  return rc;
+}
@@ -1,6 +1,7 @@
 #include "../../common/compiler.h"
 #include "db.h"
 #include "debug.h"
+#include "path_table.h"
 #include "re.h"
 #include "schema.h"
 #include "sql.h"
@@ -49,7 +50,7 @@ static int sqlite3_error_offset(sqlite3 *db UNUSED) { return -1; }
 /// running queries against mismatched table structures. This includes when a
 /// functional change is made that does not affect the structural identity of
 /// the database tables but impacts backward/forward compatibility.
-#define SCHEMA_VERSION 1
+#define SCHEMA_VERSION 8
 
 #define STR_(x) #x
 #define STR(x) STR_(x)
@@ -104,9 +105,13 @@ static int configure(sqlite3 *db) {
 
   assert(db != NULL);
 
+  // Builds commit periodically, so a crashed or interrupted build can resume
+  // from its last commit. This needs a journal to roll back a partially
+  // written transaction, but as losing the tail of a build is harmless, there
+  // is no need to sync it.
   static const char *PRAGMAS[] = {
       "pragma synchronous=OFF;",
-      "pragma journal_mode=OFF;",
+      "pragma journal_mode=DELETE;",
       "pragma temp_store=MEMORY;",
       "pragma foreign_keys=ON;",
   };
@@ -307,6 +312,10 @@ int clink_db_open(clink_db_t **db, const char *path) {
     goto done;
   d->bulk_operation_inited = true;
 
+  if (ERROR((rc = path_table_init(&d->path_table))))
+    goto done;
+  d->path_table_inited = true;
+
 done:
   if (rc) {
     clink_db_close(&d);
@@ -0,0 +1,103 @@
+#include "db.h"
+#include "debug.h"
+#include "make_relative_to.h"
+#include "path_table.h"
+#include "sql.h"
+#include <clink/db.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stddef.h>
+#include <string.h>
+
+int clink_db_purge(clink_db_t *db, const char **paths, size_t count) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  if (ERROR(db->db == NULL))
+    return EINVAL;
+
+  if (ERROR(count > 0 && paths == NULL))
+    return EINVAL;
+
+  for (size_t i = 0; i < count; ++i) {
+    if (ERROR(paths[i] == NULL))
+      return EINVAL;
+    if (ERROR(paths[i][0] != '/'))
+      return EINVAL;
+  }
+
+  if (count == 0)
+    return 0;
+
+  // Collect the identifiers of the records to remove, so each table can then
+  // be cleaned with a single statement instead of one per file.
+  static const char CREATE[] =
+      "create temp table if not exists purge (id integer primary key);";
+  static const char CLEAR[] = "delete from temp.purge;";
+  static const char COLLECT[] = "insert or ignore into temp.purge select id "
+                                "from records where path = @path;";
+
+  // names only the purged records’ symbols used are forgotten first, while
+  // those symbols still exist to identify them
+  static const char *const DELETES[] = {
+      "delete from variants where name in (select id from names where name in "
+      "(select name from symbols where path in (select id from temp.purge)) "
+      "and not exists (select 1 from symbols where symbols.name = names.name "
+      "and symbols.path not in (select id from temp.purge)));",
+      "delete from names where name in (select name from symbols where path in "
+      "(select id from temp.purge)) and not exists (select 1 from symbols "
+      "where symbols.name = names.name and symbols.path not in (select id "
+      "from temp.purge));",
+      "delete from symbols where path in (select id from temp.purge);",
+      "delete from calls where path in (select id from temp.purge);",
+      "delete from includes where includer in (select id from temp.purge) or "
+      "included in (select id from temp.purge);",
+      "delete from suffixes where record in (select id from temp.purge);",
+      "delete from content where path in (select id from temp.purge);",
+      "delete from records where id in (select id from temp.purge);",
+  };
+
+  int rc = 0;
+  sqlite3_stmt *collect = NULL;
+
+  if (ERROR((rc = sql_exec(db->db, CREATE))))
+    goto done;
+
+  if (ERROR((rc = sql_exec(db->db, CLEAR))))
+    goto done;
+
+  if (ERROR((rc = sql_prepare(db->db, COLLECT, &collect))))
+    goto done;
+
+  for (size_t i = 0; i < count; ++i) {
+
+    if (ERROR((rc = sql_bind_text(collect, 1,
+                                  make_relative_to(db, paths[i])))))
+      goto done;
+
+    int r = sqlite3_step(collect);
+    if (ERROR(r != SQLITE_DONE)) {
+      rc = sql_err_to_errno(r);
+      goto done;
+    }
+
+    if (ERROR((rc = sql_err_to_errno(sqlite3_reset(collect)))))
+      goto done;
+  }
+
+  for (size_t i = 0; i < sizeof(DELETES) / sizeof(DELETES[0]); ++i) {
+    if (ERROR((rc = sql_exec(db->db, DELETES[i]))))
+      goto done;
+  }
+
+  // the removed records’ IDs may be reused by later insertions
+  path_table_invalidate(&db->path_table);
+
+done:
+  if (collect != NULL)
+    sqlite3_finalize(collect);
+  (void)sql_exec(db->db, CLEAR);
+
+  return rc;
+}
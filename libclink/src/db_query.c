@@ -0,0 +1,306 @@
+#include "db.h"
+#include "debug.h"
+#include "iter.h"
+#include "path_range.h"
+#include "path_table.h"
+#include "re.h"
+#include "sql.h"
+#include <clink/db.h>
+#include <clink/iter.h>
+#include <clink/symbol.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// state for our iterator
+typedef struct {
+
+  /// database we are searching
+  clink_db_t *db;
+
+  /// regular expression of the symbol name we are searching for
+  char *name;
+
+  /// regular expression of the parent we are searching for
+  char *parent;
+
+  /// record paths within the path prefix
+  path_range_t range;
+
+  /// SQL query we are executing
+  sqlite3_stmt *stmt;
+
+  /// last symbol we yielded
+  clink_symbol_t last;
+
+} state_t;
+
+static void state_free(state_t **ss) {
+
+  if (ss == NULL || *ss == NULL)
+    return;
+
+  state_t *s = *ss;
+
+  s->last = (clink_symbol_t){0};
+
+  if (s->stmt != NULL)
+    sqlite3_finalize(s->stmt);
+  s->stmt = NULL;
+
+  path_range_free(&s->range);
+
+  free(s->parent);
+  s->parent = NULL;
+
+  free(s->name);
+  s->name = NULL;
+
+  free(s);
+  *ss = NULL;
+}
+
+static int next(clink_iter_t *it, const clink_symbol_t **yielded) {
+
+  if (ERROR(it == NULL))
+    return EINVAL;
+
+  if (ERROR(yielded == NULL))
+    return EINVAL;
+
+  state_t *s = it->state;
+
+  // discard any previous symbol we had
+  s->last = (clink_symbol_t){0};
+
+  // is the iterator exhausted?
+  if (s->stmt == NULL)
+    return ENOMSG;
+
+  // extract the next result
+  int rc = sqlite3_step(s->stmt);
+  if (ERROR(rc != SQLITE_ROW && rc != SQLITE_DONE))
+    return sql_err_to_errno(rc);
+
+  // did we just exhaust this iterator?
+  if (rc == SQLITE_DONE) {
+    sqlite3_finalize(s->stmt);
+    s->stmt = NULL;
+    return ENOMSG;
+  }
+
+  // construct a symbol from the result
+  s->last.category = sqlite3_column_int64(s->stmt, 2);
+  s->last.name = (char *)sqlite3_column_text(s->stmt, 0);
+  {
+    const clink_record_id_t id = sqlite3_column_int64(s->stmt, 1);
+    const char *path = NULL;
+    if (ERROR((rc = path_table_find(s->db, id, &path))))
+      return rc;
+    s->last.path = (char *)path;
+  }
+  s->last.lineno = sqlite3_column_int64(s->stmt, 3);
+  s->last.colno = sqlite3_column_int64(s->stmt, 4);
+  s->last.start.lineno = sqlite3_column_int64(s->stmt, 5);
+  s->last.start.colno = sqlite3_column_int64(s->stmt, 6);
+  s->last.start.byte = sqlite3_column_int64(s->stmt, 7);
+  s->last.end.lineno = sqlite3_column_int64(s->stmt, 8);
+  s->last.end.colno = sqlite3_column_int64(s->stmt, 9);
+  s->last.end.byte = sqlite3_column_int64(s->stmt, 10);
+  s->last.parent = (char *)sqlite3_column_text(s->stmt, 11);
+
+  // yield it
+  *yielded = &s->last;
+  return 0;
+}
+
+static void my_free(clink_iter_t *it) {
+
+  if (it == NULL)
+    return;
+
+  state_t *s = it->state;
+  state_free(&s);
+}
+
+/** bind a text parameter by name, if it is present in the query
+ *
+ * \param stmt Statement to operate on
+ * \param name Name of the parameter, including its leading `@`
+ * \param value Value to bind, which must outlive the statement
+ * \return 0 on success or an errno on failure
+ */
+static int bind_text(sqlite3_stmt *stmt, const char *name, const char *value) {
+  const int index = sqlite3_bind_parameter_index(stmt, name);
+  if (index == 0)
+    return 0;
+  return sql_bind_text(stmt, index, value);
+}
+
+int clink_db_query(clink_db_t *db, const clink_query_t *query,
+                   clink_iter_t **it) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  if (ERROR(query == NULL))
+    return EINVAL;
+
+  if (ERROR(query->path != NULL && query->path[0] != '/'))
+    return EINVAL;
+
+  if (ERROR(query->order != CLINK_ORDER_PATH &&
+            query->order != CLINK_ORDER_NONE))
+    return EINVAL;
+
+  if (ERROR(it == NULL))
+    return EINVAL;
+
+  int rc = 0;
+  clink_iter_t *i = NULL;
+  char *sql = NULL;
+  size_t sql_size = 0;
+  FILE *buffer = NULL;
+
+  // allocate state for our iterator
+  state_t *s = calloc(1, sizeof(*s));
+  if (ERROR(s == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  s->db = db;
+
+  // pre-compile any regular expressions we will be using
+  if (query->name != NULL) {
+    if (ERROR((s->name = strdup(query->name)) == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+    if (ERROR((rc = re_add(&db->regexes, s->name))))
+      goto done;
+  }
+  if (query->parent != NULL) {
+    if (ERROR((s->parent = strdup(query->parent)) == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+    if (ERROR((rc = re_add(&db->regexes, s->parent))))
+      goto done;
+  }
+
+  // translate the path prefix into ranges over `records.path`
+  if (query->path != NULL) {
+    if (ERROR((rc = path_range_init(&s->range, db, query->path))))
+      goto done;
+  }
+
+  // construct a query covering only the criteria we were given
+  buffer = open_memstream(&sql, &sql_size);
+  if (ERROR(buffer == NULL)) {
+    rc = errno;
+    goto done;
+  }
+
+  fputs("select symbols.name, symbols.path, symbols.category, symbols.line, "
+        "symbols.col, symbols.start_line, symbols.start_col, "
+        "symbols.start_byte, symbols.end_line, symbols.end_col, "
+        "symbols.end_byte, symbols.parent from symbols",
+        buffer);
+
+  // we only need the records table for filtering or sorting by path
+  if (query->path != NULL || query->order == CLINK_ORDER_PATH)
+    fputs(" inner join records on symbols.path = records.id", buffer);
+
+  const char *conjunction = " where ";
+
+  if (query->categories != 0) {
+    fputs(conjunction, buffer);
+    conjunction = " and ";
+    fputs("symbols.category in (", buffer);
+    const char *separator = "";
+    for (unsigned c = 0; c < sizeof(query->categories) * 8; ++c) {
+      if (query->categories & CLINK_CATEGORY_SET(c)) {
+        fprintf(buffer, "%s%u", separator, c);
+        separator = ", ";
+      }
+    }
+    fputs(")", buffer);
+  }
+
+  if (s->name != NULL) {
+    fputs(conjunction, buffer);
+    conjunction = " and ";
+    fputs("symbols.name regexp @name", buffer);
+  }
+
+  if (s->parent != NULL) {
+    fputs(conjunction, buffer);
+    conjunction = " and ";
+    fputs("symbols.parent regexp @parent", buffer);
+  }
+
+  if (query->path != NULL) {
+    fputs(conjunction, buffer);
+    conjunction = " and ";
+    path_range_write(&s->range, buffer);
+  }
+
+  if (query->order == CLINK_ORDER_PATH)
+    fputs(" order by records.path, symbols.line, symbols.col", buffer);
+
+  if (query->limit > 0)
+    fprintf(buffer, " limit %zu", query->limit);
+
+  fputs(";", buffer);
+
+  if (ERROR(fclose(buffer) < 0)) {
+    buffer = NULL;
+    rc = errno;
+    goto done;
+  }
+  buffer = NULL;
+
+  // create a query to lookup the symbols in the database
+  if (ERROR((rc = sql_prepare(db->db, sql, &s->stmt))))
+    goto done;
+
+  // bind the where clause to our criteria
+  if (ERROR((rc = bind_text(s->stmt, "@name", s->name))))
+    goto done;
+  if (ERROR((rc = bind_text(s->stmt, "@parent", s->parent))))
+    goto done;
+  if (query->path != NULL) {
+    if (ERROR((rc = path_range_bind(&s->range, s->stmt))))
+      goto done;
+  }
+
+  // create an iterator for stepping through our query
+  i = calloc(1, sizeof(*i));
+  if (ERROR(i == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+
+  // configure it to iterate through our query
+  i->next_symbol = next;
+  i->state = s;
+  s = NULL;
+  i->free = my_free;
+
+done:
+  if (buffer != NULL)
+    (void)fclose(buffer);
+  free(sql);
+
+  if (rc) {
+    clink_iter_free(&i);
+    state_free(&s);
+  } else {
+    *it = i;
+  }
+
+  return rc;
+}
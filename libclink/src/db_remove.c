@@ -1,6 +1,7 @@
 #include "db.h"
 #include "debug.h"
 #include "get_id.h"
+#include "path_table.h"
 #include "sql.h"
 #include <clink/db.h>
 #include <sqlite3.h>
@@ -33,6 +34,35 @@ void clink_db_remove(clink_db_t *db, const char *path) {
       return;
   }
 
+  // forget names only this path’s symbols used, so approximate matching does
+  // not suggest them
+  {
+    static const char *const DELETES[] = {
+        "delete from variants where name in (select id from names where name "
+        "in (select name from symbols where path = @path) and not exists "
+        "(select 1 from symbols where symbols.name = names.name and "
+        "symbols.path != @path))",
+        "delete from names where name in (select name from symbols where path "
+        "= @path) and not exists (select 1 from symbols where symbols.name = "
+        "names.name and symbols.path != @path)",
+    };
+
+    for (size_t i = 0; i < sizeof(DELETES) / sizeof(DELETES[0]); ++i) {
+      sqlite3_stmt *s = NULL;
+      if (ERROR(sql_prepare(db->db, DELETES[i], &s)))
+        return;
+
+      if (ERROR(sql_bind_int(s, 1, id))) {
+        sqlite3_finalize(s);
+        return;
+      }
+
+      (void)sqlite3_step(s);
+
+      sqlite3_finalize(s);
+    }
+  }
+
   // delete the path from the symbols table
   {
     static const char SYMBOLS_DELETE[] =
@@ -52,6 +82,47 @@ void clink_db_remove(clink_db_t *db, const char *path) {
     sqlite3_finalize(s);
   }
 
+  // now delete it from the call graph
+  {
+    static const char CALLS_DELETE[] = "delete from calls where path = @path";
+
+    sqlite3_stmt *s = NULL;
+    if (ERROR(sql_prepare(db->db, CALLS_DELETE, &s)))
+      return;
+
+    if (ERROR(sql_bind_int(s, 1, id))) {
+      sqlite3_finalize(s);
+      return;
+    }
+
+    (void)sqlite3_step(s);
+
+    sqlite3_finalize(s);
+  }
+
+  // now delete it from the #include graph
+  {
+    static const char *const DELETES[] = {
+        "delete from includes where includer = @path or included = @path",
+        "delete from suffixes where record = @path",
+    };
+
+    for (size_t i = 0; i < sizeof(DELETES) / sizeof(DELETES[0]); ++i) {
+      sqlite3_stmt *s = NULL;
+      if (ERROR(sql_prepare(db->db, DELETES[i], &s)))
+        return;
+
+      if (ERROR(sql_bind_int(s, 1, id))) {
+        sqlite3_finalize(s);
+        return;
+      }
+
+      (void)sqlite3_step(s);
+
+      sqlite3_finalize(s);
+    }
+  }
+
   // now delete it from the content table
   {
     static const char CONTENT_DELETE[] =
@@ -73,13 +144,13 @@ void clink_db_remove(clink_db_t *db, const char *path) {
 
   // now delete it from the record table
   {
-    static const char DELETE[] = "delete from records where path = @path";
+    static const char DELETE[] = "delete from records where id = @id";
 
     sqlite3_stmt *s = NULL;
     if (ERROR(sql_prepare(db->db, DELETE, &s)))
       return;
 
-    if (ERROR(sql_bind_text(s, 1, path))) {
+    if (ERROR(sql_bind_int(s, 1, id))) {
       sqlite3_finalize(s);
       return;
     }
@@ -88,4 +159,7 @@ void clink_db_remove(clink_db_t *db, const char *path) {
 
     sqlite3_finalize(s);
   }
+
+  // the removed record’s ID may be reused by a later insertion
+  path_table_invalidate(&db->path_table);
 }
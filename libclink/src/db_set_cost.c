@@ -0,0 +1,56 @@
+#include "db.h"
+#include "debug.h"
+#include "sql.h"
+#include <clink/db.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stdint.h>
+
+int clink_db_set_cost(clink_db_t *db, clink_record_id_t id, uint64_t size,
+                      uint64_t duration) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  if (ERROR(db->db == NULL))
+    return EINVAL;
+
+  if (ERROR(id < 0))
+    return EINVAL;
+
+  static const char UPDATE[] = "update records set size = @size, duration = "
+                               "@duration where id = @id;";
+
+  int rc = 0;
+  sqlite3_stmt *s = NULL;
+
+  if (ERROR((rc = sql_prepare(db->db, UPDATE, &s))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_int(s, 1, size))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_int(s, 2, duration))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_int(s, 3, (unsigned long)id))))
+    goto done;
+
+  {
+    int r = sqlite3_step(s);
+    if (ERROR(r != SQLITE_DONE)) {
+      rc = sql_err_to_errno(r);
+      goto done;
+    }
+  }
+
+  // did this ID have a record to update?
+  if (sqlite3_changes(db->db) == 0)
+    rc = ENOENT;
+
+done:
+  if (s != NULL)
+    sqlite3_finalize(s);
+
+  return rc;
+}
@@ -0,0 +1,51 @@
+#include "db.h"
+#include "debug.h"
+#include "sql.h"
+#include <clink/db.h>
+#include <errno.h>
+#include <sqlite3.h>
+
+int clink_db_set_metadata(clink_db_t *db, const char *key,
+                          const char *value) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  if (ERROR(db->db == NULL))
+    return EINVAL;
+
+  if (ERROR(key == NULL))
+    return EINVAL;
+
+  if (ERROR(value == NULL))
+    return EINVAL;
+
+  static const char INSERT[] =
+      "insert or replace into metadata (key, value) values (@key, @value);";
+
+  int rc = 0;
+  sqlite3_stmt *s = NULL;
+
+  if (ERROR((rc = sql_prepare(db->db, INSERT, &s))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_text(s, 1, key))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_text(s, 2, value))))
+    goto done;
+
+  {
+    int r = sqlite3_step(s);
+    if (ERROR(r != SQLITE_DONE)) {
+      rc = sql_err_to_errno(r);
+      goto done;
+    }
+  }
+
+done:
+  if (s != NULL)
+    sqlite3_finalize(s);
+
+  return rc;
+}
@@ -0,0 +1,66 @@
+#include "db.h"
+#include "debug.h"
+#include "make_relative_to.h"
+#include "sql.h"
+#include <clink/db.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <string.h>
+
+int clink_db_update_record(clink_db_t *db, const char *path, uint64_t hash,
+                           uint64_t timestamp) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  if (ERROR(db->db == NULL))
+    return EINVAL;
+
+  if (ERROR(path == NULL))
+    return EINVAL;
+
+  if (ERROR(strcmp(path, "") == 0))
+    return EINVAL;
+
+  if (ERROR(path[0] != '/'))
+    return EINVAL;
+
+  path = make_relative_to(db, path);
+
+  static const char UPDATE[] = "update records set hash = @hash, timestamp = "
+                               "@timestamp where path = @path;";
+
+  int rc = 0;
+  sqlite3_stmt *s = NULL;
+
+  if (ERROR((rc = sql_prepare(db->db, UPDATE, &s))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_int(s, 1, hash))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_int(s, 2, timestamp))))
+    goto done;
+
+  if (ERROR((rc = sql_bind_text(s, 3, path))))
+    goto done;
+
+  {
+    int r = sqlite3_step(s);
+    if (ERROR(r != SQLITE_DONE)) {
+      rc = sql_err_to_errno(r);
+      goto done;
+    }
+  }
+
+  // did this path have a record to update?
+  if (sqlite3_changes(db->db) == 0)
+    rc = ENOENT;
+
+done:
+  if (s != NULL)
+    sqlite3_finalize(s);
+
+  return rc;
+}
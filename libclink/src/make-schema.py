@@ -18,7 +18,7 @@ def get_statements(sql: Path) -> Iterator[str]:
     """
     accrued = io.StringIO()
     last_was_space = False
-    with open(sql, "rt", encoding="utf-8") as f:
+    with tempfile.TemporaryDirectory() as tmp, open(sql, "rt", encoding="utf-8") as f:
         while True:
             c = f.read(1)
 
@@ -38,19 +38,19 @@ def get_statements(sql: Path) -> Iterator[str]:
             # are we at the end of a statement?
             if c == ";":
                 query = accrued.getvalue()
-                # ensure this is a valid SQL statement
-                with tempfile.TemporaryDirectory() as tmp:
-                    try:
-                        subprocess.run(
-                            ["sqlite3", "temp.db"],
-                            input=query,
-                            cwd=tmp,
-                            check=True,
-                            universal_newlines=True,
-                        )
-                    except subprocess.CalledProcessError:
-                        sys.stderr.write(f"failed to validate SQL: {query}\n")
-                        raise
+                # ensure this is a valid SQL statement, in the context of the
+                # preceding ones that it may refer to
+                try:
+                    subprocess.run(
+                        ["sqlite3", "temp.db"],
+                        input=query,
+                        cwd=tmp,
+                        check=True,
+                        universal_newlines=True,
+                    )
+                except subprocess.CalledProcessError:
+                    sys.stderr.write(f"failed to validate SQL: {query}\n")
+                    raise
                 yield query
                 accrued = io.StringIO()
 
@@ -1,4 +1,5 @@
 #include "../../common/ctype.h"
+#include "clang.h"
 #include "debug.h"
 #include <assert.h>
 #include <clang-c/Index.h>
@@ -11,13 +12,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-static void deinit(CXTranslationUnit tu, CXIndex index) {
-  if (tu != NULL)
-    clang_disposeTranslationUnit(tu);
-
-  clang_disposeIndex(index);
-}
-
 // determine if this cursor can be a semantic parent of something else
 static bool is_parent(CXCursor cursor) {
   switch (clang_getCursorKind(cursor)) {
@@ -43,11 +37,234 @@ static bool is_parent(CXCursor cursor) {
   return false;
 }
 
+/// the main file’s tokens, lexed once on first use
+///
+/// Cursors that need to be examined token by token look up their tokens here
+/// by byte offset, instead of each re-lexing their extent.
+typedef struct {
+
+  /// translation unit the tokens belong to
+  CXTranslationUnit tu;
+
+  /// have we lexed the main file yet?
+  bool lexed;
+
+  /// the main file and its text
+  CXFile file;
+  const char *contents;
+  size_t contents_size;
+
+  /// all tokens of the main file
+  CXToken *tokens;
+  unsigned tokens_length;
+
+  /// byte offset at which each token begins, computed as needed (`UINT_MAX`
+  /// until then)
+  unsigned *offsets;
+
+} tokens_t;
+
+/// lex the main file, given a location within it
+static void tokens_lex(tokens_t *t, CXSourceLocation loc) {
+
+  assert(t != NULL);
+  assert(!t->lexed);
+  assert(clang_Location_isFromMainFile(loc));
+
+  t->lexed = true;
+
+  clang_getSpellingLocation(loc, &t->file, NULL, NULL, NULL);
+  if (t->file == NULL)
+    return;
+
+  t->contents = clang_getFileContents(t->tu, t->file, &t->contents_size);
+  if (t->contents == NULL || t->contents_size > UINT_MAX)
+    return;
+
+  const CXSourceLocation start = clang_getLocationForOffset(t->tu, t->file, 0);
+  const CXSourceLocation end =
+      clang_getLocationForOffset(t->tu, t->file, (unsigned)t->contents_size);
+  clang_tokenize(t->tu, clang_getRange(start, end), &t->tokens,
+                 &t->tokens_length);
+
+  t->offsets = malloc(t->tokens_length * sizeof(t->offsets[0]));
+  if (ERROR(t->offsets == NULL)) {
+    clang_disposeTokens(t->tu, t->tokens, t->tokens_length);
+    t->tokens = NULL;
+    t->tokens_length = 0;
+    return;
+  }
+  for (unsigned i = 0; i < t->tokens_length; ++i)
+    t->offsets[i] = UINT_MAX;
+}
+
+/// release the tokens of the main file
+static void tokens_free(tokens_t *t) {
+  assert(t != NULL);
+  if (t->tokens != NULL)
+    clang_disposeTokens(t->tu, t->tokens, t->tokens_length);
+  free(t->offsets);
+  *t = (tokens_t){0};
+}
+
+/// byte offset at which a token begins
+static unsigned token_offset(tokens_t *t, unsigned index) {
+  assert(t != NULL);
+  assert(index < t->tokens_length);
+
+  if (t->offsets[index] == UINT_MAX) {
+    const CXToken token = t->tokens[index];
+    const CXSourceLocation loc = clang_getTokenLocation(t->tu, token);
+    clang_getSpellingLocation(loc, NULL, NULL, NULL, &t->offsets[index]);
+  }
+  return t->offsets[index];
+}
+
+/** find the tokens a cursor covers
+ *
+ * This selects the same tokens `clang_tokenize` would for the cursor’s extent,
+ * when that lies within the main file.
+ *
+ * \param t Tokens to search
+ * \param cursor Cursor whose extent to look up
+ * \param first [out] Index of the first covered token
+ * \return Number of covered tokens
+ */
+static unsigned tokens_find(tokens_t *t, CXCursor cursor, unsigned *first) {
+
+  assert(t != NULL);
+  assert(first != NULL);
+
+  *first = 0;
+
+  const CXSourceRange range = clang_getCursorExtent(cursor);
+  const CXSourceLocation start = clang_getRangeStart(range);
+  const CXSourceLocation end = clang_getRangeEnd(range);
+
+  if (!t->lexed) {
+    if (!clang_Location_isFromMainFile(start))
+      return 0;
+    tokens_lex(t, start);
+  }
+
+  CXFile start_file = NULL;
+  unsigned start_offset = 0;
+  clang_getSpellingLocation(start, &start_file, NULL, NULL, &start_offset);
+  CXFile end_file = NULL;
+  unsigned end_offset = 0;
+  clang_getSpellingLocation(end, &end_file, NULL, NULL, &end_offset);
+
+  // we only know the tokens of the main file
+  if (t->file == NULL || !clang_File_isEqual(start_file, t->file) ||
+      !clang_File_isEqual(end_file, t->file))
+    return 0;
+
+  // find the first token at or after the start of the extent
+  unsigned low = 0;
+  unsigned high = t->tokens_length;
+  while (low < high) {
+    const unsigned mid = low + (high - low) / 2;
+    if (token_offset(t, mid) < start_offset) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  *first = low;
+
+  // take every token beginning before the end of the extent, but at least one
+  // as lexing the extent would
+  unsigned count = 0;
+  while (low + count < t->tokens_length &&
+         token_offset(t, low + count) < end_offset)
+    ++count;
+  if (count == 0 && low < t->tokens_length)
+    count = 1;
+
+  return count;
+}
+
+/// retrieve the text of a token
+static CXString token_spelling(tokens_t *t, unsigned index) {
+  assert(t != NULL);
+  assert(index < t->tokens_length);
+  return clang_getTokenSpelling(t->tu, t->tokens[index]);
+}
+
+/// the main file’s text for a token, or `NULL` if it differs from the token’s
+/// spelling
+static const char *token_source(tokens_t *t, unsigned index, size_t *length) {
+  assert(t != NULL);
+  assert(length != NULL);
+
+  const unsigned start = token_offset(t, index);
+  const CXSourceRange extent = clang_getTokenExtent(t->tu, t->tokens[index]);
+  unsigned end = 0;
+  clang_getSpellingLocation(clang_getRangeEnd(extent), NULL, NULL, NULL, &end);
+  if (end < start || end > t->contents_size)
+    return NULL;
+
+  // an escaped newline within the token makes its spelling differ from its text
+  const char *text = t->contents + start;
+  *length = end - start;
+  if (memchr(text, '\\', *length) != NULL)
+    return NULL;
+
+  return text;
+}
+
+/// does this token have the given spelling?
+static bool token_is(tokens_t *t, unsigned index, const char *spelling) {
+
+  size_t length = 0;
+  const char *text = token_source(t, index, &length);
+  if (text != NULL)
+    return length == strlen(spelling) && strncmp(text, spelling, length) == 0;
+
+  CXString s = token_spelling(t, index);
+  const bool eq = strcmp(clang_getCString(s), spelling) == 0;
+  clang_disposeString(s);
+  return eq;
+}
+
+/// copy the spelling of a token, returning `NULL` on out-of-memory
+static char *token_text(tokens_t *t, unsigned index) {
+
+  size_t length = 0;
+  const char *text = token_source(t, index, &length);
+  if (text != NULL)
+    return strndup(text, length);
+
+  CXString s = token_spelling(t, index);
+  char *copy = strdup(clang_getCString(s));
+  clang_disposeString(s);
+  return copy;
+}
+
+/// is this a valid C identifier?
+static bool is_identifier(const char *text) {
+  if (strcmp(text, "") == 0)
+    return false;
+  for (size_t i = 0; text[i] != '\0'; ++i) {
+    if (isalpha_(text[i]))
+      continue;
+    if (text[i] == '_')
+      continue;
+    if (i != 0 && isdigit_(text[i]))
+      continue;
+    return false;
+  }
+  return true;
+}
+
 // state used by the visitor
 typedef struct {
 
-  /// database to insert into
-  clink_db_t *db;
+  /// callback to receive each symbol we find
+  int (*accept)(const clink_symbol_t *symbol, void *context);
+
+  /// opaque state to pass to `accept`
+  void *context;
 
   /// named parent of the current context during traversal
   const char *current_parent;
@@ -56,6 +273,9 @@ typedef struct {
   clink_symbol_t *macro_expansions;
   size_t macro_expansions_length;
 
+  /// tokens of the main file
+  tokens_t *tokens;
+
   /// status of our Clang traversal (0 OK, non-zero on error)
   int rc;
 
@@ -75,7 +295,7 @@ static int add(state_t *state, clink_category_t category, const char *name,
                            .start = start,
                            .end = end,
                            .parent = (char *)state->current_parent};
-  state->rc = clink_db_add_symbol(state->db, &symbol);
+  state->rc = state->accept(&symbol, state->context);
 
   return state->rc;
 }
@@ -91,48 +311,39 @@ static int add(state_t *state, clink_category_t category, const char *name,
  * This function filters out only identifiers, as punctuation, comments, etc are
  * not relevant.
  *
- * \param db Database to insert into
+ * \param state Traversal state to report symbols through
  * \param path Originating ource file path
  * \param parent Name of semantic parent, can be `NULL`
  * \param cursor Cursor to tokenize
  * \return 0 on success or an errno on failure
  */
-static int add_tokens(clink_db_t *db, const char *path, const char *parent,
+static int add_tokens(state_t *state, const char *path, const char *parent,
                       CXCursor cursor) {
 
-  assert(db != NULL);
+  assert(state != NULL);
+  assert(state->tokens != NULL);
   assert(path != NULL);
 
-  CXTranslationUnit tu = clang_Cursor_getTranslationUnit(cursor);
+  tokens_t *t = state->tokens;
 
   int rc = 0;
 
   // find all the tokens covered by this cursor
-  CXToken *tokens = NULL;
-  unsigned tokens_len = 0;
-  {
-    const CXSourceRange range = clang_getCursorExtent(cursor);
-    clang_tokenize(tu, range, &tokens, &tokens_len);
-  }
+  unsigned first = 0;
+  const unsigned tokens_len = tokens_find(t, cursor, &first);
 
-  for (unsigned i = 0; i < tokens_len; ++i) {
+  for (unsigned i = first; i < first + tokens_len; ++i) {
 
     // we expect the first token to be the parent itself, so skip it
-    if (i == 0) {
+    if (i == first) {
 #ifndef NDEBUG
       {
         // retrieve the name of the parent
         CXString name = clang_getCursorSpelling(cursor);
         const char *namecstr = clang_getCString(name);
 
-        // get the text of this token
-        CXString text = clang_getTokenSpelling(tu, tokens[i]);
-        const char *textcstr = clang_getCString(text);
+        assert(token_is(t, i, namecstr) && "first token is not parent’s name");
 
-        assert(strcmp(namecstr, textcstr) == 0 &&
-               "first token is not parent’s name");
-
-        clang_disposeString(text);
         clang_disposeString(name);
       }
 #endif
@@ -140,7 +351,7 @@ static int add_tokens(clink_db_t *db, const char *path, const char *parent,
     }
 
     // skip anything that is not an identifier
-    CXTokenKind kind = clang_getTokenKind(tokens[i]);
+    CXTokenKind kind = clang_getTokenKind(t->tokens[i]);
     if (kind != CXToken_Identifier)
       continue;
 
@@ -148,7 +359,7 @@ static int add_tokens(clink_db_t *db, const char *path, const char *parent,
     clink_location_t start = {0};
     clink_location_t end = {0};
     {
-      const CXSourceRange range = clang_getTokenExtent(tu, tokens[i]);
+      const CXSourceRange range = clang_getTokenExtent(t->tu, t->tokens[i]);
       {
         const CXSourceLocation range_start = clang_getRangeStart(range);
         unsigned lineno, colno, byte;
@@ -170,28 +381,29 @@ static int add_tokens(clink_db_t *db, const char *path, const char *parent,
     }
 
     // get the text of this token
-    CXString text = clang_getTokenSpelling(tu, tokens[i]);
-    const char *textcstr = clang_getCString(text);
+    char *text = token_text(t, i);
+    if (ERROR(text == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
 
     clink_symbol_t symbol = {.category = CLINK_REFERENCE,
-                             .name = (char *)textcstr,
+                             .name = text,
                              .path = (char *)path,
                              .lineno = start.lineno,
                              .colno = start.colno,
                              .start = start,
                              .end = end,
                              .parent = (char *)parent};
-    rc = clink_db_add_symbol(db, &symbol);
+    rc = state->accept(&symbol, state->context);
 
-    clang_disposeString(text);
+    free(text);
 
     if (ERROR(rc != 0))
       goto done;
   }
 
 done:
-  clang_disposeTokens(tu, tokens, tokens_len);
-
   return rc;
 }
 
@@ -226,7 +438,10 @@ static int visit_children(state_t *state, CXCursor cursor) {
   }
 
   // state for descendants of this cursor to see
-  state_t for_children = {.db = state->db, .current_parent = parent};
+  state_t for_children = {.accept = state->accept,
+                          .context = state->context,
+                          .current_parent = parent,
+                          .tokens = state->tokens};
 
   // recursively descend into this cursor’s children
   (void)clang_visitChildren(cursor, visit, &for_children);
@@ -241,75 +456,35 @@ static int visit_children(state_t *state, CXCursor cursor) {
 }
 
 /// if this looks like a call, extract the callee’s name
-static char *get_callee(CXCursor cursor) {
+static char *get_callee(tokens_t *t, CXCursor cursor) {
   enum CXCursorKind kind = clang_getCursorKind(cursor);
   assert(kind == CXCursor_UnexposedExpr || kind == CXCursor_CallExpr);
   (void)kind;
 
-  CXTranslationUnit tu = clang_Cursor_getTranslationUnit(cursor);
-
-  char *rc = NULL;
-
   // find all the tokens covered by this cursor
-  CXSourceRange range = clang_getCursorExtent(cursor);
-  CXToken *tokens = NULL;
-  unsigned tokens_len = 0;
-  clang_tokenize(tu, range, &tokens, &tokens_len);
+  unsigned first = 0;
+  const unsigned tokens_len = tokens_find(t, cursor, &first);
 
   // the call must at least contain «callee»«(»«)»
   if (tokens_len < 3)
-    goto done;
+    return NULL;
 
   // the second token must be the opening paren
-  {
-    CXString paren = clang_getTokenSpelling(tu, tokens[1]);
-    const char *paren_cstr = clang_getCString(paren);
-
-    bool is_paren = strcmp(paren_cstr, "(") == 0;
-    clang_disposeString(paren);
-    if (!is_paren)
-      goto done;
-  }
+  if (!token_is(t, first + 1, "("))
+    return NULL;
 
   // the last token must be the closing paren
-  {
-    CXString paren = clang_getTokenSpelling(tu, tokens[tokens_len - 1]);
-    const char *paren_cstr = clang_getCString(paren);
-
-    bool is_paren = strcmp(paren_cstr, ")") == 0;
-    clang_disposeString(paren);
-    if (!is_paren)
-      goto done;
-  }
+  if (!token_is(t, first + tokens_len - 1, ")"))
+    return NULL;
 
   // the first token must be a valid identifier
-  {
-    CXString callee = clang_getTokenSpelling(tu, tokens[0]);
-    const char *callee_cstr = clang_getCString(callee);
-
-    bool is_id = strcmp(callee_cstr, "") != 0;
-    for (size_t i = 0; callee_cstr[i] != '\0'; ++i) {
-      if (isalpha_(callee_cstr[i]))
-        continue;
-      if (callee_cstr[i] == '_')
-        continue;
-      if (i != 0 && isdigit_(callee_cstr[i]))
-        continue;
-      is_id = false;
-      break;
-    }
-
-    if (is_id)
-      rc = strdup(callee_cstr);
-
-    clang_disposeString(callee);
-    if (!is_id)
-      goto done;
+  char *callee = token_text(t, first);
+  if (callee != NULL && !is_identifier(callee)) {
+    free(callee);
+    return NULL;
   }
 
-done:
-  clang_disposeTokens(tu, tokens, tokens_len);
-  return rc;
+  return callee;
 }
 
 // is this the name of an implementation of one of the __sync built-ins?
@@ -367,72 +542,39 @@ static bool is_sync_impl(const char *name) {
 
 #if HAS_OPS
 /// if this looks like an assignment to a symbol, extract the symbol’s name
-static char *get_assign_lhs(CXCursor cursor) {
+static char *get_assign_lhs(tokens_t *t, CXCursor cursor) {
   {
     const enum CXCursorKind kind = clang_getCursorKind(cursor);
     assert(kind == CXCursor_BinaryOperator);
     (void)kind;
   }
 
-  CXTranslationUnit tu = clang_Cursor_getTranslationUnit(cursor);
-
-  char *rc = NULL;
-
   // find all the tokens covered by this cursor
-  CXSourceRange range = clang_getCursorExtent(cursor);
-  CXToken *tokens = NULL;
-  unsigned tokens_len = 0;
-  clang_tokenize(tu, range, &tokens, &tokens_len);
+  unsigned first = 0;
+  const unsigned tokens_len = tokens_find(t, cursor, &first);
 
   // ignore anything that is not «symbol»«assign op»…
   if (tokens_len < 2)
-    goto done;
+    return NULL;
   {
     const enum CXBinaryOperatorKind kind =
         clang_getCursorBinaryOperatorKind(cursor);
     CXString expected = clang_getBinaryOperatorKindSpelling(kind);
-    const char *const exp = clang_getCString(expected);
-    CXString actual = clang_getTokenSpelling(tu, tokens[1]);
-    const char *const act = clang_getCString(actual);
-
-    const bool is_simple = strcmp(exp, act) == 0;
-    clang_disposeString(actual);
+    const bool is_simple = token_is(t, first + 1, clang_getCString(expected));
     clang_disposeString(expected);
     if (!is_simple)
-      goto done;
+      return NULL;
   }
 
   // the first token must be a valid identifier
-  {
-    CXString lhs = clang_getTokenSpelling(tu, tokens[0]);
-    const char *const lhs_cstr = clang_getCString(lhs);
-
-    bool is_id = strcmp(lhs_cstr, "") != 0;
-    for (size_t i = 0; lhs_cstr[i] != '\0'; ++i) {
-      if (isalpha_(lhs_cstr[i]))
-        continue;
-      if (lhs_cstr[i] == '_')
-        continue;
-      if (i != 0 && isdigit_(lhs_cstr[i]))
-        continue;
-      is_id = false;
-      break;
-    }
-
-    if (is_id) {
-      rc = strdup(lhs_cstr);
-    } else {
-      DEBUG("binary token \"%s\" is not a valid symbol; skipping", lhs_cstr);
-    }
-
-    clang_disposeString(lhs);
-    if (!is_id)
-      goto done;
+  char *lhs = token_text(t, first);
+  if (lhs != NULL && !is_identifier(lhs)) {
+    DEBUG("binary token \"%s\" is not a valid symbol; skipping", lhs);
+    free(lhs);
+    return NULL;
   }
 
-done:
-  clang_disposeTokens(tu, tokens, tokens_len);
-  return rc;
+  return lhs;
 }
 
 /// is this a binary operator that counts as assignment?
@@ -471,27 +613,21 @@ static bool is_assign_unary(enum CXUnaryOperatorKind op) {
 }
 
 /// if this looks like a unary assignment to a symbol, extract the symbol’s name
-static char *get_assign_unary(CXCursor cursor) {
+static char *get_assign_unary(tokens_t *t, CXCursor cursor) {
   {
     const enum CXCursorKind kind = clang_getCursorKind(cursor);
     assert(kind == CXCursor_UnaryOperator);
     (void)kind;
   }
 
-  CXTranslationUnit tu = clang_Cursor_getTranslationUnit(cursor);
-
-  char *rc = NULL;
-
   // find all the tokens covered by this cursor
-  CXSourceRange range = clang_getCursorExtent(cursor);
-  CXToken *tokens = NULL;
-  unsigned tokens_len = 0;
-  clang_tokenize(tu, range, &tokens, &tokens_len);
+  unsigned first = 0;
+  const unsigned tokens_len = tokens_find(t, cursor, &first);
 
   // ignore anything that is not «symbol»«assign op» or «assign op»«symbol»
   if (tokens_len != 2) {
     DEBUG("%u tokens in unary expression; skipping", tokens_len);
-    goto done;
+    return NULL;
   }
 
   // figure out in which position to look for the symbol
@@ -506,45 +642,52 @@ static char *get_assign_unary(CXCursor cursor) {
   }
 
   // the token must be a valid identifier
-  {
-    CXString symbol = clang_getTokenSpelling(tu, tokens[symbol_position]);
-    const char *const sym = clang_getCString(symbol);
-
-    bool is_id = strcmp(sym, "") != 0;
-    for (size_t i = 0; sym[i] != '\0'; ++i) {
-      if (isalpha_(sym[i]))
-        continue;
-      if (sym[i] == '_')
-        continue;
-      if (i != 0 && isdigit_(sym[i]))
-        continue;
-      is_id = false;
-      break;
-    }
-
-    if (is_id) {
-      rc = strdup(sym);
-    } else {
-      DEBUG("unary token \"%s\" is not a valid symbol; skipping", sym);
-    }
-
-    clang_disposeString(symbol);
-    if (!is_id)
-      goto done;
+  char *sym = token_text(t, first + symbol_position);
+  if (sym != NULL && !is_identifier(sym)) {
+    DEBUG("unary token \"%s\" is not a valid symbol; skipping", sym);
+    free(sym);
+    return NULL;
   }
 
-done:
-  clang_disposeTokens(tu, tokens, tokens_len);
-  return rc;
+  return sym;
 }
 #endif
 
+/// retrieve the range of source a cursor covers
+static void get_extent(CXCursor cursor, clink_location_t *start,
+                       clink_location_t *end) {
+
+  assert(start != NULL);
+  assert(end != NULL);
+
+  const CXSourceRange range = clang_getCursorExtent(cursor);
+  {
+    const CXSourceLocation range_start = clang_getRangeStart(range);
+    unsigned l, c, b;
+    clang_getSpellingLocation(range_start, NULL, &l, &c, &b);
+    *start = (clink_location_t){.lineno = l, .colno = c, .byte = b};
+  }
+  {
+    const CXSourceLocation range_end = clang_getRangeEnd(range);
+    unsigned l, c, b;
+    clang_getSpellingLocation(range_end, NULL, &l, &c, &b);
+    // End locations are typically exclusive. But if Libclang is reporting
+    // something that has no well-defined source location it can report 0
+    // for these fields, so simulate a zero-length range.
+    const unsigned end_colno = c > 0 ? c - 1 : start->colno;
+    const unsigned end_byte = b > 0 ? b - 1 : start->byte;
+    *end =
+        (clink_location_t){.lineno = l, .colno = end_colno, .byte = end_byte};
+  }
+}
+
 static enum CXChildVisitResult visit(CXCursor cursor, CXCursor parent,
                                      CXClientData state) {
 
   // we do not need the parent cursor
   (void)parent;
 
+  state_t *st = state;
   int rc = 0;
 
   // ignore anything not from the main file
@@ -647,7 +790,7 @@ static enum CXChildVisitResult visit(CXCursor cursor, CXCursor parent,
     // their byte-width implementations
     bool sync_impl = kind == CXCursor_CallExpr && is_sync_impl(name);
     if (maybe_atomic || sync_impl) {
-      extra_name = get_callee(cursor);
+      extra_name = get_callee(st->tokens, cursor);
       if (extra_name != NULL && strncmp(extra_name, "__", 2) == 0) {
         category = CLINK_FUNCTION_CALL;
         name = extra_name;
@@ -659,7 +802,7 @@ static enum CXChildVisitResult visit(CXCursor cursor, CXCursor parent,
   // for a pre-/post-increment/decrement, try to extract the name of the symbol
   // being incremented/decremented
   if (kind == CXCursor_UnaryOperator) {
-    extra_name = get_assign_unary(cursor);
+    extra_name = get_assign_unary(st->tokens, cursor);
     if (extra_name != NULL) {
       name = extra_name;
       DEBUG("unravelled unary operator to assignment to symbol \"%s\"", name);
@@ -670,7 +813,7 @@ static enum CXChildVisitResult visit(CXCursor cursor, CXCursor parent,
 
   // for assignments, try to extract the name of the symbol being assigned to
   if (kind == CXCursor_BinaryOperator) {
-    extra_name = get_assign_lhs(cursor);
+    extra_name = get_assign_lhs(st->tokens, cursor);
     if (extra_name != NULL) {
       name = extra_name;
       DEBUG("unravelled binary operator to assignment to symbol \"%s\"", name);
@@ -697,27 +840,7 @@ static enum CXChildVisitResult visit(CXCursor cursor, CXCursor parent,
     // retrieve the range of the covering semantic entity
     clink_location_t start = {0};
     clink_location_t end = {0};
-    {
-      const CXSourceRange range = clang_getCursorExtent(cursor);
-      {
-        const CXSourceLocation range_start = clang_getRangeStart(range);
-        unsigned l, c, b;
-        clang_getSpellingLocation(range_start, NULL, &l, &c, &b);
-        start = (clink_location_t){.lineno = l, .colno = c, .byte = b};
-      }
-      {
-        const CXSourceLocation range_end = clang_getRangeEnd(range);
-        unsigned l, c, b;
-        clang_getSpellingLocation(range_end, NULL, &l, &c, &b);
-        // End locations are typically exclusive. But if Libclang is reporting
-        // something that has no well-defined source location it can report 0
-        // for these fields, so simulate a zero-length range.
-        const unsigned end_colno = c > 0 ? c - 1 : start.colno;
-        const unsigned end_byte = b > 0 ? b - 1 : start.byte;
-        end = (clink_location_t){
-            .lineno = l, .colno = end_colno, .byte = end_byte};
-      }
-    }
+    get_extent(cursor, &start, &end);
 
     filename = clang_getFileName(file);
     const char *fname = clang_getCString(filename);
@@ -726,7 +849,6 @@ static enum CXChildVisitResult visit(CXCursor cursor, CXCursor parent,
     // preprocessing when we have no known parent. So if we are in that
     // situation, save the information for this symbol and we will recover it
     // later when we come across its parent.
-    state_t *st = state;
     if (kind == CXCursor_MacroExpansion && st->current_parent == NULL) {
 
       // construct a partially populated symbol
@@ -787,7 +909,7 @@ static enum CXChildVisitResult visit(CXCursor cursor, CXCursor parent,
 
           symbol.parent = (char *)name;
           symbol.path = (char *)fname;
-          rc = clink_db_add_symbol(st->db, &symbol);
+          rc = st->accept(&symbol, st->context);
           if (ERROR(rc != 0))
             goto done;
 
@@ -806,7 +928,7 @@ static enum CXChildVisitResult visit(CXCursor cursor, CXCursor parent,
       // “children” because they are just lexical tokens. So tokenize it and
       // treat each seen identifier as a reference.
       if (kind == CXCursor_MacroDefinition) {
-        rc = add_tokens(st->db, fname, name, cursor);
+        rc = add_tokens(st, fname, name, cursor);
         if (ERROR(rc != 0))
           goto done;
       }
@@ -850,7 +972,7 @@ static int clang_err_to_errno(int err) {
   }
 }
 
-static int init(CXIndex *index, CXTranslationUnit *tu, const char *filename,
+static int init(CXIndex index, CXTranslationUnit *tu, const char *filename,
                 size_t argc, const char **argv) {
 
   assert(index != NULL);
@@ -865,11 +987,6 @@ static int init(CXIndex *index, CXTranslationUnit *tu, const char *filename,
     argc = sizeof(DEFAULT) / sizeof(DEFAULT[0]) - 1;
   }
 
-  // create a Clang index
-  static const int excludePCH = 0;
-  static const int displayDiagnostics = 0;
-  *index = clang_createIndex(excludePCH, displayDiagnostics);
-
   // parse the input file
   unsigned options = CXTranslationUnit_None;
   options |= CXTranslationUnit_DetailedPreprocessingRecord;
@@ -880,17 +997,491 @@ static int init(CXIndex *index, CXTranslationUnit *tu, const char *filename,
   options |= CXTranslationUnit_RetainExcludedConditionalBlocks;
 #endif
   enum CXErrorCode err = clang_parseTranslationUnit2(
-      *index, filename, argv, (int)argc, NULL, 0, options, tu);
+      index, filename, argv, (int)argc, NULL, 0, options, tu);
   if (ERROR(err != CXError_Success))
     return clang_err_to_errno(err);
 
   return 0;
 }
 
-int clink_parse_with_clang(clink_db_t *db, const char *filename, size_t argc,
-                           const char **argv) {
+/// does libclang report the roles a reference plays?
+#define HAS_ROLES                                                              \
+  (CINDEX_VERSION_MAJOR > 0 ||                                                 \
+   (CINDEX_VERSION_MAJOR == 0 && CINDEX_VERSION_MINOR >= 61))
 
-  if (ERROR(db == NULL))
+/// a declaration macro expansions within can be parented to
+typedef struct {
+  char *name;
+  clink_location_t start;
+  clink_location_t end;
+} scope_t;
+
+// state used by the indexer callbacks
+typedef struct {
+
+  /// common traversal state
+  state_t state;
+
+  /// declarations seen that can be parents, in the order they were seen
+  scope_t *scopes;
+  size_t scopes_length;
+  size_t scopes_size;
+
+} index_state_t;
+
+/// order two source positions
+static int compare_location(clink_location_t a, clink_location_t b) {
+  if (a.lineno != b.lineno)
+    return a.lineno < b.lineno ? -1 : 1;
+  if (a.colno != b.colno)
+    return a.colno < b.colno ? -1 : 1;
+  return 0;
+}
+
+/// `qsort` comparator for ordering scopes by start, outermost first
+static int compare_scope(const void *a, const void *b) {
+  const scope_t *x = a;
+  const scope_t *y = b;
+  const int start = compare_location(x->start, y->start);
+  if (start != 0)
+    return start;
+  return -compare_location(x->end, y->end);
+}
+
+/** reduce scopes to the outermost ones, ordered by position
+ *
+ * Afterwards both the starts and the ends of the remaining scopes are
+ * ascending, so the outermost scope containing a position can be found by
+ * binary search.
+ *
+ * \param st State whose scopes to reduce
+ */
+static void outermost_scopes(index_state_t *st) {
+
+  assert(st != NULL);
+
+  if (st->scopes_length == 0)
+    return;
+
+  qsort(st->scopes, st->scopes_length, sizeof(st->scopes[0]), compare_scope);
+
+  // drop any scope within the last one kept
+  size_t kept = 1;
+  for (size_t i = 1; i < st->scopes_length; ++i) {
+    if (compare_location(st->scopes[i].end, st->scopes[kept - 1].end) <= 0) {
+      free(st->scopes[i].name);
+      continue;
+    }
+    st->scopes[kept++] = st->scopes[i];
+  }
+  st->scopes_length = kept;
+}
+
+/** find the outermost scope containing a position
+ *
+ * \param st State whose scopes have been reduced by `outermost_scopes`
+ * \param pos Position to look for
+ * \return The containing scope or `NULL` if there is none
+ */
+static const scope_t *find_scope(const index_state_t *st,
+                                 clink_location_t pos) {
+
+  assert(st != NULL);
+
+  // find the first scope ending at or after the position…
+  size_t lo = 0;
+  size_t hi = st->scopes_length;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (compare_location(st->scopes[mid].end, pos) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // …which contains it if it also starts at or before it
+  if (lo == st->scopes_length)
+    return NULL;
+  if (compare_location(st->scopes[lo].start, pos) > 0)
+    return NULL;
+  return &st->scopes[lo];
+}
+
+/// find the name of the nearest entity, from this one outwards, that can be a
+/// parent
+static CXString get_parent(CXCursor cursor) {
+
+  for (CXCursor c = cursor; !clang_Cursor_isNull(c);
+       c = clang_getCursorLexicalParent(c)) {
+
+    const enum CXCursorKind kind = clang_getCursorKind(c);
+    if (clang_isInvalid(kind) || clang_isTranslationUnit(kind))
+      break;
+
+    if (!is_parent(c))
+      continue;
+
+    CXString text = clang_getCursorSpelling(c);
+    const char *ctext = clang_getCString(text);
+    if (ctext != NULL && strcmp(ctext, "") != 0)
+      return text;
+    clang_disposeString(text);
+  }
+
+  return (CXString){0};
+}
+
+/// add a symbol the indexer told us about
+static int index_add(state_t *state, clink_category_t category,
+                     const char *name, CXSourceLocation loc,
+                     clink_location_t start, clink_location_t end,
+                     CXCursor scope) {
+
+  assert(state != NULL);
+  assert(name != NULL);
+
+  unsigned lineno, colno;
+  CXFile file = NULL;
+  clang_getSpellingLocation(loc, &file, &lineno, &colno, NULL);
+
+  // skip if we do not have a meaningful location for this symbol
+  if (file == NULL)
+    return 0;
+
+  CXString filename = clang_getFileName(file);
+  const char *fname = clang_getCString(filename);
+  CXString parent = get_parent(scope);
+
+  state->current_parent = parent.data == NULL ? NULL : clang_getCString(parent);
+  const int rc = add(state, category, name, fname, lineno, colno, start, end);
+  state->current_parent = NULL;
+
+  if (parent.data != NULL)
+    clang_disposeString(parent);
+  clang_disposeString(filename);
+
+  return rc;
+}
+
+/// `IndexerCallbacks.abortQuery` implementation
+static int index_abort(CXClientData data, void *reserved) {
+  (void)reserved;
+  const index_state_t *st = data;
+  return st->state.rc != 0;
+}
+
+/// visitor adding the parameters of a function declaration without a body
+static enum CXChildVisitResult visit_parameter(CXCursor cursor, CXCursor parent,
+                                               CXClientData state) {
+
+  if (clang_getCursorKind(cursor) != CXCursor_ParmDecl)
+    return CXChildVisit_Continue;
+
+  CXString text = clang_getCursorSpelling(cursor);
+  const char *name = clang_getCString(text);
+
+  if (name != NULL && strcmp(name, "") != 0) {
+    clink_location_t start = {0};
+    clink_location_t end = {0};
+    get_extent(cursor, &start, &end);
+    (void)index_add(state, CLINK_DEFINITION, name,
+                    clang_getCursorLocation(cursor), start, end, parent);
+  }
+
+  clang_disposeString(text);
+
+  const state_t *st = state;
+  return st->rc == 0 ? CXChildVisit_Continue : CXChildVisit_Break;
+}
+
+/// `IndexerCallbacks.indexDeclaration` implementation
+static void index_declaration(CXClientData data, const CXIdxDeclInfo *info) {
+
+  index_state_t *st = data;
+  if (st->state.rc != 0)
+    return;
+
+  // ignore anything the compiler made up
+  if (info->isImplicit)
+    return;
+
+  // ignore anything not from the main file
+  const CXSourceLocation loc = clang_indexLoc_getCXSourceLocation(info->loc);
+  if (!clang_Location_isFromMainFile(loc))
+    return;
+
+  // name it as the AST walk would, rather than by the indexer’s decorated name
+  CXString text = clang_getCursorSpelling(info->cursor);
+  const char *name = clang_getCString(text);
+
+  // skip entities with no name
+  if (name == NULL || strcmp(name, "") == 0)
+    goto done;
+
+  clink_location_t start = {0};
+  clink_location_t end = {0};
+  get_extent(info->cursor, &start, &end);
+
+  const CXCursor scope_cursor = info->lexicalContainer == NULL
+                                    ? clang_getNullCursor()
+                                    : info->lexicalContainer->cursor;
+
+  if (ERROR(index_add(&st->state, CLINK_DEFINITION, name, loc, start, end,
+                      scope_cursor) != 0))
+    goto done;
+
+  // if this is a definition with an initialiser, also note an assignment
+  if (clang_getCursorKind(info->cursor) == CXCursor_VarDecl &&
+      !clang_Cursor_isNull(clang_Cursor_getVarDeclInitializer(info->cursor))) {
+    if (ERROR(index_add(&st->state, CLINK_ASSIGNMENT, name, loc, start, end,
+                        scope_cursor) != 0))
+      goto done;
+  }
+
+  // the indexer only reports parameters of functions with bodies, so find those
+  // of other function declarations ourselves
+  if (!info->isDefinition && is_parent(info->cursor)) {
+    (void)clang_visitChildren(info->cursor, visit_parameter, &st->state);
+    if (st->state.rc != 0)
+      goto done;
+  }
+
+  // remember anything macro expansions could later be parented to
+  if (is_parent(info->cursor)) {
+    scope_t scope = {.name = strdup(name), .start = start, .end = end};
+    if (ERROR(scope.name == NULL)) {
+      st->state.rc = ENOMEM;
+      goto done;
+    }
+
+    if (st->scopes_length == st->scopes_size) {
+      const size_t size = st->scopes_size == 0 ? 64 : st->scopes_size * 2;
+      scope_t *scopes = realloc(st->scopes, size * sizeof(scopes[0]));
+      if (ERROR(scopes == NULL)) {
+        free(scope.name);
+        st->state.rc = ENOMEM;
+        goto done;
+      }
+      st->scopes = scopes;
+      st->scopes_size = size;
+    }
+
+    st->scopes[st->scopes_length++] = scope;
+  }
+
+done:
+  clang_disposeString(text);
+}
+
+/// `IndexerCallbacks.indexEntityReference` implementation
+static void index_reference(CXClientData data, const CXIdxEntityRefInfo *info) {
+
+  index_state_t *st = data;
+  if (st->state.rc != 0)
+    return;
+
+  // ignore references that do not appear in the source
+  if (info->kind == CXIdxEntityRef_Implicit)
+    return;
+
+  // ignore anything not from the main file
+  const CXSourceLocation loc = clang_indexLoc_getCXSourceLocation(info->loc);
+  if (!clang_Location_isFromMainFile(loc))
+    return;
+
+  if (info->referencedEntity == NULL)
+    return;
+
+  // name it as the AST walk would, rather than by the indexer’s decorated name
+  const CXCursor referenced = info->referencedEntity->cursor;
+  CXString text = clang_getCursorSpelling(referenced);
+  const char *name = clang_getCString(text);
+  char *extra_name = NULL;
+
+  // skip entities with no name
+  if (name == NULL || strcmp(name, "") == 0)
+    goto done;
+
+  // constructors of class templates are spelled with the template’s
+  // parameters, where a call to them is spelled with only the class name
+  const enum CXCursorKind kind = clang_getCursorKind(referenced);
+  const bool is_constructor =
+      kind == CXCursor_Constructor ||
+      (kind == CXCursor_FunctionTemplate &&
+       clang_getTemplateCursorKind(referenced) == CXCursor_Constructor);
+  if (is_constructor && strchr(name, '<') != NULL) {
+    extra_name = strndup(name, (size_t)(strchr(name, '<') - name));
+    if (ERROR(extra_name == NULL)) {
+      st->state.rc = ENOMEM;
+      goto done;
+    }
+    name = extra_name;
+  }
+
+  clink_location_t start = {0};
+  clink_location_t end = {0};
+  get_extent(info->cursor, &start, &end);
+
+  // parent this by the entity it appears within, so references in a
+  // function’s signature belong to the function as they do in the AST walk
+  CXCursor scope_cursor = clang_getNullCursor();
+  if (info->parentEntity != NULL) {
+    scope_cursor = info->parentEntity->cursor;
+  } else if (info->container != NULL) {
+    scope_cursor = info->container->cursor;
+  }
+
+  if (ERROR(index_add(&st->state, CLINK_REFERENCE, name, loc, start, end,
+                      scope_cursor) != 0))
+    goto done;
+
+  // note calls and assignments the reference is part of
+#if HAS_ROLES
+  const bool is_call = (info->role & CXSymbolRole_Call) != 0;
+  const bool is_write = (info->role & CXSymbolRole_Write) != 0;
+#else
+  const bool is_call = clang_getCursorKind(info->cursor) == CXCursor_CallExpr;
+  const bool is_write = false;
+#endif
+  if (is_call) {
+    if (ERROR(index_add(&st->state, CLINK_FUNCTION_CALL, name, loc, start, end,
+                        scope_cursor) != 0))
+      goto done;
+  }
+  if (is_write) {
+    if (ERROR(index_add(&st->state, CLINK_ASSIGNMENT, name, loc, start, end,
+                        scope_cursor) != 0))
+      goto done;
+  }
+
+done:
+  free(extra_name);
+  clang_disposeString(text);
+}
+
+/// visitor for the preprocessing entities the indexer does not report
+static enum CXChildVisitResult visit_preprocessing(CXCursor cursor,
+                                                   CXCursor parent,
+                                                   CXClientData state) {
+  switch (clang_getCursorKind(cursor)) {
+  case CXCursor_InclusionDirective:
+  case CXCursor_MacroDefinition:
+  case CXCursor_MacroExpansion:
+    return visit(cursor, parent, state);
+  default:
+    break;
+  }
+  return CXChildVisit_Continue;
+}
+
+/// parse a file through libclang’s indexing API
+static int parse_index(clink_clang_t *clang, const char *filename,
+                       size_t argc, const char **argv,
+                       int (*accept)(const clink_symbol_t *symbol,
+                                     void *context),
+                       void *context) {
+
+  assert(clang != NULL);
+  assert(filename != NULL);
+  assert(argc == 0 || argv != NULL);
+  assert(accept != NULL);
+
+  // if the caller did not provide any arguments, fall back on some defaults
+  if (argc == 0) {
+    static const char *DEFAULT[] = {"clang", NULL};
+    argv = DEFAULT;
+    argc = sizeof(DEFAULT) / sizeof(DEFAULT[0]) - 1;
+  }
+
+  int rc = 0;
+  index_state_t st = {.state = {.accept = accept, .context = context}};
+  CXTranslationUnit tu = NULL;
+  tokens_t tokens = {0};
+
+  // start the indexing session this state parses within
+  if (clang->action == NULL) {
+    clang->action = clang_IndexAction_create(clang->index);
+    if (ERROR(clang->action == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+  }
+
+  // Function bodies in headers are skipped once the session has parsed them,
+  // which is what makes this faster than walking the AST. So do not also ask
+  // to skip function bodies in general, which the indexer would apply to the
+  // main file too.
+  unsigned options = CXTranslationUnit_None;
+  options |= CXTranslationUnit_DetailedPreprocessingRecord;
+  options |= CXTranslationUnit_KeepGoing;
+#if CINDEX_VERSION_MINOR >= 60
+  options |= CXTranslationUnit_RetainExcludedConditionalBlocks;
+#endif
+  const unsigned index_options = CXIndexOpt_IndexFunctionLocalSymbols |
+                                 CXIndexOpt_SkipParsedBodiesInSession;
+
+  IndexerCallbacks callbacks = {.abortQuery = index_abort,
+                                .indexDeclaration = index_declaration,
+                                .indexEntityReference = index_reference};
+
+  const int err = clang_indexSourceFile(
+      clang->action, &st, &callbacks, sizeof(callbacks), index_options,
+      filename, argv, (int)argc, NULL, 0, &tu, options);
+  if ((rc = st.state.rc))
+    goto done;
+  if (ERROR(err != 0)) {
+    rc = clang_err_to_errno(err);
+    goto done;
+  }
+
+  // the indexer does not tell us about #includes and macros, so pick them up
+  // from the top level of the translation unit
+  tokens.tu = tu;
+  st.state.tokens = &tokens;
+  (void)clang_visitChildren(clang_getTranslationUnitCursor(tu),
+                            visit_preprocessing, &st.state);
+  if ((rc = st.state.rc))
+    goto done;
+
+  // parent macro expansions to the outermost declaration containing them
+  outermost_scopes(&st);
+  for (size_t i = 0; i < st.state.macro_expansions_length; ++i) {
+    clink_symbol_t s = st.state.macro_expansions[i];
+    const clink_location_t pos = {.lineno = s.lineno, .colno = s.colno};
+    const scope_t *scope = find_scope(&st, pos);
+    if (scope != NULL)
+      s.parent = scope->name;
+    s.path = (char *)filename;
+    rc = accept(&s, context);
+    if (ERROR(rc != 0))
+      goto done;
+  }
+
+done:
+  for (size_t i = 0; i < st.scopes_length; ++i)
+    free(st.scopes[i].name);
+  free(st.scopes);
+
+  for (size_t i = 0; i < st.state.macro_expansions_length; ++i)
+    clink_symbol_clear(&st.state.macro_expansions[i]);
+  free(st.state.macro_expansions);
+
+  tokens_free(&tokens);
+
+  if (tu != NULL)
+    clang_disposeTranslationUnit(tu);
+
+  return rc;
+}
+
+int clink_clang_parse_cb(clink_clang_t *clang, const char *filename,
+                         size_t argc, const char **argv,
+                         int (*accept)(const clink_symbol_t *symbol,
+                                       void *context),
+                         void *context) {
+
+  if (ERROR(clang == NULL))
     return EINVAL;
 
   if (ERROR(filename == NULL))
@@ -906,17 +1497,36 @@ int clink_parse_with_clang(clink_db_t *db, const char *filename, size_t argc,
   if (ERROR(argc > 0 && argv == NULL))
     return EINVAL;
 
+  if (ERROR(accept == NULL))
+    return EINVAL;
+
   int rc = 0;
 
+  if (clang->use_index) {
+    rc = parse_index(clang, filename, argc, argv, accept, context);
+
+    // The indexer gives up on some files that walking the AST copes with, so
+    // fall back to that for these. Any symbols already reported will be
+    // reported again.
+    if (rc != ENOTRECOVERABLE)
+      return rc;
+    DEBUG("indexing %s failed; falling back to walking its AST", filename);
+    rc = 0;
+  }
+
   // state for the traversal
-  state_t state = {.db = db};
+  state_t state = {.accept = accept, .context = context};
+  tokens_t tokens = {0};
 
-  // initialise Clang
-  CXIndex index;
+  // parse the file
   CXTranslationUnit tu = NULL;
-  if ((rc = init(&index, &tu, filename, argc, argv)))
+  if ((rc = init(clang->index, &tu, filename, argc, argv)))
     goto done;
 
+  // tokens of the main file, for cursors that need them
+  tokens.tu = tu;
+  state.tokens = &tokens;
+
   // get a top level cursor
   CXCursor root = clang_getTranslationUnitCursor(tu);
 
@@ -930,7 +1540,7 @@ int clink_parse_with_clang(clink_db_t *db, const char *filename, size_t argc,
   for (size_t i = 0; i < state.macro_expansions_length; ++i) {
     clink_symbol_t s = state.macro_expansions[i];
     s.path = (char *)filename;
-    rc = clink_db_add_symbol(db, &s);
+    rc = accept(&s, context);
     if (ERROR(rc != 0))
       goto done;
   }
@@ -940,7 +1550,52 @@ done:
     clink_symbol_clear(&state.macro_expansions[i]);
   free(state.macro_expansions);
 
-  deinit(tu, index);
+  tokens_free(&tokens);
+
+  if (tu != NULL)
+    clang_disposeTranslationUnit(tu);
+
+  return rc;
+}
+
+/// `clink_clang_parse_cb` callback for inserting into a database
+static int add_to_db(const clink_symbol_t *symbol, void *context) {
+  clink_db_t *db = context;
+  return clink_db_add_symbol(db, symbol);
+}
+
+int clink_clang_parse(clink_clang_t *clang, clink_db_t *db,
+                      const char *filename, size_t argc, const char **argv) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  return clink_clang_parse_cb(clang, filename, argc, argv, add_to_db, db);
+}
+
+int clink_parse_with_clang_cb(const char *filename, size_t argc,
+                              const char **argv,
+                              int (*accept)(const clink_symbol_t *symbol,
+                                            void *context),
+                              void *context) {
+
+  clink_clang_t *clang = NULL;
+  int rc = clink_clang_new(&clang);
+  if (rc != 0)
+    return rc;
+
+  rc = clink_clang_parse_cb(clang, filename, argc, argv, accept, context);
+
+  clink_clang_free(&clang);
 
   return rc;
 }
+
+int clink_parse_with_clang(clink_db_t *db, const char *filename, size_t argc,
+                           const char **argv) {
+
+  if (ERROR(db == NULL))
+    return EINVAL;
+
+  return clink_parse_with_clang_cb(filename, argc, argv, add_to_db, db);
+}
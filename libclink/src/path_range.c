@@ -0,0 +1,148 @@
+#include "path_range.h"
+#include "db.h"
+#include "debug.h"
+#include "sql.h"
+#include <assert.h>
+#include <clink/db.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** derive the exclusive upper bound of strings starting with a given prefix
+ *
+ * \param prefix Prefix to bound
+ * \param upper [out] The least string greater than all strings starting with
+ *   `prefix` on success, or `NULL` if there is no such string
+ * \return 0 on success or an errno on failure
+ */
+static int upper_bound(const char *prefix, char **upper) {
+
+  char *u = strdup(prefix);
+  if (ERROR(u == NULL))
+    return ENOMEM;
+
+  // SQLite compares text bytewise, so incrementing the last byte that can be
+  // incremented yields the bound
+  for (size_t len = strlen(u); len > 0; --len) {
+    if ((uint8_t)u[len - 1] != UINT8_MAX) {
+      u[len - 1] = (char)((uint8_t)u[len - 1] + 1);
+      u[len] = '\0';
+      *upper = u;
+      return 0;
+    }
+  }
+
+  free(u);
+  *upper = NULL;
+  return 0;
+}
+
+int path_range_init(path_range_t *pr, const clink_db_t *db,
+                    const char *prefix) {
+
+  assert(pr != NULL);
+  assert(db != NULL);
+  assert(prefix != NULL);
+  assert(prefix[0] == '/');
+
+  int rc = 0;
+  path_range_t r = {0};
+
+  if (ERROR((r.abs_lo = strdup(prefix)) == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  if (ERROR((rc = upper_bound(r.abs_lo, &r.abs_hi))))
+    goto done;
+
+  const size_t dir_len = strlen(db->dir);
+  const size_t prefix_len = strlen(prefix);
+  if (prefix_len > dir_len && strncmp(prefix, db->dir, dir_len) == 0) {
+    if (ERROR((r.rel_lo = strdup(prefix + dir_len)) == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+    if (ERROR((rc = upper_bound(r.rel_lo, &r.rel_hi))))
+      goto done;
+  } else if (strncmp(db->dir, prefix, prefix_len) == 0) {
+    r.all_relative = true;
+  }
+
+  *pr = r;
+  r = (path_range_t){0};
+
+done:
+  path_range_free(&r);
+
+  return rc;
+}
+
+void path_range_write(const path_range_t *pr, FILE *out) {
+
+  assert(pr != NULL);
+  assert(pr->abs_lo != NULL);
+  assert(out != NULL);
+
+  fputs("((records.path >= @abs_lo", out);
+  if (pr->abs_hi != NULL)
+    fputs(" and records.path < @abs_hi", out);
+  fputs(")", out);
+  if (pr->rel_lo != NULL) {
+    fputs(" or (records.path >= @rel_lo", out);
+    if (pr->rel_hi != NULL)
+      fputs(" and records.path < @rel_hi", out);
+    fputs(")", out);
+  } else if (pr->all_relative) {
+    fputs(" or records.path < '/' or records.path >= '0'", out);
+  }
+  fputs(")", out);
+}
+
+/** bind a text parameter by name, if it is present in the query
+ *
+ * \param stmt Statement to operate on
+ * \param name Name of the parameter, including its leading `@`
+ * \param value Value to bind, which must outlive the statement
+ * \return 0 on success or an errno on failure
+ */
+static int bind_text(sqlite3_stmt *stmt, const char *name, const char *value) {
+  const int index = sqlite3_bind_parameter_index(stmt, name);
+  if (index == 0)
+    return 0;
+  return sql_bind_text(stmt, index, value);
+}
+
+int path_range_bind(const path_range_t *pr, sqlite3_stmt *stmt) {
+
+  assert(pr != NULL);
+  assert(stmt != NULL);
+
+  int rc = 0;
+
+  if (ERROR((rc = bind_text(stmt, "@abs_lo", pr->abs_lo))))
+    return rc;
+  if (ERROR((rc = bind_text(stmt, "@abs_hi", pr->abs_hi))))
+    return rc;
+  if (ERROR((rc = bind_text(stmt, "@rel_lo", pr->rel_lo))))
+    return rc;
+  if (ERROR((rc = bind_text(stmt, "@rel_hi", pr->rel_hi))))
+    return rc;
+
+  return 0;
+}
+
+void path_range_free(path_range_t *pr) {
+
+  if (pr == NULL)
+    return;
+
+  free(pr->rel_hi);
+  free(pr->rel_lo);
+  free(pr->abs_hi);
+  free(pr->abs_lo);
+  *pr = (path_range_t){0};
+}
@@ -0,0 +1,57 @@
+/// \file
+/// \brief restriction of a query to records under a path prefix
+///
+/// Records under the database’s directory are stored relative to it, so an
+/// absolute path prefix may cover some relative paths, some absolute paths, or
+/// both. This translates such a prefix into ranges over `records.path` that
+/// SQLite can answer from the index on that column.
+
+#pragma once
+
+#include "../../common/compiler.h"
+#include <clink/db.h>
+#include <sqlite3.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/// ranges of `records.path` within a path prefix
+///
+/// Conceptually all fields of this struct are private, and should only be
+/// accessed by path_range.[ch].
+typedef struct {
+  char *abs_lo;      ///< lower bound of absolute record paths
+  char *abs_hi;      ///< upper bound of absolute record paths, if any
+  char *rel_lo;      ///< lower bound of relative record paths, if any
+  char *rel_hi;      ///< upper bound of relative record paths, if any
+  bool all_relative; ///< are all relative record paths within the prefix?
+} path_range_t;
+
+/// derive the ranges of record paths within a prefix
+///
+/// \param pr [out] Ranges on success
+/// \param db Database whose records are to be restricted
+/// \param prefix Absolute path the records’ paths must start with
+/// \return 0 on success or an errno on failure
+INTERNAL int path_range_init(path_range_t *pr, const clink_db_t *db,
+                             const char *prefix);
+
+/// write an SQL condition restricting `records.path` to the ranges
+///
+/// The condition refers to the parameters `@abs_lo`, `@abs_hi`, `@rel_lo`, and
+/// `@rel_hi`, to be bound with `path_range_bind`.
+///
+/// \param pr Ranges to write
+/// \param out Stream to write to
+INTERNAL void path_range_write(const path_range_t *pr, FILE *out);
+
+/// bind the parameters of a condition written by `path_range_write`
+///
+/// \param pr Ranges to bind, which must outlive the statement
+/// \param stmt Statement to operate on
+/// \return 0 on success or an errno on failure
+INTERNAL int path_range_bind(const path_range_t *pr, sqlite3_stmt *stmt);
+
+/// deallocate the ranges
+///
+/// \param pr Ranges to clean up
+INTERNAL void path_range_free(path_range_t *pr);
@@ -0,0 +1,61 @@
+/// \file
+/// \brief cache of record identifiers to absolute paths
+///
+/// Symbols in the database refer to their containing file by record ID. Rather
+/// than joining against the records table and reconstructing an absolute path
+/// for every query result, iterators consult this table which resolves each
+/// record ID at most once.
+
+#pragma once
+
+#include "../../common/compiler.h"
+#include "arena.h"
+#include <clink/db.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stddef.h>
+
+/// a lazily populated mapping from record ID to absolute path
+///
+/// Conceptually all fields of this struct are private, and should only be
+/// accessed by path_table*.[ch].
+typedef struct {
+  const char **paths; ///< absolute paths, indexed by record ID
+  size_t size;        ///< number of slots in `paths`
+  arena_t arena;      ///< backing memory for the path strings themselves
+  sqlite3_stmt *lookup; ///< prepared query for a record’s path, or `NULL`
+  pthread_mutex_t lock; ///< guard for concurrent lookups and invalidations
+} path_table_t;
+
+/// prepare a path table for use
+///
+/// \param pt Table to initialise
+/// \return 0 on success or an errno on failure
+INTERNAL int path_table_init(path_table_t *pt);
+
+/// find the absolute path corresponding to a given record
+///
+/// The returned pointer remains valid until the table is next invalidated or
+/// freed. This function is thread-safe.
+///
+/// \param db Database whose records to consult
+/// \param id Record identifier to lookup
+/// \param path [out] Absolute path of the record on success
+/// \return 0 on success, `ENOENT` if there is no such record, or another errno
+///   on failure
+INTERNAL int path_table_find(clink_db_t *db, clink_record_id_t id,
+                             const char **path);
+
+/// forget all previously resolved record IDs
+///
+/// This must be called whenever the records table is modified, as SQLite may
+/// reuse the IDs of deleted rows. Strings previously returned by
+/// `path_table_find` are deallocated.
+///
+/// \param pt Table to invalidate
+INTERNAL void path_table_invalidate(path_table_t *pt);
+
+/// deallocate a path table and all strings it has handed out
+///
+/// \param pt Table to clean up
+INTERNAL void path_table_free(path_table_t *pt);
@@ -0,0 +1,131 @@
+#include "../../common/compiler.h"
+#include "arena.h"
+#include "db.h"
+#include "debug.h"
+#include "path_table.h"
+#include "sql.h"
+#include <assert.h>
+#include <clink/db.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// lookup a record’s path in the database and construct its absolute form
+///
+/// The caller is expected to hold the path table’s lock.
+static int resolve(clink_db_t *db, clink_record_id_t id, const char **path) {
+
+  assert(db != NULL);
+  assert(id >= 0);
+  assert(path != NULL);
+
+  static const char LOOKUP[] = "select path from records where id = @id;";
+
+  path_table_t *pt = &db->path_table;
+  int rc = 0;
+
+  // prepare the lookup statement on first use and keep it for later misses
+  if (pt->lookup == NULL) {
+    if (ERROR((rc = sql_prepare(db->db, LOOKUP, &pt->lookup))))
+      return rc;
+  }
+  sqlite3_stmt *lookup = pt->lookup;
+
+  if (ERROR((rc = sql_bind_int(lookup, 1, (unsigned long)id))))
+    goto done;
+
+  {
+    int r = sqlite3_step(lookup);
+    if (r != SQLITE_ROW) {
+      if (r == SQLITE_DONE) {
+        rc = ENOENT;
+      } else {
+        rc = sql_err_to_errno(r);
+      }
+      goto done;
+    }
+  }
+
+  const char *stored = (const char *)sqlite3_column_text(lookup, 0);
+  assert(stored != NULL);
+
+  // paths are stored relative to the database’s directory if possible
+  const char *prefix = stored[0] == '/' ? "" : db->dir;
+  const size_t prefix_len = strlen(prefix);
+  const size_t stored_len = strlen(stored);
+
+  char *p = arena_alloc(&pt->arena, prefix_len + stored_len + 1);
+  if (ERROR(p == NULL)) {
+    rc = ENOMEM;
+    goto done;
+  }
+  memcpy(p, prefix, prefix_len);
+  memcpy(p + prefix_len, stored, stored_len + 1);
+
+  *path = p;
+
+done:
+  // end the statement’s read, so it does not hold the database open
+  (void)sqlite3_reset(lookup);
+  (void)sqlite3_clear_bindings(lookup);
+
+  return rc;
+}
+
+int path_table_find(clink_db_t *db, clink_record_id_t id, const char **path) {
+
+  assert(db != NULL);
+  assert(path != NULL);
+
+  if (ERROR(id < 0))
+    return EINVAL;
+
+  if (ERROR((uint64_t)id >= SIZE_MAX / 2 / sizeof(db->path_table.paths[0])))
+    return EOVERFLOW;
+
+  path_table_t *pt = &db->path_table;
+  int rc = 0;
+
+  if (ERROR((rc = pthread_mutex_lock(&pt->lock))))
+    return rc;
+
+  // fast path: have we already resolved this record?
+  if (LIKELY((size_t)id < pt->size && pt->paths[id] != NULL)) {
+    *path = pt->paths[id];
+    goto done;
+  }
+
+  // do we need to expand the index?
+  if ((size_t)id >= pt->size) {
+    size_t size = pt->size == 0 ? 128 : pt->size;
+    while (size <= (size_t)id)
+      size *= 2;
+    const char **p = realloc(pt->paths, size * sizeof(p[0]));
+    if (ERROR(p == NULL)) {
+      rc = ENOMEM;
+      goto done;
+    }
+    memset(&p[pt->size], 0, (size - pt->size) * sizeof(p[0]));
+    pt->paths = p;
+    pt->size = size;
+  }
+
+  const char *resolved = NULL;
+  if ((rc = resolve(db, id, &resolved)))
+    goto done;
+
+  pt->paths[id] = resolved;
+  *path = resolved;
+
+done:
+  {
+    int r UNUSED = pthread_mutex_unlock(&pt->lock);
+    assert(r == 0);
+  }
+
+  return rc;
+}
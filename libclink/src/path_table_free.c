@@ -0,0 +1,21 @@
+#include "arena.h"
+#include "path_table.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdlib.h>
+
+void path_table_free(path_table_t *pt) {
+  assert(pt != NULL);
+
+  free(pt->paths);
+  pt->paths = NULL;
+  pt->size = 0;
+
+  arena_reset(&pt->arena);
+
+  (void)sqlite3_finalize(pt->lookup);
+  pt->lookup = NULL;
+
+  (void)pthread_mutex_destroy(&pt->lock);
+}
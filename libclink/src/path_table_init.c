@@ -0,0 +1,11 @@
+#include "path_table.h"
+#include <assert.h>
+#include <pthread.h>
+
+int path_table_init(path_table_t *pt) {
+  assert(pt != NULL);
+
+  *pt = (path_table_t){0};
+
+  return pthread_mutex_init(&pt->lock, NULL);
+}
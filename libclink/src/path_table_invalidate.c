@@ -0,0 +1,27 @@
+#include "../../common/compiler.h"
+#include "arena.h"
+#include "path_table.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+void path_table_invalidate(path_table_t *pt) {
+  assert(pt != NULL);
+
+  {
+    int r UNUSED = pthread_mutex_lock(&pt->lock);
+    assert(r == 0);
+  }
+
+  // drop the index and the strings it referred to, so a long-lived handle
+  // does not accumulate paths across modifications
+  free(pt->paths);
+  pt->paths = NULL;
+  pt->size = 0;
+  arena_reset(&pt->arena);
+
+  {
+    int r UNUSED = pthread_mutex_unlock(&pt->lock);
+    assert(r == 0);
+  }
+}
@@ -17,6 +17,8 @@ create table if not exists symbols
   foreign key(path) references records(id)
 );
 
+create index if not exists symbols_path on symbols(path);
+
 create table if not exists content
   /* lines of ANSI-colour-enriched source code text */
 (
@@ -33,5 +35,71 @@ create table if not exists records
   id integer primary key,
   path text not null unique,
   hash integer not null,
-  timestamp integer not null
+  timestamp integer not null,
+  size integer not null default 0,
+    /* size in bytes of the file when last parsed */
+  duration integer not null default 0
+    /* nanoseconds spent parsing the file, or 0 if unknown */
+);
+
+create table if not exists calls
+  /* function call edges, from calling function to called function */
+(
+  caller text not null,
+  callee text not null,
+  path integer not null,
+  line integer not null,
+  col integer not null,
+  unique(path, line, col, caller, callee),
+  foreign key(path) references records(id)
+);
+
+create index if not exists calls_caller on calls(caller);
+
+create index if not exists calls_callee on calls(callee);
+
+create table if not exists suffixes
+  /* trailing path components of records, for resolving #includes */
+(
+  suffix text not null,
+  record integer not null,
+  unique(suffix, record)
+);
+
+create index if not exists suffixes_record on suffixes(record);
+
+create table if not exists includes
+  /* #include edges, from including record to included record */
+(
+  includer integer not null,
+  included integer not null,
+  unique(includer, included)
+);
+
+create index if not exists includes_included on includes(included);
+
+create table if not exists names
+  /* distinct symbol names, for approximate matching */
+(
+  id integer primary key,
+  name text not null unique,
+  indexed integer not null default 0
+    /* 1 if this name’s variants have been added, 0 otherwise */
+);
+
+create index if not exists names_unindexed on names(id) where indexed = 0;
+
+create table if not exists variants
+  /* hashes of each name and of its single-byte deletions */
+(
+  hash integer not null,
+  name integer not null,
+  unique(hash, name)
+);
+
+create table if not exists metadata
+  /* properties of the database as a whole */
+(
+  key text primary key,
+  value text not null
 );
@@ -0,0 +1,17 @@
+#include "variant_hash.h"
+#include <stddef.h>
+#include <stdint.h>
+
+int64_t variant_hash(const char *name, size_t skip) {
+
+  // 64-bit FNV-1a
+  uint64_t h = UINT64_C(14695981039346656037);
+  for (size_t i = 0; name[i] != '\0'; ++i) {
+    if (i == skip)
+      continue;
+    h ^= (uint8_t)name[i];
+    h *= UINT64_C(1099511628211);
+  }
+
+  return (int64_t)h;
+}
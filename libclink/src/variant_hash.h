@@ -0,0 +1,19 @@
+#pragma once
+
+#include "../../common/compiler.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/** hash a symbol name with one of its bytes omitted
+ *
+ * This is the key of the `variants` table, used for approximate name matching.
+ * A name and each of its single-byte deletions are stored, so two names within
+ * one edit of each other always share at least one variant. The hash is not
+ * guaranteed to be unique, so matches must be verified against the names
+ * themselves.
+ *
+ * \param name Name to hash
+ * \param skip Index of the byte to omit, or `SIZE_MAX` to omit nothing
+ * \return Hash of the variant, reinterpreted as a signed integer for SQLite
+ */
+INTERNAL int64_t variant_hash(const char *name, size_t skip);
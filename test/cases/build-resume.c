@@ -0,0 +1,19 @@
+/// a build interrupted part-way through should be resumed, not restarted
+
+// RUN: mkdir build-resume && echo 'int bar;' >build-resume/bar.h && echo '#include "bar.h"' >build-resume/foo.c && echo 'int qux;' >build-resume/qux.c
+// RUN: clink --build-only --database={%t} --parse-c=clang build-resume >/dev/null
+
+// a completed build should leave no record looking incomplete
+// RUN: echo "select count(*) from records where hash = 0 or timestamp = 0;" | sqlite3 {%t}
+// CHECK: 0
+
+// a file that was being parsed when the build stopped should be redone alone
+// RUN: echo "update records set hash = 0, timestamp = 0 where path like '%foo.c';" | sqlite3 {%t}
+// RUN: clink --build-only --colour=never --database={%t} --debug --jobs=1 --parse-c=clang build-resume 2>&1 | grep --colour=never --count "Clang-parsing C file"
+// CHECK: 1
+
+// a modified header, and the files that #include it, should also be complete
+// RUN: echo 'int baz;' >>build-resume/bar.h
+// RUN: clink --build-only --database={%t} --parse-c=clang build-resume >/dev/null
+// RUN: echo "select count(*) from records where hash = 0 or timestamp = 0;" | sqlite3 {%t}
+// CHECK: 0
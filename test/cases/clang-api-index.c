@@ -0,0 +1,49 @@
+/// parsing through libclang’s indexing API should find declarations, calls,
+/// and assignments
+
+#define SQUARE(x) ((x) * (x))
+
+typedef struct {
+  int x;
+  int y;
+} point_t;
+
+extern int scale(int factor);
+
+static int area(const point_t *p) {
+  int a = SQUARE(p->x);
+  a += scale(p->y);
+  return a;
+}
+
+int main(void) {
+  point_t p = {.x = 2, .y = 3};
+  return area(&p);
+}
+
+// RUN: clink --build-only --database={%t} --parse-c=clang --clang-api=index {%s} >/dev/null
+// RUN: echo "select name, line, col, parent from symbols where category = 0 and parent <> '' order by line, col;" | sqlite3 {%t}
+// CHECK: x|7|7|point_t
+// CHECK: y|8|7|point_t
+// CHECK: factor|11|22|scale
+// CHECK: p|13|32|area
+// CHECK: a|14|7|area
+// CHECK: p|20|11|main
+
+// RUN: echo "select name, line, col, parent from symbols where category = 1 order by line, col;" | sqlite3 {%t}
+// CHECK: SQUARE|14|11|area
+// CHECK: scale|15|8|area
+// CHECK: area|21|10|main
+
+// RUN: echo "select name, line, col, parent from symbols where category = 4 order by line, col;" | sqlite3 {%t}
+// CHECK: a|14|7|area
+// CHECK: a|15|3|area
+// CHECK: p|20|11|main
+
+// workers should parse the same way
+// RUN: echo "select name, category, line, col, parent from symbols order by line, col, name, category;" | sqlite3 {%t} >{%t}.in-process
+// RUN: rm {%t}
+// RUN: clink --build-only --database={%t} --parse-c=clang --clang-api=index --isolate-clang {%s} >/dev/null
+// RUN: echo "select name, category, line, col, parent from symbols order by line, col, name, category;" | sqlite3 {%t} >{%t}.isolated
+// RUN: test -s {%t}.isolated && diff {%t}.in-process {%t}.isolated && echo same
+// CHECK: same
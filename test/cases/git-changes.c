@@ -0,0 +1,28 @@
+/// --git should only look at files Git reports as changed since the last build
+
+// RUN: mkdir git-changes && echo 'int foo;' >git-changes/foo.c && echo 'int bar;' >git-changes/bar.c
+// RUN: git -C git-changes init --quiet && git -C git-changes add foo.c bar.c
+// RUN: git -C git-changes -c user.name=clink -c user.email=clink@example.com commit --quiet --message=initial
+
+// the first build has no baseline, so should scan everything
+// RUN: clink --build-only --database={%t} --git --parse-c=generic git-changes >/dev/null
+// RUN: echo "select count(*) from symbols where name = 'foo' or name = 'bar';" | sqlite3 {%t}
+// CHECK: 2
+
+// with nothing changed, nothing should be looked at
+// RUN: clink --build-only --colour=never --database={%t} --debug --git --jobs=1 --parse-c=generic git-changes 2>&1 | grep --colour=never "Git reports"
+// CHECK: Git reports 0 possibly changed files
+
+// a modified file and a new one should be picked up
+// RUN: echo 'int baz;' >>git-changes/foo.c && echo 'int qux;' >git-changes/qux.c
+// RUN: clink --build-only --colour=never --database={%t} --debug --git --jobs=1 --parse-c=generic git-changes 2>&1 | grep --colour=never "Git reports"
+// CHECK: Git reports 2 possibly changed files
+// RUN: echo "select count(*) from symbols where name = 'baz' or name = 'qux';" | sqlite3 {%t}
+// CHECK: 2
+
+// reverting and deleting them should be seen because they were dirty before
+// RUN: git -C git-changes checkout --quiet foo.c && rm git-changes/qux.c
+// RUN: clink --build-only --colour=never --database={%t} --debug --git --jobs=1 --parse-c=generic git-changes 2>&1 | grep --colour=never "Git reports"
+// CHECK: Git reports 2 possibly changed files
+// RUN: echo "select count(*) from symbols where name = 'baz' or name = 'qux';" | sqlite3 {%t}
+// CHECK: 0
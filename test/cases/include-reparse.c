@@ -0,0 +1,7 @@
+/// when a header changes, Clink should reparse the files that #include it
+
+// RUN: mkdir include-reparse && echo 'int bar;' >include-reparse/bar.h && echo '#include "bar.h"' >include-reparse/foo.c
+// RUN: clink --build-only --database={%t} --parse-c=clang include-reparse >/dev/null
+// RUN: echo 'int baz;' >>include-reparse/bar.h
+// RUN: clink --build-only --colour=never --database={%t} --debug --jobs=1 --parse-c=clang include-reparse 2>&1 | grep --colour=never --count "Clang-parsing C file .*foo\.c"
+// CHECK: 1
@@ -0,0 +1,35 @@
+/// parsing with libclang in worker processes should find the same symbols as
+/// parsing in-process
+
+#define SQUARE(x) ((x) * (x))
+
+struct point {
+  int x;
+  int y;
+};
+
+static int area(const struct point *p) {
+  int a = SQUARE(p->x);
+  a += p->y;
+  return a;
+}
+
+int main(void) {
+  struct point p = {.x = 2, .y = 3};
+  return area(&p);
+}
+
+// RUN: clink --build-only --database={%t} --parse-c=clang {%s} >/dev/null
+// RUN: echo "select name, category, line, col, start_byte, end_byte, parent from symbols order by line, col, name, category;" | sqlite3 {%t} >{%t}.in-process
+// RUN: rm {%t}
+// RUN: clink --build-only --database={%t} --parse-c=clang --isolate-clang {%s} >/dev/null
+// RUN: echo "select name, category, line, col, start_byte, end_byte, parent from symbols order by line, col, name, category;" | sqlite3 {%t} >{%t}.isolated
+// RUN: test -s {%t}.isolated && diff {%t}.in-process {%t}.isolated && echo same
+// CHECK: same
+
+// limits should not disturb parsing of a well-behaved file
+// RUN: rm {%t}
+// RUN: clink --build-only --database={%t} --parse-c=clang --clang-timeout=60 --clang-memory-limit=4096 {%s} >/dev/null
+// RUN: echo "select name, category, line, col, start_byte, end_byte, parent from symbols order by line, col, name, category;" | sqlite3 {%t} >{%t}.limited
+// RUN: diff {%t}.in-process {%t}.limited && echo same
+// CHECK: same
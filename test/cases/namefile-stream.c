@@ -0,0 +1,12 @@
+/// entries of a namefile should be built, whether it is a file or stdin
+
+// RUN: mkdir namefile-stream && echo 'int foo;' >namefile-stream/foo.c && echo 'int bar;' >namefile-stream/bar.c && echo 'int baz;' >namefile-stream/baz.c
+// RUN: printf 'namefile-stream/foo.c\n"namefile-stream/bar.c"\n' >namefile-stream.txt
+// RUN: clink --build-only --database={%t} --parse-c=generic -i namefile-stream.txt >/dev/null
+// RUN: echo "select count(*) from symbols where name = 'foo' or name = 'bar';" | sqlite3 {%t}
+// CHECK: 2
+
+// an entry listed twice should only be built once
+// RUN: printf 'namefile-stream/baz.c namefile-stream/baz.c namefile-stream/foo.c\n' | clink --build-only --database={%t}.2 --parse-c=generic -i - >/dev/null
+// RUN: echo "select count(*) from records;" | sqlite3 {%t}.2
+// CHECK: 2
@@ -0,0 +1,29 @@
+/// sources sharing their leading #includes should be parsed with a precompiled
+/// header of them, without changing the results
+
+// RUN: mkdir pch && printf '#pragma once\n\n\n#define TWICE(x) ((x) * 2)\n' >pch/common.h
+// RUN: printf '#ifndef OTHER_H\n#define OTHER_H\ntypedef int other_t;\n#endif\n' >pch/other.h
+// RUN: for i in 1 2 3 4 5; do printf '#include "other.h"\n#include "common.h"\nother_t v%s = TWICE(%s);\n' $i $i >pch/f$i.c; done
+// RUN: clink --build-only --database={%t} --parse-c=clang --pch=on --pch-cache={%t}.pch -j1 pch >/dev/null
+// RUN: ls {%t}.pch | grep -c '[.]pch$'
+// CHECK: 1
+
+// expansions of macros from the precompiled header should still be seen
+// RUN: echo "select count(*) from symbols where name = 'TWICE' and line = 3;" | sqlite3 {%t}
+// CHECK: 5
+
+// the precompiled header should be reused by a later build
+// RUN: clink --build-only --database={%t}.2 --parse-c=clang --pch=on --pch-cache={%t}.pch -j1 --debug pch 2>&1 | grep -c 'with precompiled header'
+// CHECK: 5
+
+// precompiled headers unused for a long time should be evicted from the cache
+// RUN: touch -d 2000-01-01 {%t}.pch/0123456789abcdef.pch {%t}.pch/0123456789abcdef.deps
+// RUN: touch {%t}.pch/fedcba9876543210.pch.AbCdEf
+// RUN: touch -d 2000-01-01 {%t}.pch/fedcba9876543210.h.GhIjKl
+// RUN: clink --build-only --database={%t}.3 --parse-c=clang --pch=on --pch-cache={%t}.pch -j1 pch >/dev/null
+// RUN: ls {%t}.pch | grep -c '^0123456789abcdef' || true
+// CHECK: 0
+// RUN: ls {%t}.pch | grep '^fedcba9876543210'
+// CHECK: fedcba9876543210.pch.AbCdEf
+// RUN: ls {%t}.pch | grep -c '[.]pch$'
+// CHECK: 1
@@ -0,0 +1,8 @@
+/// --profile should write a report of the build
+
+// RUN: mkdir profile && echo 'int foo;' >profile/foo.c && echo 'int bar;' >profile/bar.c
+// RUN: clink --build-only --database={%t} --parse-c=generic --profile=profile.json profile >/dev/null
+// RUN: python3 -m json.tool profile.json >/dev/null && grep --colour=never --only-matching '"files": 2' profile.json | head -1
+// CHECK: "files": 2
+// RUN: grep --colour=never --only-matching '"parser": "generic-c", "files": 2' profile.json
+// CHECK: "parser": "generic-c", "files": 2
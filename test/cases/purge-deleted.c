@@ -0,0 +1,19 @@
+/// when a file is deleted, Clink should forget about it on the next build
+
+// RUN: mkdir purge-deleted && echo 'int foo;' >purge-deleted/foo.c && echo 'int bar;' >purge-deleted/bar.c
+// RUN: clink --build-only --database={%t} --parse-c=clang purge-deleted >/dev/null
+// RUN: echo "1bar" | clink-repl -f {%t}
+// CHECK: >> cscope: 1 lines
+// CHECK: purge-deleted/bar.c bar 1 int bar;
+// CHECK: >>
+
+// after deleting one of the files, rebuilding should drop its symbols
+// RUN: rm purge-deleted/bar.c
+// RUN: clink --build-only --database={%t} --parse-c=clang purge-deleted >/dev/null
+// RUN: echo "1bar" | clink-repl -f {%t}
+// CHECK: >> cscope: 0 lines
+// CHECK: >>
+
+// but keep those of the remaining file
+// RUN: echo "1foo" | clink-repl -f {%t}
+// CHECK: >> cscope: 1 lines
@@ -0,0 +1,16 @@
+/// can REPL searches be restricted to part of the tree?
+
+int x;
+
+// parse this file and generate a database
+// RUN: clink --build-only --database={%t} --debug --parse-c=clang --syntax-highlighting=eager {%s} >/dev/null
+
+// a scope covering this file should find the definition
+// RUN: echo "1x" | clink-repl -f {%t} --scope {%s}
+// CHECK: >> cscope: 1 lines
+// CHECK: {%s} x 3 int x;
+// CHECK: >>
+
+// a scope elsewhere should not
+// RUN: echo "1x" | clink-repl -f {%t} --scope /nonexistent/directory
+// CHECK: >> cscope: 0 lines
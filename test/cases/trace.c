@@ -0,0 +1,8 @@
+/// --trace should write a timeline of the build
+
+// RUN: mkdir trace && echo 'int foo;' >trace/foo.c && echo 'int bar;' >trace/bar.c
+// RUN: clink --build-only --database={%t} --parse-c=generic --jobs=2 --trace=trace.json trace >/dev/null
+// RUN: python3 -m json.tool trace.json >/dev/null && grep --colour=never --only-matching '"name": "parse generic-c"' trace.json | head -1
+// CHECK: "name": "parse generic-c"
+// RUN: grep --colour=never --only-matching '"name": "worker 1"' trace.json
+// CHECK: "name": "worker 1"
@@ -0,0 +1,39 @@
+/// --watch should keep the database up to date as sources change
+
+// XFAIL: os.uname().sysname != "Linux"
+
+// RUN: mkdir watch && echo 'int foo;' >watch/foo.c && echo 'int bar;' >watch/bar.c
+// RUN: {%timeout} 60s clink --watch --database={%t} --parse-c=clang watch >/dev/null 2>&1 & echo $! >{%t}.pid
+
+// wait for the initial build, reading only so as not to create the database
+// RUN: for i in $(seq 100); do n=$(echo "select count(*) from symbols where name = 'foo';" | sqlite3 -readonly {%t} 2>/dev/null) && [ "$n" = 1 ] && break; sleep 0.1; done; echo "$n"
+// CHECK: 1
+
+// modifying a file should replace its symbols
+// RUN: echo 'int foo2;' >watch/foo.c
+// RUN: for i in $(seq 100); do n=$(echo "select count(*) from symbols where name = 'foo2';" | sqlite3 -readonly {%t} 2>/dev/null) && [ "$n" = 1 ] && break; sleep 0.1; done; echo "$n"
+// CHECK: 1
+// RUN: echo "select count(*) from symbols where name = 'foo';" | sqlite3 {%t}
+// CHECK: 0
+
+// creating a file should add its symbols
+// RUN: echo 'int baz;' >watch/baz.c
+// RUN: for i in $(seq 100); do n=$(echo "select count(*) from symbols where name = 'baz';" | sqlite3 -readonly {%t} 2>/dev/null) && [ "$n" = 1 ] && break; sleep 0.1; done; echo "$n"
+// CHECK: 1
+
+// deleting a file should remove its symbols and record
+// RUN: rm watch/bar.c
+// RUN: for i in $(seq 100); do n=$(echo "select count(*) from symbols where name = 'bar';" | sqlite3 -readonly {%t} 2>/dev/null) && [ "$n" = 0 ] && break; sleep 0.1; done; echo "$n"
+// CHECK: 0
+// RUN: echo "select count(*) from records where path like '%bar.c';" | sqlite3 {%t}
+// CHECK: 0
+
+// a file in a new directory should be found, and that directory watched
+// RUN: mkdir watch/sub && echo 'int qux;' >watch/sub/qux.c
+// RUN: for i in $(seq 100); do n=$(echo "select count(*) from symbols where name = 'qux';" | sqlite3 -readonly {%t} 2>/dev/null) && [ "$n" = 1 ] && break; sleep 0.1; done; echo "$n"
+// CHECK: 1
+// RUN: sleep 0.5 && echo 'int quux;' >watch/sub/quux.c
+// RUN: for i in $(seq 100); do n=$(echo "select count(*) from symbols where name = 'quux';" | sqlite3 -readonly {%t} 2>/dev/null) && [ "$n" = 1 ] && break; sleep 0.1; done; echo "$n"
+// CHECK: 1
+
+// RUN: kill $(cat {%t}.pid)
@@ -0,0 +1,142 @@
+#include "test.h"
+#include <clink/clink.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/// add a call to the database, asserting success
+#define ADD_CALL(db, path_, caller, callee, line)                              \
+  do {                                                                         \
+    clink_symbol_t symbol = {.category = CLINK_FUNCTION_CALL,                  \
+                             .lineno = (line),                                 \
+                             .colno = 1};                                      \
+    symbol.name = (char *)(callee);                                            \
+    symbol.path = (char *)(path_);                                             \
+    symbol.parent = (char *)(caller);                                          \
+    int r_ = clink_db_add_symbol((db), &symbol);                               \
+    if (r_)                                                                    \
+      fprintf(stderr, "clink_db_add_symbol: %s\n", strerror(r_));              \
+    ASSERT_EQ(r_, 0);                                                          \
+  } while (0)
+
+/// check the line numbers yielded by an iterator
+#define ASSERT_LINES(it, ...)                                                  \
+  do {                                                                         \
+    static const unsigned long expected[] = {__VA_ARGS__};                     \
+    for (size_t i_ = 0; i_ < sizeof(expected) / sizeof(expected[0]); ++i_) {  \
+      const clink_symbol_t *sym_ = NULL;                                       \
+      int r_ = clink_iter_next_symbol((it), &sym_);                            \
+      if (r_)                                                                  \
+        fprintf(stderr, "clink_iter_next_symbol: %s\n", strerror(r_));         \
+      ASSERT_EQ(r_, 0);                                                        \
+      ASSERT_EQ(sym_->lineno, expected[i_]);                                   \
+    }                                                                          \
+    const clink_symbol_t *sym_ = NULL;                                         \
+    int r_ = clink_iter_next_symbol((it), &sym_);                              \
+    ASSERT_EQ(r_, ENOMSG);                                                     \
+  } while (0)
+
+TEST("clink_db_find_call_chain()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // add a record for the upcoming path
+  static const char path[] = "/foo/bar.c";
+  {
+    int rc = clink_db_add_record(db, path, 0, 0, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+
+  // construct a call graph with a cycle, a → b → c → a, and d → c
+  ADD_CALL(db, path, "a", "b", 10);
+  ADD_CALL(db, path, "b", "c", 20);
+  ADD_CALL(db, path, "c", "a", 30);
+  ADD_CALL(db, path, "d", "c", 40);
+
+  // direct callers only
+  {
+    clink_iter_t *it = NULL;
+    int rc = clink_db_find_call_chain(db, "c", CLINK_CALLERS, 1, NULL, &it);
+    if (rc)
+      fprintf(stderr, "clink_db_find_call_chain: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+    ASSERT_LINES(it, 20, 40);
+    clink_iter_free(&it);
+  }
+
+  // callers within two calls, nearest first
+  {
+    clink_iter_t *it = NULL;
+    int rc = clink_db_find_call_chain(db, "c", CLINK_CALLERS, 2, NULL, &it);
+    ASSERT_EQ(rc, 0);
+    ASSERT_LINES(it, 20, 40, 10);
+    clink_iter_free(&it);
+  }
+
+  // a deep traversal should terminate despite the cycle and not yield
+  // duplicates
+  {
+    clink_iter_t *it = NULL;
+    int rc = clink_db_find_call_chain(db, "c", CLINK_CALLERS, 100, NULL, &it);
+    ASSERT_EQ(rc, 0);
+    ASSERT_LINES(it, 20, 40, 10, 30);
+    clink_iter_free(&it);
+  }
+
+  // callees within two calls
+  {
+    clink_iter_t *it = NULL;
+    int rc = clink_db_find_call_chain(db, "a", CLINK_CALLEES, 2, NULL, &it);
+    ASSERT_EQ(rc, 0);
+    ASSERT_LINES(it, 10, 20);
+    clink_iter_free(&it);
+  }
+
+  // restricting to a directory containing the calls should not change them
+  {
+    clink_iter_t *it = NULL;
+    int rc = clink_db_find_call_chain(db, "c", CLINK_CALLERS, 1, "/foo/", &it);
+    ASSERT_EQ(rc, 0);
+    ASSERT_LINES(it, 20, 40);
+    clink_iter_free(&it);
+  }
+
+  // but restricting to another directory should exclude them
+  {
+    clink_iter_t *it = NULL;
+    int rc = clink_db_find_call_chain(db, "c", CLINK_CALLERS, 1, "/bar/", &it);
+    ASSERT_EQ(rc, 0);
+    const clink_symbol_t *sym = NULL;
+    rc = clink_iter_next_symbol(it, &sym);
+    ASSERT_EQ(rc, ENOMSG);
+    clink_iter_free(&it);
+  }
+
+  // removing the file should remove its calls
+  clink_db_remove(db, path);
+  {
+    clink_iter_t *it = NULL;
+    int rc = clink_db_find_call_chain(db, "c", CLINK_CALLERS, 100, NULL, &it);
+    ASSERT_EQ(rc, 0);
+    const clink_symbol_t *sym = NULL;
+    rc = clink_iter_next_symbol(it, &sym);
+    ASSERT_EQ(rc, ENOMSG);
+    clink_iter_free(&it);
+  }
+
+  // close the database
+  clink_db_close(&db);
+}
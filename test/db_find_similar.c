@@ -0,0 +1,142 @@
+#include "test.h"
+#include <clink/clink.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// add a definition to the database, asserting success
+#define ADD_DEF(db, path_, name_)                                              \
+  do {                                                                         \
+    clink_symbol_t symbol = {.category = CLINK_DEFINITION,                     \
+                             .lineno = 1,                                      \
+                             .colno = 1};                                      \
+    symbol.name = (char *)(name_);                                             \
+    symbol.path = (char *)(path_);                                             \
+    int r_ = clink_db_add_symbol((db), &symbol);                               \
+    if (r_)                                                                    \
+      fprintf(stderr, "clink_db_add_symbol: %s\n", strerror(r_));              \
+    ASSERT_EQ(r_, 0);                                                          \
+  } while (0)
+
+/// check the names similar to a given name
+#define ASSERT_SIMILAR(db, name, ...)                                          \
+  do {                                                                         \
+    static const char *expected[] = {NULL, __VA_ARGS__};                       \
+    const size_t expected_size = sizeof(expected) / sizeof(expected[0]) - 1;   \
+    char **similar_ = NULL;                                                    \
+    size_t similar_size_ = 0;                                                  \
+    int r_ = clink_db_find_similar((db), (name), &similar_, &similar_size_);   \
+    if (r_)                                                                    \
+      fprintf(stderr, "clink_db_find_similar: %s\n", strerror(r_));            \
+    ASSERT_EQ(r_, 0);                                                          \
+    ASSERT_EQ(similar_size_, expected_size);                                   \
+    for (size_t i_ = 0; i_ < similar_size_; ++i_) {                           \
+      ASSERT_STREQ(similar_[i_], expected[i_ + 1]);                            \
+      free(similar_[i_]);                                                      \
+    }                                                                          \
+    free(similar_);                                                            \
+  } while (0)
+
+TEST("clink_db_find_similar()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // add a record for the upcoming path
+  static const char path[] = "/foo/bar.c";
+  {
+    int rc = clink_db_add_record(db, path, 0, 0, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+
+  ADD_DEF(db, path, "foo");
+  ADD_DEF(db, path, "fooo");
+  ADD_DEF(db, path, "fop");
+  ADD_DEF(db, path, "free");
+  ADD_DEF(db, path, "printf");
+  ADD_DEF(db, path, "print_menu");
+  ADD_DEF(db, path, "print_results");
+
+  // nothing should be found before the names are indexed
+  ASSERT_SIMILAR(db, "printf");
+
+  {
+    int rc = clink_db_index_names(db);
+    if (rc)
+      fprintf(stderr, "clink_db_index_names: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // indexing again should be harmless
+  {
+    int rc = clink_db_index_names(db);
+    ASSERT_EQ(rc, 0);
+  }
+
+  // an exact match
+  ASSERT_SIMILAR(db, "printf", "printf");
+
+  // a deletion, insertion and substitution
+  ASSERT_SIMILAR(db, "print_reslts", "print_results");
+  ASSERT_SIMILAR(db, "freee", "free");
+  ASSERT_SIMILAR(db, "printg", "printf");
+
+  // a transposition
+  ASSERT_SIMILAR(db, "prnitf", "printf");
+
+  // results should be ordered by distance
+  ASSERT_SIMILAR(db, "foo", "foo", "fooo", "fop");
+
+  // something entirely different
+  ASSERT_SIMILAR(db, "malloc");
+
+  // a name also used by another file
+  static const char other[] = "/foo/baz.c";
+  {
+    int rc = clink_db_add_record(db, other, 0, 0, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+  ADD_DEF(db, other, "printf");
+
+  // removing the file should remove only its own names from consideration
+  clink_db_remove(db, path);
+  ASSERT_SIMILAR(db, "printf", "printf");
+  ASSERT_SIMILAR(db, "freee");
+
+  // a removed name that returns should be indexed again
+  {
+    int rc = clink_db_add_record(db, path, 0, 0, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+  ADD_DEF(db, path, "free");
+  {
+    int rc = clink_db_index_names(db);
+    ASSERT_EQ(rc, 0);
+  }
+  ASSERT_SIMILAR(db, "freee", "free");
+
+  // purging should also remove names from consideration
+  {
+    const char *paths[] = {path, other};
+    int rc = clink_db_purge(db, paths, sizeof(paths) / sizeof(paths[0]));
+    ASSERT_EQ(rc, 0);
+  }
+  ASSERT_SIMILAR(db, "printf");
+  ASSERT_SIMILAR(db, "freee");
+
+  // close the database
+  clink_db_close(&db);
+}
@@ -0,0 +1,90 @@
+#include "test.h"
+#include <clink/clink.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+TEST("clink_db_find_symbol() with database-relative paths") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // construct a source path adjacent to the database, which will be stored
+  // relative to it
+  char *path = test_asprintf("%s.c", target);
+
+  // add a record for this path
+  {
+    int rc = clink_db_add_record(db, path, 0, 0, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+
+  // add two symbols within this file
+  for (unsigned long i = 0; i < 2; ++i) {
+    clink_symbol_t symbol = {
+        .category = CLINK_DEFINITION, .lineno = 42 + i, .colno = 10};
+
+    symbol.name = (char *)"sym-name";
+    symbol.path = path;
+
+    int rc = clink_db_add_symbol(db, &symbol);
+    if (rc)
+      fprintf(stderr, "clink_db_add_symbol: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  clink_iter_t *it = NULL;
+  {
+    int rc = clink_db_find_symbol(db, "sym-name", &it);
+    if (rc)
+      fprintf(stderr, "clink_db_find_symbol: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // the first result should have its path resolved to an absolute one
+  const char *first = NULL;
+  {
+    const clink_symbol_t *sym = NULL;
+    int rc = clink_iter_next_symbol(it, &sym);
+    if (rc)
+      fprintf(stderr, "clink_iter_next_symbol: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+
+    ASSERT_STREQ(sym->path, path);
+    ASSERT_EQ(sym->lineno, 42ul);
+    first = sym->path;
+  }
+
+  // the second result should share the same resolved path
+  {
+    const clink_symbol_t *sym = NULL;
+    int rc = clink_iter_next_symbol(it, &sym);
+    if (rc)
+      fprintf(stderr, "clink_iter_next_symbol: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+
+    ASSERT_STREQ(sym->path, path);
+    ASSERT_EQ(sym->lineno, 43ul);
+    ASSERT_EQ((const void *)sym->path, (const void *)first);
+  }
+
+  clink_iter_free(&it);
+
+  // the resolved path should outlive the iterator
+  ASSERT_STREQ(first, path);
+
+  // close the database
+  clink_db_close(&db);
+}
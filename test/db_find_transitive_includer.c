@@ -0,0 +1,109 @@
+#include "test.h"
+#include <clink/clink.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/// add a record to the database, asserting success
+#define ADD_RECORD(db, path)                                                   \
+  do {                                                                         \
+    int r_ = clink_db_add_record((db), (path), 0, 0, NULL);                    \
+    if (r_)                                                                    \
+      fprintf(stderr, "clink_db_add_record: %s\n", strerror(r_));              \
+    ASSERT_EQ(r_, 0);                                                          \
+  } while (0)
+
+/// add an #include to the database, asserting success
+#define ADD_INCLUDE(db, path_, name_, line)                                    \
+  do {                                                                         \
+    clink_symbol_t symbol = {                                                  \
+        .category = CLINK_INCLUDE, .lineno = (line), .colno = 1};              \
+    symbol.name = (char *)(name_);                                             \
+    symbol.path = (char *)(path_);                                             \
+    int r_ = clink_db_add_symbol((db), &symbol);                               \
+    if (r_)                                                                    \
+      fprintf(stderr, "clink_db_add_symbol: %s\n", strerror(r_));              \
+    ASSERT_EQ(r_, 0);                                                          \
+  } while (0)
+
+/// check the line numbers yielded by a query restricted to a path prefix
+#define ASSERT_LINES_IN(db, name, path, ...)                                   \
+  do {                                                                         \
+    clink_iter_t *it_ = NULL;                                                  \
+    int r_ = clink_db_find_transitive_includer((db), (name), (path), &it_);    \
+    if (r_)                                                                    \
+      fprintf(stderr, "clink_db_find_transitive_includer: %s\n",               \
+              strerror(r_));                                                   \
+    ASSERT_EQ(r_, 0);                                                          \
+    static const unsigned long expected[] = {__VA_ARGS__};                     \
+    for (size_t i_ = 0; i_ < sizeof(expected) / sizeof(expected[0]); ++i_) {  \
+      const clink_symbol_t *sym_ = NULL;                                       \
+      r_ = clink_iter_next_symbol(it_, &sym_);                                 \
+      ASSERT_EQ(r_, 0);                                                        \
+      ASSERT_EQ(sym_->lineno, expected[i_]);                                   \
+    }                                                                          \
+    const clink_symbol_t *sym_ = NULL;                                         \
+    r_ = clink_iter_next_symbol(it_, &sym_);                                   \
+    ASSERT_EQ(r_, ENOMSG);                                                     \
+    clink_iter_free(&it_);                                                     \
+  } while (0)
+
+/// check the line numbers yielded by a query
+#define ASSERT_LINES(db, name, ...) ASSERT_LINES_IN(db, name, NULL, __VA_ARGS__)
+
+TEST("clink_db_find_transitive_includer()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // an #include of a file we do not yet know about
+  ADD_RECORD(db, "/src/a.c");
+  ADD_INCLUDE(db, "/src/a.c", "foo.h", 1);
+
+  // the file it refers to, itself #including another unknown file
+  ADD_RECORD(db, "/src/include/foo.h");
+  ADD_INCLUDE(db, "/src/include/foo.h", "bar/baz.h", 3);
+  ADD_RECORD(db, "/src/bar/baz.h");
+
+  // an #include of a file we already know about
+  ADD_RECORD(db, "/src/c.c");
+  ADD_INCLUDE(db, "/src/c.c", "bar/baz.h", 5);
+
+  // an unrelated #include
+  ADD_RECORD(db, "/src/d.c");
+  ADD_INCLUDE(db, "/src/d.c", "other/baz.h", 7);
+
+  // everything affected by a change to baz.h
+  ASSERT_LINES(db, "/src/bar/baz.h", 1, 5, 3);
+  ASSERT_LINES(db, "bar/baz.h", 1, 5, 3);
+
+  // only those within a given directory
+  ASSERT_LINES_IN(db, "baz.h", "/src/include/", 3);
+  ASSERT_LINES_IN(db, "baz.h", "/src/c", 5);
+
+  // everything affected by a change to foo.h
+  ASSERT_LINES(db, "foo.h", 1);
+
+  // removing a file should break the chain through it
+  clink_db_remove(db, "/src/include/foo.h");
+  ASSERT_LINES(db, "baz.h", 5);
+
+  // but it should be reconnected when it reappears
+  ADD_RECORD(db, "/src/include/foo.h");
+  ASSERT_LINES(db, "foo.h", 1);
+
+  // close the database
+  clink_db_close(&db);
+}
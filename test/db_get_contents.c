@@ -0,0 +1,64 @@
+#include "test.h"
+#include <clink/clink.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+TEST("clink_db_get_contents()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // add a record for this file
+  static const char path[] = "/foo";
+  {
+    int rc = clink_db_add_record(db, path, 0, 0, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+
+  // add some lines of content
+  {
+    int rc = clink_db_add_line(db, path, 42, "bar");
+    if (rc)
+      fprintf(stderr, "clink_db_add_line: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+  {
+    int rc = clink_db_add_line(db, path, 44, "baz");
+    if (rc)
+      fprintf(stderr, "clink_db_add_line: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // retrieve these, as well as a line that has no content
+  static const unsigned long linenos[] = {44, 43, 42};
+  char *contents[3] = {0};
+  {
+    int rc = clink_db_get_contents(db, path, linenos, 3, contents);
+    if (rc)
+      fprintf(stderr, "clink_db_get_contents: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  ASSERT_STREQ(contents[0], "baz");
+  ASSERT(contents[1] == NULL);
+  ASSERT_STREQ(contents[2], "bar");
+
+  for (size_t i = 0; i < sizeof(contents) / sizeof(contents[0]); ++i)
+    free(contents[i]);
+
+  // close the database
+  clink_db_close(&db);
+}
@@ -0,0 +1,103 @@
+#include "test.h"
+#include <clink/clink.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// records seen by `accept`
+typedef struct {
+  clink_record_t records[2];
+  size_t count;
+} seen_t;
+
+static int accept(const clink_record_t *record, void *context) {
+  seen_t *seen = context;
+  if (seen->count == sizeof(seen->records) / sizeof(seen->records[0]))
+    return ERANGE;
+  seen->records[seen->count] = *record;
+  seen->records[seen->count].path = test_asprintf("%s", record->path);
+  ++seen->count;
+  return 0;
+}
+
+TEST("clink_db_get_records()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // add a record that will be stored relative to the database
+  char *path = test_asprintf("%s.c", target);
+  clink_record_id_t id = -1;
+  {
+    int rc = clink_db_add_record(db, path, 42, 128, &id);
+    ASSERT_EQ(rc, 0);
+  }
+
+  // and one that will be stored as an absolute path
+  {
+    int rc = clink_db_add_record(db, "/foo/bar.c", 43, 129, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+
+  // setting the cost of a non-existent record should fail
+  {
+    int rc = clink_db_set_cost(db, id + 100, 1, 2);
+    ASSERT_EQ(rc, ENOENT);
+  }
+
+  // set the cost of the first record
+  {
+    int rc = clink_db_set_cost(db, id, 1024, 5000);
+    if (rc)
+      fprintf(stderr, "clink_db_set_cost: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // retrieve all records
+  seen_t seen = {0};
+  {
+    int rc = clink_db_get_records(db, accept, &seen);
+    if (rc)
+      fprintf(stderr, "clink_db_get_records: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+  ASSERT_EQ(seen.count, 2u);
+
+  // we should have seen both, with absolute paths
+  const clink_record_t *first = NULL;
+  const clink_record_t *second = NULL;
+  for (size_t i = 0; i < seen.count; ++i) {
+    if (strcmp(seen.records[i].path, path) == 0)
+      first = &seen.records[i];
+    if (strcmp(seen.records[i].path, "/foo/bar.c") == 0)
+      second = &seen.records[i];
+  }
+  ASSERT_NOT_NULL(first);
+  ASSERT_NOT_NULL(second);
+
+  ASSERT_EQ(first->hash, 42u);
+  ASSERT_EQ(first->timestamp, 128u);
+  ASSERT_EQ(first->size, 1024u);
+  ASSERT_EQ(first->duration, 5000u);
+
+  ASSERT_EQ(second->hash, 43u);
+  ASSERT_EQ(second->timestamp, 129u);
+  ASSERT_EQ(second->size, 0u);
+  ASSERT_EQ(second->duration, 0u);
+
+  // close the database
+  clink_db_close(&db);
+}
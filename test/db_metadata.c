@@ -0,0 +1,57 @@
+#include "test.h"
+#include <clink/clink.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+TEST("clink_db_get_metadata()/clink_db_set_metadata()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // a property that was never set should not be found
+  {
+    char *value = NULL;
+    int rc = clink_db_get_metadata(db, "foo", &value);
+    ASSERT_EQ(rc, ENOENT);
+  }
+
+  // set a property
+  {
+    int rc = clink_db_set_metadata(db, "foo", "bar");
+    if (rc)
+      fprintf(stderr, "clink_db_set_metadata: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // replace it
+  {
+    int rc = clink_db_set_metadata(db, "foo", "baz");
+    ASSERT_EQ(rc, 0);
+  }
+
+  // we should see the latest value
+  {
+    char *value = NULL;
+    int rc = clink_db_get_metadata(db, "foo", &value);
+    ASSERT_EQ(rc, 0);
+    ASSERT_STREQ(value, "baz");
+    free(value);
+  }
+
+  // close the database
+  clink_db_close(&db);
+}
@@ -0,0 +1,73 @@
+#include "test.h"
+#include <clink/clink.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+TEST("clink_db_purge()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // add three files, each defining a symbol
+  const char *paths[] = {"/foo/a.c", "/foo/b.c", "/foo/c.c"};
+  for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
+    int rc = clink_db_add_record(db, paths[i], 0, 0, NULL);
+    ASSERT_EQ(rc, 0);
+
+    clink_symbol_t symbol = {
+        .category = CLINK_DEFINITION, .lineno = 42, .colno = 10};
+    symbol.name = (char *)"sym-name";
+    symbol.path = (char *)paths[i];
+    rc = clink_db_add_symbol(db, &symbol);
+    if (rc)
+      fprintf(stderr, "clink_db_add_symbol: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // purge two of them, along with one that never existed
+  {
+    const char *purge[] = {"/foo/a.c", "/foo/c.c", "/foo/d.c"};
+    int rc = clink_db_purge(db, purge, sizeof(purge) / sizeof(purge[0]));
+    if (rc)
+      fprintf(stderr, "clink_db_purge: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // the purged records should be gone
+  ASSERT_EQ(clink_db_find_record(db, "/foo/a.c", NULL, NULL), ENOENT);
+  ASSERT_EQ(clink_db_find_record(db, "/foo/b.c", NULL, NULL), 0);
+  ASSERT_EQ(clink_db_find_record(db, "/foo/c.c", NULL, NULL), ENOENT);
+
+  // and only the remaining file’s symbol should be found
+  {
+    clink_iter_t *it = NULL;
+    int rc = clink_db_find_definition(db, "sym-name", &it);
+    ASSERT_EQ(rc, 0);
+
+    const clink_symbol_t *symbol = NULL;
+    rc = clink_iter_next_symbol(it, &symbol);
+    ASSERT_EQ(rc, 0);
+    ASSERT_STREQ(symbol->path, "/foo/b.c");
+
+    rc = clink_iter_next_symbol(it, &symbol);
+    ASSERT_EQ(rc, ENOMSG);
+
+    clink_iter_free(&it);
+  }
+
+  // close the database
+  clink_db_close(&db);
+}
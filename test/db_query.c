@@ -0,0 +1,156 @@
+#include "test.h"
+#include <clink/clink.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/// add a symbol to the database, asserting success
+#define ADD(db, category_, name_, path_)                                       \
+  do {                                                                         \
+    clink_symbol_t symbol = {.category = (category_), .lineno = 42};           \
+    symbol.name = (char *)(name_);                                             \
+    symbol.path = (char *)(path_);                                             \
+    int r_ = clink_db_add_symbol((db), &symbol);                               \
+    if (r_)                                                                    \
+      fprintf(stderr, "clink_db_add_symbol: %s\n", strerror(r_));              \
+    ASSERT_EQ(r_, 0);                                                          \
+  } while (0)
+
+TEST("clink_db_query()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // a file adjacent to the database, that will be stored as a relative path
+  char *local = test_asprintf("%s.c", target);
+
+  static const char *const paths[] = {"/foo/drivers/net/a.c",
+                                      "/foo/drivers/network.c", "/foo/lib/b.c"};
+  for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
+    int rc = clink_db_add_record(db, paths[i], 0, 0, NULL);
+    ASSERT_EQ(rc, 0);
+    ADD(db, CLINK_DEFINITION, "sym", paths[i]);
+  }
+  {
+    int rc = clink_db_add_record(db, local, 0, 0, NULL);
+    ASSERT_EQ(rc, 0);
+    ADD(db, CLINK_DEFINITION, "sym", local);
+  }
+  ADD(db, CLINK_FUNCTION_CALL, "sym", paths[0]);
+
+  // definitions within a directory
+  {
+    const clink_query_t query = {
+        .categories = CLINK_CATEGORY_SET(CLINK_DEFINITION),
+        .name = "^sym$",
+        .path = "/foo/drivers/net/"};
+    clink_iter_t *it = NULL;
+    {
+      int rc = clink_db_query(db, &query, &it);
+      if (rc)
+        fprintf(stderr, "clink_db_query: %s\n", strerror(rc));
+      ASSERT_EQ(rc, 0);
+    }
+
+    const clink_symbol_t *sym = NULL;
+    {
+      int rc = clink_iter_next_symbol(it, &sym);
+      ASSERT_EQ(rc, 0);
+    }
+    ASSERT_STREQ(sym->path, paths[0]);
+    ASSERT_EQ((int)sym->category, (int)CLINK_DEFINITION);
+
+    {
+      int rc = clink_iter_next_symbol(it, &sym);
+      ASSERT_EQ(rc, ENOMSG);
+    }
+
+    clink_iter_free(&it);
+  }
+
+  // a textual prefix that also covers a sibling file
+  {
+    const clink_query_t query = {
+        .categories = CLINK_CATEGORY_SET(CLINK_DEFINITION),
+        .path = "/foo/drivers/net"};
+    clink_iter_t *it = NULL;
+    {
+      int rc = clink_db_query(db, &query, &it);
+      ASSERT_EQ(rc, 0);
+    }
+
+    const clink_symbol_t *sym = NULL;
+    {
+      int rc = clink_iter_next_symbol(it, &sym);
+      ASSERT_EQ(rc, 0);
+    }
+    ASSERT_STREQ(sym->path, paths[0]);
+    {
+      int rc = clink_iter_next_symbol(it, &sym);
+      ASSERT_EQ(rc, 0);
+    }
+    ASSERT_STREQ(sym->path, paths[1]);
+    {
+      int rc = clink_iter_next_symbol(it, &sym);
+      ASSERT_EQ(rc, ENOMSG);
+    }
+
+    clink_iter_free(&it);
+  }
+
+  // a prefix covering a path stored relative to the database
+  {
+    const clink_query_t query = {.path = target};
+    clink_iter_t *it = NULL;
+    {
+      int rc = clink_db_query(db, &query, &it);
+      ASSERT_EQ(rc, 0);
+    }
+
+    const clink_symbol_t *sym = NULL;
+    {
+      int rc = clink_iter_next_symbol(it, &sym);
+      ASSERT_EQ(rc, 0);
+    }
+    ASSERT_STREQ(sym->path, local);
+    {
+      int rc = clink_iter_next_symbol(it, &sym);
+      ASSERT_EQ(rc, ENOMSG);
+    }
+
+    clink_iter_free(&it);
+  }
+
+  // a limited number of any symbols
+  {
+    const clink_query_t query = {.limit = 2, .order = CLINK_ORDER_NONE};
+    clink_iter_t *it = NULL;
+    {
+      int rc = clink_db_query(db, &query, &it);
+      ASSERT_EQ(rc, 0);
+    }
+
+    size_t count = 0;
+    for (const clink_symbol_t *sym = NULL;
+         clink_iter_next_symbol(it, &sym) == 0;)
+      ++count;
+    ASSERT_EQ(count, 2ul);
+
+    clink_iter_free(&it);
+  }
+
+  // close the database
+  clink_db_close(&db);
+}
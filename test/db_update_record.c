@@ -0,0 +1,78 @@
+#include "test.h"
+#include <clink/clink.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+TEST("clink_db_update_record()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // add a record with a symbol
+  {
+    int rc = clink_db_add_record(db, "/foo/bar.c", 42, 128, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+  {
+    clink_symbol_t symbol = {.category = CLINK_DEFINITION,
+                             .lineno = 1,
+                             .colno = 1};
+    symbol.name = (char *)"baz";
+    symbol.path = (char *)"/foo/bar.c";
+    int rc = clink_db_add_symbol(db, &symbol);
+    ASSERT_EQ(rc, 0);
+  }
+
+  // updating a non-existent record should fail
+  {
+    int rc = clink_db_update_record(db, "/foo/qux.c", 1, 2);
+    ASSERT_EQ(rc, ENOENT);
+  }
+
+  // update the existing record
+  {
+    int rc = clink_db_update_record(db, "/foo/bar.c", 43, 129);
+    if (rc)
+      fprintf(stderr, "clink_db_update_record: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // the record should reflect this
+  {
+    uint64_t hash = 0;
+    uint64_t timestamp = 0;
+    int rc = clink_db_find_record(db, "/foo/bar.c", &hash, &timestamp);
+    ASSERT_EQ(rc, 0);
+    ASSERT_EQ(hash, 43u);
+    ASSERT_EQ(timestamp, 129u);
+  }
+
+  // but the symbol should be unaffected
+  {
+    clink_iter_t *it = NULL;
+    int rc = clink_db_find_definition(db, "baz", &it);
+    ASSERT_EQ(rc, 0);
+    const clink_symbol_t *symbol = NULL;
+    rc = clink_iter_next_symbol(it, &symbol);
+    ASSERT_EQ(rc, 0);
+    ASSERT_STREQ(symbol->path, "/foo/bar.c");
+    clink_iter_free(&it);
+  }
+
+  // close the database
+  clink_db_close(&db);
+}
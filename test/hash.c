@@ -0,0 +1,45 @@
+#include "../clink/src/hash.h"
+#include "test.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+TEST("hash() of nothing") {
+  // the XXH64 digest of the empty string
+  ASSERT_EQ(hash("", 0), UINT64_C(0xef46db3751d8e999));
+}
+
+TEST("hash() distinguishes small changes") {
+  static const char a[] = "int main(void) { return 0; }\nint x;\n";
+  static const char b[] = "int main(void) { return 1; }\nint x;\n";
+  ASSERT_NE(hash(a, sizeof(a) - 1), hash(b, sizeof(b) - 1));
+  ASSERT_NE(hash(a, sizeof(a) - 1), hash(a, sizeof(a) - 2));
+}
+
+TEST("hash_file() agrees with hash()") {
+
+  static const char content[] = "#include <stdio.h>\n\n"
+                                "int main(void) {\n"
+                                "  printf(\"hello world\\n\");\n"
+                                "  return 0;\n"
+                                "}\n";
+
+  // write some content to a file
+  char *path = test_tmpnam();
+  {
+    FILE *f = fopen(path, "w");
+    ASSERT_NOT_NULL(f);
+    ASSERT(fputs(content, f) >= 0);
+    ASSERT_EQ(fclose(f), 0);
+  }
+
+  uint64_t digest = 0;
+  ASSERT_EQ(hash_file(path, &digest), 0);
+  ASSERT_EQ(digest, hash(content, strlen(content)));
+}
+
+TEST("hash_file() of a non-existent file") {
+  uint64_t digest = 0;
+  ASSERT_EQ(hash_file("/this/does/not/exist", &digest), ENOENT);
+}
@@ -116,6 +116,14 @@ def lit(tmp: Path, source: Path):
     assert saw_directive, "no directives recognised"
 
 
+@pytest.fixture(autouse=True)
+def isolate_cache(tmp_path: Path, monkeypatch):
+    """
+    keep anything Clink caches out of the user's home directory
+    """
+    monkeypatch.setenv("XDG_CACHE_HOME", str(tmp_path / "cache"))
+
+
 # find our associated test cases
 root = Path(__file__).parent / "cases"
 cases = sorted(
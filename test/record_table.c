@@ -0,0 +1,190 @@
+#include "../clink/src/record_table.h"
+#include "test.h"
+#include <clink/clink.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+TEST("record_table_find()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // add enough records that the table needs to grow
+  enum { COUNT = 2000 };
+  for (size_t i = 0; i < COUNT; ++i) {
+    char *path = test_asprintf("/foo/%zu.c", i);
+    clink_record_id_t id = -1;
+    int rc = clink_db_add_record(db, path, i, i + 1, &id);
+    ASSERT_EQ(rc, 0);
+    if (i % 2 == 0) {
+      rc = clink_db_set_cost(db, id, 10, 100);
+      ASSERT_EQ(rc, 0);
+    }
+  }
+
+  record_table_t *rt = NULL;
+  {
+    int rc = record_table_new(&rt, db);
+    if (rc)
+      fprintf(stderr, "record_table_new: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // later changes to the database should not affect the table
+  clink_db_close(&db);
+
+  // we should be able to find every record
+  for (size_t i = 0; i < COUNT; ++i) {
+    char *path = test_asprintf("/foo/%zu.c", i);
+    const clink_record_t *record = record_table_find(rt, path);
+    ASSERT_NOT_NULL(record);
+    ASSERT_STREQ(record->path, path);
+    ASSERT_EQ(record->hash, (uint64_t)i);
+    ASSERT_EQ(record->timestamp, (uint64_t)i + 1);
+  }
+
+  // but not things that are absent
+  ASSERT(record_table_find(rt, "/foo/bar.c") == NULL);
+
+  // costs should be summed over only those records that have them
+  {
+    uint64_t size = 0;
+    uint64_t duration = 0;
+    record_table_cost(rt, &size, &duration);
+    ASSERT_EQ(size, (uint64_t)COUNT / 2 * 10);
+    ASSERT_EQ(duration, (uint64_t)COUNT / 2 * 100);
+  }
+
+  record_table_free(&rt);
+}
+
+TEST("record_table_unseen()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // add some records
+  const char *paths[] = {"/foo/a.c", "/foo/b.c", "/foo/c.c"};
+  for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
+    int rc = clink_db_add_record(db, paths[i], 0, 0, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+
+  record_table_t *rt = NULL;
+  {
+    int rc = record_table_new(&rt, db);
+    ASSERT_EQ(rc, 0);
+  }
+  clink_db_close(&db);
+
+  // see two of the files, and one we have no record for
+  record_table_mark(rt, "/foo/a.c");
+  record_table_mark(rt, "/foo/c.c");
+  record_table_mark(rt, "/foo/d.c");
+
+  // only the remaining one should be reported as unseen
+  {
+    const char **unseen = NULL;
+    size_t count = 0;
+    int rc = record_table_unseen(rt, &unseen, &count);
+    ASSERT_EQ(rc, 0);
+    ASSERT_EQ(count, 1u);
+    ASSERT_STREQ(unseen[0], "/foo/b.c");
+    free(unseen);
+  }
+
+  record_table_free(&rt);
+}
+
+TEST("record_table_unseen_within()") {
+
+  (void)clink_set_debug(stderr);
+
+  // construct a unique path
+  char *target = test_tmpnam();
+
+  // open it as a database
+  clink_db_t *db = NULL;
+  {
+    int rc = clink_db_open(&db, target);
+    if (rc)
+      fprintf(stderr, "clink_db_open: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+
+  // add some records
+  const char *paths[] = {"/foo/a.c", "/foo/bar/b.c", "/foo/bar/c.c",
+                         "/foo/barbaz/d.c"};
+  for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
+    int rc = clink_db_add_record(db, paths[i], 0, 0, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+
+  record_table_t *rt = NULL;
+  {
+    int rc = record_table_new(&rt, db);
+    ASSERT_EQ(rc, 0);
+  }
+  clink_db_close(&db);
+
+  record_table_mark(rt, "/foo/bar/c.c");
+
+  // a directory should match only unseen files beneath it
+  {
+    const char **unseen = NULL;
+    size_t count = 0;
+    int rc = record_table_unseen_within(rt, "/foo/bar/", &unseen, &count);
+    ASSERT_EQ(rc, 0);
+    ASSERT_EQ(count, 1u);
+    ASSERT_STREQ(unseen[0], "/foo/bar/b.c");
+    free(unseen);
+  }
+
+  // a file should match only itself
+  {
+    const char **unseen = NULL;
+    size_t count = 0;
+    int rc = record_table_unseen_within(rt, "/foo/a.c", &unseen, &count);
+    ASSERT_EQ(rc, 0);
+    ASSERT_EQ(count, 1u);
+    ASSERT_STREQ(unseen[0], "/foo/a.c");
+    free(unseen);
+  }
+
+  // a seen file should not match
+  {
+    const char **unseen = NULL;
+    size_t count = 0;
+    int rc = record_table_unseen_within(rt, "/foo/bar/c.c", &unseen, &count);
+    ASSERT_EQ(rc, 0);
+    ASSERT_EQ(count, 0u);
+    free(unseen);
+  }
+
+  record_table_free(&rt);
+}
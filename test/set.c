@@ -0,0 +1,46 @@
+#include "../clink/src/set.h"
+#include "test.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+TEST("set_add() with invalid parameters should fail") {
+  set_t *s = NULL;
+  ASSERT_EQ(set_new(&s), 0);
+
+  const char *item = NULL;
+  ASSERT_EQ(set_add(NULL, &item), EINVAL);
+  ASSERT_EQ(set_add(s, NULL), EINVAL);
+  ASSERT_EQ(set_add(s, &item), EINVAL);
+
+  set_free(&s);
+}
+
+TEST("set_add() keeps its copies stable as it grows") {
+  set_t *s = NULL;
+  ASSERT_EQ(set_new(&s), 0);
+
+  // add enough strings that the set needs to grow several times
+  enum { COUNT = 10000 };
+  const char **copies = calloc(COUNT, sizeof(copies[0]));
+  ASSERT_NOT_NULL(copies);
+  for (size_t i = 0; i < COUNT; ++i) {
+    char *str = test_asprintf("/foo/%zu.c", i);
+    const char *item = str;
+    ASSERT_EQ(set_add(s, &item), 0);
+    ASSERT(item != str);
+    ASSERT_STREQ(item, str);
+    copies[i] = item;
+  }
+
+  // every string should still be present, at the same address as before
+  for (size_t i = 0; i < COUNT; ++i) {
+    char *str = test_asprintf("/foo/%zu.c", i);
+    const char *item = str;
+    ASSERT_EQ(set_add(s, &item), EALREADY);
+    ASSERT(item == copies[i]);
+  }
+
+  free(copies);
+  set_free(&s);
+}
@@ -0,0 +1,215 @@
+#include "../clink/src/option.h"
+#include "../clink/src/throttle.h"
+#include "test.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// throttle.c logs via `DEBUG`, which consults Clink’s global options
+option_t option;
+
+/// nanoseconds in a measurement window
+enum { WINDOW = 1000000000 };
+
+/// bytes a libclang parse is expected to need
+enum { ESTIMATE = 1024 };
+
+/// our fake monotonic clock
+static uint64_t fake_time;
+
+/// our fake available memory
+static uint64_t fake_memory;
+
+static uint64_t fake_clock(void) { return fake_time; }
+
+static uint64_t fake_available(void) { return fake_memory; }
+
+/// run a window in which each permitted worker processes one file
+static void window(throttle_t *t, uint64_t bytes, uint64_t waited) {
+  fake_time += WINDOW;
+  const size_t limit = throttle_limit(t);
+  for (size_t i = 0; i < limit; ++i)
+    throttle_done(t, bytes / limit, waited / limit);
+}
+
+/// a worker blocked in `throttle_wait`
+typedef struct {
+  throttle_t *throttle;
+  unsigned long thread_id;
+  atomic_bool returned;
+} waiter_t;
+
+static void *wait_entry(void *arg) {
+  waiter_t *w = arg;
+  throttle_wait(w->throttle, w->thread_id);
+  atomic_store(&w->returned, true);
+  return NULL;
+}
+
+TEST("throttle adaptation") {
+
+  fake_time = 0;
+  fake_memory = UINT64_MAX;
+
+  throttle_t *t = NULL;
+  {
+    int rc = throttle_new(&t, 4, true, ESTIMATE);
+    if (rc)
+      fprintf(stderr, "throttle_new: %s\n", strerror(rc));
+    ASSERT_EQ(rc, 0);
+  }
+  throttle_set_sources(t, fake_clock, fake_available);
+
+  // all workers should start out permitted
+  ASSERT_EQ(throttle_limit(t), (size_t)4);
+
+  // workers mostly waiting on each other should cause a back off
+  window(t, 1000, 2 * (uint64_t)WINDOW * 4);
+  ASSERT_EQ(throttle_limit(t), (size_t)3);
+
+  // a worker above the limit should now block
+  for (unsigned long i = 0; i < 3; ++i)
+    throttle_wait(t, i);
+  waiter_t waiter = {.throttle = t, .thread_id = 3};
+  pthread_t thread;
+  {
+    int rc = pthread_create(&thread, NULL, wait_entry, &waiter);
+    ASSERT_EQ(rc, 0);
+  }
+  {
+    const struct timespec pause = {.tv_nsec = 50000000};
+    (void)nanosleep(&pause, NULL);
+  }
+  ASSERT(!atomic_load(&waiter.returned));
+
+  // after backing off, the limit should hold for a while even if throughput
+  // is unchanged
+  for (size_t i = 0; i < 5; ++i) {
+    window(t, 1000, 0);
+    ASSERT_EQ(throttle_limit(t), (size_t)3);
+  }
+
+  // but not while memory is short
+  fake_memory = ESTIMATE - 1;
+  window(t, 1000, 0);
+  ASSERT_EQ(throttle_limit(t), (size_t)3);
+  window(t, 1000, 0);
+  ASSERT_EQ(throttle_limit(t), (size_t)3);
+
+  // once memory is available, it should probe upwards, releasing the worker
+  fake_memory = UINT64_MAX;
+  window(t, 1000, 0);
+  ASSERT_EQ(throttle_limit(t), (size_t)4);
+  {
+    int rc = pthread_join(thread, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+  ASSERT(atomic_load(&waiter.returned));
+
+  // if that probe hurt throughput, it should be undone
+  window(t, 500, 0);
+  ASSERT_EQ(throttle_limit(t), (size_t)3);
+
+  // and then held again
+  for (size_t i = 0; i < 2; ++i) {
+    window(t, 500, 0);
+    ASSERT_EQ(throttle_limit(t), (size_t)3);
+  }
+
+  // unless throughput improves, which should end the hold early
+  window(t, 1000, 0);
+  ASSERT_EQ(throttle_limit(t), (size_t)4);
+
+  throttle_free(&t);
+}
+
+TEST("throttle measurement windows") {
+
+  fake_time = 0;
+  fake_memory = UINT64_MAX;
+
+  throttle_t *t = NULL;
+  {
+    int rc = throttle_new(&t, 4, true, ESTIMATE);
+    ASSERT_EQ(rc, 0);
+  }
+  throttle_set_sources(t, fake_clock, fake_available);
+
+  // a window with fewer files than active workers should not move the limit
+  fake_time += WINDOW;
+  for (size_t i = 0; i < 3; ++i)
+    throttle_done(t, 1000, (uint64_t)WINDOW);
+  ASSERT_EQ(throttle_limit(t), (size_t)4);
+
+  // until it is complete
+  throttle_done(t, 1000, (uint64_t)WINDOW);
+  ASSERT_EQ(throttle_limit(t), (size_t)3);
+
+  // nor should a window too short to be a fair measure
+  fake_time += WINDOW / 2;
+  for (size_t i = 0; i < 3; ++i)
+    throttle_done(t, 1000, (uint64_t)WINDOW);
+  ASSERT_EQ(throttle_limit(t), (size_t)3);
+
+  throttle_free(&t);
+}
+
+TEST("throttle undoing a back off") {
+
+  fake_time = 0;
+  fake_memory = UINT64_MAX;
+
+  throttle_t *t = NULL;
+  {
+    int rc = throttle_new(&t, 4, true, ESTIMATE);
+    ASSERT_EQ(rc, 0);
+  }
+  throttle_set_sources(t, fake_clock, fake_available);
+
+  // back off under contention
+  window(t, 1000, 2 * (uint64_t)WINDOW * 4);
+  ASSERT_EQ(throttle_limit(t), (size_t)3);
+
+  // if throughput then drops, the back off was a mistake
+  window(t, 500, 0);
+  ASSERT_EQ(throttle_limit(t), (size_t)4);
+
+  throttle_free(&t);
+}
+
+TEST("throttle releasing") {
+
+  fake_time = 0;
+  fake_memory = UINT64_MAX;
+
+  throttle_t *t = NULL;
+  {
+    int rc = throttle_new(&t, 2, true, ESTIMATE);
+    ASSERT_EQ(rc, 0);
+  }
+  throttle_set_sources(t, fake_clock, fake_available);
+
+  window(t, 1000, 2 * (uint64_t)WINDOW * 2);
+  ASSERT_EQ(throttle_limit(t), (size_t)1);
+
+  // a blocked worker should be let go on release
+  waiter_t waiter = {.throttle = t, .thread_id = 1};
+  pthread_t thread;
+  {
+    int rc = pthread_create(&thread, NULL, wait_entry, &waiter);
+    ASSERT_EQ(rc, 0);
+  }
+  throttle_release(t);
+  {
+    int rc = pthread_join(thread, NULL);
+    ASSERT_EQ(rc, 0);
+  }
+  ASSERT(atomic_load(&waiter.returned));
+
+  throttle_free(&t);
+}